@@ -55,14 +55,19 @@ uint8_t paraSaveInRam[16*1024];
 #define update_log(M, ...) custom_log("UPDATE", M, ##__VA_ARGS__)
 #define update_log_trace() custom_log_trace("UPDATE")
 
+static void checkcrc_update( void *context, const uint8_t *data, uint32_t length )
+{
+    CRC16_Update( (CRC16_Context *)context, data, length );
+}
+
 static OSStatus checkcrc(uint16_t crc_in, int partition_type, int total_len)
 {
     uint16_t crc = 0;
     mico_logic_partition_t* part;
-    int len;
     OSStatus err = kNoErr;
     uint32_t update_data_offset = 0x0;
     CRC16_Context contex;
+    mico_flash_checksum_t checksum = { checkcrc_update, &contex };
 
     CRC16_Init( &contex );
     
@@ -73,23 +78,12 @@ static OSStatus checkcrc(uint16_t crc_in, int partition_type, int total_len)
     if (part == NULL)
         goto exit;
 
-    while(total_len > 0){
-      if( SizePerRW < total_len ){
-        len = SizePerRW;
-      } else {
-        len = total_len;
-      }
-      err = MicoFlashRead( MICO_PARTITION_OTA_TEMP, &update_data_offset, data , len);
-      require_noerr(err, exit);
-
-      total_len -= len;
-
-      CRC16_Update( &contex, data, len );
-    }
+    err = MicoFlashChecksum( MICO_PARTITION_OTA_TEMP, &update_data_offset, total_len, &checksum, 1, data, SizePerRW );
+    require_noerr(err, exit);
 
   CRC16_Final( &contex, &crc );
-    if (crc == crc_in)
-        err = kNoErr;
+    if (crc != crc_in)
+        err = kChecksumErr;
 exit:
     update_log("CRC check return %d, got crc %x, calcuated crc %x", err, crc_in, crc);
     return err;
@@ -56,19 +56,12 @@ size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen)
 {
   uart_recv_log_trace();
 
-  int datalen;
+  uint32_t datalen;
   
   while(1) {
-    if( MicoUartRecv( UART_FOR_APP, inBuf, inBufLen, UART_RECV_TIMEOUT) == kNoErr){
-      return inBufLen;
+    if( MicoUartRecvFrame( UART_FOR_APP, inBuf, inBufLen, &datalen, UART_RECV_TIMEOUT) == kNoErr && datalen ){
+      return datalen;
     }
-   else{
-     datalen = MicoUartGetLengthInBuffer( UART_FOR_APP );
-     if(datalen){
-       MicoUartRecv(UART_FOR_APP, inBuf, datalen, UART_RECV_TIMEOUT);
-       return datalen;
-     }
-   }
   }
   
 }
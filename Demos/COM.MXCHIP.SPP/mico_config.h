@@ -77,4 +77,6 @@
  * MiCO TCP server used for configuration and ota. */
 #define MICO_CONFIG_SERVER_ENABLE 
 #define MICO_CONFIG_SERVER_PORT    8000
+/* Serve config clients from the config server thread instead of a thread per client */
+//#define MICO_CONFIG_SERVER_SINGLE_THREAD
 
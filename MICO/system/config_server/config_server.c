@@ -30,6 +30,7 @@
 */
 
 #include "MICO.h"
+#include "mico_system_ota.h"
 
 #include "Platform.h"
 
@@ -49,9 +50,9 @@
 #define kMIMEType_MXCHIP_OTA    "application/ota-stream"
 
 typedef struct _configContext_t{
-  uint32_t offset;
   bool     isFlashLocked;
-  CRC16_Context crc16_contex;
+  mico_ota_sink_t *ota_sink;  /* Allocated when an OTA stream starts, the client thread stack is small */
+  bool     isRefused;         /* Single thread mode: another client writes the flash, the OTA data is dropped */
 } configContext_t;
 
 extern OSStatus     ConfigIncommingJsonMessage( const char *input, bool *need_reboot, mico_Context_t * const inContext );
@@ -71,6 +72,32 @@ extern OSStatus     ConfigIncommingJsonMessageUAP( const uint8_t *input, size_t
 
 static mico_semaphore_t close_listener_sem = NULL, close_client_sem[ MAX_TCP_CLIENT_PER_SERVER ] = { NULL };
 
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+/* All clients are served by the listener thread, each one is a small state machine
+   driven by select, so a client costs a HTTPHeader_t instead of a thread stack */
+#define CONFIG_CLIENT_IDLE_TIMEOUT      (60*1000)
+
+typedef struct _configClient_t{
+  int             fd;
+  bool            readingBody;
+  uint32_t        lastActiveTime;
+  HTTPHeader_t    *httpHeader;
+  configContext_t httpContext;
+} configClient_t;
+
+static configClient_t *config_clients[ MAX_TCP_CLIENT_PER_SERVER ] = { NULL };
+
+/* The flash mutex is recursive and every client runs on this thread, so it cannot keep
+   them apart. The client streaming an OTA image owns the flash until its header is cleared */
+static configContext_t *config_flash_owner = NULL;
+
+static OSStatus config_client_open( int fd );
+static void config_client_close( int index );
+static void config_client_refuse( int fd, int status );
+static struct timeval_t *config_clients_prepare( fd_set *readfds, struct timeval_t *t );
+static void config_clients_process( fd_set *readfds );
+#endif
+
 WEAK void config_server_delegate_report( json_object *app_menu, mico_Context_t *in_context )
 {
   UNUSED_PARAMETER(app_menu);
@@ -102,7 +129,11 @@ OSStatus config_server_start ( mico_Context_t *in_context )
   close_listener_sem = NULL;
   for (; i < MAX_TCP_CLIENT_PER_SERVER; i++)
     close_client_sem[ i ] = NULL;
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+  err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "Config Server", localConfiglistener_thread, STACK_SIZE_LOCAL_CONFIG_SINGLE_THREAD, (void*)in_context );
+#else
   err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "Config Server", localConfiglistener_thread, STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD, (void*)in_context );
+#endif
   require_noerr(err, exit);
   
   mico_thread_msleep(200);
@@ -144,6 +175,9 @@ void localConfiglistener_thread(void *inContext)
   int sockaddr_t_size;
   fd_set readfds;
   char ip_address[16];
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+  struct timeval_t t;
+#endif
   
   int localConfiglistener_fd = -1;
   int close_listener_fd = -1;
@@ -168,7 +202,12 @@ void localConfiglistener_thread(void *inContext)
     FD_ZERO(&readfds);
     FD_SET(localConfiglistener_fd, &readfds);
     FD_SET(close_listener_fd, &readfds);
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+    if( select(1, &readfds, NULL, NULL, config_clients_prepare( &readfds, &t )) < 0 )
+      FD_ZERO(&readfds);
+#else
     select(1, &readfds, NULL, NULL, NULL);
+#endif
 
     /* Check close requests */
     if(FD_ISSET(close_listener_fd, &readfds)){
@@ -183,13 +222,27 @@ void localConfiglistener_thread(void *inContext)
       if ( IsValidSocket( j ) ) {
         inet_ntoa(ip_address, addr.s_ip );
         config_log("Config Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+        if(kNoErr != config_client_open( j ) )
+#else
         if(kNoErr !=  mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Clients", localConfig_thread, STACK_SIZE_LOCAL_CONFIG_CLIENT_THREAD, (void *)j) )
+#endif
           SocketClose(&j);
       }
     }
+
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+    config_clients_process( &readfds );
+#endif
   }
 
 exit:
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+    for( j = 0; j < MAX_TCP_CLIENT_PER_SERVER; j++ ){
+      if( config_clients[j] != NULL )
+        config_client_close( j );
+    }
+#endif
     if( close_listener_sem != NULL ){
       mico_delete_event_fd( close_listener_fd );
       mico_rtos_deinit_semaphore( &close_listener_sem );
@@ -212,7 +265,7 @@ void localConfig_thread(void *inFd)
   struct timeval_t t;
   HTTPHeader_t *httpHeader = NULL;
   int close_client_fd = -1;
-  configContext_t httpContext = {0, false, 0};
+  configContext_t httpContext = { false, NULL };
 
   for( close_sem_index = 0; close_sem_index < MAX_TCP_CLIENT_PER_SERVER; close_sem_index++ ){
     if( close_client_sem[close_sem_index] == NULL )
@@ -220,6 +273,7 @@ void localConfig_thread(void *inFd)
   }
 
   if( close_sem_index == MAX_TCP_CLIENT_PER_SERVER){
+    SocketClose(&clientFd);
     mico_rtos_delete_thread(NULL);
     return;
   }
@@ -317,6 +371,174 @@ exit:
   return;
 }
 
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+static OSStatus config_client_open( int fd )
+{
+  OSStatus err = kNoErr;
+  configClient_t *client = NULL;
+  int i;
+
+  for( i = 0; i < MAX_TCP_CLIENT_PER_SERVER; i++ ){
+    if( config_clients[i] == NULL )
+      break;
+  }
+  require_action( i < MAX_TCP_CLIENT_PER_SERVER, exit, err = kNoResourcesErr );
+
+  client = calloc( 1, sizeof(configClient_t) );
+  require_action( client, exit, err = kNoMemoryErr );
+
+  client->fd = fd;
+  client->lastActiveTime = mico_get_time();
+  client->httpHeader = HTTPHeaderCreateWithCallback(onReceivedData, onClearHTTPHeader, &client->httpContext);
+  require_action( client->httpHeader, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( client->httpHeader );
+
+  config_clients[i] = client;
+  client = NULL;
+  config_log("Free memory %d bytes", MicoGetMemoryInfo()->free_memory) ;
+
+exit:
+  if( client ) free( client );
+  return err;
+}
+
+static void config_client_close( int index )
+{
+  configClient_t *client = config_clients[index];
+
+  SocketClose( &client->fd );
+  if( client->httpHeader ){
+    HTTPHeaderClear( client->httpHeader );
+    free( client->httpHeader );
+  }
+  free( client );
+  config_clients[index] = NULL;
+}
+
+static bool config_client_request_buffered( configClient_t *client )
+{
+  char *end;
+  return client->readingBody == false && client->httpHeader->len != 0 && findHeader( client->httpHeader, &end );
+}
+
+/* Add the client sockets to readfds and return the select timeout: wait forever without
+   clients, do not wait if a request is already buffered, otherwise wake up for idle check */
+static struct timeval_t *config_clients_prepare( fd_set *readfds, struct timeval_t *t )
+{
+  struct timeval_t *timeout = NULL;
+  int i;
+
+  t->tv_sec = 1;
+  t->tv_usec = 0;
+  for( i = 0; i < MAX_TCP_CLIENT_PER_SERVER; i++ ){
+    if( config_clients[i] == NULL )
+      continue;
+    FD_SET( config_clients[i]->fd, readfds );
+    timeout = t;
+    if( config_client_request_buffered( config_clients[i] ) )
+      t->tv_sec = 0;
+  }
+  return timeout;
+}
+
+/* Answer a request that is not served with a status line, the connection is closed after it */
+static void config_client_refuse( int fd, int status )
+{
+  uint8_t *httpResponse = NULL;
+  size_t httpResponseLen = 0;
+
+  if( CreateHTTPRespondMessageNoCopy( status, kMIMEType_TextPlain, 0, &httpResponse, &httpResponseLen ) == kNoErr )
+    SocketSend( fd, httpResponse, httpResponseLen );
+  if( httpResponse ) free( httpResponse );
+}
+
+/* Read what is available and respond to a complete request, the connection is kept on kNoErr */
+static OSStatus config_client_process( configClient_t *client )
+{
+  OSStatus err;
+  HTTPHeader_t *httpHeader = client->httpHeader;
+
+  client->lastActiveTime = mico_get_time();
+
+  if( client->readingBody == false ){
+    err = SocketTryReadHTTPHeader( client->fd, httpHeader );
+    switch ( err )
+    {
+      case kNoErr:
+        break;
+      case EWOULDBLOCK:
+        return kNoErr;
+      case kNoSpaceErr:
+        config_log("ERROR: Cannot fit HTTPHeader.");
+        goto exit;
+      case kConnectionErr:
+        config_log("ERROR: Connection closed.");
+        goto exit;
+      default:
+        config_log("ERROR: HTTP Header parse internal error: %d", err);
+        goto exit;
+    }
+    client->readingBody = true;
+
+    /* The blocking chunked reader would stall every other client */
+    if( httpHeader->chunkedData == true ){
+      config_client_refuse( client->fd, kStatusLengthRequired );
+      err = kUnsupportedErr;
+      goto exit;
+    }
+
+    /* Another client writes the flash, an OTA image or a configuration could not be applied */
+    if( client->httpContext.isRefused == true || ( config_flash_owner != NULL && config_flash_owner != &client->httpContext
+        && ( HTTPHeaderMatchURL( httpHeader, kCONFIGURLWrite ) == kNoErr || HTTPHeaderMatchURL( httpHeader, kCONFIGURLWriteByUAP ) == kNoErr ) ) ){
+      config_client_refuse( client->fd, kStatusServiceUnavailable );
+      err = kAlreadyInUseErr;
+      goto exit;
+    }
+
+    /* Wait for the socket unless the body has arrived with the header */
+    if( httpHeader->chunkedData == false && httpHeader->extraDataLen < httpHeader->contentLength )
+      return kNoErr;
+  }
+
+  err = SocketTryReadHTTPBody( client->fd, httpHeader );
+  if( err == EWOULDBLOCK )
+    return kNoErr;
+  require_noerr( err, exit );
+
+  err = _LocalConfigRespondInComingMessage( client->fd, httpHeader, Context );
+  require_noerr( err, exit );
+
+  HTTPHeaderClear( httpHeader );
+  client->readingBody = false;
+
+exit:
+  return err;
+}
+
+static void config_clients_process( fd_set *readfds )
+{
+  OSStatus err;
+  int i;
+
+  for( i = 0; i < MAX_TCP_CLIENT_PER_SERVER; i++ ){
+    if( config_clients[i] == NULL )
+      continue;
+
+    if( FD_ISSET( config_clients[i]->fd, readfds ) || config_client_request_buffered( config_clients[i] ) ){
+      err = config_client_process( config_clients[i] );
+      if( err != kNoErr ){
+        config_log("Exit: Client exit with err = %d", err);
+        config_client_close( i );
+      }
+    }
+    else if( mico_get_time() - config_clients[i]->lastActiveTime > CONFIG_CLIENT_IDLE_TIMEOUT ){
+      config_log("Exit: Client idle, fd: %d", config_clients[i]->fd);
+      config_client_close( i );
+    }
+  }
+}
+#endif
+
 static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos, uint8_t * inData, size_t inLen, void * inUserContext )
 {
   OSStatus err = kUnknownErr;
@@ -325,7 +547,7 @@ static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos,
   configContext_t *context = (configContext_t *)inUserContext;
   mico_logic_partition_t* ota_partition = MicoFlashGetInfo( MICO_PARTITION_OTA_TEMP );
 
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPHeaderGetField( inHeader, "Content-Type", &value, &valueSize );
   if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
     printf("%d/", inPos);
 
@@ -334,31 +556,42 @@ static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos,
       return kUnsupportedErr;
     }
 
-     if(inPos == 0){
-       context->offset = 0x0;
-       CRC16_Init( &context->crc16_contex );
+     /* Called at 0 twice when the header came without body data, prepare the flash once */
+     if(inPos == 0 && context->isFlashLocked == false){
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+       /* Accepted so the body is not buffered, config_client_process answers 503 */
+       if( config_flash_owner != NULL && config_flash_owner != context ){
+         context->isRefused = true;
+         return kNoErr;
+       }
+       config_flash_owner = context;
+#endif
+       if( context->ota_sink == NULL )
+         context->ota_sink = malloc( sizeof(mico_ota_sink_t) );
+       require_action( context->ota_sink, exit, err = kNoMemoryErr );
+       mico_ota_sink_init( context->ota_sink, MICO_PARTITION_OTA_TEMP, 0, false );
        mico_rtos_lock_mutex(&Context->flashContentInRam_mutex); //We are write the Flash content, no other write is possible
        context->isFlashLocked = true;
        err = MicoFlashErase( MICO_PARTITION_OTA_TEMP, 0x0, ota_partition->partition_length);
        require_noerr(err, flashErrExit);
-       err = MicoFlashWrite( MICO_PARTITION_OTA_TEMP, &context->offset, (uint8_t *)inData, inLen);
-       require_noerr(err, flashErrExit);
-       CRC16_Update( &context->crc16_contex, inData, inLen);
-     }else{
-       err = MicoFlashWrite( MICO_PARTITION_OTA_TEMP, &context->offset, (uint8_t *)inData, inLen);
-       require_noerr(err, flashErrExit);
-       CRC16_Update( &context->crc16_contex, inData, inLen);
      }
+     if( context->isRefused == true )
+       return kNoErr;
+     require_action( context->ota_sink, exit, err = kNotPreparedErr );
+     err = mico_ota_sink_write( context->ota_sink, inData, inLen );
+     require_noerr(err, flashErrExit);
   }
   else{
     return kUnsupportedErr;
   }
 
+exit:
   if(err!=kNoErr)  config_log("onReceivedData");
   return err;
 
 flashErrExit:
   mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
+  context->isFlashLocked = false;
   return err;
 }
 
@@ -371,6 +604,17 @@ static void onClearHTTPHeader(struct _HTTPHeader_t * inHeader, void * inUserCont
     mico_rtos_unlock_mutex(&Context->flashContentInRam_mutex);
     context->isFlashLocked = false;
   }
+
+  if(context->ota_sink != NULL){
+    free(context->ota_sink);
+    context->ota_sink = NULL;
+  }
+
+#ifdef MICO_CONFIG_SERVER_SINGLE_THREAD
+  if( config_flash_owner == context )
+    config_flash_owner = NULL;
+#endif
+  context->isRefused = false;
  }
 
 OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext)
@@ -486,7 +730,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico
       err = SocketSend( fd, httpResponse, httpResponseLen );
       require_noerr( err, exit );
 
-      config = json_tokener_parse(inHeader->extraDataPtr);
+      config = json_tokener_parse_arena(inHeader->extraDataPtr, 0);
       require_action(config, exit, err = kUnknownErr);
       config_log("Recv config object=%s", json_object_to_json_string(config));
       mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -537,6 +781,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico
       mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
 
       json_object_put(config);
+      config = NULL;
 
       inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
       mico_system_context_update( inContext );
@@ -572,7 +817,9 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico
   else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr && ota_partition->partition_owner != MICO_FLASH_NONE){
     if(inHeader->contentLength > 0){
       config_log("Receive OTA data!");
-      CRC16_Final( &http_context->crc16_contex, &crc);
+      require_action( http_context->ota_sink, exit, err = kNotPreparedErr );
+      err = mico_ota_sink_final( http_context->ota_sink, NULL, &crc, NULL );
+      require_noerr(err, exit);
       memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
       inContext->flashContentInRam.bootTable.length = inHeader->contentLength;
       inContext->flashContentInRam.bootTable.start_address = ota_partition->partition_start_addr;
@@ -26,6 +26,11 @@
 static int mDNS_fd = -1;
 static bool bonjour_instance = false;
 
+/* Answers waiting for the delayed response, see dns_sd_service_record_t.pending */
+static bool     mdns_response_scheduled = false;
+static uint32_t mdns_response_first = 0;     // mico_get_time() when it was scheduled
+static uint32_t mdns_response_due = 0;
+
 typedef enum{
   RECORD_REMOVED,
   RECORD_UPDATE,
@@ -34,6 +39,41 @@ typedef enum{
   RECORD_NORMAL,
 } mdns_record_state_t;
 
+/* Records of a service, as answered by mdns_response_add_service */
+#define MDNS_RECORD_SERVICES_PTR       (1<<0)   // _services._dns-sd._udp PTR -> service name
+#define MDNS_RECORD_PTR                (1<<1)   // service name PTR -> instance name
+#define MDNS_RECORD_TXT                (1<<2)
+#define MDNS_RECORD_SRV                (1<<3)
+#define MDNS_RECORD_A                  (1<<4)
+#define MDNS_RECORD_SERVICE_ALL        (MDNS_RECORD_PTR|MDNS_RECORD_TXT|MDNS_RECORD_SRV|MDNS_RECORD_A)
+#define MDNS_RECORD_TYPE_COUNT         5
+
+/* Owner names of a service, see mdns_name_entry_t */
+#define MDNS_NAME_SERVICE              0
+#define MDNS_NAME_INSTANCE             1
+#define MDNS_NAME_HOST                 2
+#define MDNS_NAME_KIND_COUNT           3
+
+/* An owner name in lower-cased wire format, hashed into mdns_name_table when the record is added,
+   so that question and answer names are matched without walking all records */
+typedef struct mdns_name_entry
+{
+  struct mdns_name_entry* next;     // Next in its mdns_name_table bucket
+  uint32_t                hash;
+  uint16_t                length;
+  uint8_t                 record;   // Index in available_services
+  uint8_t                 kind;     // MDNS_NAME_XXX
+  uint8_t                 name[1];
+} mdns_name_entry_t;
+
+/* A name read from a packet, in the same format */
+typedef struct
+{
+  uint32_t  hash;
+  uint16_t  length;
+  uint8_t   name[MDNS_NAME_LENGTH_MAX];
+} mdns_name_key_t;
+
 typedef struct
 {
   char*               hostname;
@@ -45,6 +85,12 @@ typedef struct
   uint32_t            ttl;
   uint16_t            port;
   uint8_t             count_down;
+  uint8_t             answered;     // MDNS_RECORD_XXX already in the response being built
+  uint8_t             pending;      // MDNS_RECORD_XXX waiting for the delayed response
+  uint8_t             requested;    // MDNS_RECORD_XXX asked for by the query being processed
+  uint8_t             direct;       // Asked for by name, not as additional records of a PTR
+  mdns_name_entry_t*  names[MDNS_NAME_KIND_COUNT];
+  uint32_t            sent_time[MDNS_RECORD_TYPE_COUNT];  // Last multicast of each record, 0: never
   mdns_record_state_t state;
 } dns_sd_service_record_t;
 
@@ -56,6 +102,8 @@ typedef struct
 
 
 #define SERVICE_QUERY_NAME             "_services._dns-sd._udp.local."
+#define SERVICE_QUERY_WIRE             "\011_services\007_dns-sd\004_udp\005local"   // Lower-cased wire format
+#define SERVICE_QUERY_TTL              1500
 
 //#define mdns_utils_log(M, ...) custom_log("mDNS Utils", M, ##__VA_ARGS__)
 //#define mdns_utils_log_trace() custom_log_trace("mDNS Utils")
@@ -64,24 +112,39 @@ typedef struct
 #define mdns_utils_log_trace()
 
 
-static dns_sd_service_record_t   available_services[ MAX_RECORD_COUNT ];
-static uint8_t	available_service_count = MAX_RECORD_COUNT;
+static dns_sd_service_record_t*  available_services = NULL;
+static uint8_t	available_service_count = 0;       // Slots allocated, see find_empty_record
+
+static mdns_name_entry_t*  mdns_name_table[ MDNS_NAME_HASH_SIZE ];
+static mdns_name_key_t     mdns_owner_key;          // Names of the packet being processed, under bonjour_mutex
+static mdns_name_key_t     mdns_rdata_key;
+
+/* Interface addresses in network byte order, indexed by WiFi_Interface and refreshed by
+   mdns_refresh_interface_ip instead of being read for every answer. 0: no address */
+static uint32_t            mdns_interface_ip[ 2 ];
+
+#define mdns_name_find( prev, key )  mdns_name_next( prev, (key)->hash, (key)->length, (key)->name )
 
 static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name );
-static int dns_compare_name_to_string( dns_name_t* name, const char* string );
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size );
+static int dns_get_next_record( dns_message_iterator_t* iter, dns_record_t* r, dns_name_t* name );
 static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_t flags, uint16_t question_count, uint16_t answer_count, uint16_t authorative_count );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
 static void mdns_send_message(int fd, dns_message_iterator_t* message );
-static void dns_free_message( dns_message_iterator_t* message );
-static void mdns_process_query(int fd, dns_name_t* name, dns_question_t* question, dns_message_iterator_t* source );
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata );
+static void mdns_process_query( mdns_name_key_t* key, dns_question_t* question );
+static void mdns_process_known_answers( dns_message_iterator_t* iter, uint16_t count );
+static bool mdns_packet_name_key( dns_name_t* name, mdns_name_key_t* key );
+static mdns_name_entry_t* mdns_name_next( mdns_name_entry_t* prev, uint32_t hash, uint16_t length, const uint8_t* name );
+static void mdns_send_pending_response( int fd );
+static void mdns_browse_process_response( dns_message_iterator_t* answers, uint16_t count );
+static void mdns_browse_run( int fd );
+static uint32_t mdns_browse_next_event( uint32_t now, uint32_t timeout );
 static void dns_write_uint16( dns_message_iterator_t* iter, uint16_t data );
 static void dns_write_uint32( dns_message_iterator_t* iter, uint32_t data );
-static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16_t length );
 static uint16_t dns_read_uint16( dns_message_iterator_t* iter );
 static void dns_skip_name( dns_message_iterator_t* iter );
-static void dns_write_name( dns_message_iterator_t* iter, const char* src );
+static void mdns_response_begin( mdns_response_t* response, int fd, uint16_t id );
+static bool mdns_response_add_record( mdns_response_t* response, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, const void* rdata );
+static void mdns_response_add_service( mdns_response_t* response, dns_sd_service_record_t* record, uint8_t records, uint32_t ttl, uint32_t ip );
+static void mdns_response_send( mdns_response_t* response );
 
 static OSStatus start_bonjour_service(void);
 
@@ -91,17 +154,39 @@ static int update_state_fd = 0;
 static mico_thread_t mfi_bonjour_thread_handler;
 static void _bonjour_thread(void *arg);
 
+/* Records asked for by the query being processed, the others have requested and direct cleared */
+static uint8_t mdns_query_records[ MDNS_RECORD_COUNT_MAX ];
+static uint8_t mdns_query_record_count = 0;
+
+static void mdns_query_request( uint8_t record_index, uint8_t requested, uint8_t direct )
+{
+  dns_sd_service_record_t* record = &available_services[record_index];
+
+  if ( ( record->requested | record->direct ) == 0 )
+    mdns_query_records[ mdns_query_record_count++ ] = record_index;
+  record->requested |= requested;
+  record->direct    |= direct;
+}
+
+static uint32_t mdns_random_delay( uint32_t min, uint32_t max )
+{
+  uint32_t random = 0;
+
+  MicoRandomNumberRead( &random, sizeof(random) );
+  return min + random % ( max - min + 1 );
+}
+
 void process_dns_questions(int fd, dns_message_iterator_t* iter )
 {
   dns_name_t name;
   dns_question_t question;
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
+  dns_sd_service_record_t* record;
+  mdns_name_entry_t* entry;
+  uint8_t all_requested = 0;
+  uint32_t due;
   int a = 0;
+  int b = 0;
   int question_processed;
-  uint32_t myip;
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
   
   for ( a = 0; a < htons(iter->header->question_count); ++a )
   {
@@ -109,104 +194,327 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
       break;
     if(dns_get_next_question( iter, &question, &name )==0)
       break;
+    if ( mdns_packet_name_key( &name, &mdns_owner_key ) == false )
+      continue;
     question_processed = 0;
     switch ( question.question_type ){
     case RR_TYPE_PTR:
-      if ( available_services != NULL ){
-        // Check if its a query for all available services  
-        if ( dns_compare_name_to_string( &name, SERVICE_QUERY_NAME ) ){
-          int b = 0;
-          if(dns_create_message( &response, 512 )) {
-            dns_write_header(&response, iter->header->id, 0x8400, 0, available_service_count, 0 );          
-            for ( b = 0; b < available_service_count; ++b ){
-              dns_write_record( &response, SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-            }
-            mdns_send_message(fd, &response );
-            dns_free_message( &response );
-            question_processed = 1;
-          }
+      // Check if its a query for all available services  
+      if ( mdns_owner_key.length == sizeof(SERVICE_QUERY_WIRE) && memcmp( mdns_owner_key.name, SERVICE_QUERY_WIRE, sizeof(SERVICE_QUERY_WIRE) ) == 0 ){
+        for ( b = 0; b < available_service_count; ++b ){
+          if( available_services[b].state == RECORD_NORMAL || available_services[b].state == RECORD_UPDATE )
+            mdns_query_request( b, MDNS_RECORD_SERVICES_PTR, 0 );
         }
-        // else check if its one of our records
-        else {
-          int b = 0;
-          for ( b = 0; b < available_service_count; ++b ){
-            //printf("UDP multicast test: Recv a SERVICE Detail request: %s.\r\n", name);
-            if ( dns_compare_name_to_string( &name, available_services[b].service_name )){
-              
-              if( available_services[b].state != RECORD_NORMAL )
-                continue;
-
-              micoWlanGetIPStatus(&para, available_services[b].interface);
-              myip = htonl(inet_addr(para.ip));
-              if( myip == 0 || myip == 0xFFFFFFFF) continue;
-              
-              // Send the PTR, TXT, SRV and A records
-              if(dns_create_message( &response, 512 )){
-                dns_write_header( &response, iter->header->id, 0x8400, 0, 4, 0 );
-                //dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (u8*) available_services[b].service_name );
-                dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, available_services[b].ttl, (uint8_t*) available_services[b].instance_name );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, available_services[b].ttl, (uint8_t*) available_services[b].txt_att );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, available_services[b].ttl, (uint8_t*) &available_services[b]);
-                dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, available_services[b].ttl, (uint8_t*) &myip);
-                mdns_send_message(fd, &response );
-                dns_free_message( &response );
-                question_processed = 1;
-              }
-            }
-          }
+        question_processed = 1;
+      }
+      // else check if its one of our records
+      else {
+        for ( entry = mdns_name_find( NULL, &mdns_owner_key ); entry != NULL; entry = mdns_name_find( entry, &mdns_owner_key ) ){
+          if( entry->kind != MDNS_NAME_SERVICE || available_services[entry->record].state != RECORD_NORMAL )
+            continue;
+
+          // Send the PTR, TXT, SRV and A records
+          mdns_query_request( entry->record, MDNS_RECORD_SERVICE_ALL, 0 );
+          question_processed = 1;
         }
       }
       break;
     }
     if (!question_processed ){
-      mdns_process_query(fd, &name, &question, iter);
+      mdns_process_query( &mdns_owner_key, &question );
     }
   }
+  for ( b = 0; b < mdns_query_record_count; ++b ){
+    record = &available_services[ mdns_query_records[b] ];
+    if ( record->requested & MDNS_RECORD_PTR )
+      record->direct |= MDNS_RECORD_PTR;
+    record->requested |= record->direct;
+  }
+
+  // Leave out what the querier already knows, RFC 6762 section 7.1
+  mdns_process_known_answers( iter, ntohs(iter->header->answer_count) );
+
+  for ( b = 0; b < mdns_query_record_count; ++b ){
+    record = &available_services[ mdns_query_records[b] ];
+    // No additional records for a known PTR
+    if ( ( record->direct & MDNS_RECORD_PTR ) && !( record->requested & MDNS_RECORD_PTR ) )
+      record->requested &= record->direct | MDNS_RECORD_SERVICES_PTR;
+    record->pending |= record->requested;
+    all_requested |= record->requested;
+    record->requested = 0;
+    record->direct = 0;
+  }
+  mdns_query_record_count = 0;
+  if ( all_requested == 0 )
+    return;
+
+  /* Unique records are answered at once, shared ones after a random delay so that answers to
+     several queriers, and to other queries of this one, go out in one packet (RFC 6762, section 6) */
+  due = mico_get_time();
+  if ( ntohs(iter->header->flags) & DNS_MESSAGE_TRUNCATION )
+    due += mdns_random_delay( MDNS_TRUNCATED_DELAY_MIN, MDNS_TRUNCATED_DELAY_MAX );
+  else if ( all_requested & ( MDNS_RECORD_SERVICES_PTR | MDNS_RECORD_PTR ) )
+    due += mdns_random_delay( MDNS_RESPONSE_DELAY_MIN, MDNS_RESPONSE_DELAY_MAX );
+  
+  // Join a response already scheduled. A truncated query may push it back, but not past
+  // MDNS_TRUNCATED_DELAY_MAX from when it was scheduled, or a query storm would starve it
+  if ( mdns_response_scheduled == false ){
+    mdns_response_scheduled = true;
+    mdns_response_first = mico_get_time();
+    mdns_response_due = due;
+  }
+  else if ( ( ntohs(iter->header->flags) & DNS_MESSAGE_TRUNCATION ) && (int32_t)( due - mdns_response_due ) > 0 ){
+    if ( due - mdns_response_first > MDNS_TRUNCATED_DELAY_MAX )
+      due = mdns_response_first + MDNS_TRUNCATED_DELAY_MAX;
+    mdns_response_due = due;
+  }
+
+  if ( (int32_t)( mico_get_time() - mdns_response_due ) >= 0 )
+    mdns_send_pending_response( fd );
 }
 
-static void mdns_process_query(int fd, dns_name_t* name, 
-                               dns_question_t* question, dns_message_iterator_t* source )
+static void mdns_process_query( mdns_name_key_t* key, dns_question_t* question )
 {
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
-  uint32_t myip;
-  int b = 0;
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
+  mdns_name_entry_t* entry;
   
   switch ( question->question_type )
   {
   case RR_QTYPE_ANY:
   case RR_TYPE_A:
-    for ( b = 0; b < available_service_count; ++b ){
-      if ( dns_compare_name_to_string( name, available_services[b].hostname ) ){				
-
-        micoWlanGetIPStatus(&para, available_services[b].interface);
-        myip = htonl(inet_addr(para.ip));
-        if( myip == 0 || myip == 0xFFFFFFFF) continue;
-
-        if(dns_create_message( &response, 256 )){
-          dns_write_header( &response, source->header->id, 0x8400, 0, 1, 0 );
-          dns_write_record( &response, available_services[b].hostname, RR_CLASS_IN | RR_CACHE_FLUSH, RR_TYPE_A, available_services[b].ttl, (uint8_t *)&myip);
-          mdns_send_message(fd, &response );
-          dns_free_message( &response );
-          return;
-        }
-      }
+    for ( entry = mdns_name_find( NULL, key ); entry != NULL; entry = mdns_name_find( entry, key ) ){
+      if( entry->kind != MDNS_NAME_HOST || available_services[entry->record].state == RECORD_REMOVED )
+        continue;
+
+      mdns_query_request( entry->record, 0, MDNS_RECORD_A );
+      return;
     }    
+    if ( question->question_type == RR_TYPE_A )
+      break;
+  case RR_TYPE_SRV:
+  case RR_TYPE_TXT:
+    // Instance names, asked by queriers resolving an instance
+    for ( entry = mdns_name_find( NULL, key ); entry != NULL; entry = mdns_name_find( entry, key ) ){
+      if( entry->kind != MDNS_NAME_INSTANCE || available_services[entry->record].state != RECORD_NORMAL )
+        continue;
+
+      if ( question->question_type != RR_TYPE_TXT )
+        mdns_query_request( entry->record, 0, MDNS_RECORD_SRV | MDNS_RECORD_A );
+      if ( question->question_type != RR_TYPE_SRV )
+        mdns_query_request( entry->record, 0, MDNS_RECORD_TXT );
+    }
+    break;
   default:
    break;;
   }
 }
 
+static uint32_t mdns_record_ip( dns_sd_service_record_t* record )
+{
+  return mdns_interface_ip[ record->interface ];
+}
+
+/* Read the address of an interface into mdns_interface_ip, on start, on every WiFi status change
+   and when DHCP completes. Returns whether the address changed */
+static bool mdns_refresh_interface_ip( WiFi_Interface interface )
+{
+  IPStatusTypedef para;
+  uint32_t ip;
+  bool changed;
+
+  memset( &para, 0x0, sizeof(para) );
+  micoWlanGetIPStatus(&para, interface);
+  ip = htonl(inet_addr(para.ip));
+  if ( ip == 0xFFFFFFFF )
+    ip = 0;
+
+  mico_rtos_lock_mutex( &bonjour_mutex );
+  changed = ( mdns_interface_ip[ interface ] != ip );
+  mdns_interface_ip[ interface ] = ip;
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+  return changed;
+}
+
+/* Compare TXT rdata to a txt_att string, which is converted by dns_string_to_wire */
+static int dns_compare_txt( const uint8_t* rdata, uint16_t length, const char* txt )
+{
+  const uint8_t* end = rdata + length;
+  uint8_t count;
+
+  while ( *txt != 0 )
+  {
+    if ( rdata >= end )
+      return 0;
+    count = *rdata++;
+    while ( *txt != '.' && *txt != 0 )
+    {
+      if ( *txt == '/' && txt[1] != 0 )
+        txt++;
+      if ( count == 0 || rdata >= end || *rdata != (uint8_t) *txt )
+        return 0;
+      rdata++;
+      txt++;
+      count--;
+    }
+    if ( count != 0 )
+      return 0;
+    if ( *txt == '.' )
+      txt++;
+  }
+  // dns_string_to_wire ends the strings with an empty one
+  return ( rdata + 1 == end && *rdata == 0 );
+}
+
+/* Whether a name in the rdata of an answer is the name of an entry */
+static bool mdns_rdata_name_is( dns_name_t* name, mdns_name_entry_t* entry )
+{
+  return entry != NULL && mdns_packet_name_key( name, &mdns_rdata_key ) && entry->hash == mdns_rdata_key.hash
+      && entry->length == mdns_rdata_key.length && memcmp( entry->name, mdns_rdata_key.name, entry->length ) == 0;
+}
+
+/* Records of a service that an answer from a query or another responder covers, its owner name
+   being the service's name of this kind. It must have at least half of our TTL left (RFC 6762,
+   sections 7.1 and 7.4) */
+static uint8_t mdns_known_answer_records( dns_sd_service_record_t* service, uint8_t kind, dns_record_t* record )
+{
+  dns_name_t rdata_name;
+  uint32_t ttl = service->ttl;
+  uint32_t myip;
+  uint8_t known = 0;
+
+  if( service->state == RECORD_REMOVED )
+    return 0;
+
+  rdata_name.start_of_name   = record->rdata.iter;
+  rdata_name.start_of_packet = (uint8_t*) record->rdata.header;
+  rdata_name.end_of_packet   = (uint8_t*) record->rdata.end;
+
+  switch ( record->record_type )
+  {
+  case RR_TYPE_PTR:
+    if ( kind == MDNS_NAME_SERVICE && mdns_rdata_name_is( &rdata_name, service->names[MDNS_NAME_INSTANCE] ) )
+      known = MDNS_RECORD_PTR;
+    break;
+  case RR_TYPE_SRV:
+    rdata_name.start_of_name += 6;
+    if ( kind == MDNS_NAME_INSTANCE && record->rd_length > 6 && ( ( record->rdata.iter[4] << 8 ) | record->rdata.iter[5] ) == service->port
+        && mdns_rdata_name_is( &rdata_name, service->names[MDNS_NAME_HOST] ) )
+      known = MDNS_RECORD_SRV;
+    break;
+  case RR_TYPE_TXT:
+    if ( kind == MDNS_NAME_INSTANCE && dns_compare_txt( record->rdata.iter, record->rd_length, service->txt_att ) )
+      known = MDNS_RECORD_TXT;
+    break;
+  case RR_TYPE_A:
+    if ( kind == MDNS_NAME_HOST && record->rd_length == 4 ){
+      myip = mdns_record_ip( service );
+      if ( memcmp( record->rdata.iter, &myip, 4 ) == 0 )
+        known = MDNS_RECORD_A;
+    }
+    break;
+  default:
+    break;
+  }
+
+  if ( record->ttl < ttl / 2 )
+    known = 0;
+  return known;
+}
+
+/* Drop the records covered by the next count answers from the query being processed and from the pending response */
+static void mdns_process_known_answers( dns_message_iterator_t* iter, uint16_t count )
+{
+  dns_name_t name;
+  dns_record_t record;
+  dns_sd_service_record_t* service;
+  mdns_name_entry_t* entry;
+  uint8_t known;
+  int a;
+
+  for ( a = 0; a < count; ++a ){
+    if ( dns_get_next_record( iter, &record, &name ) == 0 )
+      break;
+    if ( mdns_packet_name_key( &name, &mdns_owner_key ) == false )
+      continue;
+
+    // A _services._dns-sd._udp PTR is looked up by the service name in its rdata
+    if ( record.record_type == RR_TYPE_PTR && mdns_owner_key.length == sizeof(SERVICE_QUERY_WIRE)
+        && memcmp( mdns_owner_key.name, SERVICE_QUERY_WIRE, sizeof(SERVICE_QUERY_WIRE) ) == 0 ){
+      name.start_of_name = record.rdata.iter;
+      name.end_of_packet = record.rdata.end;
+      if ( record.ttl < SERVICE_QUERY_TTL / 2 || mdns_packet_name_key( &name, &mdns_owner_key ) == false )
+        continue;
+      for ( entry = mdns_name_find( NULL, &mdns_owner_key ); entry != NULL; entry = mdns_name_find( entry, &mdns_owner_key ) ){
+        service = &available_services[entry->record];
+        if ( entry->kind != MDNS_NAME_SERVICE || service->state == RECORD_REMOVED )
+          continue;
+        service->pending   &= ~MDNS_RECORD_SERVICES_PTR;
+        service->requested &= ~MDNS_RECORD_SERVICES_PTR;
+      }
+      continue;
+    }
+
+    for ( entry = mdns_name_find( NULL, &mdns_owner_key ); entry != NULL; entry = mdns_name_find( entry, &mdns_owner_key ) ){
+      service = &available_services[entry->record];
+      known = mdns_known_answer_records( service, entry->kind, &record );
+      service->pending   &= ~known;
+      service->requested &= ~known;
+    }
+  }
+}
+
+/* Records multicast less than MDNS_MULTICAST_INTERVAL ago */
+static uint8_t mdns_rate_limited_records( dns_sd_service_record_t* record, uint32_t now )
+{
+  uint8_t limited = 0;
+  int i;
+
+  for ( i = 0; i < MDNS_RECORD_TYPE_COUNT; i++ ){
+    if ( record->sent_time[i] != 0 && now - record->sent_time[i] < MDNS_MULTICAST_INTERVAL )
+      limited |= ( 1 << i );
+  }
+  return limited;
+}
+
+static void mdns_send_pending_response( int fd )
+{
+  mdns_response_t response;
+  dns_sd_service_record_t* record;
+  uint32_t now = mico_get_time();
+  uint32_t myip;
+  uint8_t records;
+  int b;
+
+  mdns_response_scheduled = false;
+  mdns_response_begin( &response, fd, 0x0 );
+
+  for ( b = 0; b < available_service_count; ++b ){
+    record = &available_services[b];
+    records = record->pending & ~mdns_rate_limited_records( record, now );
+    record->pending = 0;
+    if ( records == 0 || record->state == RECORD_REMOVED )
+      continue;
+
+    myip = mdns_record_ip( record );
+    if( myip == 0 || myip == 0xFFFFFFFF )
+      records &= MDNS_RECORD_SERVICES_PTR;
+
+    if ( records & MDNS_RECORD_SERVICES_PTR )
+      mdns_response_add_service( &response, record, MDNS_RECORD_SERVICES_PTR, SERVICE_QUERY_TTL, 0 );
+    if ( records & ~MDNS_RECORD_SERVICES_PTR )
+      mdns_response_add_service( &response, record, records & ~MDNS_RECORD_SERVICES_PTR, record->ttl, myip );
+  }
+
+  mdns_response_send( &response );
+}
 
 static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name )
 {
   // Set the name pointers and then skip it
   name->start_of_name   = (uint8_t*) iter->iter;
   name->start_of_packet = (uint8_t*) iter->header;
+  name->end_of_packet   = iter->end;
   dns_skip_name( iter );
-  if (iter->iter > iter->end)
+  if (iter->iter + 4 > iter->end)
     return 0;
   
   // Read the type and class
@@ -215,132 +523,297 @@ static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t*
   return 1;
 }
 
-static int dns_compare_name_to_string( dns_name_t* name, const char* string )
+static int dns_get_next_record( dns_message_iterator_t* iter, dns_record_t* r, dns_name_t* name )
+{
+  // Set the name pointers and then skip it
+  name->start_of_name   = (uint8_t*) iter->iter;
+  name->start_of_packet = (uint8_t*) iter->header;
+  name->end_of_packet   = iter->end;
+  dns_skip_name( iter );
+  if (iter->iter + 10 > iter->end)
+    return 0;
+  
+  // Read the type, class, TTL and rdata length
+  r->record_type  = dns_read_uint16( iter );
+  r->record_class = dns_read_uint16( iter );
+  r->ttl          = (uint32_t) dns_read_uint16( iter ) << 16;
+  r->ttl         += dns_read_uint16( iter );
+  r->rd_length    = dns_read_uint16( iter );
+  if (iter->iter + r->rd_length > iter->end)
+    return 0;
+
+  r->rdata.header = iter->header;
+  r->rdata.iter   = iter->iter;
+  r->rdata.end    = iter->iter + r->rd_length;
+  iter->iter     += r->rd_length;
+  return 1;
+}
+
+/* Convert a dotted name, or a TXT record with '.' separated strings, to wire format. '/' escapes the
+   next character. Returns the wire length, 0 if it does not fit in size or a label exceeds max_label */
+static uint16_t dns_string_to_wire( const char* src, uint8_t* out, uint32_t size, uint8_t max_label )
 {
-  uint8_t section_length;
-  int finished = 0;
-  int result   = 1;
-  uint8_t* buffer 	  = name->start_of_name;
-  char *temp;
+  uint32_t length = 0;
+  uint8_t* segment_length_pointer;
   
-  while ( !finished )
+  while ( *src != 0 )
   {
-    // Check if the name is compressed. If so, find the uncompressed version
-    while ( *buffer & 0xC0 )
-    {
-      uint16_t offset = ( *buffer++ ) << 8;
-      offset += *buffer;
-      offset &= 0x3FFF;
-      buffer = name->start_of_packet + offset;
-    }
+    /* Remember where we need to store the segment length and reset the counter*/
+    if ( length >= size )
+      return 0;
+    segment_length_pointer = &out[length++];
+    *segment_length_pointer = 0;
     
-    // Compare section
-    section_length = *( buffer++ );
-    temp = malloc(section_length+1);
-    temp[section_length] = 0;
-    memcpy(temp, buffer, section_length );
-    free(temp);
-    if ( strncmp( (char*) buffer, string, section_length ) )
+    /* Copy bytes until '.' or end of string*/
+    while ( *src != '.' && *src != 0 )
     {
-      result	 = 0;
-      finished = 1;
+      if ( *src == '/' && src[1] != 0 )
+        src++; // skip '/'
+      
+      if ( length >= size || *segment_length_pointer == max_label )
+        return 0;
+      out[length++] = *src++;
+      ++*segment_length_pointer;
     }
-    string += section_length + 1;
-    buffer += section_length;
     
-    // Check if we've finished comparing
-    if ( *buffer == 0 || *string == 0 )
+    /* Check if we stopped because of a '.', if so, skip it*/
+    if ( *src == '.' )
     {
-      finished = 1;
-      // Check if one of the strings has more data
-      if ( *buffer != 0 || *string != 0 )
-      {
-        result = 0;
-      }
+      ++src;
     }
   }
   
-  return result;
+  /* Add the ending null */
+  if ( length >= size )
+    return 0;
+  out[length++] = 0;
+  return (uint16_t) length;
 }
 
-static int dns_create_message( dns_message_iterator_t* message, uint16_t size )
+/* Follow the compression pointers at buffer to the next label. NULL if there are too many jumps,
+   or a pointer or the label it leads to does not lie between packet and end */
+static const uint8_t* dns_next_label( const uint8_t* packet, const uint8_t* end, const uint8_t* buffer, int* jumps )
 {
-  message->header = (dns_message_header_t*) malloc( size );
-  if ( message->header == NULL )
+  uint16_t offset;
+  
+  while ( buffer < end && ( *buffer & 0xC0 ) == 0xC0 )
   {
-    return 0;
+    if ( ++*jumps > 8 || buffer + 2 > end )
+      return NULL;
+    offset = ( ( buffer[0] & 0x3F ) << 8 ) | buffer[1];
+    if ( offset >= end - packet )
+      return NULL;
+    buffer = packet + offset;
   }
   
-  message->iter = (uint8_t *) message->header + sizeof(dns_message_header_t);
-  return 1;
+  if ( buffer >= end || buffer + *buffer + 1 > end )
+    return NULL;
+  return buffer;
 }
 
-static void dns_free_message( dns_message_iterator_t* message )
+/* Compare a name already in the packet, which may be compressed, to a sequence of wire format labels */
+static int dns_compare_packet_name( const uint8_t* packet, const uint8_t* end, uint16_t offset, const uint8_t* labels )
 {
-  free(message->header);
-  message->header = NULL;
+  const uint8_t* buffer = packet + offset;
+  int jumps = 0;
+  
+  while ( 1 )
+  {
+    buffer = dns_next_label( packet, end, buffer, &jumps );
+    if ( buffer == NULL )
+      return 0;
+    
+    if ( *buffer != *labels )
+      return 0;
+    if ( *buffer == 0 )
+      return 1;
+    if ( strnicmp( (const char*) buffer + 1, (const char*) labels + 1, *buffer ) )
+      return 0;
+    
+    buffer += *buffer + 1;
+    labels += *labels + 1;
+  }
 }
 
-static void dns_write_string( dns_message_iterator_t* iter, const char* src )
+/* FNV-1a */
+static uint32_t mdns_name_hash( const uint8_t* name, uint16_t length )
 {
-  uint8_t* segment_length_pointer;
-  uint8_t  segment_length;
+  uint32_t hash = 2166136261u;
+  
+  while ( length-- )
+    hash = ( hash ^ *name++ ) * 16777619u;
+  return hash;
+}
+
+/* Lower-case the labels of a wire format name, names are compared case-insensitively (RFC 6762, section 16) */
+static void dns_lower_name( uint8_t* name )
+{
+  uint8_t* end;
   
-  while ( *src != 0 && *src != 0xC0)
+  for ( ; *name != 0; name = end )
   {
-    /* Remember where we need to store the segment length and reset the counter*/
-    segment_length_pointer = iter->iter++;
-    segment_length = 0;
-    
-    /* Copy bytes until '.' or end of string*/
-    while ( *src != '.' && *src != 0 && *src != 0xC0)
-    {
-      if (*src == '/')
-        src++; // skip '/'
-      
-      *iter->iter++ = *src++;
-      ++segment_length;
-    }
-    
-    /* Store the length of the segment*/
-    *segment_length_pointer = segment_length;
-    
-    /* Check if we stopped because of a '.', if so, skip it*/
-    if ( *src == '.' )
+    end = name + *name + 1;
+    for ( name++; name < end; name++ )
     {
-      ++src;
+      if ( *name >= 'A' && *name <= 'Z' )
+        *name += 'a' - 'A';
     }
+  }
+}
+
+/* Key of a dotted name, as converted by dns_string_to_wire */
+static bool mdns_string_name_key( const char* string, mdns_name_key_t* key )
+{
+  key->length = dns_string_to_wire( string, key->name, sizeof(key->name), DNS_MAX_LABEL_LENGTH );
+  if ( key->length == 0 )
+    return false;
+  dns_lower_name( key->name );
+  key->hash = mdns_name_hash( key->name, key->length );
+  return true;
+}
+
+/* Key of a name in a packet, following its compression pointers */
+static bool mdns_packet_name_key( dns_name_t* name, mdns_name_key_t* key )
+{
+  const uint8_t* buffer = name->start_of_name;
+  uint16_t length = 0;
+  int jumps = 0;
+  
+  while ( 1 )
+  {
+    buffer = dns_next_label( name->start_of_packet, name->end_of_packet, buffer, &jumps );
+    if ( buffer == NULL )
+      return false;
     
+    if ( ( *buffer & 0xC0 ) != 0 || length + *buffer + 1 > sizeof(key->name) )
+      return false;
+    memcpy( &key->name[length], buffer, *buffer + 1 );
+    length += *buffer + 1;
+    if ( *buffer == 0 )
+      break;
+    buffer += *buffer + 1;
   }
   
-  if (*src == 0xC0) { // compress name
-    *iter->iter++ = *src++;
-    *iter->iter++ = *src++;
-  } else {
-    /* Add the ending null */
-    *iter->iter++ = 0;
+  key->length = length;
+  dns_lower_name( key->name );
+  key->hash = mdns_name_hash( key->name, key->length );
+  return true;
+}
+
+/* Next entry after prev, or the first if prev is NULL, with this name. See mdns_name_find */
+static mdns_name_entry_t* mdns_name_next( mdns_name_entry_t* prev, uint32_t hash, uint16_t length, const uint8_t* name )
+{
+  mdns_name_entry_t* entry = ( prev != NULL ) ? prev->next : mdns_name_table[ hash & ( MDNS_NAME_HASH_SIZE - 1 ) ];
+  
+  for ( ; entry != NULL; entry = entry->next )
+  {
+    if ( entry->hash == hash && entry->length == length && memcmp( entry->name, name, length ) == 0 )
+      return entry;
   }
+  return NULL;
 }
 
+static bool mdns_name_add( uint8_t record_index, uint8_t kind, const char* string )
+{
+  mdns_name_entry_t* entry;
+  mdns_name_entry_t** bucket;
+  
+  if ( string == NULL || mdns_string_name_key( string, &mdns_owner_key ) == false )
+    return false;
+  
+  entry = (mdns_name_entry_t*) malloc( sizeof(mdns_name_entry_t) + mdns_owner_key.length );
+  if ( entry == NULL )
+    return false;
+  entry->hash   = mdns_owner_key.hash;
+  entry->length = mdns_owner_key.length;
+  entry->record = record_index;
+  entry->kind   = kind;
+  memcpy( entry->name, mdns_owner_key.name, mdns_owner_key.length );
+  
+  bucket = &mdns_name_table[ entry->hash & ( MDNS_NAME_HASH_SIZE - 1 ) ];
+  entry->next = *bucket;
+  *bucket     = entry;
+  available_services[record_index].names[kind] = entry;
+  return true;
+}
 
-static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_t flags, uint16_t question_count, uint16_t answer_count, uint16_t authorative_count )
+static void mdns_name_remove( dns_sd_service_record_t* record )
 {
-  memset( iter->header, 0, sizeof(dns_message_header_t) );
-  iter->header->id				= htons(id);
-  iter->header->flags 			= htons(flags);
-  iter->header->question_count	= htons(question_count);
-  iter->header->name_server_count = htons(authorative_count);
-  iter->header->answer_count		= htons(answer_count);
+  mdns_name_entry_t** link;
+  int kind;
+  
+  for ( kind = 0; kind < MDNS_NAME_KIND_COUNT; kind++ )
+  {
+    if ( record->names[kind] == NULL )
+      continue;
+    for ( link = &mdns_name_table[ record->names[kind]->hash & ( MDNS_NAME_HASH_SIZE - 1 ) ]; *link != record->names[kind]; link = &( *link )->next );
+    *link = record->names[kind]->next;
+    free( record->names[kind] );
+    record->names[kind] = NULL;
+  }
+}
+
+static bool mdns_response_reserve( mdns_response_t* response, uint32_t length )
+{
+  if ( response->message.iter + length > response->message.end )
+    response->overflow = true;
+  return !response->overflow;
 }
 
+/* Write a name, replacing its longest suffix already in the packet with a pointer */
+static void mdns_response_write_name( mdns_response_t* response, const char* name )
+{
+  uint8_t* packet = (uint8_t*) response->message.header;
+  uint8_t* start  = response->message.iter;
+  uint8_t* label;
+  uint8_t* pointer_at = NULL;
+  uint16_t length;
+  int i;
+  
+  length = dns_string_to_wire( name, start, response->message.end - start, DNS_MAX_LABEL_LENGTH );
+  if ( length == 0 )
+  {
+    response->overflow = true;
+    return;
+  }
+  
+  for ( label = start; *label != 0; label += *label + 1 )
+  {
+    for ( i = 0; i < response->name_count; i++ )
+    {
+      if ( dns_compare_packet_name( packet, start, response->names[i], label ) )
+        break;
+    }
+    /* Stop before the label is overwritten, its length byte becomes the pointer */
+    if ( i < response->name_count )
+    {
+      pointer_at = label;
+      label[0] = 0xC0 | ( response->names[i] >> 8 );
+      label[1] = response->names[i] & 0xFF;
+      break;
+    }
+  }
+  response->message.iter = ( pointer_at != NULL ) ? pointer_at + 2 : start + length;
+  
+  /* Remember the labels written in full, later names may point to them */
+  for ( label = start; label < response->message.iter && *label != 0 && ( *label & 0xC0 ) == 0; label += *label + 1 )
+  {
+    if ( response->name_count < MDNS_COMPRESSION_NAME_COUNT && label - packet < 0x3FFF )
+      response->names[response->name_count++] = label - packet;
+  }
+}
 
-static void dns_write_record( dns_message_iterator_t* iter, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, uint8_t* rdata )
+static void mdns_response_write_record( mdns_response_t* response, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, const void* rdata )
 {
+  dns_message_iterator_t* iter = &response->message;
   uint8_t* rd_length;
   uint8_t* temp_ptr;
+  uint16_t length;
   
   /* Write the name, type, class, TTL*/
-  dns_write_name	( iter, name );
+  mdns_response_write_name( response, name );
+  if ( !mdns_response_reserve( response, 10 ) )
+    return;
   dns_write_uint16( iter, record_type );
   dns_write_uint16( iter, record_class );
   dns_write_uint32( iter, ttl );
@@ -353,24 +826,36 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
   switch ( record_type )
   {
   case RR_TYPE_A:
-    dns_write_bytes( iter, rdata, 4 );
+    if ( !mdns_response_reserve( response, 4 ) )
+      return;
+    memcpy( iter->iter, rdata, 4 );
+    iter->iter += 4;
     break;
     
   case RR_TYPE_PTR:
+    mdns_response_write_name( response, (const char*) rdata );
+    break;
+    
   case RR_TYPE_TXT:
-    dns_write_name( iter, (const char*) rdata );
+    /* Character strings, never compressed */
+    length = dns_string_to_wire( (const char*) rdata, iter->iter, iter->end - iter->iter, 0xFF );
+    if ( length == 0 )
+      response->overflow = true;
+    iter->iter += length;
     break;
     
   case RR_TYPE_SRV:
     /* Set priority and weight to 0*/
+    if ( !mdns_response_reserve( response, 6 ) )
+      return;
     dns_write_uint16( iter, 0 );
     dns_write_uint16( iter, 0 );
     
     /* Write the port*/
-    dns_write_uint16( iter, ( (dns_sd_service_record_t*) rdata )->port );
+    dns_write_uint16( iter, ( (const dns_sd_service_record_t*) rdata )->port );
     
-    /* Write the hostname*/
-    dns_write_string( iter, ( (dns_sd_service_record_t*) rdata )->hostname );
+    /* Write the hostname, mDNS allows it to be compressed (RFC 6762, section 18.14) */
+    mdns_response_write_name( response, ( (const dns_sd_service_record_t*) rdata )->hostname );
     break;
   default:
     break;
@@ -380,56 +865,206 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
   rd_length[1] = ( iter->iter - temp_ptr ) & 0xFF;
 }
 
-static void mdns_send_message(int fd, dns_message_iterator_t* message )
+/* All responses are built by the bonjour thread under bonjour_mutex, so they can share this buffer */
+static uint32_t mdns_tx_buffer[ MDNS_TX_BUFFER_SIZE / sizeof(uint32_t) ];
+
+static void mdns_response_reset( mdns_response_t* response )
 {
-  struct sockaddr_t addr;
-  
-  addr.s_ip = inet_addr("224.0.0.251");
-  addr.s_port = 5353;
-  sendto(fd, message->header, message->iter - (uint8_t*)message->header, 0, &addr, sizeof(addr));
-  addr.s_ip = inet_addr("255.255.255.255");
-  addr.s_port = 5353;
-  sendto(fd, message->header, message->iter - (uint8_t*)message->header, 0, &addr, sizeof(addr));
+  response->message.iter = (uint8_t*) response->message.header + sizeof(dns_message_header_t);
+  response->flags         &= ~DNS_MESSAGE_TRUNCATION;
+  response->question_count = 0;
+  response->answer_count = 0;
+  response->name_count   = 0;
+  response->overflow     = false;
 }
 
-static void dns_write_uint16( dns_message_iterator_t* iter, uint16_t data )
+static void mdns_response_begin( mdns_response_t* response, int fd, uint16_t id )
 {
-  // We cannot assume the u8 alignment of iter->iter so we can't just typecast and assign
-  iter->iter[0] = data >> 8;
-  iter->iter[1] = data & 0xFF;
-  iter->iter += 2;
+  int i;
+  
+  response->message.header = (dns_message_header_t*) mdns_tx_buffer;
+  response->message.end    = (uint8_t*) mdns_tx_buffer + sizeof(mdns_tx_buffer);
+  response->fd             = fd;
+  response->id             = id;
+  response->flags          = DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE;
+  mdns_response_reset( response );
+  
+  for ( i = 0; i < available_service_count; i++ )
+    available_services[i].answered = 0;
 }
 
-static void dns_write_uint32( dns_message_iterator_t* iter, uint32_t data )
+static void mdns_response_send( mdns_response_t* response )
 {
-  iter->iter[0] = data >> 24;
-  iter->iter[1] = data >> 16;
-  iter->iter[2] = data >> 8;
-  iter->iter[3] = data & 0xFF;
-  iter->iter += 4;
+  if ( response->answer_count == 0 && response->question_count == 0 )
+    return;
+  
+  dns_write_header( &response->message, response->id, response->flags, response->question_count, response->answer_count, 0 );
+  mdns_send_message( response->fd, &response->message );
+  mdns_response_reset( response );
 }
 
-static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16_t length )
+static bool mdns_response_add_record( mdns_response_t* response, const char* name, uint16_t record_class, uint16_t record_type, uint32_t ttl, const void* rdata )
 {
-  int a = 0;
+  uint8_t* record_start = response->message.iter;
+  uint16_t name_count   = response->name_count;
   
-  for ( a = 0; a < length; ++a )
+  mdns_response_write_record( response, name, record_class, record_type, ttl, rdata );
+  if ( response->overflow == true )
   {
-    iter->iter[a] = data[a];
+    /* Roll back, send the answers so far and retry in an empty packet */
+    response->message.iter = record_start;
+    response->name_count   = name_count;
+    response->overflow     = false;
+    if ( response->answer_count == 0 )
+      return false;
+    
+    // A query tells the responders that more known answers follow
+    if ( response->question_count != 0 )
+      response->flags |= DNS_MESSAGE_TRUNCATION;
+    mdns_response_send( response );
+    mdns_response_write_record( response, name, record_class, record_type, ttl, rdata );
+    if ( response->overflow == true )
+    {
+      mdns_response_reset( response );
+      return false;
+    }
   }
-  iter->iter += length;
+  response->answer_count++;
+  return true;
 }
 
-static uint16_t dns_read_uint16( dns_message_iterator_t* iter )
+/* Questions of a query, they must be added before any known answer */
+static bool mdns_response_add_question( mdns_response_t* response, const char* name, uint16_t question_type )
 {
-  uint16_t temp = (uint16_t) ( *iter->iter++ ) << 8;
-  temp += (uint16_t) ( *iter->iter++ );
+  uint8_t* question_start = response->message.iter;
+  uint16_t name_count     = response->name_count;
+  
+  if ( response->answer_count != 0 )
+    return false;
+  
+  mdns_response_write_name( response, name );
+  if ( mdns_response_reserve( response, 4 ) )
+  {
+    dns_write_uint16( &response->message, question_type );
+    dns_write_uint16( &response->message, RR_CLASS_IN );
+    response->question_count++;
+    return true;
+  }
+  
+  response->message.iter = question_start;
+  response->name_count   = name_count;
+  response->overflow     = false;
+  return false;
+}
+
+static void mdns_record_sent( dns_sd_service_record_t* record, uint8_t record_bit )
+{
+  mdns_name_entry_t* host = record->names[MDNS_NAME_HOST];
+  mdns_name_entry_t* entry;
+  uint32_t now = mico_get_time();
+  int bit;
+
+  for ( bit = 0; ( 1 << bit ) != record_bit; bit++ );
+  record->answered |= record_bit;
+  record->sent_time[bit] = now;
+
+  /* The A record is shared by the services of a host */
+  if ( record_bit == MDNS_RECORD_A && host != NULL ){
+    for ( entry = mdns_name_find( NULL, host ); entry != NULL; entry = mdns_name_find( entry, host ) ){
+      if ( entry->kind == MDNS_NAME_HOST )
+        available_services[entry->record].sent_time[bit] = now;
+    }
+  }
+}
+
+/* Add the selected records of a service, skipping those already in this response */
+static void mdns_response_add_service( mdns_response_t* response, dns_sd_service_record_t* record, uint8_t records, uint32_t ttl, uint32_t ip )
+{
+  mdns_name_entry_t* host = record->names[MDNS_NAME_HOST];
+  mdns_name_entry_t* entry;
+  dns_sd_service_record_t* other;
+  
+  records &= ~record->answered;
+  
+  /* Services sharing a host name and an address share one A record, and a goodbye
+     for it is only sent once no service using it is alive any more */
+  if ( ( records & MDNS_RECORD_A ) && host != NULL )
+  {
+    for ( entry = mdns_name_find( NULL, host ); entry != NULL; entry = mdns_name_find( entry, host ) )
+    {
+      other = &available_services[entry->record];
+      if ( entry->kind != MDNS_NAME_HOST || other == record || mdns_record_ip( other ) != ip )
+        continue;
+      if ( other->answered & MDNS_RECORD_A )
+        records &= ~MDNS_RECORD_A;
+      else if ( ttl == 0 && ( other->state == RECORD_NORMAL || other->state == RECORD_UPDATE ) )
+        records &= ~MDNS_RECORD_A;
+    }
+  }
+  
+  if ( ( records & MDNS_RECORD_SERVICES_PTR ) && mdns_response_add_record( response, SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, ttl, record->service_name ) )
+    mdns_record_sent( record, MDNS_RECORD_SERVICES_PTR );
+  if ( ( records & MDNS_RECORD_PTR ) && mdns_response_add_record( response, record->service_name, RR_CLASS_IN, RR_TYPE_PTR, ttl, record->instance_name ) )
+    mdns_record_sent( record, MDNS_RECORD_PTR );
+  if ( ( records & MDNS_RECORD_TXT ) && mdns_response_add_record( response, record->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, ttl, record->txt_att ) )
+    mdns_record_sent( record, MDNS_RECORD_TXT );
+  if ( ( records & MDNS_RECORD_SRV ) && mdns_response_add_record( response, record->instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, ttl, record ) )
+    mdns_record_sent( record, MDNS_RECORD_SRV );
+  if ( ( records & MDNS_RECORD_A ) && mdns_response_add_record( response, record->hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, ttl, &ip ) )
+    mdns_record_sent( record, MDNS_RECORD_A );
+}
+
+
+static void dns_write_header( dns_message_iterator_t* iter, uint16_t id, uint16_t flags, uint16_t question_count, uint16_t answer_count, uint16_t authorative_count )
+{
+  memset( iter->header, 0, sizeof(dns_message_header_t) );
+  iter->header->id				= htons(id);
+  iter->header->flags 			= htons(flags);
+  iter->header->question_count	= htons(question_count);
+  iter->header->name_server_count = htons(authorative_count);
+  iter->header->answer_count		= htons(answer_count);
+}
+
+
+static void mdns_send_message(int fd, dns_message_iterator_t* message )
+{
+  struct sockaddr_t addr;
+  
+  addr.s_ip = inet_addr("224.0.0.251");
+  addr.s_port = 5353;
+  sendto(fd, message->header, message->iter - (uint8_t*)message->header, 0, &addr, sizeof(addr));
+  addr.s_ip = inet_addr("255.255.255.255");
+  addr.s_port = 5353;
+  sendto(fd, message->header, message->iter - (uint8_t*)message->header, 0, &addr, sizeof(addr));
+}
+
+static void dns_write_uint16( dns_message_iterator_t* iter, uint16_t data )
+{
+  // We cannot assume the u8 alignment of iter->iter so we can't just typecast and assign
+  iter->iter[0] = data >> 8;
+  iter->iter[1] = data & 0xFF;
+  iter->iter += 2;
+}
+
+static void dns_write_uint32( dns_message_iterator_t* iter, uint32_t data )
+{
+  iter->iter[0] = data >> 24;
+  iter->iter[1] = data >> 16;
+  iter->iter[2] = data >> 8;
+  iter->iter[3] = data & 0xFF;
+  iter->iter += 4;
+}
+
+static uint16_t dns_read_uint16( dns_message_iterator_t* iter )
+{
+  uint16_t temp = (uint16_t) ( *iter->iter++ ) << 8;
+  temp += (uint16_t) ( *iter->iter++ );
   return temp;
 }
 
 static void dns_skip_name( dns_message_iterator_t* iter )
 {
-  while ( *iter->iter != 0 )
+  while ( iter->iter < iter->end && *iter->iter != 0 )
   {
     // Check if the name is compressed
     if ( *iter->iter & 0xC0 )
@@ -441,248 +1076,841 @@ static void dns_skip_name( dns_message_iterator_t* iter )
     {
       iter->iter += (uint32_t) *iter->iter + 1;
     }
-    if (iter->iter > iter->end)
-      break;
+    if (iter->iter > iter->end)
+      break;
+  }
+  // Skip the null u8
+  ++iter->iter;
+}
+
+static bool is_service_match ( dns_sd_service_record_t *record, char *service_name, WiFi_Interface interface )
+{
+  if( record->state == RECORD_REMOVED || record->state == RECORD_REMOVE )
+    return false;
+
+  if( ( service_name == NULL || strcmp( record->service_name, service_name ) == 0 ) && record->interface == interface )
+    return true;
+
+  return false;
+}
+
+static int find_record_by_service ( char *service_name, WiFi_Interface interface )
+{
+  mdns_name_entry_t* entry;
+  uint32_t insert_index = 0xFF;
+
+  if ( mdns_string_name_key( service_name, &mdns_owner_key ) == false )
+    return insert_index;
+
+  for ( entry = mdns_name_find( NULL, &mdns_owner_key ); entry != NULL; entry = mdns_name_find( entry, &mdns_owner_key ) ){
+    if( entry->kind == MDNS_NAME_SERVICE && is_service_match ( &available_services[entry->record], NULL, interface ) ){
+      insert_index = entry->record;
+      break;
+    }
+  }  
+  return insert_index;
+}
+
+/* A removed slot, or a new one if all are in use. Name entries refer to records by index, so the
+   table may move when it grows */
+static int find_empty_record ( void )
+{
+  dns_sd_service_record_t* services;
+  int i;
+  uint32_t insert_index = 0xFF;
+
+  for ( i = 0; i < available_service_count; i++ ){
+    if( available_services[i].state == RECORD_REMOVED ){
+      insert_index = i;
+      break;
+    }
+  }
+  if ( insert_index != 0xFF || available_service_count + MDNS_RECORD_GROW_COUNT > MDNS_RECORD_COUNT_MAX )
+    return insert_index;
+
+  services = (dns_sd_service_record_t*) realloc( available_services, ( available_service_count + MDNS_RECORD_GROW_COUNT ) * sizeof(dns_sd_service_record_t) );
+  if ( services == NULL )
+    return insert_index;
+  memset( &services[available_service_count], 0x0, MDNS_RECORD_GROW_COUNT * sizeof(dns_sd_service_record_t) );
+  available_services = services;
+  insert_index = available_service_count;
+  available_service_count += MDNS_RECORD_GROW_COUNT;
+  return insert_index;
+}
+
+static mico_thread_t _bonjour_announce_handler = NULL;
+
+void _bonjour_send_anounce_thread(void *arg)
+{
+  uint32_t insert_index = 0xFF;
+  UNUSED_PARAMETER( arg );
+
+  while(1){
+    insert_index = 0xFF;
+    mico_rtos_lock_mutex( &bonjour_mutex );
+    for ( int i = 0; i < available_service_count; i++ ){
+      if( available_services[i].state != RECORD_REMOVED && available_services[i].count_down != 0 ){
+        insert_index = i;
+        break;
+      }
+    }  
+    mico_rtos_unlock_mutex( &bonjour_mutex );
+
+    if( insert_index == 0xFF )
+      goto exit;
+    
+    mdns_utils_log( "sem trigger" );
+    mico_rtos_set_semaphore( &update_state_sem );
+    mico_thread_msleep(200);
+  }
+  
+exit:
+  _bonjour_announce_handler = NULL;
+  mico_rtos_delete_thread( NULL );
+  return;
+}
+
+static void _clean_record_resource( dns_sd_service_record_t *record )
+{
+  mdns_name_remove( record );
+  if(record->service_name)  {
+    free(record->service_name);
+    record->service_name = NULL;
+  }
+  if(record->hostname){
+    free(record->hostname);
+    record->hostname = NULL;
+    }
+  if(record->instance_name){
+      free(record->instance_name);
+      record->instance_name = NULL;
+    }
+  if(record->txt_att){
+    free(record->txt_att);
+    record->txt_att = NULL;
+  }
+
+}
+
+
+OSStatus mdns_add_record( mdns_init_t init, WiFi_Interface interface, uint32_t time_to_live )
+{
+  int len;
+  OSStatus err = kNoErr;
+  uint32_t insert_index = 0xFF;
+
+  if( bonjour_instance == false ){
+    err = start_bonjour_service( );
+    require_noerr(err, exit);
+  }
+  
+  mico_rtos_lock_mutex( &bonjour_mutex );
+
+  insert_index = find_record_by_service ( init.service_name, interface );
+  if( insert_index == 0xFF)
+    insert_index = find_empty_record ( );
+
+  require_action( insert_index < available_service_count, unlock, err = kNoResourcesErr);
+
+  _clean_record_resource( &available_services[insert_index] );
+
+  available_services[insert_index].interface = interface;
+  available_services[insert_index].service_name = (char*)__strdup(init.service_name);
+  available_services[insert_index].hostname = (char*)__strdup(init.host_name);
+
+  // Full instance name, "<instance>.<service>", its service suffix is compressed when written
+  len = strlen(init.instance_name) + strlen(init.service_name) + 2;
+  available_services[insert_index].instance_name = (char*)malloc(len);
+  snprintf(available_services[insert_index].instance_name, len, "%s.%s", init.instance_name, init.service_name);
+  
+  available_services[insert_index].txt_att = (char*)__strdup(init.txt_record);
+
+  available_services[insert_index].port = init.service_port;
+  available_services[insert_index].pending = 0;
+  memset( available_services[insert_index].sent_time, 0x0, sizeof(available_services[insert_index].sent_time) );
+  available_services[insert_index].state = RECORD_UPDATE;
+  available_services[insert_index].count_down = 5;
+  available_services[insert_index].ttl = time_to_live;
+
+  // Owner names for the lookup of questions and answers
+  if( mdns_name_add( insert_index, MDNS_NAME_SERVICE, available_services[insert_index].service_name ) == false
+     || mdns_name_add( insert_index, MDNS_NAME_INSTANCE, available_services[insert_index].instance_name ) == false
+     || mdns_name_add( insert_index, MDNS_NAME_HOST, available_services[insert_index].hostname ) == false ){
+    _clean_record_resource( &available_services[insert_index] );
+    available_services[insert_index].state = RECORD_REMOVED;
+    err = kNoMemoryErr;
+    goto unlock;
+  }
+  
+  if( _bonjour_announce_handler == NULL)
+    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
+
+unlock:
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+
+exit:
+  return err;
+}
+
+
+void mdns_update_txt_record( char *service_name, WiFi_Interface interface, char *txt_record )
+{
+  uint32_t insert_index = 0xFF;
+
+  if( bonjour_instance == false ) return;
+
+  mico_rtos_lock_mutex( &bonjour_mutex );
+
+  insert_index = find_record_by_service ( service_name, interface );
+  if( insert_index == 0xFF ) goto exit;
+
+  if(available_services[insert_index].txt_att)  free(available_services[insert_index].txt_att);
+  available_services[insert_index].txt_att = (char*)__strdup(txt_record);
+  available_services[insert_index].state = RECORD_UPDATE;
+  available_services[insert_index].count_down = 5;
+
+  if( _bonjour_announce_handler == NULL)
+    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
+
+exit:
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+}
+  
+
+void mdns_suspend_record( char *service_name, WiFi_Interface interface, bool will_remove )
+{
+  int i;
+  uint32_t insert_index = 0xFF;
+  
+  mdns_utils_log( "Suspend %s@%d",  service_name, interface);
+
+  if( bonjour_instance == false ) return;
+
+  mico_rtos_lock_mutex( &bonjour_mutex );
+
+  for ( i = 0; i < available_service_count; i++ ){
+    if( is_service_match ( &available_services[i], service_name, interface ) == false) 
+      continue;
+    
+    mdns_utils_log( "Find index %d to suspend", i);
+    if( will_remove == true )
+      available_services[i].state = RECORD_REMOVE;
+    else{
+      if( available_services[i].state != RECORD_REMOVE )
+        available_services[i].state = RECORD_SUSPEND;
+    }
+  
+    available_services[i].count_down = 5; 
+    insert_index = i;
+  }
+
+  if( insert_index == 0xFF )
+    goto exit;
+
+  if( _bonjour_announce_handler == NULL)
+    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
+
+exit:
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+  return;
+}
+
+void mdns_resume_record( char *service_name, WiFi_Interface interface )
+{
+  int i;
+  uint32_t insert_index = 0xFF;
+
+  if( bonjour_instance == false ) return;
+
+  mico_rtos_lock_mutex( &bonjour_mutex );
+
+  for ( i = 0; i < available_service_count; i++ ){
+    if( is_service_match( &available_services[i], service_name, interface ) == false )
+      continue;
+
+    available_services[i].state = RECORD_UPDATE;
+    available_services[i].count_down = 5; 
+    insert_index = i;
+  }
+
+  if( insert_index == 0xFF )
+    goto exit;
+
+  if( _bonjour_announce_handler == NULL)
+    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
+
+exit:
+  mico_rtos_unlock_mutex( &bonjour_mutex );
+  return;
+}
+
+/*************************************************************************************************************
+ * Querier: continuous querying of the browsed services and a cache of their records (RFC 6762, sections 5 and 10)
+ *************************************************************************************************************/
+
+typedef struct
+{
+  char*                   service_name;   // NULL: unused
+  mdns_browse_callback_t  callback;
+  void*                   arg;
+  uint32_t                next_query;     // mico_get_time() of the next query
+  uint32_t                interval;       // Doubles after every query, up to MDNS_QUERY_INTERVAL_MAX
+} mdns_browser_t;
+
+typedef struct
+{
+  uint16_t  type;       // RR_TYPE_PTR, SRV, TXT or A, 0: unused
+  char*     name;
+  char*     target;     // PTR and SRV target, TXT strings
+  uint32_t  ip;         // A
+  uint16_t  port;       // SRV
+  uint8_t   refresh;    // PTR: cache maintenance queries sent for this TTL
+  bool      resolving;  // PTR: a query was sent to resolve it
+  bool      reported;   // PTR: MDNS_SERVICE_ADDED was called
+  uint32_t  received;   // mico_get_time() when the record was received
+  uint32_t  ttl;        // In seconds
+} mdns_cache_record_t;
+
+static mdns_browser_t      mdns_browsers[ MDNS_BROWSE_COUNT ];
+static mdns_cache_record_t mdns_cache[ MDNS_CACHE_SIZE ];
+static uint8_t             mdns_browser_count = 0;
+
+/* Names are read here rather than on the small stack of the bonjour thread */
+static char mdns_name_buffer[2][ MDNS_NAME_LENGTH_MAX ];
+
+/* Read a name to a string, '.' and '/' inside labels are escaped with '/' as dns_string_to_wire expects */
+static int dns_read_name( dns_name_t* name, char* out, uint32_t size )
+{
+  const uint8_t* buffer = name->start_of_name;
+  uint32_t length = 0;
+  uint8_t count;
+  int jumps = 0;
+  
+  while ( 1 )
+  {
+    buffer = dns_next_label( name->start_of_packet, name->end_of_packet, buffer, &jumps );
+    if ( buffer == NULL || ( *buffer & 0xC0 ) != 0 )
+      return 0;
+    if ( *buffer == 0 )
+      break;
+    
+    for ( count = *buffer++; count > 0; count--, buffer++ )
+    {
+      if ( length + 2 >= size )
+        return 0;
+      if ( *buffer == '.' || *buffer == '/' )
+        out[length++] = '/';
+      out[length++] = *buffer;
+    }
+    if ( length + 1 >= size )
+      return 0;
+    out[length++] = '.';
+  }
+  out[length] = 0;
+  return 1;
+}
+
+/* Convert TXT rdata to the mdns_init_t.txt_record format */
+static char* dns_read_txt( const uint8_t* rdata, uint16_t length )
+{
+  uint32_t size = 1;
+  uint16_t i;
+  char* txt;
+  char* out;
+  
+  for ( i = 0; i < length; i++ )
+    size += ( rdata[i] == '.' || rdata[i] == '/' ) ? 2 : 1;
+  
+  txt = out = (char*) malloc( size );
+  if ( txt == NULL )
+    return NULL;
+  
+  for ( i = 0; i < length; )
+  {
+    const uint8_t* end = rdata + i + 1 + rdata[i];
+    if ( end > rdata + length )
+      end = rdata + length;
+    if ( rdata[i] != 0 && out != txt )
+      *out++ = '.';
+    for ( i++; rdata + i < end; i++ )
+    {
+      if ( rdata[i] == '.' || rdata[i] == '/' )
+        *out++ = '/';
+      *out++ = rdata[i];
+    }
+  }
+  *out = 0;
+  return txt;
+}
+
+static bool mdns_name_equal( const char* a, const char* b )
+{
+  size_t length = strlen( a );
+  
+  return ( length == strlen( b ) && strnicmp( a, b, length ) == 0 );
+}
+
+static mdns_browser_t* mdns_find_browser( const char* service_name )
+{
+  int i;
+  
+  for ( i = 0; i < MDNS_BROWSE_COUNT; i++ )
+  {
+    if ( mdns_browsers[i].service_name != NULL && mdns_name_equal( mdns_browsers[i].service_name, service_name ) )
+      return &mdns_browsers[i];
+  }
+  return NULL;
+}
+
+/* An instance name is "<instance>.<service name>" */
+static mdns_browser_t* mdns_find_browser_of_instance( const char* instance_name )
+{
+  size_t length = strlen( instance_name );
+  size_t service_length;
+  int i;
+  
+  for ( i = 0; i < MDNS_BROWSE_COUNT; i++ )
+  {
+    if ( mdns_browsers[i].service_name == NULL )
+      continue;
+    service_length = strlen( mdns_browsers[i].service_name );
+    if ( length > service_length + 1 && instance_name[length - service_length - 1] == '.'
+        && strnicmp( instance_name + length - service_length, mdns_browsers[i].service_name, service_length ) == 0 )
+      return &mdns_browsers[i];
+  }
+  return NULL;
+}
+
+/* Find a record by its type, and its name and target unless they are NULL */
+static mdns_cache_record_t* mdns_cache_find( uint16_t type, const char* name, const char* target )
+{
+  int i;
+  
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type != type )
+      continue;
+    if ( name != NULL && !mdns_name_equal( mdns_cache[i].name, name ) )
+      continue;
+    if ( target != NULL && !mdns_name_equal( mdns_cache[i].target, target ) )
+      continue;
+    return &mdns_cache[i];
+  }
+  return NULL;
+}
+
+static uint32_t mdns_cache_expire_time( mdns_cache_record_t* record )
+{
+  return record->received + record->ttl * 1000;
+}
+
+/* Fill service from the records of the instance a PTR points to, returns true when it is resolved */
+static bool mdns_browse_service( mdns_cache_record_t* ptr, mdns_service_t* service )
+{
+  mdns_cache_record_t* srv = mdns_cache_find( RR_TYPE_SRV, ptr->target, NULL );
+  mdns_cache_record_t* txt = mdns_cache_find( RR_TYPE_TXT, ptr->target, NULL );
+  mdns_cache_record_t* a   = ( srv != NULL ) ? mdns_cache_find( RR_TYPE_A, srv->target, NULL ) : NULL;
+  
+  memset( service, 0, sizeof(mdns_service_t) );
+  service->instance_name = ptr->target;
+  service->txt_record    = ( txt != NULL ) ? txt->target : NULL;
+  if ( srv != NULL )
+  {
+    service->host_name = srv->target;
+    service->port      = srv->port;
+  }
+  if ( a != NULL )
+    service->ip = a->ip;
+  
+  return ( srv != NULL && a != NULL );
+}
+
+static void mdns_cache_remove( mdns_cache_record_t* record )
+{
+  mdns_browser_t* browser;
+  mdns_service_t service;
+  
+  if ( record->type == RR_TYPE_PTR && record->reported == true )
+  {
+    browser = mdns_find_browser( record->name );
+    if ( browser != NULL )
+    {
+      mdns_browse_service( record, &service );
+      browser->callback( MDNS_SERVICE_REMOVED, &service, browser->arg );
+    }
+  }
+  
+  if ( record->name != NULL )
+    free( record->name );
+  if ( record->target != NULL )
+    free( record->target );
+  memset( record, 0, sizeof(mdns_cache_record_t) );
+}
+
+/* Add or refresh a record, the one closest to expiry makes room when the cache is full */
+static void mdns_cache_update( uint16_t type, const char* name, const char* target, uint32_t ip, uint16_t port, uint32_t ttl, uint32_t now )
+{
+  mdns_cache_record_t* record;
+  int i;
+  
+  /* PTR records of a service are shared, the others are unique to their name */
+  record = mdns_cache_find( type, name, ( type == RR_TYPE_PTR ) ? target : NULL );
+  
+  // Goodbye, remove it in one second (RFC 6762, section 10.1), repeated goodbyes do not postpone it
+  if ( ttl == 0 )
+  {
+    if ( record != NULL && record->ttl > 1 )
+    {
+      record->received = now;
+      record->ttl      = 1;
+    }
+    return;
+  }
+  
+  if ( record == NULL )
+  {
+    record = &mdns_cache[0];
+    for ( i = 0; i < MDNS_CACHE_SIZE && record->type != 0; i++ )
+    {
+      if ( mdns_cache[i].type == 0 || (int32_t)( mdns_cache_expire_time( &mdns_cache[i] ) - mdns_cache_expire_time( record ) ) < 0 )
+        record = &mdns_cache[i];
+    }
+    if ( record->type != 0 )
+      mdns_cache_remove( record );
+    
+    record->name = __strdup( name );
+    require( record->name, exit );
+    record->type = type;
+  }
+  
+  if ( target != NULL && ( record->target == NULL || strcmp( record->target, target ) != 0 ) )
+  {
+    if ( record->target != NULL )
+      free( record->target );
+    record->target = __strdup( target );
+    if ( record->target == NULL )
+    {
+      mdns_cache_remove( record );
+      goto exit;
+    }
+  }
+  
+  record->ip       = ip;
+  record->port     = port;
+  record->received = now;
+  record->ttl      = ( ttl > MDNS_CACHE_TTL_MAX ) ? MDNS_CACHE_TTL_MAX : ttl;
+  record->refresh  = 0;
+  
+exit:
+  return;
+}
+
+/* Report the instances resolved since the last call, and query for the others */
+static void mdns_browse_report( uint32_t now )
+{
+  mdns_browser_t* browser;
+  mdns_service_t service;
+  int i;
+  
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type != RR_TYPE_PTR || mdns_cache[i].reported == true )
+      continue;
+    browser = mdns_find_browser( mdns_cache[i].name );
+    if ( browser == NULL )
+      continue;
+    
+    if ( mdns_browse_service( &mdns_cache[i], &service ) )
+    {
+      mdns_cache[i].reported = true;
+      browser->callback( MDNS_SERVICE_ADDED, &service, browser->arg );
+    }
+    else if ( mdns_cache[i].resolving == false )
+    {
+      /* Its responder did not send the SRV or A record, ask for them once soon */
+      mdns_cache[i].resolving = true;
+      if ( (int32_t)( browser->next_query - now ) > MDNS_RESPONSE_DELAY_MAX )
+        browser->next_query = now + mdns_random_delay( MDNS_RESPONSE_DELAY_MIN, MDNS_RESPONSE_DELAY_MAX );
+    }
+  }
+}
+
+/* Cache the records of browsed services from a response, to us or to anyone else */
+static void mdns_browse_process_response( dns_message_iterator_t* answers, uint16_t count )
+{
+  /* The browsed services decide which PTR, SRV and TXT records are kept, and SRV records which A records */
+  const uint16_t pass_types[3][2] = { { RR_TYPE_PTR, RR_TYPE_PTR }, { RR_TYPE_SRV, RR_TYPE_TXT }, { RR_TYPE_A, RR_TYPE_A } };
+  dns_message_iterator_t iter;
+  dns_record_t record;
+  dns_name_t name;
+  dns_name_t rdata_name;
+  char* owner  = mdns_name_buffer[0];
+  char* target = mdns_name_buffer[1];
+  char* txt;
+  uint32_t now = mico_get_time();
+  uint32_t ip;
+  int pass, a;
+  
+  if ( mdns_browser_count == 0 )
+    return;
+  
+  for ( pass = 0; pass < 3; pass++ )
+  {
+    iter = *answers;
+    for ( a = 0; a < count; a++ )
+    {
+      if ( dns_get_next_record( &iter, &record, &name ) == 0 )
+        break;
+      if ( record.record_type != pass_types[pass][0] && record.record_type != pass_types[pass][1] )
+        continue;
+      if ( ( record.record_class & ~RR_CACHE_FLUSH ) != RR_CLASS_IN || dns_read_name( &name, owner, MDNS_NAME_LENGTH_MAX ) == 0 )
+        continue;
+      
+      rdata_name.start_of_name   = record.rdata.iter;
+      rdata_name.start_of_packet = (uint8_t*) record.rdata.header;
+      rdata_name.end_of_packet   = record.rdata.end;
+      
+      switch ( record.record_type )
+      {
+      case RR_TYPE_PTR:
+        if ( mdns_find_browser( owner ) != NULL && dns_read_name( &rdata_name, target, MDNS_NAME_LENGTH_MAX ) )
+          mdns_cache_update( RR_TYPE_PTR, owner, target, 0, 0, record.ttl, now );
+        break;
+      case RR_TYPE_SRV:
+        rdata_name.start_of_name += 6;
+        if ( record.rd_length > 6 && mdns_find_browser_of_instance( owner ) != NULL && dns_read_name( &rdata_name, target, MDNS_NAME_LENGTH_MAX ) )
+          mdns_cache_update( RR_TYPE_SRV, owner, target, 0, ( record.rdata.iter[4] << 8 ) | record.rdata.iter[5], record.ttl, now );
+        break;
+      case RR_TYPE_TXT:
+        if ( mdns_find_browser_of_instance( owner ) == NULL )
+          break;
+        txt = dns_read_txt( record.rdata.iter, record.rd_length );
+        if ( txt != NULL )
+        {
+          mdns_cache_update( RR_TYPE_TXT, owner, txt, 0, 0, record.ttl, now );
+          free( txt );
+        }
+        break;
+      case RR_TYPE_A:
+        if ( record.rd_length == 4 && mdns_cache_find( RR_TYPE_SRV, NULL, owner ) != NULL )
+        {
+          ip = ( (uint32_t) record.rdata.iter[0] << 24 ) | ( (uint32_t) record.rdata.iter[1] << 16 ) | ( (uint32_t) record.rdata.iter[2] << 8 ) | record.rdata.iter[3];
+          mdns_cache_update( RR_TYPE_A, owner, NULL, ip, 0, record.ttl, now );
+        }
+        break;
+      default:
+        break;
+      }
+    }
   }
-  // Skip the null u8
-  ++iter->iter;
+  
+  mdns_browse_report( now );
 }
 
-static void dns_write_name( dns_message_iterator_t* iter, const char* src )
+/* One query for a browsed service, with questions for its unresolved instances and its known answers */
+static void mdns_browse_send_query( int fd, mdns_browser_t* browser, uint32_t now )
 {
-  dns_write_string( iter, src );
+  mdns_response_t query;
+  mdns_cache_record_t* srv;
+  uint32_t remaining;
+  int i;
+  
+  mdns_response_begin( &query, fd, 0x0 );
+  query.flags = 0;
+  mdns_response_add_question( &query, browser->service_name, RR_TYPE_PTR );
+  
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type != RR_TYPE_PTR || !mdns_name_equal( mdns_cache[i].name, browser->service_name ) )
+      continue;
+    srv = mdns_cache_find( RR_TYPE_SRV, mdns_cache[i].target, NULL );
+    if ( srv == NULL )
+    {
+      mdns_response_add_question( &query, mdns_cache[i].target, RR_TYPE_SRV );
+      mdns_response_add_question( &query, mdns_cache[i].target, RR_TYPE_TXT );
+    }
+    else if ( mdns_cache_find( RR_TYPE_A, srv->target, NULL ) == NULL )
+      mdns_response_add_question( &query, srv->target, RR_TYPE_A );
+  }
+  
+  /* Known answers, that responders leave out of their answers (RFC 6762, section 7.1) */
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type != RR_TYPE_PTR || !mdns_name_equal( mdns_cache[i].name, browser->service_name ) )
+      continue;
+    remaining = ( mdns_cache_expire_time( &mdns_cache[i] ) - now ) / 1000;
+    if ( remaining > mdns_cache[i].ttl / 2 )
+      mdns_response_add_record( &query, mdns_cache[i].name, RR_CLASS_IN, RR_TYPE_PTR, remaining, mdns_cache[i].target );
+  }
+  
+  mdns_response_send( &query );
 }
 
-static bool is_service_match ( dns_sd_service_record_t *record, char *service_name, WiFi_Interface interface )
+/* Refresh point of a PTR record, at 80%, 85%, 90% and 95% of its TTL (RFC 6762, section 5.2) */
+static uint32_t mdns_cache_refresh_time( mdns_cache_record_t* record )
 {
-  if( record->state == RECORD_REMOVED || record->state == RECORD_REMOVE )
-    return false;
-
-  if( ( service_name == NULL || strcmp( record->service_name, service_name ) == 0 ) && record->interface == interface )
-    return true;
-
-  return false;
+  return record->received + record->ttl * 10 * ( 80 + 5 * record->refresh );
 }
 
-static int find_record_by_service ( char *service_name, WiFi_Interface interface )
+/* Expire cached records and send the queries that are due */
+static void mdns_browse_run( int fd )
 {
+  mdns_browser_t* browser;
+  uint32_t now = mico_get_time();
   int i;
-  uint32_t insert_index = 0xFF;
-
-  for ( i = 0; i < available_service_count; i++ ){
-    if( is_service_match ( &available_services[i], service_name, interface ) ){
-      insert_index = i;
-      break;
+  
+  if ( mdns_browser_count == 0 )
+    return;
+  
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type == 0 )
+      continue;
+    if ( (int32_t)( now - mdns_cache_expire_time( &mdns_cache[i] ) ) >= 0 )
+    {
+      mdns_cache_remove( &mdns_cache[i] );
+      continue;
     }
-  }  
-  return insert_index;
-}
-
-static int find_empty_record ( void )
-{
-  int i;
-  uint32_t insert_index = 0xFF;
-
-  for ( i = 0; i < available_service_count; i++ ){
-    if( available_services[i].state == RECORD_REMOVED ){
-      insert_index = i;
-      break;
+    if ( mdns_cache[i].type == RR_TYPE_PTR && mdns_cache[i].refresh < 4 && (int32_t)( now - mdns_cache_refresh_time( &mdns_cache[i] ) ) >= 0 )
+    {
+      mdns_cache[i].refresh++;
+      browser = mdns_find_browser( mdns_cache[i].name );
+      if ( browser != NULL )
+        browser->next_query = now;
     }
   }
-  return insert_index;
-}
-
-static mico_thread_t _bonjour_announce_handler = NULL;
-
-void _bonjour_send_anounce_thread(void *arg)
-{
-  uint32_t insert_index = 0xFF;
-  UNUSED_PARAMETER( arg );
-
-  while(1){
-    insert_index = 0xFF;
-    for ( int i = 0; i < available_service_count; i++ ){
-      if( available_services[i].state != RECORD_REMOVED && available_services[i].count_down != 0 ){
-        insert_index = i;
-        break;
-      }
-    }  
-
-    if( insert_index == 0xFF )
-      goto exit;
+  
+  for ( i = 0; i < MDNS_BROWSE_COUNT; i++ )
+  {
+    browser = &mdns_browsers[i];
+    if ( browser->service_name == NULL || (int32_t)( now - browser->next_query ) < 0 )
+      continue;
     
-    mdns_utils_log( "sem trigger" );
-    mico_rtos_set_semaphore( &update_state_sem );
-    mico_thread_msleep(200);
+    mdns_browse_send_query( fd, browser, now );
+    browser->next_query = now + browser->interval;
+    if ( browser->interval < MDNS_QUERY_INTERVAL_MAX / 2 )
+      browser->interval *= 2;
+    else
+      browser->interval = MDNS_QUERY_INTERVAL_MAX;
   }
-  
-exit:
-  _bonjour_announce_handler = NULL;
-  mico_rtos_delete_thread( NULL );
-  return;
 }
 
-static void _clean_record_resource( dns_sd_service_record_t *record )
+/* Milliseconds until mdns_browse_run has something to do, no more than timeout */
+static uint32_t mdns_browse_next_event( uint32_t now, uint32_t timeout )
 {
-  if(record->service_name)  {
-    free(record->service_name);
-    record->service_name = NULL;
+  uint32_t event;
+  int i;
+  
+  if ( mdns_browser_count == 0 )
+    return timeout;
+  
+  for ( i = 0; i < MDNS_BROWSE_COUNT; i++ )
+  {
+    if ( mdns_browsers[i].service_name == NULL )
+      continue;
+    event = mdns_browsers[i].next_query - now;
+    if ( (int32_t) event < (int32_t) timeout )
+      timeout = ( (int32_t) event < 0 ) ? 0 : event;
   }
-  if(record->hostname){
-    free(record->hostname);
-    record->hostname = NULL;
-    }
-  if(record->instance_name){
-      free(record->instance_name);
-      record->instance_name = NULL;
-    }
-  if(record->txt_att){
-    free(record->txt_att);
-    record->txt_att = NULL;
+  
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type == 0 )
+      continue;
+    event = mdns_cache_expire_time( &mdns_cache[i] ) - now;
+    if ( mdns_cache[i].type == RR_TYPE_PTR && mdns_cache[i].refresh < 4 )
+      event = mdns_cache_refresh_time( &mdns_cache[i] ) - now;
+    if ( (int32_t) event < (int32_t) timeout )
+      timeout = ( (int32_t) event < 0 ) ? 0 : event;
   }
-
+  return timeout;
 }
 
-
-OSStatus mdns_add_record( mdns_init_t init, WiFi_Interface interface, uint32_t time_to_live )
+OSStatus mdns_browse_start( char *service_name, mdns_browse_callback_t callback, void *arg )
 {
-  int len;
   OSStatus err = kNoErr;
-  uint32_t insert_index = 0xFF;
-
+  mdns_browser_t* browser = NULL;
+  int i;
+  
+  require_action( service_name && callback, exit, err = kParamErr );
+  
   if( bonjour_instance == false ){
     err = start_bonjour_service( );
     require_noerr(err, exit);
   }
   
-  insert_index = find_record_by_service ( init.service_name, interface );
-  if( insert_index == 0xFF)
-    insert_index = find_empty_record ( );
-
-  require_action( insert_index < available_service_count, exit, err = kNoResourcesErr);
-  
   mico_rtos_lock_mutex( &bonjour_mutex );
-
-  _clean_record_resource( &available_services[insert_index] );
-
-  available_services[insert_index].interface = interface;
-  available_services[insert_index].service_name = (char*)__strdup(init.service_name);
-  available_services[insert_index].hostname = (char*)__strdup(init.host_name);
-
-  len = strlen(init.instance_name);
-  available_services[insert_index].instance_name = (char*)malloc(len+3);//// 0xc00c+\0
-  memcpy(available_services[insert_index].instance_name, init.instance_name, len);
-  available_services[insert_index].instance_name[len]= 0xc0;
-  available_services[insert_index].instance_name[len+1]= 0x0c;
-  available_services[insert_index].instance_name[len+2]= 0;
   
-  available_services[insert_index].txt_att = (char*)__strdup(init.txt_record);
-
-  available_services[insert_index].port = init.service_port;
-  available_services[insert_index].state = RECORD_UPDATE;
-  available_services[insert_index].count_down = 5;
-  available_services[insert_index].ttl = time_to_live;
+  browser = mdns_find_browser( service_name );
+  for ( i = 0; i < MDNS_BROWSE_COUNT && browser == NULL; i++ )
+  {
+    if ( mdns_browsers[i].service_name == NULL )
+      browser = &mdns_browsers[i];
+  }
+  require_action( browser, unlock, err = kNoResourcesErr );
   
-  if( _bonjour_announce_handler == NULL)
-    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
-
+  if ( browser->service_name == NULL )
+  {
+    browser->service_name = __strdup( service_name );
+    require_action( browser->service_name, unlock, err = kNoMemoryErr );
+    mdns_browser_count++;
+  }
+  browser->callback   = callback;
+  browser->arg        = arg;
+  browser->interval   = MDNS_QUERY_INTERVAL_MIN;
+  browser->next_query = mico_get_time() + mdns_random_delay( MDNS_RESPONSE_DELAY_MIN, MDNS_RESPONSE_DELAY_MAX );
+  
+  /* Instances already cached by another browse */
+  mdns_browse_report( mico_get_time() );
+  
+unlock:
   mico_rtos_unlock_mutex( &bonjour_mutex );
-
+  // Wake up the bonjour thread for the first query
+  if ( err == kNoErr )
+    mico_rtos_set_semaphore( &update_state_sem );
+  
 exit:
   return err;
 }
 
-
-void mdns_update_txt_record( char *service_name, WiFi_Interface interface, char *txt_record )
-{
-  uint32_t insert_index = 0xFF;
-
-  if( bonjour_instance == false ) return;
-
-  insert_index = find_record_by_service ( service_name, interface );
-  if( insert_index == 0xFF ) return;
-
-  mico_rtos_lock_mutex( &bonjour_mutex );
-
-  if(available_services[insert_index].txt_att)  free(available_services->txt_att);
-  available_services[insert_index].txt_att = (char*)__strdup(txt_record);
-  available_services[insert_index].state = RECORD_UPDATE;
-  available_services[insert_index].count_down = 5;
-
-  if( _bonjour_announce_handler == NULL)
-    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
-
-  mico_rtos_unlock_mutex( &bonjour_mutex );
-}
-  
-
-void mdns_suspend_record( char *service_name, WiFi_Interface interface, bool will_remove )
+void mdns_browse_stop( char *service_name )
 {
+  mdns_browser_t* browser;
   int i;
-  uint32_t insert_index = 0xFF;
   
-  mdns_utils_log( "Suspend %s@%d",  service_name, interface);
-
-  if( bonjour_instance == false ) return;
-
-  mico_rtos_lock_mutex( &bonjour_mutex );
-
-  for ( i = 0; i < available_service_count; i++ ){
-    if( is_service_match ( &available_services[i], service_name, interface ) == false) 
-      continue;
-    
-    mdns_utils_log( "Find index %d to suspend", i);
-    if( will_remove == true )
-      available_services[i].state = RECORD_REMOVE;
-    else{
-      if( available_services[i].state != RECORD_REMOVE )
-        available_services[i].state = RECORD_SUSPEND;
-    }
+  if( bonjour_instance == false )
+    return;
   
-    available_services[i].count_down = 5; 
-    insert_index = i;
-  }
-
-  if( insert_index == 0xFF )
-    goto exit;
-
-  if( _bonjour_announce_handler == NULL)
-    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
-
-exit:
-  mico_rtos_unlock_mutex( &bonjour_mutex );
-  return;
-}
-
-void mdns_resume_record( char *service_name, WiFi_Interface interface )
-{
-  int i;
-  uint32_t insert_index = 0xFF;
-
-  if( bonjour_instance == false ) return;
-
   mico_rtos_lock_mutex( &bonjour_mutex );
-
-  for ( i = 0; i < available_service_count && is_service_match( &available_services[i], service_name, interface ); i++ ){
-    available_services[i].state = RECORD_UPDATE;
-    available_services[i].count_down = 5; 
-    insert_index = i;
+  
+  browser = mdns_find_browser( service_name );
+  require( browser, exit );
+  
+  /* Its instances go without a callback, their SRV, TXT and A records expire on their own */
+  for ( i = 0; i < MDNS_CACHE_SIZE; i++ )
+  {
+    if ( mdns_cache[i].type == RR_TYPE_PTR && mdns_name_equal( mdns_cache[i].name, browser->service_name ) )
+    {
+      mdns_cache[i].reported = false;
+      mdns_cache_remove( &mdns_cache[i] );
+    }
   }
-
-  if( insert_index == 0xFF )
-    goto exit;
-
-  if( _bonjour_announce_handler == NULL)
-    mico_rtos_create_thread( &_bonjour_announce_handler, MICO_APPLICATION_PRIORITY, "Bonjour Announce", _bonjour_send_anounce_thread, 0x200, NULL );
-
+  
+  free( browser->service_name );
+  memset( browser, 0, sizeof(mdns_browser_t) );
+  mdns_browser_count--;
+  
 exit:
   mico_rtos_unlock_mutex( &bonjour_mutex );
-  return;
 }
 
 void mdns_handler(int fd, uint8_t* pkt, int pkt_len)
 {
   dns_message_iterator_t iter;
+  dns_question_t question;
+  dns_name_t name;
+  uint16_t count;
+  int a;
   
   iter.header = (dns_message_header_t*) pkt;
   iter.iter   = (uint8_t*) iter.header + sizeof(dns_message_header_t);
@@ -691,6 +1919,20 @@ void mdns_handler(int fd, uint8_t* pkt, int pkt_len)
   // Check if the message is a response (otherwise its a query)
   if ( ntohs(iter.header->flags) & DNS_MESSAGE_IS_A_RESPONSE )
   {
+    if ( mdns_response_scheduled == false && mdns_browser_count == 0 )
+      return;
+    for ( a = 0; a < ntohs(iter.header->question_count); ++a )
+    {
+      if ( dns_get_next_question( &iter, &question, &name ) == 0 )
+        return;
+    }
+    count = ntohs(iter.header->answer_count) + ntohs(iter.header->name_server_count) + ntohs(iter.header->additional_record_count);
+    
+    mdns_browse_process_response( &iter, count );
+    
+    // Another responder sent what we were about to, RFC 6762 section 7.4
+    if ( mdns_response_scheduled == true )
+      mdns_process_known_answers( &iter, count );
   }
   else
   {
@@ -698,40 +1940,30 @@ void mdns_handler(int fd, uint8_t* pkt, int pkt_len)
   }
 }
 
-void bonjour_send_record(int record_index)
+static void bonjour_add_record( mdns_response_t* response, int record_index )
 {
-  dns_message_iterator_t response;
   uint32_t myip;
-  IPStatusTypedef para;
   int ttl  = 0;
 
   /* Send service and a ttl > 0 for a working record*/
   if( available_services[record_index].state == RECORD_NORMAL || available_services[record_index].state == RECORD_UPDATE ){
     ttl = available_services[record_index].ttl;
-    
-    if(dns_create_message( &response, 512 )) {
-      dns_write_header(&response, 0x0, 0x8400, 0, available_service_count, 0 );          
-      dns_write_record( &response, SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[record_index].service_name );
-      mdns_send_message(mDNS_fd, &response );
-      dns_free_message( &response );
-    }
+    mdns_response_add_service( response, &available_services[record_index], MDNS_RECORD_SERVICES_PTR, SERVICE_QUERY_TTL, 0 );
   }
-  micoWlanGetIPStatus(&para, available_services[record_index].interface);
-  myip = htonl(inet_addr(para.ip));
-  if( myip == 0 || myip == 0xFFFFFFFF) return;
+  myip = mdns_record_ip( &available_services[record_index] );
+  if( myip == 0 ) return;
 
+  mdns_utils_log( "TTL = %d",  ttl);
+  mdns_response_add_service( response, &available_services[record_index], MDNS_RECORD_SERVICE_ALL, ttl, myip );
+}
 
-  if(dns_create_message( &response, 512 )){
-    mdns_utils_log( "TTL = %d",  ttl);
-    micoWlanGetIPStatus(&para, available_services[record_index].interface);
-    dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-    dns_write_record( &response, available_services[record_index].service_name, RR_CLASS_IN, RR_TYPE_PTR, ttl, (uint8_t*) available_services[record_index].instance_name );
-    dns_write_record( &response, available_services[record_index].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, ttl, (uint8_t*) available_services[record_index].txt_att );
-    dns_write_record( &response, available_services[record_index].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, ttl, (uint8_t*) &available_services[record_index]);
-    dns_write_record( &response, available_services[record_index].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, ttl, (uint8_t*) &myip);
-    mdns_send_message(mDNS_fd, &response );
-    dns_free_message( &response );
-  }
+void bonjour_send_record(int record_index)
+{
+  mdns_response_t response;
+
+  mdns_response_begin( &response, mDNS_fd, 0x0 );
+  bonjour_add_record( &response, record_index );
+  mdns_response_send( &response );
 }
 
 void BonjourNotify_WifiStatusHandler( WiFiEvent event, void *arg )
@@ -739,15 +1971,19 @@ void BonjourNotify_WifiStatusHandler( WiFiEvent event, void *arg )
   UNUSED_PARAMETER(arg);  
   switch (event) {
   case NOTIFY_STATION_UP:
+    mdns_refresh_interface_ip( Station );
     mdns_resume_record( NULL, Station );
     break;
   case NOTIFY_STATION_DOWN:
+    mdns_refresh_interface_ip( Station );
     mdns_suspend_record( NULL, Station, false );
     break;
   case NOTIFY_AP_UP:
+    mdns_refresh_interface_ip( Soft_AP );
     mdns_resume_record( NULL, Soft_AP );
     break;
   case NOTIFY_AP_DOWN:
+    mdns_refresh_interface_ip( Soft_AP );
     mdns_suspend_record( NULL, Soft_AP, false );
     break;
   default:
@@ -756,6 +1992,16 @@ void BonjourNotify_WifiStatusHandler( WiFiEvent event, void *arg )
   return;
 }
 
+/* A station address obtained after NOTIFY_STATION_UP or changed by a lease renewal,
+   the records are announced again with it (RFC 6762, section 8.4) */
+void BonjourNotify_DHCPCompleteHandler( IPStatusTypedef *pnet, void *arg )
+{
+  UNUSED_PARAMETER(pnet);
+  UNUSED_PARAMETER(arg);
+  if ( mdns_refresh_interface_ip( Station ) == true && mdns_interface_ip[ Station ] != 0 )
+    mdns_resume_record( NULL, Station );
+}
+
 void BonjourNotify_SYSWillPoerOffHandler( void *arg )
 {
     UNUSED_PARAMETER(arg);  
@@ -779,7 +2025,8 @@ static OSStatus start_bonjour_service(void)
 
   update_state_fd = mico_create_event_fd( update_state_sem );
 
-  memset( available_services, 0x0, sizeof( available_services ) );
+  mdns_refresh_interface_ip( Soft_AP );
+  mdns_refresh_interface_ip( Station );
 
   
   buf = malloc(1500);
@@ -796,6 +2043,8 @@ static OSStatus start_bonjour_service(void)
 
   err = mico_system_notify_register( mico_notify_WIFI_STATUS_CHANGED, (void *)BonjourNotify_WifiStatusHandler, NULL );
   require_noerr( err, exit );
+  err = mico_system_notify_register( mico_notify_DHCP_COMPLETED, (void *)BonjourNotify_DHCPCompleteHandler, NULL );
+  require_noerr( err, exit );
   err = mico_system_notify_register( mico_notify_SYS_WILL_POWER_OFF, (void *)BonjourNotify_SYSWillPoerOffHandler, NULL );
   require_noerr( err, exit );
 
@@ -815,13 +2064,25 @@ void _bonjour_thread(void *arg)
   fd_set readfds;
   struct sockaddr_t addr;
   socklen_t addrLen;
+  mdns_response_t response;
+  uint32_t delay;
   //OSStatus err = kNoErr;
   UNUSED_PARAMETER( arg );
 
-  t.tv_sec = 1;
-  t.tv_usec = 0;
-  
   while(1) {
+    /* Wake up for the pending response and the querier, if any */
+    mico_rtos_lock_mutex( &bonjour_mutex );
+    delay = 1000;
+    if ( mdns_response_scheduled ){
+      delay = mdns_response_due - mico_get_time();
+      if ( (int32_t) delay < 0 )
+        delay = 0;
+    }
+    delay = mdns_browse_next_event( mico_get_time(), delay );
+    mico_rtos_unlock_mutex( &bonjour_mutex );
+    t.tv_sec = delay / 1000;
+    t.tv_usec = ( delay % 1000 ) * 1000;
+
     /*Check status on erery sockets on bonjour query */
     FD_ZERO(&readfds);
     FD_SET(mDNS_fd, &readfds);
@@ -832,11 +2093,13 @@ void _bonjour_thread(void *arg)
       mdns_utils_log( "sem recved" );
       mico_rtos_get_semaphore( &update_state_sem, 0 );
       mico_rtos_lock_mutex( &bonjour_mutex );
+      // Announcements of all records go out together
+      mdns_response_begin( &response, mDNS_fd, 0x0 );
       for ( i = 0; i < available_service_count; i++ ){
         switch ( available_services[i].state ){
           case RECORD_REMOVE: 
             mdns_utils_log( "Remove record %d", i );
-            bonjour_send_record( i );
+            bonjour_add_record( &response, i );
             available_services[i].count_down--;
             if( available_services[i].count_down == 0){
               _clean_record_resource( &available_services[i] );
@@ -846,14 +2109,14 @@ void _bonjour_thread(void *arg)
           case RECORD_SUSPEND:
             if( available_services[i].count_down ){
               mdns_utils_log( "Suspend record %d", i );
-              bonjour_send_record( i );
+              bonjour_add_record( &response, i );
               if( available_services[i].count_down )
                 available_services[i].count_down--;       
             }
             break;
           case RECORD_UPDATE:
             mdns_utils_log( "Update record %d, cd: %d", i, available_services[i].count_down );
-            bonjour_send_record( i );
+            bonjour_add_record( &response, i );
             available_services[i].count_down--;
             if( available_services[i].count_down == 0)
               available_services[i].state = RECORD_NORMAL;
@@ -862,6 +2125,7 @@ void _bonjour_thread(void *arg)
             break;
         }
       }
+      mdns_response_send( &response );
       mico_rtos_unlock_mutex( &bonjour_mutex );
     }
     
@@ -872,6 +2136,12 @@ void _bonjour_thread(void *arg)
       mdns_handler(mDNS_fd, (uint8_t *)buf, con);
       mico_rtos_unlock_mutex( &bonjour_mutex );
     }
+
+    mico_rtos_lock_mutex( &bonjour_mutex );
+    if ( mdns_response_scheduled && (int32_t)( mico_get_time() - mdns_response_due ) >= 0 )
+      mdns_send_pending_response( mDNS_fd );
+    mdns_browse_run( mDNS_fd );
+    mico_rtos_unlock_mutex( &bonjour_mutex );
   }
   
   //mdns_utils_log("Exit: mDNS thread exit with err = %d", err);
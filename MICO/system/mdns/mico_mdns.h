@@ -30,7 +30,41 @@
 /**************************************************************************************************************
  * INCLUDES
  **************************************************************************************************************/
-#define MAX_RECORD_COUNT 4
+/* Service records, the table grows MDNS_RECORD_GROW_COUNT slots at a time up to MDNS_RECORD_COUNT_MAX (< 255) */
+#define MDNS_RECORD_GROW_COUNT      4
+#ifndef MDNS_RECORD_COUNT_MAX
+#define MDNS_RECORD_COUNT_MAX       64
+#endif
+
+/* Buckets of the record name lookup, a power of two */
+#define MDNS_NAME_HASH_SIZE         32
+
+/* Responses are built in one static buffer, answers that do not fit go out in further packets */
+#ifndef MDNS_TX_BUFFER_SIZE
+#define MDNS_TX_BUFFER_SIZE 1024
+#endif
+
+/* Names remembered per packet for RFC 1035 message compression */
+#define MDNS_COMPRESSION_NAME_COUNT 32
+
+#define DNS_MAX_LABEL_LENGTH        63
+
+/* Response timing, in milliseconds (RFC 6762, section 6) */
+#define MDNS_RESPONSE_DELAY_MIN     20      // Answers to shared records are delayed to aggregate them
+#define MDNS_RESPONSE_DELAY_MAX     120
+#define MDNS_TRUNCATED_DELAY_MIN    400     // Query has the TC bit, wait for the rest of its known answers
+#define MDNS_TRUNCATED_DELAY_MAX    500
+#define MDNS_MULTICAST_INTERVAL     1000    // A record is multicast at most once per interval
+
+/* Querier */
+#ifndef MDNS_CACHE_SIZE
+#define MDNS_CACHE_SIZE             16      // Records kept for the browsed services
+#endif
+#define MDNS_BROWSE_COUNT           4       // Services browsed at the same time
+#define MDNS_QUERY_INTERVAL_MIN     1000    // Continuous querying interval doubles from ... (RFC 6762, section 5.2)
+#define MDNS_QUERY_INTERVAL_MAX     3600000 // ... up to one hour
+#define MDNS_CACHE_TTL_MAX          86400   // Longer TTLs are cut to one day
+#define MDNS_NAME_LENGTH_MAX        256
 
 
 #define DNS_MESSAGE_IS_A_RESPONSE           0x8000
@@ -95,6 +129,7 @@ typedef struct
 {
   uint8_t* start_of_name;
   uint8_t* start_of_packet; // Used for compressed names;
+  uint8_t* end_of_packet;   // Labels and compression pointers must stay before it
 } dns_name_t;
 
 typedef struct
@@ -129,6 +164,19 @@ typedef struct
   dns_message_iterator_t rdata;
 } dns_record_t;
 
+typedef struct
+{
+  dns_message_iterator_t message;
+  int                    fd;
+  uint16_t               id;
+  uint16_t               flags;
+  uint16_t               question_count;
+  uint16_t               answer_count;
+  uint16_t               name_count;
+  uint16_t               names[ MDNS_COMPRESSION_NAME_COUNT ];  // Offsets of labels already in the packet
+  bool                   overflow;
+} mdns_response_t;
+
 
 
 
@@ -35,14 +35,81 @@
 #include "Mico.h"
 #include "mico_system.h"
 
-typedef struct _Notify_list{
-  void  *function;
-  void  *arg;
-  struct _Notify_list *next;
-  void  *contex;
-} _Notify_list_t;
-
-_Notify_list_t* Notify_list[20] = {NULL};
+/* Subscribers of all notifications, allocated from a static pool. The system takes 15 of them
+ * (system_misc 6, EasyLink 3, mDNS 3, TFTP OTA, SNTP and MiCOKit MFG 1 each), the rest are left
+ * to the application. Some system callers do not check for kNoResourcesErr, define a larger
+ * count if the application registers more */
+#ifndef MICO_NOTIFY_SLOT_COUNT
+#define MICO_NOTIFY_SLOT_COUNT          48
+#endif
+
+#if MICO_NOTIFY_SLOT_COUNT > 255
+#error "MICO_NOTIFY_SLOT_COUNT must fit the 8-bit slot links"
+#endif
+
+/* Deferred notifications waiting for the notification thread */
+#ifndef MICO_NOTIFY_QUEUE_LENGTH
+#define MICO_NOTIFY_QUEUE_LENGTH        8
+#endif
+
+#ifndef MICO_NOTIFY_THREAD_STACK_SIZE
+#define MICO_NOTIFY_THREAD_STACK_SIZE   0x800
+#endif
+
+#define NOTIFY_TYPE_COUNT               ( mico_notify_Stack_Overflow_ERROR + 1 )
+#define NOTIFY_NAME_LENGTH              64      // Host names copied for deferred delivery
+
+typedef struct _Notify_slot{
+  void    *function;      // NULL: free
+  void    *arg;
+  uint8_t next;           // Next slot + 1 of the same notification, 0: last
+  uint8_t delivery;       // mico_notify_delivery_t
+  uint8_t priority;
+  uint8_t generation;     // Changes when the slot is freed, see notify_deliver
+  mico_notify_stats_t stats;
+} _Notify_slot_t;
+
+/* A triggered notification and its arguments */
+typedef struct _Notify_event{
+  uint8_t   type;
+  uint32_t  time;         // mico_get_time() when triggered
+  union {
+    ScanResult              *ap_list;
+    ScanResult_adv          *ap_adv_list;
+    WiFiEvent               status;
+    struct { apinfo_adv_t *ap_info; char *key; int key_len; } para;
+    IPStatusTypedef         *net;
+    network_InitTypeDef_st  *nwkpara;
+    struct { int datalen; char *data; } extra;
+    int                     fd;
+    struct { uint8_t *hostname; uint32_t ip; } dns;
+    OSStatus                err;
+    char                    *taskname;
+  } arg;
+} _Notify_event_t;
+
+/* A deferred notification in the queue, with copies of the data its pointer arguments refer to */
+typedef struct _Notify_message{
+  _Notify_event_t event;
+  union {
+    IPStatusTypedef net;
+    char            name[NOTIFY_NAME_LENGTH];   // DNS host name
+  } copy;
+} _Notify_message_t;
+
+/* A subscriber as read under the lock, its function is called without it */
+typedef struct _Notify_target{
+  void    *function;
+  void    *arg;
+  uint8_t slot;
+  uint8_t generation;
+} _Notify_target_t;
+
+static _Notify_slot_t Notify_slots[MICO_NOTIFY_SLOT_COUNT];
+static uint8_t Notify_list[NOTIFY_TYPE_COUNT];    // First slot + 1 of each notification, 0: none
+static mico_mutex_t notify_mutex = NULL;
+static mico_queue_t notify_queue = NULL;
+static mico_thread_t notify_thread = NULL;
 
 /* MICO system defined notifications */
 typedef void (*mico_notify_WIFI_SCAN_COMPLETE_function)           ( ScanResult *pApList, void * inContext );
@@ -60,224 +127,437 @@ typedef void (*mico_notify_WIFI_CONNECT_FAILED_function)          ( OSStatus err
 typedef void (*mico_notify_WIFI_FATAL_ERROR_function)             ( void * inContext );
 typedef void (*mico_notify_STACK_OVERFLOW_ERROR_function)         ( char *taskname, void * const inContext );
 
-/* User defined notifications */
+static void notify_lock( uint8_t type )
+{
+  /* The stack overflow hook may run where the scheduler cannot block */
+  if( type != mico_notify_Stack_Overflow_ERROR )
+    mico_rtos_lock_mutex( &notify_mutex );
+}
 
-void ApListCallback(ScanResult *pApList)
+static void notify_unlock( uint8_t type )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_SCAN_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_SCAN_COMPLETE_function)(temp->function))(pApList, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+  if( type != mico_notify_Stack_Overflow_ERROR )
+    mico_rtos_unlock_mutex( &notify_mutex );
+}
+
+static bool notify_deferrable( uint8_t type )
+{
+  switch( type ){
+    case mico_notify_WIFI_STATUS_CHANGED:
+    case mico_notify_DHCP_COMPLETED:
+    case mico_notify_TCP_CLIENT_CONNECTED:
+    case mico_notify_DNS_RESOLVE_COMPLETED:
+    case mico_notify_WIFI_CONNECT_FAILED:
+    case mico_notify_WIFI_Fatal_ERROR:
+      return true;
+    default:
+      return false;
   }
 }
 
-void ApListAdvCallback(ScanResult_adv *pApAdvList)
+/* Read the subscribers of a notification with this delivery, returns how many. *deferred is set if
+   there are deferred subscribers too */
+static int notify_collect( uint8_t type, uint8_t delivery, _Notify_target_t *targets, bool *deferred )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_SCAN_ADV_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_SCAN_ADV_COMPLETE_function)(temp->function))(pApAdvList, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+  _Notify_slot_t *slot;
+  uint8_t index;
+  int count = 0;
+
+  notify_lock( type );
+  for( index = Notify_list[type]; index != 0; index = slot->next ){
+    slot = &Notify_slots[index - 1];
+    if( slot->delivery != delivery ){
+      if( deferred != NULL )
+        *deferred = true;
+      continue;
+    }
+    targets[count].function = slot->function;
+    targets[count].arg = slot->arg;
+    targets[count].slot = index - 1;
+    targets[count].generation = slot->generation;
+    count++;
   }
+  notify_unlock( type );
+  return count;
 }
 
-void WifiStatusHandler(WiFiEvent status)
+static void notify_call( _Notify_event_t *event, void *function, void *arg )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_STATUS_CHANGED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_STATUS_CHANGED_function)(temp->function))(status, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+  switch( event->type ){
+    case mico_notify_WIFI_SCAN_COMPLETED:
+      ((mico_notify_WIFI_SCAN_COMPLETE_function)function)( event->arg.ap_list, arg );
+      break;
+    case mico_notify_WIFI_SCAN_ADV_COMPLETED:
+      ((mico_notify_WIFI_SCAN_ADV_COMPLETE_function)function)( event->arg.ap_adv_list, arg );
+      break;
+    case mico_notify_WIFI_STATUS_CHANGED:
+      ((mico_notify_WIFI_STATUS_CHANGED_function)function)( event->arg.status, arg );
+      break;
+    case mico_notify_WiFI_PARA_CHANGED:
+      ((mico_notify_WiFI_PARA_CHANGED_function)function)( event->arg.para.ap_info, event->arg.para.key, event->arg.para.key_len, arg );
+      break;
+    case mico_notify_DHCP_COMPLETED:
+      ((mico_notify_DHCP_COMPLETE_function)function)( event->arg.net, arg );
+      break;
+    case mico_notify_EASYLINK_WPS_COMPLETED:
+      ((mico_notify_EASYLINK_COMPLETE_function)function)( event->arg.nwkpara, arg );
+      break;
+    case mico_notify_EASYLINK_GET_EXTRA_DATA:
+      ((mico_notify_EASYLINK_GET_EXTRA_DATA_function)function)( event->arg.extra.datalen, event->arg.extra.data, arg );
+      break;
+    case mico_notify_TCP_CLIENT_CONNECTED:
+      ((mico_notify_TCP_CLIENT_CONNECTED_function)function)( event->arg.fd, arg );
+      break;
+    case mico_notify_DNS_RESOLVE_COMPLETED:
+      ((mico_notify_DNS_RESOLVE_COMPLETED_function)function)( event->arg.dns.hostname, event->arg.dns.ip, arg );
+      break;
+    case mico_notify_SYS_WILL_POWER_OFF:
+      ((mico_notify_SYS_WILL_POWER_OFF_function)function)( arg );
+      break;
+    case mico_notify_WIFI_CONNECT_FAILED:
+      ((mico_notify_WIFI_CONNECT_FAILED_function)function)( event->arg.err, arg );
+      break;
+    case mico_notify_WIFI_Fatal_ERROR:
+      ((mico_notify_WIFI_FATAL_ERROR_function)function)( arg );
+      break;
+    case mico_notify_Stack_Overflow_ERROR:
+      ((mico_notify_STACK_OVERFLOW_ERROR_function)function)( event->arg.taskname, arg );
+      break;
+    default:
+      break;
   }
 }
 
-void connected_ap_info(apinfo_adv_t *ap_info, char *key, int key_len)
+/* Call a subscriber and update its counters, unless it was removed meanwhile */
+static void notify_deliver( _Notify_event_t *event, _Notify_target_t *target )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WiFI_PARA_CHANGED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WiFI_PARA_CHANGED_function)(temp->function))(ap_info, key, key_len, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+  _Notify_slot_t *slot = &Notify_slots[target->slot];
+  uint32_t start = mico_get_time();
+  uint32_t end;
+
+  notify_call( event, target->function, target->arg );
+  end = mico_get_time();
+
+  notify_lock( event->type );
+  if( slot->generation == target->generation && slot->function == target->function ){
+    slot->stats.count++;
+    slot->stats.latency_total += end - event->time;
+    if( end - event->time > slot->stats.latency_max )
+      slot->stats.latency_max = end - event->time;
+    if( end - start > slot->stats.duration_max )
+      slot->stats.duration_max = end - start;
   }
+  notify_unlock( event->type );
 }
 
-void NetCallback(IPStatusTypedef *pnet)
+/* Queue a copy for the notification thread, without waiting if the queue is full */
+static void notify_defer( _Notify_event_t *event )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_DHCP_COMPLETED];
-  if(temp == NULL)
+  _Notify_message_t message;
+  _Notify_slot_t *slot;
+  uint8_t index;
+
+  message.event = *event;
+  switch( event->type ){
+    case mico_notify_DHCP_COMPLETED:
+      message.copy.net = *event->arg.net;
+      break;
+    case mico_notify_DNS_RESOLVE_COMPLETED:
+      strncpy( message.copy.name, (char *)event->arg.dns.hostname, NOTIFY_NAME_LENGTH - 1 );
+      message.copy.name[NOTIFY_NAME_LENGTH - 1] = 0;
+      break;
+    default:
+      break;
+  }
+
+  if( mico_rtos_push_to_queue( &notify_queue, &message, MICO_NO_WAIT ) == kNoErr )
     return;
-  else{
-    do{
-      ((mico_notify_DHCP_COMPLETE_function)(temp->function))(pnet, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+
+  notify_lock( event->type );
+  for( index = Notify_list[event->type]; index != 0; index = slot->next ){
+    slot = &Notify_slots[index - 1];
+    if( slot->delivery == MICO_NOTIFY_DEFERRED )
+      slot->stats.dropped++;
   }
+  notify_unlock( event->type );
 }
 
-void RptConfigmodeRslt(network_InitTypeDef_st *nwkpara)
+static void notify_thread_main( void *arg )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_EASYLINK_WPS_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_EASYLINK_COMPLETE_function)(temp->function))(nwkpara, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
+  _Notify_message_t message;
+  _Notify_target_t targets[MICO_NOTIFY_SLOT_COUNT];
+  int count, i;
+  UNUSED_PARAMETER( arg );
+
+  while(1){
+    if( mico_rtos_pop_from_queue( &notify_queue, &message, MICO_WAIT_FOREVER ) != kNoErr )
+      continue;
+
+    switch( message.event.type ){
+      case mico_notify_DHCP_COMPLETED:
+        message.event.arg.net = &message.copy.net;
+        break;
+      case mico_notify_DNS_RESOLVE_COMPLETED:
+        message.event.arg.dns.hostname = (uint8_t *)message.copy.name;
+        break;
+      default:
+        break;
+    }
+
+    count = notify_collect( message.event.type, MICO_NOTIFY_DEFERRED, targets, NULL );
+    for( i = 0; i < count; i++ )
+      notify_deliver( &message.event, &targets[i] );
   }
 }
 
-void easylink_user_data_result(int datalen, char*data)
+/* Call the inline subscribers of a notification, in priority order, and queue it for the deferred ones */
+static void notify_dispatch( _Notify_event_t *event )
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_EASYLINK_GET_EXTRA_DATA];
-  if(temp == NULL)
+  _Notify_target_t targets[MICO_NOTIFY_SLOT_COUNT];
+  bool deferred = false;
+  int count, i;
+
+  /* Read without the lock, a function registered at this moment gets the next one */
+  if( Notify_list[event->type] == 0 )
     return;
-  else{
-    do{
-      ((mico_notify_EASYLINK_GET_EXTRA_DATA_function)(temp->function))(datalen, data, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }  
+
+  event->time = mico_get_time();
+  count = notify_collect( event->type, MICO_NOTIFY_INLINE, targets, &deferred );
+  for( i = 0; i < count; i++ )
+    notify_deliver( event, &targets[i] );
+
+  if( deferred == true )
+    notify_defer( event );
+}
+
+/* User defined notifications */
+
+void ApListCallback(ScanResult *pApList)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_WIFI_SCAN_COMPLETED;
+  event.arg.ap_list = pApList;
+  notify_dispatch( &event );
+}
+
+void ApListAdvCallback(ScanResult_adv *pApAdvList)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_WIFI_SCAN_ADV_COMPLETED;
+  event.arg.ap_adv_list = pApAdvList;
+  notify_dispatch( &event );
+}
+
+void WifiStatusHandler(WiFiEvent status)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_WIFI_STATUS_CHANGED;
+  event.arg.status = status;
+  notify_dispatch( &event );
+}
+
+void connected_ap_info(apinfo_adv_t *ap_info, char *key, int key_len)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_WiFI_PARA_CHANGED;
+  event.arg.para.ap_info = ap_info;
+  event.arg.para.key = key;
+  event.arg.para.key_len = key_len;
+  notify_dispatch( &event );
+}
+
+void NetCallback(IPStatusTypedef *pnet)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_DHCP_COMPLETED;
+  event.arg.net = pnet;
+  notify_dispatch( &event );
+}
+
+void RptConfigmodeRslt(network_InitTypeDef_st *nwkpara)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_EASYLINK_WPS_COMPLETED;
+  event.arg.nwkpara = nwkpara;
+  notify_dispatch( &event );
+}
+
+void easylink_user_data_result(int datalen, char*data)
+{
+  _Notify_event_t event;
+  event.type = mico_notify_EASYLINK_GET_EXTRA_DATA;
+  event.arg.extra.datalen = datalen;
+  event.arg.extra.data = data;
+  notify_dispatch( &event );
 }
 
 void socket_connected(int fd)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_TCP_CLIENT_CONNECTED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_TCP_CLIENT_CONNECTED_function)(temp->function))(fd, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_TCP_CLIENT_CONNECTED;
+  event.arg.fd = fd;
+  notify_dispatch( &event );
 }
 
 void dns_ip_set(uint8_t *hostname, uint32_t ip)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_DNS_RESOLVE_COMPLETED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_DNS_RESOLVE_COMPLETED_function)(temp->function))(hostname, ip, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_DNS_RESOLVE_COMPLETED;
+  event.arg.dns.hostname = hostname;
+  event.arg.dns.ip = ip;
+  notify_dispatch( &event );
 }
 
 void sendNotifySYSWillPowerOff(void)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_SYS_WILL_POWER_OFF];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_SYS_WILL_POWER_OFF_function)(temp->function))(temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_SYS_WILL_POWER_OFF;
+  notify_dispatch( &event );
 }
 
 void join_fail(OSStatus err)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_CONNECT_FAILED];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_CONNECT_FAILED_function)(temp->function))(err, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_WIFI_CONNECT_FAILED;
+  event.arg.err = err;
+  notify_dispatch( &event );
 }
 
 void wifi_reboot_event(void)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_WIFI_Fatal_ERROR];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_WIFI_FATAL_ERROR_function)(temp->function))(temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_WIFI_Fatal_ERROR;
+  notify_dispatch( &event );
 }
 
 void mico_rtos_stack_overflow(char *taskname)
 {
-  _Notify_list_t *temp =  Notify_list[mico_notify_Stack_Overflow_ERROR];
-  if(temp == NULL)
-    return;
-  else{
-    do{
-      ((mico_notify_STACK_OVERFLOW_ERROR_function)(temp->function))(taskname, temp->arg);
-      temp = temp->next;
-    }while(temp!=NULL);
-  }    
+  _Notify_event_t event;
+  event.type = mico_notify_Stack_Overflow_ERROR;
+  event.arg.taskname = taskname;
+  notify_dispatch( &event );
+}
+
+/* Subscribers may register from several threads before mico_system_init, so
+   only the first mutex created is published and the others are released */
+static OSStatus notify_mutex_init( void )
+{
+  OSStatus err = kNoErr;
+  mico_mutex_t mutex = NULL;
+
+  require_quiet( notify_mutex == NULL, exit );
+
+  err = mico_rtos_init_mutex( &mutex );
+  require_noerr( err, exit );
+
+  mico_rtos_suspend_all_thread( );
+  if( notify_mutex == NULL ){
+    notify_mutex = mutex;
+    mutex = NULL;
+  }
+  mico_rtos_resume_all_thread( );
+
+  if( mutex != NULL )
+    mico_rtos_deinit_mutex( &mutex );
+
+exit:
+  return err;
+}
+
+/* The queue and the thread are created for the first deferred subscriber */
+static OSStatus notify_thread_start( void )
+{
+  OSStatus err = kNoErr;
+
+  if( notify_queue == NULL ){
+    err = mico_rtos_init_queue( &notify_queue, "Notify", sizeof(_Notify_message_t), MICO_NOTIFY_QUEUE_LENGTH );
+    require_noerr( err, exit );
+  }
+  if( notify_thread == NULL ){
+    err = mico_rtos_create_thread( &notify_thread, MICO_APPLICATION_PRIORITY, "Notify", notify_thread_main, MICO_NOTIFY_THREAD_STACK_SIZE, NULL );
+    require_noerr_action( err, exit, notify_thread = NULL );
+  }
+
+exit:
+  return err;
 }
 
 OSStatus mico_system_notify_register( mico_notify_types_t notify_type, void* functionAddress, void* arg )
+{
+  return mico_system_notify_register_adv( notify_type, functionAddress, arg, MICO_NOTIFY_INLINE, 0 );
+}
+
+OSStatus mico_system_notify_register_adv( mico_notify_types_t notify_type, void* functionAddress, void* arg, mico_notify_delivery_t delivery, uint8_t priority )
 {
   OSStatus err = kNoErr;
-  _Notify_list_t *temp =  Notify_list[notify_type];
-  _Notify_list_t *notify = (_Notify_list_t *)malloc(sizeof(_Notify_list_t));
-  require_action(notify, exit, err = kNoMemoryErr);
-  notify->function = functionAddress;
-  notify->arg = arg;
-  notify->next = NULL;
-  if(Notify_list[notify_type] == NULL){
-    Notify_list[notify_type] = notify;
-    notify->next = NULL;
-  }else{
-    if(temp->function == functionAddress)
-        return kNoErr;   //Nodify already exist
-    while(temp->next!=NULL){
-      temp = temp->next;
-      if(temp->function == functionAddress)
-        return kNoErr;   //Nodify already exist
-    }
-    temp->next = notify;
+  _Notify_slot_t *slot = NULL;
+  uint8_t *link;
+  int i;
+
+  require_action( notify_type < NOTIFY_TYPE_COUNT && functionAddress, exit, err = kParamErr );
+  require_action( delivery == MICO_NOTIFY_INLINE || notify_deferrable( notify_type ), exit, err = kUnsupportedErr );
+
+  err = notify_mutex_init( );
+  require_noerr( err, exit );
+  mico_rtos_lock_mutex( &notify_mutex );
+
+  if( delivery == MICO_NOTIFY_DEFERRED ){
+    err = notify_thread_start( );
+    require_noerr( err, unlock );
+  }
+
+  for( link = &Notify_list[notify_type]; *link != 0; link = &Notify_slots[*link - 1].next ){
+    if( Notify_slots[*link - 1].function == functionAddress )
+      goto unlock;   //Nodify already exist
   }
+
+  for( i = 0; i < MICO_NOTIFY_SLOT_COUNT && slot == NULL; i++ ){
+    if( Notify_slots[i].function == NULL )
+      slot = &Notify_slots[i];
+  }
+  require_action( slot, unlock, err = kNoResourcesErr );
+
+  slot->function = functionAddress;
+  slot->arg = arg;
+  slot->delivery = delivery;
+  slot->priority = priority;
+  memset( &slot->stats, 0x0, sizeof(slot->stats) );
+
+  /* After the subscribers of the same or a higher priority */
+  for( link = &Notify_list[notify_type]; *link != 0 && Notify_slots[*link - 1].priority >= priority; link = &Notify_slots[*link - 1].next );
+  slot->next = *link;
+  *link = slot - Notify_slots + 1;
+
+unlock:
+  mico_rtos_unlock_mutex( &notify_mutex );
 exit:
   return err;
 }
 
+static void notify_free_slot( uint8_t *link )
+{
+  _Notify_slot_t *slot = &Notify_slots[*link - 1];
+
+  *link = slot->next;
+  slot->function = NULL;
+  slot->generation++;
+}
+
 OSStatus mico_system_notify_remove( mico_notify_types_t notify_type, void *functionAddress )
 {
   OSStatus err = kNoErr;
-  _Notify_list_t *temp2;
-  _Notify_list_t *temp = Notify_list[notify_type];
-  require_action(Notify_list[notify_type], exit, err = kDeletedErr);
-  do{
-    if(temp->function == functionAddress){
-      if(temp == Notify_list[notify_type]){  //first element
-        Notify_list[notify_type] = Notify_list[notify_type]->next;
-        free(temp);
-      }else{
-        temp2->next = temp->next;
-        free(temp);
-      }
-       break;
-    }
-    require_action(temp->next!=NULL, exit, err = kNotFoundErr);
-    temp2 = temp;
-    temp = temp->next;
-  }while(temp != NULL);
+  uint8_t *link;
+
+  require_action( notify_type < NOTIFY_TYPE_COUNT, exit, err = kParamErr );
+  require_action( Notify_list[notify_type], exit, err = kDeletedErr );
+
+  mico_rtos_lock_mutex( &notify_mutex );
+  for( link = &Notify_list[notify_type]; *link != 0 && Notify_slots[*link - 1].function != functionAddress; link = &Notify_slots[*link - 1].next );
+  if( *link != 0 )
+    notify_free_slot( link );
+  else
+    err = kNotFoundErr;
+  mico_rtos_unlock_mutex( &notify_mutex );
 
 exit:
   return err;
@@ -285,15 +565,40 @@ exit:
 
 OSStatus mico_system_notify_remove_all( mico_notify_types_t notify_type)
 {
-    _Notify_list_t *temp = Notify_list[notify_type];;
+    OSStatus err = kNoErr;
+
+    require_action( notify_type < NOTIFY_TYPE_COUNT, exit, err = kParamErr );
+    require( Notify_list[notify_type], exit );
+
+    mico_rtos_lock_mutex( &notify_mutex );
+    while( Notify_list[notify_type] != 0 )
+        notify_free_slot( &Notify_list[notify_type] );
+    mico_rtos_unlock_mutex( &notify_mutex );
 
-    while(temp) {
-        Notify_list[notify_type] = Notify_list[notify_type]->next;
-        free(temp);
-        temp = Notify_list[notify_type];
+exit:
+    return err;
+}
+
+OSStatus mico_system_notify_get_stats( mico_notify_types_t notify_type, void *functionAddress, mico_notify_stats_t *stats )
+{
+  OSStatus err = kNotFoundErr;
+  uint8_t index;
+
+  require_action( notify_type < NOTIFY_TYPE_COUNT && stats, exit, err = kParamErr );
+  require( Notify_list[notify_type], exit );
+
+  mico_rtos_lock_mutex( &notify_mutex );
+  for( index = Notify_list[notify_type]; index != 0; index = Notify_slots[index - 1].next ){
+    if( Notify_slots[index - 1].function == functionAddress ){
+      *stats = Notify_slots[index - 1].stats;
+      err = kNoErr;
+      break;
     }
+  }
+  mico_rtos_unlock_mutex( &notify_mutex );
 
-    return kNoErr;
+exit:
+  return err;
 }
 
 
@@ -0,0 +1,142 @@
+/**
+******************************************************************************
+* @file    mico_system_ota.c 
+* @author  MiCO Team
+* @version V1.0.0
+* @date    18-Oct-2026
+* @brief   This file provide an OTA sink, that writes an OTA image to flash and 
+*          calculates its digests while it is being received
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2014 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy 
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights 
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR 
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+
+#include "Common.h"
+#include "Mico.h"
+#include "mico_system.h"
+#include "mico_system_ota.h"
+
+static void ota_sink_hash( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len )
+{
+  if( len == 0 )
+    return;
+  if( sink->use_md5 )
+    Md5Update( &sink->md5, (unsigned char *)data, len );
+  CRC16_Update( &sink->crc16, data, len );
+  sink->hashed += len;
+}
+
+/* Hash everything but the last trailer_len bytes of the stream seen so far */
+static void ota_sink_update( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len )
+{
+  uint32_t excess;
+
+  if( len >= sink->trailer_len ){
+    ota_sink_hash( sink, sink->trailer, sink->trailer_used );
+    ota_sink_hash( sink, data, len - sink->trailer_len );
+    memcpy( sink->trailer, data + len - sink->trailer_len, sink->trailer_len );
+    sink->trailer_used = sink->trailer_len;
+  }else{
+    if( sink->trailer_used + len > sink->trailer_len ){
+      excess = sink->trailer_used + len - sink->trailer_len;
+      ota_sink_hash( sink, sink->trailer, excess );
+      memmove( sink->trailer, sink->trailer + excess, sink->trailer_used - excess );
+      sink->trailer_used -= excess;
+    }
+    memcpy( sink->trailer + sink->trailer_used, data, len );
+    sink->trailer_used += len;
+  }
+  sink->offset += len;
+}
+
+OSStatus mico_ota_sink_init( mico_ota_sink_t *sink, mico_partition_t partition, uint32_t trailer_len, bool use_md5 )
+{
+  OSStatus err = kNoErr;
+  
+  require_action( sink, exit, err = kParamErr );
+  require_action( trailer_len <= MICO_OTA_SINK_TRAILER_MAX, exit, err = kParamErr );
+  
+  memset( sink, 0x0, sizeof(mico_ota_sink_t) );
+  sink->partition = partition;
+  sink->trailer_len = trailer_len;
+  sink->use_md5 = use_md5;
+  if( use_md5 )
+    InitMd5( &sink->md5 );
+  CRC16_Init( &sink->crc16 );
+
+exit:
+  return err;
+}
+
+OSStatus mico_ota_sink_write( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len )
+{
+  OSStatus err = kNoErr;
+  uint32_t offset = sink->offset;
+
+  err = MicoFlashWrite( sink->partition, &offset, (uint8_t *)data, len );
+  require_noerr( err, exit );
+
+  ota_sink_update( sink, data, len );
+
+exit:
+  return err;
+}
+
+void mico_ota_sink_observer( void *context, uint32_t off_set, const uint8_t *data, uint32_t len )
+{
+  mico_ota_sink_t *sink = (mico_ota_sink_t *)context;
+
+  if( off_set == sink->offset )
+    ota_sink_update( sink, data, len );
+  else if( off_set + len > sink->offset )
+    sink->broken = true; /* Gap or partial overlap, the digests cannot follow */
+}
+
+void mico_ota_sink_checkpoint( const mico_ota_sink_t *sink, mico_ota_sink_t *checkpoint )
+{
+  memcpy( checkpoint, sink, sizeof(mico_ota_sink_t) );
+}
+
+void mico_ota_sink_restore( mico_ota_sink_t *sink, const mico_ota_sink_t *checkpoint )
+{
+  memcpy( sink, checkpoint, sizeof(mico_ota_sink_t) );
+}
+
+OSStatus mico_ota_sink_final( mico_ota_sink_t *sink, uint8_t md5[16], uint16_t *crc, uint8_t *trailer )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( sink->broken == false, exit, err = kIntegrityErr );
+  require_action_quiet( sink->trailer_used == sink->trailer_len, exit, err = kSizeErr );
+
+  if( md5 && sink->use_md5 )
+    Md5Final( &sink->md5, md5 );
+  if( crc )
+    CRC16_Final( &sink->crc16, crc );
+  if( trailer )
+    memcpy( trailer, sink->trailer, sink->trailer_len );
+
+exit:
+  return err;
+}
+
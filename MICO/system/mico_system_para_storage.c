@@ -45,6 +45,64 @@ static int32_t seedNum = 0;
 #define CRC_OFFSET    ( 0xE00 )
 #define CRC_SIZE      ( 2 )
 
+/* Parameter journal, appended behind the CRC of the active partition. Every
+ * update is one record: journal_head_t, then journal_chunk_t + data for each
+ * changed byte range. Chunk offsets use the partition layout above, key-value
+ * pairs use the JOURNAL_KV_xxx tags instead. When the journal is full, the
+ * parameters and live key-value pairs are compacted into the other partition. */
+#define JOURNAL_OFFSET      ( 0xE04 )
+#define JOURNAL_ALIGN( x )  ( ( (x) + 3 ) & ~3UL )
+#define JOURNAL_EMPTY       ( 0xFFFF )
+#define JOURNAL_READ_SIZE   ( 64 )
+
+#define JOURNAL_KV_SET      ( 0xFFF0 )  /* data: kv_entry_t, key, value */
+#define JOURNAL_KV_DELETE   ( 0xFFF1 )  /* data: kv_entry_t, key */
+
+/* Space taken by a key-value pair after compaction, one record per pair */
+#define KV_RECORD_SIZE( key_length, length ) \
+  JOURNAL_ALIGN( sizeof(journal_head_t) + sizeof(journal_chunk_t) + sizeof(kv_entry_t) + (key_length) + (length) )
+
+typedef struct {
+  uint16_t length;    /* length of the chunks */
+  uint16_t crc;       /* CRC16 of the chunks */
+} journal_head_t;
+
+typedef struct {
+  uint16_t offset;
+  uint16_t length;
+} journal_chunk_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t key_length;
+} kv_entry_t;
+
+/* RAM index of the key-value pairs, values are read from flash */
+typedef struct {
+  uint32_t hash;
+  uint16_t offset;      /* key offset in the active partition, value follows */
+  uint16_t length;      /* value length */
+  uint8_t  type;
+  uint8_t  key_length;
+} kv_index_t;
+
+typedef struct {
+  uint8_t  *ram;
+  uint8_t  *shadow;
+  uint32_t size;
+  uint32_t offset;
+} para_region_t;
+
+/* Copy of the parameters in flash: flash_content_t followed by user data */
+static uint8_t *para_shadow = NULL;
+static mico_partition_t para_active = MICO_PARTITION_PARAMETER_1;
+static uint32_t journal_end = JOURNAL_OFFSET;
+static mico_mutex_t para_mutex = NULL;
+
+static kv_index_t *kv_index = NULL;
+static uint16_t kv_count = 0;
+static uint16_t kv_capacity = 0;
+
 //#define para_log(M, ...) custom_log("MiCO Settting", M, ##__VA_ARGS__)
 
 #define para_log(M, ...)
@@ -65,71 +123,539 @@ static bool is_crc_match( uint16_t crc_1, uint16_t crc_2)
   return true;
 }
 
-static OSStatus internal_update_config( mico_Context_t * const inContext )
+static void para_get_regions( mico_Context_t * const inContext, para_region_t *regions )
+{
+  regions[0].ram = (uint8_t *)&inContext->flashContentInRam.micoSystemConfig;
+  regions[0].shadow = para_shadow + SYS_CONFIG_OFFSET;
+  regions[0].size = SYS_CONFIG_SIZE;
+  regions[0].offset = SYS_CONFIG_OFFSET;
+
+  regions[1].ram = (uint8_t *)inContext->user_config_data;
+  regions[1].shadow = para_shadow + sizeof( flash_content_t );
+  regions[1].size = inContext->user_config_data_size;
+  regions[1].offset = USER_CONFIG_OFFSET;
+}
+
+static void para_shadow_sync( mico_Context_t * const inContext )
+{
+  if( para_shadow == NULL ) return;
+  memcpy( para_shadow, &inContext->flashContentInRam, sizeof( flash_content_t ) );
+  memcpy( para_shadow + sizeof( flash_content_t ), inContext->user_config_data, inContext->user_config_data_size );
+}
+
+/* FNV-1a */
+static uint32_t kv_hash( const char *key, uint8_t key_length )
+{
+  uint32_t hash = 2166136261UL;
+  while( key_length-- ){
+    hash ^= (uint8_t)*key++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static int32_t kv_find( const char *key, uint8_t key_length, uint32_t hash )
+{
+  char buf[MICO_KV_KEY_MAX];
+  uint32_t para_offset;
+  uint16_t i;
+
+  for( i = 0; i < kv_count; i++ ){
+    if( kv_index[i].hash != hash || kv_index[i].key_length != key_length ) continue;
+    para_offset = kv_index[i].offset;
+    if( MicoFlashRead( para_active, &para_offset, (uint8_t *)buf, key_length ) != kNoErr ) continue;
+    if( memcmp( buf, key, key_length ) == 0 ) return i;
+  }
+  return -1;
+}
+
+static OSStatus kv_index_set( const char *key, uint8_t key_length, uint16_t offset, uint16_t length, uint8_t type )
+{
+  OSStatus err = kNoErr;
+  uint32_t hash = kv_hash( key, key_length );
+  int32_t i = kv_find( key, key_length, hash );
+  kv_index_t *grown;
+
+  if( i < 0 ){
+    if( kv_count == kv_capacity ){
+      grown = realloc( kv_index, ( kv_capacity ? kv_capacity * 2 : 8 ) * sizeof(kv_index_t) );
+      require_action( grown, exit, err = kNoMemoryErr );
+      kv_index = grown;
+      kv_capacity = kv_capacity ? kv_capacity * 2 : 8;
+    }
+    i = kv_count++;
+  }
+  kv_index[i].hash = hash;
+  kv_index[i].offset = offset;
+  kv_index[i].length = length;
+  kv_index[i].type = type;
+  kv_index[i].key_length = key_length;
+
+exit:
+  return err;
+}
+
+static void kv_index_delete( const char *key, uint8_t key_length )
+{
+  int32_t i = kv_find( key, key_length, kv_hash( key, key_length ) );
+  if( i >= 0 )
+    kv_index[i] = kv_index[--kv_count];
+}
+
+/* Journal space the live key-value pairs take after compaction */
+static uint32_t kv_compact_size( void )
+{
+  uint32_t size = 0;
+  uint16_t i;
+
+  for( i = 0; i < kv_count; i++ )
+    size += KV_RECORD_SIZE( kv_index[i].key_length, kv_index[i].length );
+  return size;
+}
+
+/* Journal space the live key-value pairs would take after compaction, once
+ * txn is applied. A transaction written as one record can be smaller than its
+ * pairs compacted one record each, so this is checked before it is accepted */
+static uint32_t kv_txn_compact_size( const mico_kv_txn_t *txn )
+{
+  uint32_t size = kv_compact_size( );
+  int32_t found;
+  uint8_t key_length;
+  uint8_t i, j;
+
+  for( i = 0; i < txn->count; i++ ){
+    /* Only the last operation on a key is left */
+    for( j = i + 1; j < txn->count && strcmp( txn->ops[i].key, txn->ops[j].key ) != 0; j++ );
+    if( j < txn->count ) continue;
+
+    key_length = strlen( txn->ops[i].key );
+    found = kv_find( txn->ops[i].key, key_length, kv_hash( txn->ops[i].key, key_length ) );
+    if( found >= 0 )
+      size -= KV_RECORD_SIZE( kv_index[found].key_length, kv_index[found].length );
+    if( txn->ops[i].value )
+      size += KV_RECORD_SIZE( key_length, txn->ops[i].length );
+  }
+  return size;
+}
+
+/* Copy a key-value pair from source as one record at *para_offset in target */
+static OSStatus kv_copy_entry( mico_partition_t target, mico_partition_t source, const kv_index_t *entry, uint32_t *para_offset )
+{
+  OSStatus err = kNoErr;
+  uint8_t buf[JOURNAL_READ_SIZE];
+  journal_head_t head;
+  journal_chunk_t chunk;
+  kv_entry_t kv;
+  CRC16_Context crc_context;
+  uint32_t source_offset, remain, length;
+
+  chunk.offset = JOURNAL_KV_SET;
+  chunk.length = sizeof(kv_entry_t) + entry->key_length + entry->length;
+  kv.type = entry->type;
+  kv.key_length = entry->key_length;
+
+  CRC16_Init( &crc_context );
+  CRC16_Update( &crc_context, &chunk, sizeof(journal_chunk_t) );
+  CRC16_Update( &crc_context, &kv, sizeof(kv_entry_t) );
+  source_offset = entry->offset;
+  for( remain = entry->key_length + entry->length; remain; remain -= length ){
+    length = MIN( remain, JOURNAL_READ_SIZE );
+    err = MicoFlashRead( source, &source_offset, buf, length );
+    require_noerr(err, exit);
+    CRC16_Update( &crc_context, buf, length );
+  }
+  head.length = sizeof(journal_chunk_t) + chunk.length;
+  CRC16_Final( &crc_context, &head.crc );
+
+  err = MicoFlashWrite( target, para_offset, (uint8_t *)&head, sizeof(journal_head_t) );
+  require_noerr(err, exit);
+  err = MicoFlashWrite( target, para_offset, (uint8_t *)&chunk, sizeof(journal_chunk_t) );
+  require_noerr(err, exit);
+  err = MicoFlashWrite( target, para_offset, (uint8_t *)&kv, sizeof(kv_entry_t) );
+  require_noerr(err, exit);
+  source_offset = entry->offset;
+  for( remain = entry->key_length + entry->length; remain; remain -= length ){
+    length = MIN( remain, JOURNAL_READ_SIZE );
+    err = MicoFlashRead( source, &source_offset, buf, length );
+    require_noerr(err, exit);
+    err = MicoFlashWrite( target, para_offset, buf, length );
+    require_noerr(err, exit);
+  }
+  *para_offset = JOURNAL_ALIGN( *para_offset );
+
+exit:
+  return err;
+}
+
+/* Write parameters as the base of partition, followed by the key-value pairs
+ * copied from source. CRC is written last, the base is not valid before that */
+static OSStatus para_write_base( mico_Context_t * const inContext, mico_partition_t partition, mico_partition_t source )
 {
   OSStatus err = kNoErr;
   uint32_t para_offset;
   CRC16_Context crc_context;
   uint16_t crc_result;
-  
-  uint16_t crc_readback;;
+  uint16_t crc_readback;
+  uint8_t *content = (uint8_t *)&inContext->flashContentInRam;
+  uint8_t *user = (uint8_t *)inContext->user_config_data;
+  uint16_t i;
 
   para_log("Flash write!");
 
+  if( para_shadow != NULL ){
+    content = para_shadow;
+    user = para_shadow + sizeof( flash_content_t );
+  }
+
   CRC16_Init( &crc_context );
-  CRC16_Update( &crc_context, &inContext->flashContentInRam.micoSystemConfig, SYS_CONFIG_SIZE );
-  CRC16_Update( &crc_context, inContext->user_config_data, inContext->user_config_data_size );
+  CRC16_Update( &crc_context, content + SYS_CONFIG_OFFSET, SYS_CONFIG_SIZE );
+  CRC16_Update( &crc_context, user, inContext->user_config_data_size );
 
   CRC16_Final( &crc_context, &crc_result );
 
-  err = MicoFlashErase( MICO_PARTITION_PARAMETER_1, 0x0, sizeof(flash_content_t) );
+  /* Checked before the erase, so partition keeps its old base if it fails */
+  require_action( JOURNAL_OFFSET + kv_compact_size( ) <= MicoFlashGetInfo( partition )->partition_length, exit, err = kNoSpaceErr );
+
+  err = MicoFlashErase( partition, 0x0, MicoFlashGetInfo( partition )->partition_length );
   require_noerr(err, exit);
 
   para_offset = 0x0;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+  err = MicoFlashWrite( partition, &para_offset, content, sizeof(flash_content_t));
   require_noerr(err, exit);
 
   para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
+  err = MicoFlashWrite( partition, &para_offset, user, inContext->user_config_data_size );
   require_noerr(err, exit);
 
+  para_offset = JOURNAL_OFFSET;
+  for( i = 0; i < kv_count; i++ ){
+    err = kv_copy_entry( partition, source, &kv_index[i], &para_offset );
+    require_noerr(err, exit);
+  }
+
   para_offset = CRC_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&crc_result, CRC_SIZE );
+  err = MicoFlashWrite( partition, &para_offset, (uint8_t *)&crc_result, CRC_SIZE );
   require_noerr(err, exit);
-  
+
   /* Read back*/
   para_offset = CRC_OFFSET;
-  err = MicoFlashRead( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&crc_readback, CRC_SIZE );
+  err = MicoFlashRead( partition, &para_offset, (uint8_t *)&crc_readback, CRC_SIZE );
   para_log( "crc_readback = %d", crc_readback);
-  if( crc_readback == 0x0)
-    return kWriteErr;
-  
+  require_action( crc_readback == crc_result, exit, err = kWriteErr );
+
+exit:
+  return err;
+}
+
+/* Write parameters and key-value pairs to the other partition and continue the
+ * journal there. The new base gets a seed newer than every base in flash */
+static OSStatus para_compact( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  mico_partition_t target;
+  uint32_t para_offset;
+  uint16_t i;
+
+  target = ( para_active == MICO_PARTITION_PARAMETER_1 ) ? MICO_PARTITION_PARAMETER_2 : MICO_PARTITION_PARAMETER_1;
+  para_log("Journal compact to %d", target);
+
+  inContext->flashContentInRam.micoSystemConfig.seed = ++seedNum;
+  if( para_shadow != NULL )
+    ((flash_content_t *)para_shadow)->micoSystemConfig.seed = seedNum;
+
+  err = para_write_base( inContext, target, para_active );
+  require_noerr(err, exit);
+
+  /* Key-value pairs are packed in the same order in the new partition */
+  para_offset = JOURNAL_OFFSET;
+  for( i = 0; i < kv_count; i++ ){
+    kv_index[i].offset = para_offset + sizeof(journal_head_t) + sizeof(journal_chunk_t) + sizeof(kv_entry_t);
+    para_offset += KV_RECORD_SIZE( kv_index[i].key_length, kv_index[i].length );
+  }
+  para_active = target;
+  journal_end = para_offset;
+
+exit:
+  return err;
+}
+
+/* Rewrite both partitions, main partition is read by bootloader */
+static OSStatus internal_update_config( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+
+  para_shadow_sync( inContext );
+
+  err = para_compact( inContext );
+  require_noerr(err, exit);
 
   /* Write backup data*/
-  err = MicoFlashErase( MICO_PARTITION_PARAMETER_2, 0x0, sizeof(flash_content_t) );
+  err = para_compact( inContext );
   require_noerr(err, exit);
 
-  para_offset = 0x0;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t));
+exit:
+  return err;
+}
+
+/* Find the next range changed in RAM from *pos, ranges closer than a chunk header are merged */
+static bool journal_next_chunk( const para_region_t *region, uint32_t *pos, uint32_t *length )
+{
+  uint32_t i = *pos, end;
+
+  while( i < region->size && region->ram[i] == region->shadow[i] ) i++;
+  if( i == region->size ) return false;
+
+  *pos = i;
+  end = ++i;
+  for( ; i < region->size && i - end < sizeof(journal_chunk_t); i++ ){
+    if( region->ram[i] != region->shadow[i] ) end = i + 1;
+  }
+  *length = end - *pos;
+  return true;
+}
+
+/* Write part of a journal record. A record written in part cannot be programmed over and
+ * replay stops at it, so the journal is closed on a failure and the next append compacts */
+static OSStatus journal_write( uint32_t *para_offset, const void *data, uint32_t length )
+{
+  OSStatus err = MicoFlashWrite( para_active, para_offset, (uint8_t *)data, length );
+  if( err != kNoErr )
+    journal_end = MicoFlashGetInfo( para_active )->partition_length;
+  return err;
+}
+
+/* Append parameters changed since the last write as one journal record */
+static OSStatus journal_append( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  para_region_t regions[2];
+  journal_head_t head;
+  journal_chunk_t chunk;
+  CRC16_Context crc_context;
+  uint32_t pos, length, para_offset, record_length = 0;
+  uint8_t i;
+
+  para_get_regions( inContext, regions );
+
+  CRC16_Init( &crc_context );
+  for( i = 0; i < 2; i++ ){
+    for( pos = 0; journal_next_chunk( &regions[i], &pos, &length ); pos += length ){
+      chunk.offset = regions[i].offset + pos;
+      chunk.length = length;
+      CRC16_Update( &crc_context, &chunk, sizeof(journal_chunk_t) );
+      CRC16_Update( &crc_context, regions[i].ram + pos, length );
+      record_length += sizeof(journal_chunk_t) + length;
+    }
+  }
+  require_quiet( record_length, exit );
+  require_action_quiet( journal_end + sizeof(journal_head_t) + record_length <= MicoFlashGetInfo( para_active )->partition_length,
+                        exit, err = kNoSpaceErr );
+
+  head.length = record_length;
+  CRC16_Final( &crc_context, &head.crc );
+
+  para_offset = journal_end;
+  err = journal_write( &para_offset, &head, sizeof(journal_head_t) );
   require_noerr(err, exit);
 
-  para_offset = USER_CONFIG_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
+  for( i = 0; i < 2; i++ ){
+    for( pos = 0; journal_next_chunk( &regions[i], &pos, &length ); pos += length ){
+      chunk.offset = regions[i].offset + pos;
+      chunk.length = length;
+      err = journal_write( &para_offset, &chunk, sizeof(journal_chunk_t) );
+      require_noerr(err, exit);
+      err = journal_write( &para_offset, regions[i].ram + pos, length );
+      require_noerr(err, exit);
+    }
+  }
+
+  journal_end = JOURNAL_ALIGN( para_offset );
+  para_shadow_sync( inContext );
+  para_log("Journal append %d bytes, end = %d", record_length, journal_end);
+
+exit:
+  return err;
+}
+
+/* Append the key-value operations of a transaction as one journal record */
+static OSStatus journal_append_kv( const mico_kv_txn_t *txn )
+{
+  OSStatus err = kNoErr;
+  journal_head_t head;
+  journal_chunk_t chunk;
+  kv_entry_t kv;
+  CRC16_Context crc_context;
+  uint32_t para_offset, record_length = 0;
+  uint16_t key_offset[MICO_KV_TXN_MAX_OPS];
+  uint8_t i;
+
+  CRC16_Init( &crc_context );
+  for( i = 0; i < txn->count; i++ ){
+    kv.type = txn->ops[i].type;
+    kv.key_length = strlen( txn->ops[i].key );
+    chunk.offset = txn->ops[i].value ? JOURNAL_KV_SET : JOURNAL_KV_DELETE;
+    chunk.length = sizeof(kv_entry_t) + kv.key_length + ( txn->ops[i].value ? txn->ops[i].length : 0 );
+    CRC16_Update( &crc_context, &chunk, sizeof(journal_chunk_t) );
+    CRC16_Update( &crc_context, &kv, sizeof(kv_entry_t) );
+    CRC16_Update( &crc_context, txn->ops[i].key, kv.key_length );
+    if( txn->ops[i].value )
+      CRC16_Update( &crc_context, txn->ops[i].value, txn->ops[i].length );
+    record_length += sizeof(journal_chunk_t) + chunk.length;
+  }
+  require_action_quiet( journal_end + sizeof(journal_head_t) + record_length <= MicoFlashGetInfo( para_active )->partition_length,
+                        exit, err = kNoSpaceErr );
+
+  head.length = record_length;
+  CRC16_Final( &crc_context, &head.crc );
+
+  para_offset = journal_end;
+  err = journal_write( &para_offset, &head, sizeof(journal_head_t) );
   require_noerr(err, exit);
 
-  para_offset = CRC_OFFSET;
-  err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&crc_result, CRC_SIZE );
+  for( i = 0; i < txn->count; i++ ){
+    kv.type = txn->ops[i].type;
+    kv.key_length = strlen( txn->ops[i].key );
+    chunk.offset = txn->ops[i].value ? JOURNAL_KV_SET : JOURNAL_KV_DELETE;
+    chunk.length = sizeof(kv_entry_t) + kv.key_length + ( txn->ops[i].value ? txn->ops[i].length : 0 );
+    err = journal_write( &para_offset, &chunk, sizeof(journal_chunk_t) );
+    require_noerr(err, exit);
+    err = journal_write( &para_offset, &kv, sizeof(kv_entry_t) );
+    require_noerr(err, exit);
+    key_offset[i] = para_offset;
+    err = journal_write( &para_offset, txn->ops[i].key, kv.key_length );
+    require_noerr(err, exit);
+    if( txn->ops[i].value ){
+      err = journal_write( &para_offset, txn->ops[i].value, txn->ops[i].length );
+      require_noerr(err, exit);
+    }
+  }
+  journal_end = JOURNAL_ALIGN( para_offset );
+
+  /* Record is in flash, apply it to the index in order */
+  for( i = 0; i < txn->count; i++ ){
+    if( txn->ops[i].value ){
+      err = kv_index_set( txn->ops[i].key, strlen( txn->ops[i].key ), key_offset[i], txn->ops[i].length, txn->ops[i].type );
+      require_noerr(err, exit);
+    }
+    else
+      kv_index_delete( txn->ops[i].key, strlen( txn->ops[i].key ) );
+  }
+
+exit:
+  return err;
+}
+
+/* Apply a key-value chunk at *para_offset of partition to the index */
+static OSStatus journal_replay_kv( mico_partition_t partition, const journal_chunk_t *chunk, uint32_t *para_offset )
+{
+  OSStatus err = kNoErr;
+  char key[MICO_KV_KEY_MAX];
+  kv_entry_t kv;
+  uint32_t key_offset;
+
+  require_action( chunk->length >= sizeof(kv_entry_t), exit, err = kIntegrityErr );
+  err = MicoFlashRead( partition, para_offset, (uint8_t *)&kv, sizeof(kv_entry_t) );
+  require_noerr(err, exit);
+  require_action( kv.key_length && kv.key_length <= MICO_KV_KEY_MAX && sizeof(kv_entry_t) + kv.key_length <= chunk->length,
+                  exit, err = kIntegrityErr );
+
+  key_offset = *para_offset;
+  err = MicoFlashRead( partition, para_offset, (uint8_t *)key, kv.key_length );
   require_noerr(err, exit);
 
+  if( chunk->offset == JOURNAL_KV_SET ){
+    err = kv_index_set( key, kv.key_length, key_offset, chunk->length - sizeof(kv_entry_t) - kv.key_length, kv.type );
+    require_noerr(err, exit);
+  }
+  else
+    kv_index_delete( key, kv.key_length );
+
+  *para_offset = key_offset + chunk->length - sizeof(kv_entry_t);
+
 exit:
   return err;
 }
 
-OSStatus mico_system_context_restore( mico_Context_t * const inContext )
-{ 
+/* Apply journal records in partition to parameters in RAM and the key-value
+ * index. Returns kIntegrityErr if a broken record or unerased data follows the
+ * last good record */
+static OSStatus journal_replay( mico_Context_t * const inContext, mico_partition_t partition )
+{
   OSStatus err = kNoErr;
-  require_action( inContext, exit, err = kNotPreparedErr );
+  uint8_t buf[JOURNAL_READ_SIZE];
+  journal_head_t head;
+  journal_chunk_t chunk;
+  CRC16_Context crc_context;
+  uint16_t crc_result;
+  uint32_t para_offset, record_offset, record_end, length, i;
+  uint32_t partition_length = MicoFlashGetInfo( partition )->partition_length;
+  uint8_t *ram;
+
+  kv_count = 0;
 
+  record_offset = JOURNAL_OFFSET;
+  while( record_offset + sizeof(journal_head_t) <= partition_length ){
+    para_offset = record_offset;
+    err = MicoFlashRead( partition, &para_offset, (uint8_t *)&head, sizeof(journal_head_t) );
+    require_noerr(err, exit);
+    if( head.length == JOURNAL_EMPTY && head.crc == JOURNAL_EMPTY ) break;
+
+    record_end = para_offset + head.length;
+    require_action( record_end <= partition_length, exit, err = kIntegrityErr );
+
+    /* Check the whole record before any change is applied */
+    CRC16_Init( &crc_context );
+    for( ; para_offset < record_end; ){
+      length = MIN( record_end - para_offset, JOURNAL_READ_SIZE );
+      err = MicoFlashRead( partition, &para_offset, buf, length );
+      require_noerr(err, exit);
+      CRC16_Update( &crc_context, buf, length );
+    }
+    CRC16_Final( &crc_context, &crc_result );
+    require_action( crc_result == head.crc, exit, err = kIntegrityErr );
+
+    para_offset = record_offset + sizeof(journal_head_t);
+    while( para_offset < record_end ){
+      err = MicoFlashRead( partition, &para_offset, (uint8_t *)&chunk, sizeof(journal_chunk_t) );
+      require_noerr(err, exit);
+      require_action( para_offset + chunk.length <= record_end, exit, err = kIntegrityErr );
+
+      if( chunk.offset == JOURNAL_KV_SET || chunk.offset == JOURNAL_KV_DELETE ){
+        err = journal_replay_kv( partition, &chunk, &para_offset );
+        require_noerr(err, exit);
+        continue;
+      }
+
+      if( chunk.offset >= SYS_CONFIG_OFFSET && chunk.offset + chunk.length <= sizeof(flash_content_t) )
+        ram = (uint8_t *)&inContext->flashContentInRam + chunk.offset;
+      else if( chunk.offset >= USER_CONFIG_OFFSET && chunk.offset + chunk.length <= USER_CONFIG_OFFSET + inContext->user_config_data_size )
+        ram = (uint8_t *)inContext->user_config_data + chunk.offset - USER_CONFIG_OFFSET;
+      else
+        ram = NULL;
+      require_action( ram, exit, err = kIntegrityErr );
+      err = MicoFlashRead( partition, &para_offset, ram, chunk.length );
+      require_noerr(err, exit);
+    }
+    record_offset = JOURNAL_ALIGN( record_end );
+  }
+
+  /* Next record is written here, it should be erased */
+  journal_end = record_offset;
+  para_offset = record_offset;
+  while( para_offset < partition_length ){
+    length = MIN( partition_length - para_offset, JOURNAL_READ_SIZE );
+    err = MicoFlashRead( partition, &para_offset, buf, length );
+    require_noerr(err, exit);
+    for( i = 0; i < length; i++ )
+      require_action( buf[i] == 0xFF, exit, err = kIntegrityErr );
+  }
+
+exit:
+  return err;
+}
+
+static OSStatus context_restore_default( mico_Context_t * const inContext )
+{
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
   sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
@@ -145,7 +671,20 @@ OSStatus mico_system_context_restore( mico_Context_t * const inContext )
 
   para_log("Restore to default");
 
-  err = internal_update_config( inContext );
+  /* Key-value pairs are application's configuration too */
+  kv_count = 0;
+
+  return internal_update_config( inContext );
+}
+
+OSStatus mico_system_context_restore( mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  require_action( inContext && para_mutex, exit, err = kNotPreparedErr );
+
+  mico_rtos_lock_mutex( &para_mutex );
+  err = context_restore_default( inContext );
+  mico_rtos_unlock_mutex( &para_mutex );
   require_noerr(err, exit);
 
 exit:
@@ -153,12 +692,8 @@ exit:
 }
 
 #ifdef MFG_MODE_AUTO
-OSStatus MICORestoreMFG( void )
-{ 
-  OSStatus err = kNoErr;
-  mico_Context_t *inContext = mico_system_context_get();
-  require_action( inContext, exit, err = kNotPreparedErr );
-
+static OSStatus context_restore_mfg( mico_Context_t * const inContext )
+{
   /*wlan configration is not need to change to a default state, use easylink to do that*/
   sprintf(inContext->flashContentInRam.micoSystemConfig.name, DEFAULT_NAME);
   inContext->flashContentInRam.micoSystemConfig.configured = mfgConfigured;
@@ -167,7 +702,18 @@ OSStatus MICORestoreMFG( void )
   /*Application's default configuration*/
   appRestoreDefault_callback(inContext->user_config_data, inContext->user_config_data_size);
 
-  err = internal_update_config( inContext );
+  return internal_update_config( inContext );
+}
+
+OSStatus MICORestoreMFG( void )
+{
+  OSStatus err = kNoErr;
+  mico_Context_t *inContext = mico_system_context_get();
+  require_action( inContext && para_mutex, exit, err = kNotPreparedErr );
+
+  mico_rtos_lock_mutex( &para_mutex );
+  err = context_restore_mfg( inContext );
+  mico_rtos_unlock_mutex( &para_mutex );
   require_noerr(err, exit);
 
 exit:
@@ -183,18 +729,26 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   CRC16_Context crc_context;
   uint16_t crc_result, crc_target;
   uint16_t crc_backup_result, crc_backup_target;
-  mico_logic_partition_t *partition; 
+  bool main_valid, backup_valid, repair = false;
   uint8_t *sys_backup_data = NULL;
   uint8_t *user_backup_data = NULL;
 
   OSStatus err = kNoErr;
 
+  if( para_mutex == NULL )
+    mico_rtos_init_mutex( &para_mutex );
+  mico_rtos_lock_mutex( &para_mutex );
+
   sys_backup_data = malloc( SYS_CONFIG_SIZE );
   require_action( sys_backup_data, exit, err = kNoMemoryErr );
 
   user_backup_data = malloc( inContext->user_config_data_size );
   require_action( user_backup_data, exit, err = kNoMemoryErr );
 
+  /* Journal needs a copy of the parameters in flash, full rewrite is used without it */
+  if( para_shadow != NULL ) free( para_shadow );
+  para_shadow = malloc( sizeof( flash_content_t ) + inContext->user_config_data_size );
+  kv_count = 0;
 
   /* Load data and crc from main partition */
   para_offset = 0x0;
@@ -225,64 +779,40 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   para_log( "crc_backup_result = %d", crc_backup_result);
 
   crc_offset = CRC_OFFSET;
-  err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &crc_offset, (uint8_t *)&crc_backup_target, CRC_SIZE );  
+  err = MicoFlashRead( MICO_PARTITION_PARAMETER_2, &crc_offset, (uint8_t *)&crc_backup_target, CRC_SIZE );
   para_log( "crc_backup_target = %d", crc_backup_target);
-  
-  /* Data collapsed at main partition */
-  if( is_crc_match( crc_result, crc_target ) == false ){
-    /* Data collapsed at main partition and backup partition both, restore to default */
-    if( is_crc_match( crc_backup_result, crc_backup_target ) == false ){
-      para_log("Config failed on both partition, restore to default settings!");
-      err = mico_system_context_restore( inContext );
-      require_noerr(err, exit);
-    }
-    /* main collapsed, backup correct, copy data from back up to main */
-    else {
-      para_log("Config failed on main, recover!");
-
-      memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
-      memcpy( (uint8_t *)&inContext->flashContentInRam.micoSystemConfig, sys_backup_data, SYS_CONFIG_SIZE);
-
-      partition = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_1 );
-
-      err = MicoFlashErase( MICO_PARTITION_PARAMETER_1 ,0x0, partition->partition_length );
-      require_noerr(err, exit);
 
-      para_offset = 0x0;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t) );
-      require_noerr(err, exit);
-
-      para_offset = USER_CONFIG_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-      require_noerr(err, exit);
+  main_valid = is_crc_match( crc_result, crc_target );
+  backup_valid = is_crc_match( crc_backup_result, crc_backup_target );
 
-      crc_offset = CRC_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_1, &crc_offset, (uint8_t *)&crc_backup_result, CRC_SIZE );
-      require_noerr(err, exit);
+  /* Data collapsed at main partition and backup partition both, restore to default */
+  if( main_valid == false && backup_valid == false ){
+    para_log("Config failed on both partition, restore to default settings!");
+    err = context_restore_default( inContext );
+    require_noerr(err, exit);
+  }
+  else {
+    /* Backup partition holds the newest base if main collapsed or it was compacted later */
+    para_active = MICO_PARTITION_PARAMETER_1;
+    if( main_valid == false || ( backup_valid == true &&
+       (int32_t)( ((mico_sys_config_t *)sys_backup_data)->seed - inContext->flashContentInRam.micoSystemConfig.seed ) > 0 ) ){
+      if( main_valid == false ){
+        para_log("Config failed on main, recover!");
+        memset(&inContext->flashContentInRam, 0x0, sizeof(inContext->flashContentInRam));
+      }
+      memcpy( (uint8_t *)&inContext->flashContentInRam.micoSystemConfig, sys_backup_data, SYS_CONFIG_SIZE);
+      memcpy( inContext->user_config_data, user_backup_data, inContext->user_config_data_size );
+      para_active = MICO_PARTITION_PARAMETER_2;
     }
-  }   
-  /* main correct */
-  else { 
-      /* main correct , backup collapsed, or main!=backup, copy data from main to back up */
-    if( is_crc_match( crc_result, crc_backup_result ) == false || is_crc_match( crc_backup_result, crc_backup_target ) == false ){
-      para_log("Config failed on backup, recover!");
-
-      partition = MicoFlashGetInfo( MICO_PARTITION_PARAMETER_2 );
-
-      err = MicoFlashErase( MICO_PARTITION_PARAMETER_2 ,0x0, partition->partition_length );
-      require_noerr(err, exit);
-  
-      para_offset = 0x0;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, (uint8_t *)&inContext->flashContentInRam, sizeof(flash_content_t) );
-      require_noerr(err, exit);
-
-      para_offset = USER_CONFIG_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &para_offset, inContext->user_config_data, inContext->user_config_data_size );
-      require_noerr(err, exit);
 
-      crc_offset = CRC_OFFSET;
-      err = MicoFlashWrite( MICO_PARTITION_PARAMETER_2, &crc_offset, (uint8_t *)&crc_target, CRC_SIZE );
-      require_noerr(err, exit);
+    /* Compact to rebuild a broken journal or the other collapsed partition */
+    if( journal_replay( inContext, para_active ) != kNoErr ){
+      para_log("Journal broken, recover!");
+      repair = true;
+    }
+    if( main_valid == false || backup_valid == false ){
+      para_log("Config failed on %s, recover!", main_valid? "backup" : "main");
+      repair = true;
     }
   }
 
@@ -294,12 +824,20 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
   if(inContext->flashContentInRam.micoSystemConfig.magic_number != SYS_MAGIC_NUMBR){
     para_log("Magic number error, restore to default");
 #ifdef MFG_MODE_AUTO
-    err = MICORestoreMFG( );
+    err = context_restore_mfg( inContext );
 #else
-    err = mico_system_context_restore( inContext );
+    err = context_restore_default( inContext );
 #endif
     require_noerr(err, exit);
   }
+  else if( repair == true ){
+    para_shadow_sync( inContext );
+    err = para_compact( inContext );
+    require_noerr(err, exit);
+  }
+  else {
+    para_shadow_sync( inContext );
+  }
 
 
   if(inContext->flashContentInRam.micoSystemConfig.dhcpEnable == DHCP_Disable){
@@ -309,24 +847,172 @@ OSStatus MICOReadConfiguration(mico_Context_t *inContext)
     strcpy((char *)inContext->micoStatus.dnsServer, inContext->flashContentInRam.micoSystemConfig.dnsServer);
   }
 
-exit: 
+exit:
   if( sys_backup_data!= NULL) free( sys_backup_data );
   if( user_backup_data!= NULL) free( user_backup_data );
+  mico_rtos_unlock_mutex( &para_mutex );
   return err;
 }
 
 OSStatus mico_system_context_update( mico_Context_t *in_context )
 {
   OSStatus err = kNoErr;
-  require_action( in_context, exit, err = kNotPreparedErr );
+  require_action( in_context && para_mutex, exit, err = kNotPreparedErr );
+
+  mico_rtos_lock_mutex( &para_mutex );
 
   in_context->flashContentInRam.micoSystemConfig.seed = ++seedNum;
 
-  err = internal_update_config( in_context );
+  /* Bootloader reads boot table from main partition only, rewrite both partitions */
+  if( para_shadow == NULL || memcmp( para_shadow, &in_context->flashContentInRam.bootTable, SYS_CONFIG_OFFSET ) != 0 ){
+    err = internal_update_config( in_context );
+  }
+  /* Journal is full or could not be written, continue on the other partition */
+  else if( journal_append( in_context ) != kNoErr ){
+    para_shadow_sync( in_context );
+    err = para_compact( in_context );
+  }
+
+  mico_rtos_unlock_mutex( &para_mutex );
   require_noerr(err, exit);
 
 exit:
   return err;
 }
 
+/*****************************************************************************/
+/* Key-value storage */
+
+void mico_system_kv_txn_init( mico_kv_txn_t *txn )
+{
+  txn->count = 0;
+}
+
+OSStatus mico_system_kv_txn_set( mico_kv_txn_t *txn, const char *key, mico_kv_type_t type, const void *value, uint32_t length )
+{
+  OSStatus err = kNoErr;
+  require_action( txn && key && value, exit, err = kParamErr );
+  require_action( strlen( key ) && strlen( key ) <= MICO_KV_KEY_MAX, exit, err = kParamErr );
+  require_action( ( type != MICO_KV_TYPE_UINT32 && type != MICO_KV_TYPE_INT32 ) || length == sizeof(uint32_t), exit, err = kSizeErr );
+  require_action( length <= JOURNAL_EMPTY - sizeof(kv_entry_t) - MICO_KV_KEY_MAX, exit, err = kSizeErr );
+  require_action( txn->count < MICO_KV_TXN_MAX_OPS, exit, err = kNoResourcesErr );
+
+  txn->ops[txn->count].key = key;
+  txn->ops[txn->count].value = value;
+  txn->ops[txn->count].length = length;
+  txn->ops[txn->count].type = type;
+  txn->count++;
+
+exit:
+  return err;
+}
+
+OSStatus mico_system_kv_txn_delete( mico_kv_txn_t *txn, const char *key )
+{
+  OSStatus err = kNoErr;
+  require_action( txn && key, exit, err = kParamErr );
+  require_action( strlen( key ) && strlen( key ) <= MICO_KV_KEY_MAX, exit, err = kParamErr );
+  require_action( txn->count < MICO_KV_TXN_MAX_OPS, exit, err = kNoResourcesErr );
+
+  txn->ops[txn->count].key = key;
+  txn->ops[txn->count].value = NULL;
+  txn->ops[txn->count].length = 0;
+  txn->ops[txn->count].type = MICO_KV_TYPE_BLOB;
+  txn->count++;
+
+exit:
+  return err;
+}
+
+OSStatus mico_system_kv_txn_commit( mico_kv_txn_t *txn )
+{
+  OSStatus err = kNoErr;
+  mico_Context_t *inContext = mico_system_context_get();
+  require_action( txn, exit, err = kParamErr );
+  require_action( inContext && para_mutex && para_shadow, exit, err = kNotPreparedErr );
+  require_quiet( txn->count, exit );
+
+  mico_rtos_lock_mutex( &para_mutex );
+  /* The result must still fit when the journal is compacted */
+  require_action_quiet( JOURNAL_OFFSET + kv_txn_compact_size( txn ) <= MicoFlashGetInfo( para_active )->partition_length,
+                        unlock, err = kNoSpaceErr );
+
+  err = journal_append_kv( txn );
+  if( err == kNoSpaceErr ){
+    err = para_compact( inContext );
+    if( err == kNoErr )
+      err = journal_append_kv( txn );
+  }
+
+unlock:
+  mico_rtos_unlock_mutex( &para_mutex );
+  txn->count = 0;
+
+exit:
+  return err;
+}
+
+OSStatus mico_system_kv_set( const char *key, mico_kv_type_t type, const void *value, uint32_t length )
+{
+  OSStatus err = kNoErr;
+  mico_kv_txn_t txn;
+
+  mico_system_kv_txn_init( &txn );
+  err = mico_system_kv_txn_set( &txn, key, type, value, length );
+  require_noerr(err, exit);
+  err = mico_system_kv_txn_commit( &txn );
+
+exit:
+  return err;
+}
+
+OSStatus mico_system_kv_delete( const char *key )
+{
+  OSStatus err = kNoErr;
+  mico_kv_txn_t txn;
+  int32_t i;
+
+  require_action( key && strlen( key ) && strlen( key ) <= MICO_KV_KEY_MAX, exit, err = kParamErr );
+  require_action( para_mutex, exit, err = kNotPreparedErr );
+
+  mico_rtos_lock_mutex( &para_mutex );
+  i = kv_find( key, strlen( key ), kv_hash( key, strlen( key ) ) );
+  mico_rtos_unlock_mutex( &para_mutex );
+  require_action_quiet( i >= 0, exit, err = kNotFoundErr );
+
+  mico_system_kv_txn_init( &txn );
+  err = mico_system_kv_txn_delete( &txn, key );
+  require_noerr(err, exit);
+  err = mico_system_kv_txn_commit( &txn );
+
+exit:
+  return err;
+}
+
+OSStatus mico_system_kv_get( const char *key, mico_kv_type_t type, void *value, uint32_t *length )
+{
+  OSStatus err = kNoErr;
+  uint32_t para_offset;
+  int32_t i;
+
+  require_action( key && value && length, exit, err = kParamErr );
+  require_action( strlen( key ) && strlen( key ) <= MICO_KV_KEY_MAX, exit, err = kParamErr );
+  require_action( para_mutex, exit, err = kNotPreparedErr );
+
+  mico_rtos_lock_mutex( &para_mutex );
+  i = kv_find( key, strlen( key ), kv_hash( key, strlen( key ) ) );
+  require_action_quiet( i >= 0, unlock, err = kNotFoundErr );
+  require_action_quiet( kv_index[i].type == type, unlock, err = kTypeErr );
+  require_action_quiet( kv_index[i].length <= *length, unlock, { *length = kv_index[i].length; err = kSizeErr; } );
+
+  para_offset = kv_index[i].offset + kv_index[i].key_length;
+  err = MicoFlashRead( para_active, &para_offset, value, kv_index[i].length );
+  *length = kv_index[i].length;
+
+unlock:
+  mico_rtos_unlock_mutex( &para_mutex );
+exit:
+  return err;
+}
+
 
@@ -45,6 +45,7 @@ extern "C" {
 /* Define MICO service thread stack size */
 #define STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD   0x300
 #define STACK_SIZE_LOCAL_CONFIG_CLIENT_THREAD   0x450
+#define STACK_SIZE_LOCAL_CONFIG_SINGLE_THREAD   0x500   /* Listener that also serves the clients */
 #define STACK_SIZE_NTP_CLIENT_THREAD            0x450
 #define STACK_SIZE_mico_system_MONITOR_THREAD   0x300
 
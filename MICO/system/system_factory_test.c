@@ -164,7 +164,7 @@ void mxchip_mfg_test(void)
   volatile ring_buffer_t  rx_buffer;
   volatile uint8_t *      rx_data;
   
-  rx_data = malloc(50);
+  rx_data = malloc(64);
   require(rx_data, exit);
   
   /* Initialize UART interface */
@@ -175,7 +175,7 @@ void mxchip_mfg_test(void)
   uart_config.flow_control = FLOW_CONTROL_DISABLED;
   uart_config.flags = UART_WAKEUP_DISABLE;
   
-  ring_buffer_init  ( (ring_buffer_t *)&rx_buffer, (uint8_t *)rx_data, 50 );
+  ring_buffer_init  ( (ring_buffer_t *)&rx_buffer, (uint8_t *)rx_data, 64 );
   MicoUartInitialize( MFG_TEST, &uart_config, (ring_buffer_t *)&rx_buffer );  
 
   mf_printf("==== MXCHIP Manufacture Test ====\r\n");
@@ -328,20 +328,12 @@ exit:
 static size_t _uart_get_one_packet(uint8_t* inBuf, int inBufLen)
 {
   
-  int datalen;
+  uint32_t datalen;
   
   while(1) {
-    if( MicoUartRecv( UART_FOR_APP, inBuf, inBufLen, 500) == kNoErr){
-      return inBufLen;
+    if( MicoUartRecvFrame( UART_FOR_APP, inBuf, inBufLen, &datalen, 500) == kNoErr && datalen ){
+      return datalen;
     }
-    else{
-      datalen = MicoUartGetLengthInBuffer( UART_FOR_APP );
-      if(datalen){
-        MicoUartRecv(UART_FOR_APP, inBuf, datalen, 500);
-        return datalen;
-      }
-    }
-    
   }
 }
 #endif
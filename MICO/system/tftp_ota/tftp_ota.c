@@ -2,6 +2,7 @@
 #include "tftp.h"
 #include "CheckSumUtils.h"
 #include "mico_system.h"
+#include "mico_system_ota.h"
 
 
 #define DEFAULT_OTA_AP "MICO_OTA_AP"
@@ -26,6 +27,16 @@ enum {
     OTA_MD5_FAIL = -3,
     OTA_NO_MEM = -4,
 };
+static void tftp_ota_md5_update( void *context, const uint8_t *data, uint32_t length )
+{
+    Md5Update( (md5_context *)context, (unsigned char *)data, length );
+}
+
+static void tftp_ota_crc_update( void *context, const uint8_t *data, uint32_t length )
+{
+    CRC16_Update( (CRC16_Context *)context, data, length );
+}
+
 /* Call back for OTA finished */
 __weak void mico_ota_finished(int result, uint8_t *reserved)
 {
@@ -77,7 +88,7 @@ void tftp_ota(void)
     network_InitTypeDef_st conf;
     tftp_file_info_t fileinfo;
     uint32_t ipaddr = inet_addr(DEFAULT_OTA_SERVER), flashaddr;
-    int filelen, maxretry = 5, len, left, i = 0;
+    int filelen, maxretry = 5, i = 0;
     uint8_t md5_recv[16];
     uint8_t md5_calc[16];
     uint8_t *tmpbuf;
@@ -86,6 +97,8 @@ void tftp_ota(void)
     mico_logic_partition_t* ota_partition = MicoFlashGetInfo( MICO_PARTITION_OTA_TEMP );
     uint16_t crc = 0;
     CRC16_Context contex;
+    mico_flash_checksum_t checksums[2] = { { tftp_ota_md5_update, &ctx }, { tftp_ota_crc_update, &contex } };
+    mico_ota_sink_t sink;
     mico_Context_t* context = NULL;
     
 #define TMP_BUF_LEN 1024
@@ -145,38 +158,37 @@ void tftp_ota(void)
     fileinfo.flashtype = MICO_PARTITION_OTA_TEMP;
     strcpy(fileinfo.filename, "mico_ota.bin");
 
+    /* Hash the image while tget writes it, the MD5 appended to the image is held back */
+    mico_ota_sink_init( &sink, MICO_PARTITION_OTA_TEMP, 16, true );
+    MicoFlashSetWriteObserver( MICO_PARTITION_OTA_TEMP, mico_ota_sink_observer, &sink );
     while((filelen = tget (&fileinfo, ipaddr)) < 0) {
         fota_log("tget return filelen %d, maxretry %d", filelen, maxretry);
+        mico_ota_sink_init( &sink, MICO_PARTITION_OTA_TEMP, 16, true );
         maxretry--;
         if (maxretry < 0) {
             fota_log("ERROR!! Can't get OTA image.");
+            MicoFlashSetWriteObserver( MICO_PARTITION_OTA_TEMP, NULL, NULL );
             free(tmpbuf);
             mico_ota_finished(OTA_NO_FILE, NULL);
             return;
         }
     }
 
+    MicoFlashSetWriteObserver( MICO_PARTITION_OTA_TEMP, NULL, NULL );
     filelen -= 16; // remove md5.
     fota_log("tftp download image finished, OTA bin len %d", filelen);
-    flashaddr = filelen;
-    MicoFlashRead(MICO_PARTITION_OTA_TEMP, &flashaddr, (uint8_t *)md5_recv, 16);
-    InitMd5( &ctx );
-    CRC16_Init( &contex );
-    flashaddr = 0;
-    left = filelen;
-    while(left > 0) {
-        if (left > TMP_BUF_LEN) {
-            len = TMP_BUF_LEN;
-        } else {
-            len = left;
-        }
-        left -= len;
-        MicoFlashRead(MICO_PARTITION_OTA_TEMP, &flashaddr, (uint8_t *)tmpbuf, len);
-        Md5Update( &ctx, (uint8_t *)tmpbuf, len);
-        CRC16_Update( &contex, tmpbuf, len );
+    if( sink.hashed != (uint32_t)filelen || mico_ota_sink_final( &sink, md5_calc, &crc, md5_recv ) != kNoErr ) {
+        /* Blocks were not written in order, verify the image in flash instead */
+        flashaddr = filelen;
+        MicoFlashRead(MICO_PARTITION_OTA_TEMP, &flashaddr, (uint8_t *)md5_recv, 16);
+        InitMd5( &ctx );
+        CRC16_Init( &contex );
+        flashaddr = 0;
+        /* One pass feeds both MD5 and CRC16, in place when the OTA partition is memory mapped */
+        MicoFlashChecksum(MICO_PARTITION_OTA_TEMP, &flashaddr, filelen, checksums, 2, tmpbuf, TMP_BUF_LEN);
+        Md5Final( &ctx, md5_calc );
+        CRC16_Final( &contex, &crc );
     }
-    Md5Final( &ctx, md5_calc );
-    CRC16_Final( &contex, &crc );
     
     if(memcmp(md5_calc, md5_recv, 16) != 0) {
         fota_log("ERROR!! MD5 Error.");
@@ -58,6 +58,35 @@ uint8_t spi_tx_buffer = 0;
 //[5]0 1 2 3 ... 127	
 //[6]0 1 2 3 ... 127	
 //[7]0 1 2 3 ... 127 			   
+static u8 OLED_GRAM[8][128];
+
+//Pages changed since the last OLED_Refresh_Gram, and the changed columns [start, end) of each page
+static u8 oled_gram_dirty = 0;
+static u8 oled_gram_dirty_start[8];
+static u8 oled_gram_dirty_end[8];
+
+static void OLED_Gram_Mark(u8 page, u8 x0, u8 x1)
+{
+  if( ( oled_gram_dirty & ( 1 << page ) ) == 0 ){
+    oled_gram_dirty |= ( 1 << page );
+    oled_gram_dirty_start[page] = x0;
+    oled_gram_dirty_end[page] = x1;
+    return;
+  }
+  if( x0 < oled_gram_dirty_start[page] ) oled_gram_dirty_start[page] = x0;
+  if( x1 > oled_gram_dirty_end[page] ) oled_gram_dirty_end[page] = x1;
+}
+
+//Copy len column bytes to page y from column x, clipped to the screen
+static void OLED_Gram_Write(u8 x, u8 y, const u8 *dat, u8 len)
+{
+  if( y > 7 || x > Max_Column-1 ) return;
+  if( len > Max_Column - x ) len = Max_Column - x;
+  if( len == 0 ) return;
+  memcpy( &OLED_GRAM[y][x], dat, len );
+  OLED_Gram_Mark( y, x, x + len );
+}
+
 
 #if OLED_MODE==1
 //SSD1106дһֽڡ
@@ -76,47 +105,102 @@ void OLED_WR_Byte(u8 dat,u8 cmd)
   OLED_CS_Set();	  
   OLED_DC_Set();	 
 } 	    	    
+
+void OLED_Refresh_Gram(void)
+{
+  u8 page, n;
+
+  for( page = 0; page < 8; page++ )
+  {
+    if( ( oled_gram_dirty & ( 1 << page ) ) == 0 ) continue;
+    OLED_WR_Byte(0xb0+page,OLED_CMD);
+    OLED_WR_Byte(0x10|(oled_gram_dirty_start[page]>>4),OLED_CMD);
+    OLED_WR_Byte(oled_gram_dirty_start[page]&0x0f,OLED_CMD);
+    for(n=oled_gram_dirty_start[page];n<oled_gram_dirty_end[page];n++)
+      OLED_WR_Byte(OLED_GRAM[page][n],OLED_DATA);
+  }
+  oled_gram_dirty = 0;
+}
 #else
 //SSD1106дһֽڡ
 //dat:Ҫд/
 //cmd:/־ 0,ʾ;1,ʾ;
-void OLED_WR_Byte(u8 dat,u8 cmd)
-{  
-  platform_spi_config_t config;
-  platform_spi_message_segment_t oled_spi_msg =
-            { &dat,            NULL,       (unsigned long) 1 };
-
-  config.chip_select = &platform_gpio_pins[micokit_spi_oled.chip_select];
-  config.speed       = micokit_spi_oled.speed;
-  config.mode        = micokit_spi_oled.mode;
-  config.bits        = micokit_spi_oled.bits;
+static void OLED_SPI_Lock(platform_spi_config_t *config)
+{
+  config->chip_select = &platform_gpio_pins[micokit_spi_oled.chip_select];
+  config->speed       = micokit_spi_oled.speed;
+  config->mode        = micokit_spi_oled.mode;
+  config->bits        = micokit_spi_oled.bits;
   
   if( platform_spi_drivers[micokit_spi_oled.port].spi_mutex == NULL)
     mico_rtos_init_mutex( &platform_spi_drivers[micokit_spi_oled.port].spi_mutex );
 
   mico_rtos_lock_mutex( &platform_spi_drivers[micokit_spi_oled.port].spi_mutex );
 
-  platform_spi_init( &platform_spi_drivers[micokit_spi_oled.port], &platform_spi_peripherals[micokit_spi_oled.port], &config );
+  platform_spi_init( &platform_spi_drivers[micokit_spi_oled.port], &platform_spi_peripherals[micokit_spi_oled.port], &config[0] );
   OLED_DC_INIT();   
+}
+
+static void OLED_SPI_Unlock(void)
+{
+  OLED_DC_Set();   
+
+  mico_rtos_unlock_mutex( &platform_spi_drivers[micokit_spi_oled.port].spi_mutex );
+}
+
+//Send len bytes as one SPI transfer, the bus is locked by OLED_SPI_Lock
+static void OLED_SPI_Write(platform_spi_config_t *config, const u8 *dat, u32 len, u8 cmd)
+{
+  platform_spi_message_segment_t oled_spi_msg =
+            { dat,            NULL,       (unsigned long) len };
 
   if(cmd)
     OLED_DC_Set();
   else 
     OLED_DC_Clr();		  
 
-  platform_spi_transfer( &platform_spi_drivers[micokit_spi_oled.port], &config, &oled_spi_msg, 1 );
-  
-  OLED_DC_Set();   
+  platform_spi_transfer( &platform_spi_drivers[micokit_spi_oled.port], config, &oled_spi_msg, 1 );
+}
 
-  mico_rtos_unlock_mutex( &platform_spi_drivers[micokit_spi_oled.port].spi_mutex );
+void OLED_WR_Byte(u8 dat,u8 cmd)
+{  
+  platform_spi_config_t config;
+
+  OLED_SPI_Lock( &config );
+  OLED_SPI_Write( &config, &dat, 1, cmd );
+  OLED_SPI_Unlock( );
 } 
+
+//Send the changed columns of each dirty page, one command and one data transfer per page
+void OLED_Refresh_Gram(void)
+{
+  platform_spi_config_t config;
+  u8 page, cmd[3];
+
+  if( oled_gram_dirty == 0 ) return;
+
+  OLED_SPI_Lock( &config );
+  for( page = 0; page < 8; page++ )
+  {
+    if( ( oled_gram_dirty & ( 1 << page ) ) == 0 ) continue;
+    cmd[0] = 0xb0 + page;                                 //page address
+    cmd[1] = 0x10 | ( oled_gram_dirty_start[page] >> 4 );  //column high address
+    cmd[2] = oled_gram_dirty_start[page] & 0x0f;          //column low address
+    OLED_SPI_Write( &config, cmd, sizeof(cmd), OLED_CMD );
+    OLED_SPI_Write( &config, &OLED_GRAM[page][oled_gram_dirty_start[page]], 
+                    oled_gram_dirty_end[page] - oled_gram_dirty_start[page], OLED_DATA );
+  }
+  oled_gram_dirty = 0;
+  OLED_SPI_Unlock( );
+}
 #endif
 
+//Same column origin as OLED_Refresh_Gram, so direct writes line up with the framebuffer
 void OLED_Set_Pos(unsigned char x, unsigned char y) 
 { 
   OLED_WR_Byte(0xb0+y,OLED_CMD);
   OLED_WR_Byte(((x&0xf0)>>4)|0x10,OLED_CMD);
-  OLED_WR_Byte((x&0x0f)|0x01,OLED_CMD); 
+  OLED_WR_Byte(x&0x0f,OLED_CMD); 
 }   	  
 //OLEDʾ    
 void OLED_Display_On(void)
@@ -135,14 +219,16 @@ void OLED_Display_Off(void)
 //,,ĻǺɫ!ûһ!!!	  
 void OLED_Clear(void)  
 {  
-  u8 i,n;		    
+  OLED_Gram_Clear();
+  OLED_Refresh_Gram();
+}
+
+void OLED_Gram_Clear(void)  
+{  
+  u8 i;		    
+  memset(OLED_GRAM,0,sizeof(OLED_GRAM));
   for(i=0;i<8;i++)  
-  {  
-    OLED_WR_Byte (0xb0+i,OLED_CMD);    //ҳַ0~7
-    OLED_WR_Byte (0x00,OLED_CMD);      //ʾλáе͵ַ
-    OLED_WR_Byte (0x10,OLED_CMD);      //ʾλáиߵַ   
-    for(n=0;n<128;n++)OLED_WR_Byte(0,OLED_DATA); 
-  } //ʾ
+    OLED_Gram_Mark(i,0,Max_Column);
 }
 
 
@@ -153,23 +239,22 @@ void OLED_Clear(void)
 //size:ѡ 16/12 
 void OLED_ShowChar(u8 x,u8 y,u8 chr)
 {      	
-  unsigned char c=0,i=0;	
+  OLED_Gram_ShowChar(x,y,chr);
+  OLED_Refresh_Gram();
+}
+
+void OLED_Gram_ShowChar(u8 x,u8 y,u8 chr)
+{      	
+  unsigned char c=0;	
   c=chr-' ';//õƫƺֵ			
   if(x>Max_Column-1){x=0;y=y+2;}
   if(SIZE ==16)
   {
-    OLED_Set_Pos(x,y);	
-    for(i=0;i<8;i++)
-      OLED_WR_Byte(F8X16[c*16+i],OLED_DATA);
-    OLED_Set_Pos(x,y+1);
-    for(i=0;i<8;i++)
-      OLED_WR_Byte(F8X16[c*16+i+8],OLED_DATA);
+    OLED_Gram_Write(x,y,&F8X16[c*16],8);
+    OLED_Gram_Write(x,y+1,&F8X16[c*16+8],8);
   }
   else {	
-    OLED_Set_Pos(x,y+1);
-    for(i=0;i<6;i++)
-      OLED_WR_Byte(F6x8[c][i],OLED_DATA);
-    
+    OLED_Gram_Write(x,y+1,F6x8[c],6);
   }
 }
 //m^n
@@ -196,16 +281,23 @@ void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size)
     {
       if(temp==0)
       {
-        OLED_ShowChar(x+(size/2)*t,y,' ');
+        OLED_Gram_ShowChar(x+(size/2)*t,y,' ');
         continue;
       }else enshow=1; 
       
     }
-    OLED_ShowChar(x+(size/2)*t,y,temp+'0'); 
+    OLED_Gram_ShowChar(x+(size/2)*t,y,temp+'0'); 
   }
+  OLED_Refresh_Gram();
 } 
 //ʾһַŴ
 void OLED_ShowString(u8 x,u8 y,u8 *chr)
+{
+  OLED_Gram_ShowString(x,y,chr);
+  OLED_Refresh_Gram();
+}
+
+void OLED_Gram_ShowString(u8 x,u8 y,u8 *chr)
 {
   unsigned char j=0;
   u8 x_t = x,y_t = y;
@@ -215,14 +307,14 @@ void OLED_ShowString(u8 x,u8 y,u8 *chr)
     // add for CR/LF
     if( ('\r' == chr[j]) && ('\n' == chr[j+1]) ){  // CR LF
       while(x_t <= 120){  // fill rest chars in current line
-        OLED_ShowChar(x_t,y_t,' ');
+        OLED_Gram_ShowChar(x_t,y_t,' ');
         x_t += 8;
       }
       j += 2;
     }
     else if( ('\r' == chr[j]) || ('\n' == chr[j]) ){   // CR or LF
       while(x_t <= 120){  // fill rest chars in current line
-        OLED_ShowChar(x_t,y_t,' ');
+        OLED_Gram_ShowChar(x_t,y_t,' ');
         x_t += 8;
       }
       j += 1;
@@ -235,7 +327,7 @@ void OLED_ShowString(u8 x,u8 y,u8 *chr)
           break;
         }
       }
-      OLED_ShowChar(x_t,y_t,chr[j]);
+      OLED_Gram_ShowChar(x_t,y_t,chr[j]);
       x_t += 8;
       j++;
     }
@@ -245,38 +337,52 @@ void OLED_ShowString(u8 x,u8 y,u8 *chr)
 //ʾ
 void OLED_ShowCHinese(u8 x,u8 y,u8 no)
 {      			    
-  u8 t,adder=0;
-  OLED_Set_Pos(x,y);	
-  for(t=0;t<16;t++)
-  {
-    OLED_WR_Byte(Hzk[2*no][t],OLED_DATA);
-    adder+=1;
-  }	
-  OLED_Set_Pos(x,y+1);	
-  for(t=0;t<16;t++)
-  {	
-    OLED_WR_Byte(Hzk[2*no+1][t],OLED_DATA);
-    adder+=1;
-  }					
+  OLED_Gram_Write(x,y,(u8 *)Hzk[2*no],16);
+  OLED_Gram_Write(x,y+1,(u8 *)Hzk[2*no+1],16);
+  OLED_Refresh_Gram();
 }
 /***********ʾʾBMPͼƬ12864ʼ(x,y),xķΧ0127yΪҳķΧ07*****************/
 void OLED_DrawBMP(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,unsigned char BMP[])
+{ 	
+  OLED_Gram_DrawBMP(x0,y0,x1,y1,BMP);
+  OLED_Refresh_Gram();
+}
+
+void OLED_Gram_DrawBMP(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,unsigned char BMP[])
 { 	
   unsigned int j=0;
-  unsigned char x,y;
+  unsigned char y;
   
-  if(y1%8==0) y=y1/8;      
-  else y=y1/8+1;
+  if(x1<=x0) return;
   for(y=y0;y<y1;y++)
   {
-    OLED_Set_Pos(x0,y);
-    for(x=x0;x<x1;x++)
-    {      
-      OLED_WR_Byte(BMP[j++],OLED_DATA);	    	
-    }
+    OLED_Gram_Write(x0,y,&BMP[j],x1-x0);
+    j+=x1-x0;
   }
 } 
 
+//, only OLED_GRAM is changed
+//x:0~127
+//y:0~63
+//t:1  0,
+void OLED_DrawPoint(u8 x,u8 y,u8 t)
+{
+  if(x>Max_Column-1||y>Max_Row-1) return;
+  if(t) OLED_GRAM[y/8][x] |= 1<<(y%8);
+  else  OLED_GRAM[y/8][x] &= ~(1<<(y%8));
+  OLED_Gram_Mark(y/8,x,x+1);
+}
+
+//x1,y1,x2,y2 ĶԽ, only OLED_GRAM is changed
+//dot:0,;1,
+void OLED_Fill(u8 x1,u8 y1,u8 x2,u8 y2,u8 dot)
+{
+  u8 x,y;
+  for(x=x1;x<=x2&&x<Max_Column;x++)
+    for(y=y1;y<=y2&&y<Max_Row;y++)
+      OLED_DrawPoint(x,y,dot);
+} 
+
 
 //ʼSSD1306					    
 void OLED_Init(void)
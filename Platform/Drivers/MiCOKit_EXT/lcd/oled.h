@@ -120,6 +120,15 @@ void OLED_Init(void);
 void OLED_Clear(void);
 void OLED_ShowString(u8 x,u8 y, u8 *p);
 
+// The screen content is kept in a 1KB framebuffer (OLED_GRAM). The OLED_Gram_xxx functions,
+// OLED_DrawPoint and OLED_Fill only draw into it, OLED_Refresh_Gram then sends the changed part 
+// of each page in one SPI transfer. The other functions draw and refresh at once.
+void OLED_Refresh_Gram(void);
+void OLED_Gram_Clear(void);
+void OLED_Gram_ShowChar(u8 x,u8 y,u8 chr);
+void OLED_Gram_ShowString(u8 x,u8 y, u8 *p);
+void OLED_Gram_DrawBMP(unsigned char x0, unsigned char y0,unsigned char x1, unsigned char y1,unsigned char BMP[]);
+
 
 #endif  
 	 
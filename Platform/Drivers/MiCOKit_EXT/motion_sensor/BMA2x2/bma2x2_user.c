@@ -57,6 +57,14 @@ mico_i2c_device_t bma2x2_i2c_device = {
  *	\param cnt : The no of byte of data to be read
  */
 s8 BMA2x2_I2C_bus_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u8 cnt);
+ /*	\Brief: The function is used as I2C burst read, all bytes are read in one transfer
+ *	\Return : Status of the I2C read
+ *	\param dev_addr : The device address of the sensor
+ *	\param reg_addr : Address of the first register, will data is going to be read
+ *	\param reg_data : This data read from the sensor, which is hold in an array
+ *	\param cnt : The no of byte of data to be read
+ */
+s8 BMA2x2_I2C_burst_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u32 cnt);
  /*	\Brief: The function is used as I2C bus write
  *	\Return : Status of the I2C write
  *	\param dev_addr : The device address of the sensor
@@ -111,12 +119,12 @@ s32 bma2x2_data_readout_template(void);
  *---------------------------------------------------------------------------*/
 struct bma2x2_t bma2x2;
 /*----------------------------------------------------------------------------*
-*  V_BMA2x2RESOLUTION_u8R used for selecting the accelerometer resolution
+*  V_BMA2x2RESOLUTION_U8 used for selecting the accelerometer resolution
  *	12 bit
  *	14 bit
  *	10 bit
 *----------------------------------------------------------------------------*/
-extern u8 V_BMA2x2RESOLUTION_u8R;
+extern u8 V_BMA2x2RESOLUTION_U8;
 /* This function is an example for reading sensor data
  *	\param: None
  *	\return: communication result
@@ -238,6 +246,7 @@ s8 BMA2x2_I2C_routine(void) {
  *--------------------------------------------------------------------------*/
 	bma2x2.bus_write = BMA2x2_I2C_bus_write;
 	bma2x2.bus_read = BMA2x2_I2C_bus_read;
+	bma2x2.burst_read = BMA2x2_I2C_burst_read;
 	bma2x2.delay_msec = BMA2x2_delay_msek;
 	bma2x2.dev_addr = BMA2x2_I2C_ADDR2;
 
@@ -377,6 +386,28 @@ s8 BMA2x2_I2C_bus_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u8 cnt)
 	return (s8)iError;
 }
 
+ /*	\Brief: The function is used as I2C burst read, e.g. for the FIFO data register
+ *	\Return : Status of the I2C read
+ *	\param dev_addr : The device address of the sensor
+ *	\param reg_addr : Address of the first register, will data is going to be read
+ *	\param reg_data : This data read from the sensor, which is hold in an array
+ *	\param cnt : The no of byte of data to be read, all of them are read in one transfer
+ */
+s8 BMA2x2_I2C_burst_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u32 cnt)
+{
+        mico_i2c_message_t bma2x2_i2c_msg = {NULL, NULL, 0, 0, 0, false};
+	s32 iError = 0;
+	u8 array[1];
+	array[0] = reg_addr;
+
+        iError = MicoI2cBuildCombinedMessage(&bma2x2_i2c_msg, array, reg_data, 1, (uint16_t)cnt, 3);
+        if(0 != iError){
+          return (s8)iError; 
+        }
+        iError = MicoI2cTransfer(&bma2x2_i2c_device, &bma2x2_i2c_msg, 1);
+	return (s8)iError;
+}
+
 /*	\Brief: The function is used as SPI bus read
  *	\Return : Status of the SPI read
  *	\param dev_addr : The device address of the sensor
@@ -518,6 +549,8 @@ exit:
 OSStatus bma2x2_data_readout(s16 *v_accel_x_s16, s16 *v_accel_y_s16, s16 *v_accel_z_s16)
 {
   OSStatus err = kUnknownErr;
+  /* bma2x2acc_data structure used to read accel xyz data*/
+  struct bma2x2_accel_data sample_xyz;
   
   /* result of communication results*/
   s32 com_rslt = BMA2x2_ERROR;
@@ -529,13 +562,28 @@ OSStatus bma2x2_data_readout(s16 *v_accel_x_s16, s16 *v_accel_y_s16, s16 *v_acce
     
   /************ START READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY DATA *********/
 
-  com_rslt = bma2x2_read_accel_x(v_accel_x_s16);/* Read the accel X data*/
+  com_rslt = bma2x2_read_accel_xyz(&sample_xyz);/* Read the accel XYZ data in one burst*/
 
-  com_rslt += bma2x2_read_accel_y(v_accel_y_s16);/* Read the accel Y data*/
+  *v_accel_x_s16 = sample_xyz.x;
+  *v_accel_y_s16 = sample_xyz.y;
+  *v_accel_z_s16 = sample_xyz.z;
+  /************ END READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY ********/
+  
+  if(0 == com_rslt){
+    err = kNoErr;
+  }
+  return err;
+}
 
-  com_rslt += bma2x2_read_accel_z(v_accel_z_s16);/* Read the accel Z data*/
+OSStatus bma2x2_fifo_start(void)
+{
+  OSStatus err = kUnknownErr;
+  s32 com_rslt = BMA2x2_ERROR;
   
-  /************ END READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY ********/
+  MicoI2cInitialize(&bma2x2_i2c_device);
+  
+  com_rslt = bma2x2_set_fifo_data_select(BMA2x2_FIFO_XYZ);
+  com_rslt += bma2x2_set_fifo_mode(BMA2x2_FIFO_STREAM);
   
   if(0 == com_rslt){
     err = kNoErr;
@@ -543,6 +591,53 @@ OSStatus bma2x2_data_readout(s16 *v_accel_x_s16, s16 *v_accel_y_s16, s16 *v_acce
   return err;
 }
 
+OSStatus bma2x2_fifo_readout(s16 *v_accel_xyz_s16, uint8_t max_frames, uint8_t *frames)
+{
+  OSStatus err = kUnknownErr;
+  s32 com_rslt = BMA2x2_ERROR;
+  u8 *v_data_u8 = (u8 *)v_accel_xyz_s16;
+  u8 v_frame_count_u8 = 0;
+  u8 v_mask_u8, v_shift_u8;
+  u32 i;
+  
+  *frames = 0;
+  MicoI2cInitialize(&bma2x2_i2c_device);
+  
+  com_rslt = bma2x2_get_fifo_frame_count(&v_frame_count_u8);
+  if(0 != com_rslt) goto exit;
+  if(v_frame_count_u8 > max_frames) v_frame_count_u8 = max_frames;
+  
+  /* All frames in one burst from the FIFO data register, the frames have the layout of the 
+     acceleration data registers and are converted in place */
+  if(v_frame_count_u8 > 0){
+    com_rslt = bma2x2_burst_read(BMA2x2_FIFO_DATA_OUTPUT_REG, v_data_u8, v_frame_count_u8 * BMA2x2_FIFO_FRAME_LEN);
+    if(0 != com_rslt) goto exit;
+  }
+  
+  switch (V_BMA2x2RESOLUTION_U8) {
+  case BMA2x2_12_RESOLUTION:
+    v_mask_u8 = BMA2x2_12_BIT_SHIFT;
+    v_shift_u8 = 4;
+    break;
+  case BMA2x2_10_RESOLUTION:
+    v_mask_u8 = BMA2x2_10_BIT_SHIFT;
+    v_shift_u8 = 6;
+    break;
+  default:
+    v_mask_u8 = BMA2x2_14_BIT_SHIFT;
+    v_shift_u8 = 2;
+    break;
+  }
+  for(i = 0; i < v_frame_count_u8 * 3; i++){
+    v_accel_xyz_s16[i] = (s16)((((s32)((s8)v_data_u8[2*i+1])) << 8) | (v_data_u8[2*i] & v_mask_u8)) >> v_shift_u8;
+  }
+  *frames = v_frame_count_u8;
+  err = kNoErr;
+  
+exit:
+  return err;
+}
+
 OSStatus bma2x2_sensor_deinit(void)
 {
   OSStatus err = kUnknownErr;
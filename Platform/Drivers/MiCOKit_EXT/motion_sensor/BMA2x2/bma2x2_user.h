@@ -47,4 +47,14 @@ OSStatus bma2x2_sensor_init(void);
 OSStatus bma2x2_data_readout(s16 *v_accel_x_s16, s16 *v_accel_y_s16, s16 *v_accel_z_s16);
 OSStatus bma2x2_sensor_deinit(void);
 
+/* FIFO in stream mode, frames are read in one I2C transfer */
+#define BMA2x2_FIFO_DEPTH        32
+#define BMA2x2_FIFO_FRAME_LEN    6
+#define BMA2x2_FIFO_XYZ          0
+#define BMA2x2_FIFO_STREAM       2
+
+OSStatus bma2x2_fifo_start(void);
+/* v_accel_xyz_s16 holds max_frames x,y,z frames, frames is set to the number read */
+OSStatus bma2x2_fifo_readout(s16 *v_accel_xyz_s16, uint8_t max_frames, uint8_t *frames);
+
 #endif
\ No newline at end of file
@@ -57,6 +57,14 @@ mico_i2c_device_t bmg160_i2c_device = {
  *	\param cnt : The no of byte of data to be read
  */
 s8 BMG160_I2C_bus_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u8 cnt);
+ /*	\Brief: The function is used as I2C burst read, all bytes are read in one transfer
+ *	\Return : Status of the I2C read
+ *	\param dev_addr : The device address of the sensor
+ *	\param reg_addr : Address of the first register, will data is going to be read
+ *	\param reg_data : This data read from the sensor, which is hold in an array
+ *	\param cnt : The no of byte of data to be read
+ */
+s8 BMG160_I2C_burst_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, s32 cnt);
  /*	\Brief: The function is used as I2C bus write
  *	\Return : Status of the I2C write
  *	\param dev_addr : The device address of the sensor
@@ -238,6 +246,7 @@ return com_rslt;
 
 	bmg160.bus_write = BMG160_I2C_bus_write;
 	bmg160.bus_read = BMG160_I2C_bus_read;
+	bmg160.burst_read = BMG160_I2C_burst_read;
 	bmg160.delay_msec = BMG160_delay_msek;
 	bmg160.dev_addr = BMG160_I2C_ADDR1;
 
@@ -356,6 +365,28 @@ s8 BMG160_I2C_bus_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, u8 cnt)
 	return (s8)iError;
 }
 
+ /*	\Brief: The function is used as I2C burst read, e.g. for the FIFO data register
+ *	\Return : Status of the I2C read
+ *	\param dev_addr : The device address of the sensor
+ *	\param reg_addr : Address of the first register, will data is going to be read
+ *	\param reg_data : This data read from the sensor, which is hold in an array
+ *	\param cnt : The no of byte of data to be read, all of them are read in one transfer
+ */
+s8 BMG160_I2C_burst_read(u8 dev_addr, u8 reg_addr, u8 *reg_data, s32 cnt)
+{
+        mico_i2c_message_t bmg160_i2c_msg = {NULL, NULL, 0, 0, 0, false};
+	s32 iError = BMG160_INIT_VALUE;
+	u8 array[1];
+	array[0] = reg_addr;
+
+        iError = MicoI2cBuildCombinedMessage(&bmg160_i2c_msg, array, reg_data, 1, (uint16_t)cnt, 3);
+        if(0 != iError){
+          return (s8)iError; 
+        }
+        iError = MicoI2cTransfer(&bmg160_i2c_device, &bmg160_i2c_msg, 1);
+	return (s8)iError;
+}
+
 /*	\Brief: The function is used as SPI bus read
  *	\Return : Status of the SPI read
  *	\param dev_addr : The device address of the sensor
@@ -497,6 +528,8 @@ exit:
 OSStatus bmg160_data_readout(s16 *v_gyro_datax_s16, s16 *v_gyro_datay_s16, s16 *v_gyro_dataz_s16)
 {
   OSStatus err = kUnknownErr;
+  /* structure used for read the sensor data - xyz*/
+  struct bmg160_data_t data_gyro;
   
   /* result of communication results*/
   s32 com_rslt = BMG160_ERROR;
@@ -508,13 +541,28 @@ OSStatus bmg160_data_readout(s16 *v_gyro_datax_s16, s16 *v_gyro_datay_s16, s16 *
     
   /************ START READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY DATA *********/
 
-  com_rslt = bmg160_get_data_X(v_gyro_datax_s16);/* Read the gyro X data*/
+  com_rslt = bmg160_get_data_XYZ(&data_gyro);/* Read the gyro XYZ data in one burst*/
 
-  com_rslt += bmg160_get_data_Y(v_gyro_datay_s16);/* Read the gyro Y data*/
+  *v_gyro_datax_s16 = data_gyro.datax;
+  *v_gyro_datay_s16 = data_gyro.datay;
+  *v_gyro_dataz_s16 = data_gyro.dataz;
+  /************ END READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY ********/
+  
+  if(0 == com_rslt){
+    err = kNoErr;
+  }
+  return err;
+}
 
-  com_rslt += bmg160_get_data_Z(v_gyro_dataz_s16);/* Read the gyro Z data*/
+OSStatus bmg160_fifo_start(void)
+{
+  OSStatus err = kUnknownErr;
+  s32 com_rslt = BMG160_ERROR;
   
-  /************ END READ TRUE PRESSURE, TEMPERATURE AND HUMIDITY ********/
+  MicoI2cInitialize(&bmg160_i2c_device);
+  
+  com_rslt = bmg160_set_fifo_data_select(BMG160_FIFO_XYZ);
+  com_rslt += bmg160_set_fifo_mode(BMG160_FIFO_STREAM);
   
   if(0 == com_rslt){
     err = kNoErr;
@@ -522,6 +570,37 @@ OSStatus bmg160_data_readout(s16 *v_gyro_datax_s16, s16 *v_gyro_datay_s16, s16 *
   return err;
 }
 
+OSStatus bmg160_fifo_readout(s16 *v_gyro_xyz_s16, uint8_t max_frames, uint8_t *frames)
+{
+  OSStatus err = kUnknownErr;
+  s32 com_rslt = BMG160_ERROR;
+  u8 *v_data_u8 = (u8 *)v_gyro_xyz_s16;
+  u8 v_frame_count_u8 = BMG160_INIT_VALUE;
+  u32 i;
+  
+  *frames = 0;
+  MicoI2cInitialize(&bmg160_i2c_device);
+  
+  com_rslt = bmg160_get_fifo_frame_count(&v_frame_count_u8);
+  if(0 != com_rslt) goto exit;
+  if(v_frame_count_u8 > max_frames) v_frame_count_u8 = max_frames;
+  
+  /* All frames in one burst from the FIFO data register, x,y,z LSB first, converted in place */
+  if(v_frame_count_u8 > 0){
+    com_rslt = bmg160_burst_read(BMG160_FIFO_DATA_ADDR, v_data_u8, v_frame_count_u8 * BMG160_FIFO_FRAME_LEN);
+    if(0 != com_rslt) goto exit;
+  }
+  
+  for(i = 0; i < v_frame_count_u8 * 3; i++){
+    v_gyro_xyz_s16[i] = (s16)((((s32)((s8)v_data_u8[2*i+1])) << 8) | v_data_u8[2*i]);
+  }
+  *frames = v_frame_count_u8;
+  err = kNoErr;
+  
+exit:
+  return err;
+}
+
 OSStatus bmg160_sensor_deinit(void)
 {
   OSStatus err = kUnknownErr;
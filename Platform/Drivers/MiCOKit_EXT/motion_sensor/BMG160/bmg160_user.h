@@ -47,6 +47,16 @@ OSStatus bmg160_sensor_init(void);
 OSStatus bmg160_data_readout(s16 *v_gyro_datax_s16, s16 *v_gyro_datay_s16, s16 *v_gyro_dataz_s16);
 OSStatus bmg160_sensor_deinit(void);
 
+/* FIFO in stream mode, frames are read in one I2C transfer */
+#define BMG160_FIFO_DEPTH        100
+#define BMG160_FIFO_FRAME_LEN    6
+#define BMG160_FIFO_XYZ          0
+#define BMG160_FIFO_STREAM       2
+
+OSStatus bmg160_fifo_start(void);
+/* v_gyro_xyz_s16 holds max_frames x,y,z frames, frames is set to the number read */
+OSStatus bmg160_fifo_readout(s16 *v_gyro_xyz_s16, uint8_t max_frames, uint8_t *frames);
+
 #endif
 
 
@@ -32,6 +32,19 @@
 #include "bmg160/bmg160_user.h"
 #include "bmm050/bmm050_user.h"
 #include "motion_sensor.h"
+#include "mico_rtos.h"
+#include "RingBufferUtils.h"
+
+#define MOTION_SAMPLING_STACK_SIZE    0x400
+
+static spsc_ring_buffer_t motion_sample_ring;
+static mico_thread_t motion_sampling_thread = NULL;
+static volatile bool motion_sampling_running = false;
+static uint32_t motion_sampling_interval;
+static uint32_t motion_samples_dropped = 0;
+static uint32_t motion_accel_time, motion_gyro_time, motion_mag_time;
+/* FIFO frames of one poll, only used by the sampling thread */
+static s16 motion_fifo_frames[BMG160_FIFO_DEPTH * 3];
 
 OSStatus motion_sensor_init(void)
 {
@@ -70,7 +83,7 @@ OSStatus motion_sensor_readout(motion_data_t *motion_data)
   require_noerr( err, exit );
   
   /* triaxial geomagnetic sensor data read*/
-  err = bmm050_data_readout(&motion_data->mag_data.mag_dataz,
+  err = bmm050_data_readout(&motion_data->mag_data.mag_datax,
                             &motion_data->mag_data.mag_datay,
                             &motion_data->mag_data.mag_dataz);
   require_noerr( err, exit );
@@ -99,5 +112,106 @@ exit:
   return err;
 }
 
+static void motion_sample_push(uint8_t sensor, const s16 *xyz, uint32_t frames, uint32_t *last_time, uint32_t now)
+{
+  motion_sample_t sample;
+  uint32_t i;
+  
+  sample.sensor = sensor;
+  for(i = 0; i < frames; i++){
+    sample.timestamp = *last_time + (now - *last_time) * (i + 1) / frames;
+    sample.x = xyz[3*i];
+    sample.y = xyz[3*i + 1];
+    sample.z = xyz[3*i + 2];
+    if(spsc_ring_buffer_free_space(&motion_sample_ring) < sizeof(motion_sample_t)){
+      motion_samples_dropped++;
+      continue;
+    }
+    spsc_ring_buffer_write(&motion_sample_ring, (uint8_t *)&sample, sizeof(motion_sample_t));
+  }
+  *last_time = now;
+}
 
+static void motion_sampling_thread_func(void *arg)
+{
+  uint8_t frames;
+  uint32_t now;
+  UNUSED_PARAMETER(arg);
+  
+  motion_accel_time = motion_gyro_time = motion_mag_time = mico_get_time();
+  
+  while(motion_sampling_running){
+    now = mico_get_time();
+    
+    if(kNoErr == bma2x2_fifo_readout(motion_fifo_frames, BMA2x2_FIFO_DEPTH, &frames))
+      motion_sample_push(MOTION_SENSOR_ACCEL, motion_fifo_frames, frames, &motion_accel_time, now);
+    
+    if(kNoErr == bmg160_fifo_readout(motion_fifo_frames, BMG160_FIFO_DEPTH, &frames))
+      motion_sample_push(MOTION_SENSOR_GYRO, motion_fifo_frames, frames, &motion_gyro_time, now);
+    
+    /* BMM050 has no FIFO, read the latest data */
+    if(kNoErr == bmm050_data_readout(&motion_fifo_frames[0], &motion_fifo_frames[1], &motion_fifo_frames[2]))
+      motion_sample_push(MOTION_SENSOR_MAG, motion_fifo_frames, 1, &motion_mag_time, now);
+    
+    mico_thread_msleep(motion_sampling_interval);
+  }
+  
+  mico_rtos_delete_thread(NULL);
+}
 
+OSStatus motion_sensor_sampling_start(uint8_t *buffer, uint32_t size, uint32_t interval_ms)
+{
+  OSStatus err = kUnknownErr;
+  
+  require_action(motion_sampling_thread == NULL, exit, err = kAlreadyInUseErr);
+  
+  err = spsc_ring_buffer_init(&motion_sample_ring, buffer, size);
+  require_noerr( err, exit );
+  require_action(size >= sizeof(motion_sample_t), exit, err = kSizeErr);
+  
+  err = bma2x2_fifo_start();
+  require_noerr( err, exit );
+  
+  err = bmg160_fifo_start();
+  require_noerr( err, exit );
+  
+  motion_sampling_interval = interval_ms;
+  motion_samples_dropped = 0;
+  motion_sampling_running = true;
+  err = mico_rtos_create_thread(&motion_sampling_thread, MICO_APPLICATION_PRIORITY, "Motion sampling", 
+                                motion_sampling_thread_func, MOTION_SAMPLING_STACK_SIZE, NULL);
+  if(err != kNoErr){
+    motion_sampling_running = false;
+    motion_sampling_thread = NULL;
+  }
+  
+exit:
+  return err;
+}
+
+uint32_t motion_sensor_sampling_read(motion_sample_t *samples, uint32_t max_samples)
+{
+  uint32_t count = spsc_ring_buffer_used_space(&motion_sample_ring) / sizeof(motion_sample_t);
+  
+  if(count > max_samples) count = max_samples;
+  return spsc_ring_buffer_read(&motion_sample_ring, (uint8_t *)samples, count * sizeof(motion_sample_t)) / sizeof(motion_sample_t);
+}
+
+uint32_t motion_sensor_sampling_dropped(void)
+{
+  return motion_samples_dropped;
+}
+
+OSStatus motion_sensor_sampling_stop(void)
+{
+  OSStatus err = kNoErr;
+  
+  require_quiet(motion_sampling_thread, exit);
+  
+  motion_sampling_running = false;
+  err = mico_rtos_thread_join(&motion_sampling_thread);
+  motion_sampling_thread = NULL;
+  
+exit:
+  return err;
+}
@@ -62,6 +62,30 @@ OSStatus motion_sensor_init(void);
 OSStatus motion_sensor_readout(motion_data_t *motion_data);
 OSStatus motion_sensor_deinit(void);
 
+/* Burst sampling: a thread drains the accelerometer and gyroscope FIFOs and reads the magnetometer,
+   each in one I2C burst per poll, and pushes timestamped samples to a lock-free ring buffer that is
+   read by the application thread. Call motion_sensor_init() first. */
+typedef enum {
+  MOTION_SENSOR_ACCEL,
+  MOTION_SENSOR_GYRO,
+  MOTION_SENSOR_MAG,
+} motion_sensor_type_t;
+
+typedef struct _motion_sample_t {
+  uint32_t     timestamp;     // ms, samples from a FIFO are spread over the time since the last poll
+  uint8_t      sensor;        // motion_sensor_type_t
+  int16_t      x;
+  int16_t      y;
+  int16_t      z;
+} motion_sample_t;
+
+// buffer holds the samples not read yet, size must be a power of two. 
+OSStatus motion_sensor_sampling_start(uint8_t *buffer, uint32_t size, uint32_t interval_ms);
+uint32_t motion_sensor_sampling_read(motion_sample_t *samples, uint32_t max_samples);
+// Samples lost because the application did not read them in time
+uint32_t motion_sensor_sampling_dropped(void);
+OSStatus motion_sensor_sampling_stop(void);
+
 #endif  // __TEMP_HUM_SENSOR_H_
 
 
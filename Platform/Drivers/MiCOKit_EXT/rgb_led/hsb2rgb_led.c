@@ -21,106 +21,124 @@
 
 #include "Common.h"
 #include "debug.h"
+#include "mico_rtos.h"
 #include "hsb2rgb_led.h"
 #include "rgb_led.h"
 
 #define hsb2rgb_led_log(M, ...) custom_log("HSB2RGB_LED", M, ##__VA_ARGS__)
 #define hsb2rgb_led_log_trace() custom_log_trace("HSB2RGB_LED")
 
-#define H2R_MAX_RGB_val 255.0f
+#define H2R_MAX_RGB_val 255UL
 
-static float constrain(float value, float min, float max){
+// hue, saturation and brightness are handled in 1/10 units: 0~3600, 0~1000, 0~1000
+#define H2R_HUE_MAX      3600
+#define H2R_HUE_SECTOR   1200
+#define H2R_PERCENT_MAX  1000
+
+// a fade pushes a new frame to the LED every H2R_FADE_PERIOD_MS or slower
+#define H2R_FADE_PERIOD_MS     10
+#define H2R_FADE_MAX_FRAMES    100
+
+enum {
+  H2R_HUE_SECONDARY_TERM = 0,   // 1 - hue_secondary * sat
+  H2R_HUE_PRIMARY_TERM,         // 1 - hue_primary * sat
+  H2R_SAT_TERTIARY_TERM,        // 1 - sat
+};
+
+// term that drives red, green and blue in each 120 degree hue sector
+static const uint8_t H2R_SECTOR_MAP[3][3] = {
+  { H2R_HUE_SECONDARY_TERM, H2R_HUE_PRIMARY_TERM, H2R_SAT_TERTIARY_TERM },
+  { H2R_SAT_TERTIARY_TERM, H2R_HUE_SECONDARY_TERM, H2R_HUE_PRIMARY_TERM },
+  { H2R_HUE_PRIMARY_TERM, H2R_SAT_TERTIARY_TERM, H2R_HUE_SECONDARY_TERM },
+};
+
+// gamma 2.2 correction: 255 * (value / 255) ^ 2.2
+static const uint8_t H2R_GAMMA_TABLE[256] = {
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+    6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+   12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+   20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+   30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+   42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+   56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+   73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+   91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+  113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+  137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+  163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+  192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+  223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+static bool h2r_gamma_enabled = false;
+
+// color on the LED in 1/10 units, the start point of the next fade
+static uint16_t h2r_current[3] = {0};
+
+static mico_timer_t h2r_fade_timer;
+static bool h2r_fade_timer_inited = false;
+static uint8_t h2r_fade_frames[H2R_FADE_MAX_FRAMES][3];
+static uint16_t h2r_fade_from[3];
+static int16_t h2r_fade_delta[3];
+static uint16_t h2r_fade_count = 0;
+static volatile uint16_t h2r_fade_index = 0;
+
+static uint16_t constrain(uint16_t value, uint16_t max){
   if(value >= max)
     return max;
-  if(value <=min )
-    return min;
   return value;
 }
 
-//float Percent(float value){
-//  return value = (((float)value / 255.0) * 100.0);
-//}
-
-static void H2R_HSBtoRGB(float hue, float sat, float bright, float *color) {
-  // constrain all input variables to expected range
-  hue = constrain(hue, 0, 360);
-  sat = constrain(sat, 0, 100);
-  bright = constrain(bright, 0, 100);
-  // define maximum value for RGB array elements
-  float max_rgb_val = H2R_MAX_RGB_val;
-  // convert saturation and brightness value to decimals and init r, g, b variables
-  float sat_f = (float)sat / 100.0f;
-  float bright_f = (float)bright / 100.0f;
-  float r, g, b;
-  // If brightness is 0 then color is black (achromatic)
-  // therefore, R, G and B values will all equal to 0
-  if (bright <= 0) {
-    color[0] = 0;
-    color[1] = 0;
-    color[2] = 0;
-  }
-  // If saturation is 0 then color is gray (achromatic)
-  // therefore, R, G and B values will all equal the current brightness
-  if (sat <= 0) {
-    color[0] = bright_f * max_rgb_val;
-    color[1] = bright_f * max_rgb_val;
-    color[2] = bright_f * max_rgb_val;
-  }
-  // if saturation and brightness are greater than 0 then calculate
-  // R, G and B values based on the current hue and brightness
-  else {
-    if (hue >= 0 && hue < 120) {
-      float hue_primary = 1.0f - ((float)hue / 120.0f);
-      float hue_secondary = (float)hue / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-      g = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-      b = (bright_f * max_rgb_val) * sat_tertiary;
-    }
-    else if (hue >= 120 && hue < 240) {
-      float hue_primary = 1.0f - (((float)hue-120.0f) / 120.0f);
-      float hue_secondary = ((float)hue-120.0f) / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * sat_tertiary;
-      g = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-      b = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-    }
-    else if (hue >= 240 && hue <= 360) {
-      float hue_primary = 1.0f - (((float)hue-240.0f) / 120.0f);
-      float hue_secondary = ((float)hue-240.0f) / 120.0f;
-      float sat_primary = (1.0f - hue_primary) * (1.0f - sat_f);
-      float sat_secondary = (1.0f - hue_secondary) * (1.0f - sat_f);
-      float sat_tertiary = 1.0f - sat_f;
-      r = (bright_f * max_rgb_val) * (hue_secondary + sat_secondary);
-      g = (bright_f * max_rgb_val) * sat_tertiary;
-      b = (bright_f * max_rgb_val) * (hue_primary + sat_primary);
-    }
-    color[0] = r;
-    color[1] = g;
-    color[2] = b;
+static uint16_t constrain_float(float value, float max){
+  if(value >= max)
+    value = max;
+  if(value <= 0)
+    return 0;
+  return (uint16_t)(value * 10.0f + 0.5f);
+}
+
+// Integer version of the HSB model used by this driver: every channel is
+// bright * (1 - x * sat), x being hue_secondary, hue_primary or 1 in a sector.
+static void H2R_HSBtoRGB(uint16_t hue, uint16_t sat, uint16_t bright, uint8_t *color) {
+  uint32_t sector, hue_secondary, sat_q15, bright_q8, term[3];
+  uint8_t i;
+  
+  // constrain all input variables to expected range, hue 360 equals hue 0
+  hue = constrain(hue, H2R_HUE_MAX);
+  sat = constrain(sat, H2R_PERCENT_MAX);
+  bright = constrain(bright, H2R_PERCENT_MAX);
+  if (hue == H2R_HUE_MAX)
+    hue = 0;
+  
+  sector = hue / H2R_HUE_SECTOR;
+  // Q15 of (hue - sector start) / 120, 27962 / 1024 is 32768 / 1200
+  hue_secondary = ((hue - sector * H2R_HUE_SECTOR) * 27962UL) >> 10;
+  sat_q15 = ((uint32_t)sat << 15) / H2R_PERCENT_MAX;
+  // Q8 of the brightness scaled to 0~255
+  bright_q8 = ((uint32_t)bright * (H2R_MAX_RGB_val << 8)) / H2R_PERCENT_MAX;
+  
+  term[H2R_HUE_SECONDARY_TERM] = (1UL << 15) - ((hue_secondary * sat_q15) >> 15);
+  term[H2R_HUE_PRIMARY_TERM] = (1UL << 15) - ((((1UL << 15) - hue_secondary) * sat_q15) >> 15);
+  term[H2R_SAT_TERTIARY_TERM] = (1UL << 15) - sat_q15;
+  
+  for (i = 0; i < 3; i++) {
+    color[i] = (uint8_t)((((bright_q8 * term[H2R_SECTOR_MAP[sector][i]]) >> 15) + 0x80) >> 8);
+    if (h2r_gamma_enabled)
+      color[i] = H2R_GAMMA_TABLE[color[i]];
   }
-  //  color[0] = Percent(color[0]);
-  //  color[1] = Percent(color[1]);
-  //  color[2] = Percent(color[2]);
 }
 
 /*----------------------------------------------------- INTERNAL FUNCTION  ---------------------------------------*/
 
 // call RGB LED driver to control LED
-static void OpenLED_RGB(float *color)
+static void OpenLED_RGB(uint8_t *color)
 {
-  uint8_t blue = (uint8_t)(color[2]);
-  uint8_t green = (uint8_t)(color[1]);
-  uint8_t red = (uint8_t)(color[0]);
-  
-  //hsb2rgb_led_log("OpenLED_RGB: red=%d, green=%d, blue=%d.", red, green, blue);
+  //hsb2rgb_led_log("OpenLED_RGB: red=%d, green=%d, blue=%d.", color[0], color[1], color[2]);
   
   rgb_led_init();
-  rgb_led_open(red, green, blue);
+  rgb_led_open(color[0], color[1], color[2]);
 }
 
 static void CloseLED_RGB()
@@ -129,6 +147,48 @@ static void CloseLED_RGB()
   rgb_led_close();
 }
 
+// hue, saturation and brightness after index frames of the fade
+static void H2R_FadeStep(uint16_t index, uint16_t *hsb)
+{
+  int32_t value;
+  uint8_t i;
+  
+  for (i = 0; i < 3; i++) {
+    value = h2r_fade_from[i] + (int32_t)h2r_fade_delta[i] * index / h2r_fade_count;
+    if (i == 0 && value < 0)
+      value += H2R_HUE_MAX;
+    else if (i == 0 && value >= H2R_HUE_MAX)
+      value -= H2R_HUE_MAX;
+    hsb[i] = (uint16_t)value;
+  }
+}
+
+// frames are computed ahead, the timer only pushes them to the LED
+static void _h2r_fade_timeout_handler( void* arg )
+{
+  (void)(arg);
+  uint16_t index = h2r_fade_index;
+  
+  if (index < h2r_fade_count) {
+    rgb_led_open(h2r_fade_frames[index][0], h2r_fade_frames[index][1], h2r_fade_frames[index][2]);
+    h2r_fade_index = ++index;
+  }
+  if (index >= h2r_fade_count)
+    mico_stop_timer(&h2r_fade_timer);
+}
+
+static void H2R_SetColor(uint16_t hue, uint16_t sat, uint16_t bright)
+{
+  uint8_t color[3];
+  
+  hsb2rgb_led_fade_stop();
+  h2r_current[0] = constrain(hue, H2R_HUE_MAX);
+  h2r_current[1] = constrain(sat, H2R_PERCENT_MAX);
+  h2r_current[2] = constrain(bright, H2R_PERCENT_MAX);
+  H2R_HSBtoRGB(hue, sat, bright, color);
+  OpenLED_RGB(color);
+}
+
 
 /*----------------------------------------------------- USER INTERFACES ---------------------------------------*/
 
@@ -139,12 +199,85 @@ void hsb2rgb_led_init(void)
 
 void hsb2rgb_led_open(float hues, float saturation, float brightness)
 {
-  float color[3] = {0};
-  H2R_HSBtoRGB(hues, saturation, brightness, color);
-  OpenLED_RGB(color);
+  H2R_SetColor(constrain_float(hues, 360), constrain_float(saturation, 100), constrain_float(brightness, 100));
+}
+
+void hsb2rgb_led_open_fixed(uint16_t hues, uint8_t saturation, uint8_t brightness)
+{
+  H2R_SetColor(constrain(hues, 360) * 10, constrain(saturation, 100) * 10, constrain(brightness, 100) * 10);
+}
+
+void hsb2rgb_led_set_gamma(bool enable)
+{
+  h2r_gamma_enabled = enable;
+}
+
+OSStatus hsb2rgb_led_fade(uint16_t hues, uint8_t saturation, uint8_t brightness, uint32_t duration_ms)
+{
+  OSStatus err = kNoErr;
+  uint16_t target[3], hsb[3], i;
+  int32_t hue_delta;
+  
+  hsb2rgb_led_fade_stop();
+  
+  target[0] = constrain(hues, 360) * 10;
+  target[1] = constrain(saturation, 100) * 10;
+  target[2] = constrain(brightness, 100) * 10;
+  
+  if (duration_ms < H2R_FADE_PERIOD_MS) {
+    H2R_SetColor(target[0], target[1], target[2]);
+    goto exit;
+  }
+  
+  // hue goes the short way round the color wheel
+  hue_delta = (int32_t)target[0] - h2r_current[0];
+  if (hue_delta > H2R_HUE_MAX / 2)
+    hue_delta -= H2R_HUE_MAX;
+  else if (hue_delta < -H2R_HUE_MAX / 2)
+    hue_delta += H2R_HUE_MAX;
+  
+  for (i = 0; i < 3; i++)
+    h2r_fade_from[i] = h2r_current[i];
+  h2r_fade_delta[0] = (int16_t)hue_delta;
+  h2r_fade_delta[1] = (int16_t)target[1] - (int16_t)h2r_current[1];
+  h2r_fade_delta[2] = (int16_t)target[2] - (int16_t)h2r_current[2];
+  
+  h2r_fade_count = (duration_ms / H2R_FADE_PERIOD_MS >= H2R_FADE_MAX_FRAMES)? H2R_FADE_MAX_FRAMES : (uint16_t)(duration_ms / H2R_FADE_PERIOD_MS);
+  for (i = 0; i < h2r_fade_count; i++) {
+    H2R_FadeStep(i + 1, hsb);
+    H2R_HSBtoRGB(hsb[0], hsb[1], hsb[2], h2r_fade_frames[i]);
+  }
+  h2r_fade_index = 0;
+  
+  if (h2r_fade_timer_inited) {
+    mico_deinit_timer(&h2r_fade_timer);
+    h2r_fade_timer_inited = false;
+  }
+  err = mico_init_timer(&h2r_fade_timer, duration_ms / h2r_fade_count, _h2r_fade_timeout_handler, NULL);
+  require_noerr_action(err, exit, h2r_fade_count = 0);
+  h2r_fade_timer_inited = true;
+  
+  rgb_led_init();
+  err = mico_start_timer(&h2r_fade_timer);
+  require_noerr_action(err, exit, h2r_fade_count = 0);
+  
+exit:
+  return err;
+}
+
+void hsb2rgb_led_fade_stop(void)
+{
+  if (h2r_fade_count == 0)
+    return;
+  
+  mico_stop_timer(&h2r_fade_timer);
+  H2R_FadeStep(h2r_fade_index, h2r_current);
+  h2r_fade_count = 0;
 }
 
 void hsb2rgb_led_close(void)
 {
+  hsb2rgb_led_fade_stop();
+  h2r_current[2] = 0;
   CloseLED_RGB();
 }
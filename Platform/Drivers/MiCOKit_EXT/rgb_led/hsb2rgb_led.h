@@ -24,9 +24,21 @@
 #define __HSB2RGB_LED_H_
 
 
+#include "Common.h"
+
 void hsb2rgb_led_init(void);
 void hsb2rgb_led_open(float hues, float saturation, float brightness);
 void hsb2rgb_led_close(void);
 
+/* integer conversion without float math, hues: 0~360, saturation: 0~100, brightness: 0~100 */
+void hsb2rgb_led_open_fixed(uint16_t hues, uint8_t saturation, uint8_t brightness);
+/* apply gamma 2.2 correction to the RGB output, disabled by default */
+void hsb2rgb_led_set_gamma(bool enable);
+
+/* fade from the current color to the target in duration_ms, all frames are
+ * computed at once and pushed to the LED by a timer */
+OSStatus hsb2rgb_led_fade(uint16_t hues, uint8_t saturation, uint8_t brightness, uint32_t duration_ms);
+void hsb2rgb_led_fade_stop(void);
+
 
 #endif   // __HSB2RGB_LED_H_
\ No newline at end of file
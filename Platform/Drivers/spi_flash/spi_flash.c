@@ -33,9 +33,19 @@
 #include "spi_flash.h"
 #include "spi_flash_internal.h"
 #include "spi_flash_platform_interface.h"
+#include "mico_rtos.h"
 #include <string.h> /* for NULL */
 
 #define sFLASH_SPI_PAGESIZE       0x100
+#define sFLASH_SPI_SECTORSIZE     0x1000
+#define sFLASH_SPI_BLOCKSIZE      0x10000
+
+/* A page program is done well within one tick, so it is polled back to back.
+ * The budget follows the number of reads the last page took, within these bounds. */
+#define sFLASH_PROGRAM_SPIN_MIN   16
+#define sFLASH_PROGRAM_SPIN_MAX   1024
+
+static unsigned int sflash_program_spin_polls = 128;
 
 int sflash_read_ID( const sflash_handle_t* const handle, void* const data_addr )
 {
@@ -93,7 +103,7 @@ int sflash_chip_erase( const sflash_handle_t* const handle )
     return generic_sflash_command( handle, SFLASH_CHIP_ERASE1, 0, NULL, 0, NULL, NULL );
 }
 
-int sflash_sector_erase ( const sflash_handle_t* const handle, unsigned long device_address )
+static int sflash_erase_command( const sflash_handle_t* const handle, sflash_command_t cmd, unsigned long device_address )
 {
 
     char device_address_array[3] =  { ( ( device_address & 0x00FF0000 ) >> 16 ),
@@ -106,11 +116,53 @@ int sflash_sector_erase ( const sflash_handle_t* const handle, unsigned long dev
     {
         return status;
     }
-    retval = generic_sflash_command( handle, SFLASH_SECTOR_ERASE, 3, device_address_array, 0, NULL, NULL );
+    retval = generic_sflash_command( handle, cmd, 3, device_address_array, 0, NULL, NULL );
     check_string(retval == 0, "SPI Flash erase error");
     return retval;
 }
 
+int sflash_sector_erase ( const sflash_handle_t* const handle, unsigned long device_address )
+{
+    return sflash_erase_command( handle, SFLASH_SECTOR_ERASE, device_address );
+}
+
+int sflash_block_erase ( const sflash_handle_t* const handle, unsigned long device_address )
+{
+    return sflash_erase_command( handle, SFLASH_BLOCK_ERASE_LARGE, device_address );
+}
+
+/* Erases every 4KB sector that overlaps [device_address, device_address + size).
+ * Whole aligned 64KB blocks inside the range go with one block erase, which takes
+ * far less time than the sixteen sector erases it replaces. */
+int sflash_erase( const sflash_handle_t* const handle, unsigned long device_address, unsigned long size )
+{
+    int status;
+    unsigned long end_address = ( device_address + size + sFLASH_SPI_SECTORSIZE - 1 ) & ~( (unsigned long) sFLASH_SPI_SECTORSIZE - 1 );
+
+    device_address &= ~( (unsigned long) sFLASH_SPI_SECTORSIZE - 1 );
+
+    while ( device_address < end_address )
+    {
+        if ( ( device_address % sFLASH_SPI_BLOCKSIZE ) == 0 && ( end_address - device_address ) >= sFLASH_SPI_BLOCKSIZE )
+        {
+            status = sflash_block_erase( handle, device_address );
+            device_address += sFLASH_SPI_BLOCKSIZE;
+        }
+        else
+        {
+            status = sflash_sector_erase( handle, device_address );
+            device_address += sFLASH_SPI_SECTORSIZE;
+        }
+
+        if ( status != 0 )
+        {
+            return status;
+        }
+    }
+
+    return 0;
+}
+
 int sflash_read_status_register( const sflash_handle_t* const handle, void* const dest_addr )
 {
     return generic_sflash_command( handle, SFLASH_READ_STATUS_REGISTER, 0, NULL, 1, NULL, dest_addr );
@@ -191,78 +243,73 @@ int sflash_get_size( const sflash_handle_t* const handle, /*@out@*/ unsigned lon
 }
 
 
-int sflash_write_page( const sflash_handle_t* const handle, unsigned long device_address, const void* const data_addr, int size )
+/* Number of bytes one program command may carry. Most parts take a whole
+ * page, some only program a byte at a time. */
+static unsigned int sflash_max_program_size( const sflash_handle_t* const handle )
 {
-    int status;
-    int write_size;
-    int max_write_size = 256;
-    unsigned char enable_before_every_write = 1;
-    unsigned char* data_addr_ptr = (unsigned char*) data_addr;
-    unsigned char curr_device_address[3];
-
-    if ( handle->write_allowed == SFLASH_WRITE_ALLOWED )
-    {
-    }
-    else
-    {
-        return -1;
-    }
-
-    /* Some manufacturers support programming an entire page in one command. */
-
-#ifdef SFLASH_SUPPORT_MACRONIX_PARTS
-    if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_MACRONIX )
-    {
-        max_write_size = 256;  /* TODO: this should be 256, but that causes write errors */
-        enable_before_every_write = 1;
-    }
-#endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
-
-#ifdef SFLASH_SUPPORT_WINBOND_PARTS
-    if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_WINBOND )
-    {
-        max_write_size = 256;  /* TODO: this should be 256, but that causes write errors */
-        enable_before_every_write = 1;
-    }
-#endif /* ifdef SFLASH_SUPPORT_MACRONIX_PARTS */
+    unsigned int max_write_size = sFLASH_SPI_PAGESIZE;
 
 #ifdef SFLASH_SUPPORT_SST_PARTS
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_SST )
     {
         max_write_size = 1;
-        enable_before_every_write = 1;
     }
 #endif /* ifdef SFLASH_SUPPORT_SST_PARTS */
 #ifdef SFLASH_SUPPORT_EON_PARTS
     if ( SFLASH_MANUFACTURER( handle->device_id ) == SFLASH_MANUFACTURER_EON )
     {
-        max_write_size = (unsigned int) 1;
-        enable_before_every_write = 1;
+        max_write_size = 1;
     }
 #endif /* ifdef SFLASH_SUPPORT_EON_PARTS */
 
+    return max_write_size;
+}
+
+/**
+  * @brief  Writes block of data to the FLASH. The block is split on page
+  *         boundaries and write protection is checked once for the whole
+  *         block, so every page costs one write-enable, one program command
+  *         and the busy poll.
+  * @param  data_addr: pointer to the buffer containing the data to be written
+  *         to the FLASH.
+  * @param  device_address: FLASH's internal address to write to.
+  * @param  size: number of bytes to write to the FLASH, any length.
+  * @retval 0 on success, the status of the first failing command otherwise
+  */
+int sflash_write( const sflash_handle_t* const handle, unsigned long device_address, const void* const data_addr, unsigned int size )
+{
+    int status;
+    unsigned int write_size;
+    unsigned int max_write_size;
+    const unsigned char* data_addr_ptr = (const unsigned char*) data_addr;
+    unsigned char curr_device_address[3];
+
+    if ( size == 0 )
+    {
+        return 0;
+    }
 
-    if ( ( enable_before_every_write == 0 ) &&
-         ( 0 != ( status = sflash_write_enable( handle ) ) ) )
+    /* Clears block protection if needed and leaves the latch set for the first page */
+    if ( 0 != ( status = sflash_write_enable( handle ) ) )
     {
         return status;
     }
 
-    /* Generic x-bytes-at-a-time write */
+    max_write_size = sflash_max_program_size( handle );
 
-    while ( size > 0 )
+    while ( 1 )
     {
-        write_size = ( size > max_write_size )? max_write_size : size;
+        /* A program command wraps at the end of its page, stop there */
+        write_size = max_write_size - (unsigned int) ( device_address % max_write_size );
+        if ( write_size > size )
+        {
+            write_size = size;
+        }
+
         curr_device_address[0] = ( ( device_address & 0x00FF0000 ) >> 16 );
         curr_device_address[1] = ( ( device_address & 0x0000FF00 ) >>  8 );
         curr_device_address[2] = ( ( device_address & 0x000000FF ) >>  0 );
 
-        if ( ( enable_before_every_write == 1 ) &&
-             ( 0 != ( status = sflash_write_enable( handle ) ) ) )
-        {
-            return status;
-        }
-
         if ( 0 != ( status = generic_sflash_command( handle, SFLASH_WRITE, 3, curr_device_address, write_size, data_addr_ptr, NULL ) ) )
         {
             return status;
@@ -272,98 +319,17 @@ int sflash_write_page( const sflash_handle_t* const handle, unsigned long device
         device_address += write_size;
         size -= write_size;
 
-    }
-
-    return 0;
-}
+        if ( size == 0 )
+        {
+            return 0;
+        }
 
-/**
-  * @brief  Writes block of data to the FLASH. In this function, the number of
-  *         WRITE cycles are reduced, using Page WRITE sequence.
-  * @param  pBuffer: pointer to the buffer  containing the data to be written
-  *         to the FLASH.
-  * @param  WriteAddr: FLASH's internal address to write to.
-  * @param  NumByteToWrite: number of bytes to write to the FLASH.
-  * @retval None
-  */
-int sflash_write( const sflash_handle_t* const handle, unsigned long device_address, const void* const data_addr, unsigned int size )
-{
-  int status;
-  uint8_t NumOfPage = 0, NumOfSingle = 0, Addr = 0, count = 0, temp = 0;
-  unsigned char* data_addr_ptr = (unsigned char*) data_addr;
-
-  Addr = device_address % sFLASH_SPI_PAGESIZE;
-  count = sFLASH_SPI_PAGESIZE - Addr;
-  NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-  NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-  if (Addr == 0) /*!< WriteAddr is sFLASH_PAGESIZE aligned  */
-  {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
-    {
-      status = sflash_write_page( handle, device_address, data_addr_ptr, size );
-      //sFLASH_WritePage(pBuffer, WriteAddr, NumByteToWrite);
-    }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
-    {
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle);
-    }
-  }
-  else /*!< WriteAddr is not sFLASH_PAGESIZE aligned  */
-  {
-    if (NumOfPage == 0) /*!< NumByteToWrite < sFLASH_PAGESIZE */
-    {
-      if (NumOfSingle > count) /*!< (NumByteToWrite + WriteAddr) > sFLASH_PAGESIZE */
-      {
-        temp = NumOfSingle - count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-        //sFLASH_WritePage(pBuffer, WriteAddr, count);
-        device_address +=  count;
-        data_addr_ptr += count;
-
-        status = sflash_write_page( handle, device_address, data_addr_ptr, temp);
-      }
-      else
-      {
-        status = sflash_write_page(handle, device_address, data_addr_ptr, size);
-      }
-    }
-    else /*!< NumByteToWrite > sFLASH_PAGESIZE */
-    {
-      size -= count;
-      NumOfPage =  size / sFLASH_SPI_PAGESIZE;
-      NumOfSingle = size % sFLASH_SPI_PAGESIZE;
-
-      status = sflash_write_page( handle, device_address, data_addr_ptr, count );
-      //sFLASH_WritePage(pBuffer, WriteAddr, count);
-      device_address +=  count;
-      data_addr_ptr += count;
-
-      while (NumOfPage--)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, sFLASH_SPI_PAGESIZE );
-        //sFLASH_WritePage(pBuffer, WriteAddr, sFLASH_SPI_PAGESIZE);
-        device_address +=  sFLASH_SPI_PAGESIZE;
-        data_addr_ptr += sFLASH_SPI_PAGESIZE;
-      }
-
-      if (NumOfSingle != 0)
-      {
-        status = sflash_write_page( handle, device_address, data_addr_ptr, NumOfSingle );
-        //sFLASH_WritePage(pBuffer, WriteAddr, NumOfSingle);
-      }
+        /* The write enable latch clears at the end of every program */
+        if ( 0 != ( status = generic_sflash_command( handle, SFLASH_WRITE_ENABLE, 0, NULL, 0, NULL, NULL ) ) )
+        {
+            return status;
+        }
     }
-  }
-  return status;
 }
 
 int sflash_write_status_register( const sflash_handle_t* const handle, char value )
@@ -431,6 +397,69 @@ static inline int is_write_command( sflash_command_t cmd )
              ( cmd == SFLASH_BLOCK_ERASE_LARGE ) )? 1 : 0;
 }
 
+/* Waits until the chip has finished a write command. Page programs are polled
+ * back to back for twice as many reads as the previous page needed, after that
+ * (and straight away for erases, which take tens of milliseconds up to seconds)
+ * the thread sleeps between status reads, doubling the interval up to a cap
+ * that grows with the size of the erase. */
+static int sflash_wait_ready( const sflash_handle_t* const handle, sflash_command_t cmd )
+{
+    int status;
+    unsigned char status_register;
+    unsigned int spin_polls = 0;
+    unsigned int reads = 0;
+    uint32_t sleep_ms = 1;
+    uint32_t max_sleep_ms;
+
+    switch ( cmd )
+    {
+        case SFLASH_WRITE:
+            spin_polls   = sflash_program_spin_polls;
+            max_sleep_ms = 1;
+            break;
+        case SFLASH_SECTOR_ERASE:
+            max_sleep_ms = 8;
+            break;
+        case SFLASH_BLOCK_ERASE_MID:
+        case SFLASH_BLOCK_ERASE_LARGE:
+            max_sleep_ms = 32;
+            break;
+        default:
+            max_sleep_ms = 256;
+            break;
+    }
+
+    while ( 1 )
+    {
+        status = sflash_read_status_register( handle, &status_register );
+        if ( status != 0 )
+        {
+            return status;
+        }
+        reads++;
+
+        if ( ( status_register & SFLASH_STATUS_REGISTER_BUSY ) == (unsigned char) 0 )
+        {
+            if ( cmd == SFLASH_WRITE )
+            {
+                reads *= 2;
+                sflash_program_spin_polls = ( reads < sFLASH_PROGRAM_SPIN_MIN ) ? sFLASH_PROGRAM_SPIN_MIN :
+                                            ( reads > sFLASH_PROGRAM_SPIN_MAX ) ? sFLASH_PROGRAM_SPIN_MAX : reads;
+            }
+            return 0;
+        }
+
+        if ( spin_polls > 0 )
+        {
+            spin_polls--;
+            continue;
+        }
+
+        mico_thread_msleep( sleep_ms );
+        sleep_ms = ( sleep_ms * 2 > max_sleep_ms ) ? max_sleep_ms : sleep_ms * 2;
+    }
+}
+
 
 int generic_sflash_command(                                      const sflash_handle_t* const handle,
                                                                  sflash_command_t             cmd,
@@ -463,20 +492,14 @@ int generic_sflash_command(                                      const sflash_ha
 
     if ( is_write_command( cmd ) == 1 )
     {
-        unsigned char status_register;
         /* write commands require waiting until chip is finished writing */
-
-        do
+        status = sflash_wait_ready( handle, cmd );
+        if ( status != 0 )
         {
-            status = sflash_read_status_register( handle, &status_register );
-            if ( status != 0 )
-            {
-                /*@-mustdefine@*/ /* Lint: do not need to define data_MISO due to failure */
-                return status;
-                /*@+mustdefine@*/
-            }
-        } while( ( status_register & SFLASH_STATUS_REGISTER_BUSY ) != (unsigned char) 0 );
-
+            /*@-mustdefine@*/ /* Lint: do not need to define data_MISO due to failure */
+            return status;
+            /*@+mustdefine@*/
+        }
     }
 
     /*@-mustdefine@*/ /* Lint: lint does not realise data_MISO was set by sflash_platform_send_recv */
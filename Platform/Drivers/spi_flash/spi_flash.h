@@ -56,6 +56,8 @@ int sflash_read         ( const sflash_handle_t* const handle, unsigned long dev
 int sflash_write        ( const sflash_handle_t* const handle, unsigned long device_address,  /*@observer@*/ const void* const data_addr, unsigned int size );
 int sflash_chip_erase   ( const sflash_handle_t* const handle );
 int sflash_sector_erase ( const sflash_handle_t* const handle, unsigned long device_address );
+int sflash_block_erase  ( const sflash_handle_t* const handle, unsigned long device_address );
+int sflash_erase        ( const sflash_handle_t* const handle, unsigned long device_address, unsigned long size );
 int sflash_get_size     ( const sflash_handle_t* const handle, /*@out@*/ unsigned long* size );
 
 
@@ -35,6 +35,7 @@
 #include "platform.h"
 #include "platform_config.h"
 #include "stdio.h"
+#include "string.h"
 
 #ifdef USE_MICO_SPI_FLASH
 #include "spi_flash.h"
@@ -58,6 +59,20 @@
 #define FLASH_START_ADDRESS     (uint32_t)0x08000000  
 #define FLASH_END_ADDRESS       (uint32_t)0x080FFFFF
 #define FLASH_SIZE              (FLASH_END_ADDRESS -  FLASH_START_ADDRESS + 1)
+
+/* Program parallelism: x32 over the 2.7V to 3.6V supply range, x64 when the
+   board applies 8-9V to VPP and defines INT_FLASH_EXTERNAL_VPP in platform_config.h */
+#ifdef INT_FLASH_EXTERNAL_VPP
+#define INT_FLASH_PROGRAM_SIZE  (8)
+#define INT_FLASH_PSIZE         FLASH_PSIZE_DOUBLE_WORD
+#define INT_FLASH_VOLTAGE_RANGE VoltageRange_4
+#else
+#define INT_FLASH_PROGRAM_SIZE  (4)
+#define INT_FLASH_PSIZE         FLASH_PSIZE_WORD
+#define INT_FLASH_VOLTAGE_RANGE VoltageRange_3
+#endif
+
+#define INT_FLASH_ERROR_FLAGS   (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
@@ -71,7 +86,6 @@ static OSStatus _GetAddress(uint32_t sector, uint32_t *startAddress, uint32_t *e
 static OSStatus internalFlashInitialize( void );
 static OSStatus internalFlashErase(uint32_t StartAddress, uint32_t EndAddress);
 static OSStatus internalFlashWrite(volatile uint32_t* FlashAddress, uint32_t* Data ,uint32_t DataLength);
-static OSStatus internalFlashByteWrite( volatile uint32_t* FlashAddress, uint8_t* Data ,uint32_t DataLength );
 #ifdef MCU_EBANLE_FLASH_PROTECT
 static uint32_t _GetWRPSector(uint32_t Address);
 static OSStatus internalFlashProtect(uint32_t StartAddress, uint32_t EndAddress, bool enable);
@@ -188,6 +202,22 @@ exit:
   return err;
 }
 
+OSStatus platform_flash_map( const platform_flash_t *peripheral, uint32_t start_address, uint32_t length, const uint8_t** mapped )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( peripheral != NULL && mapped != NULL, exit, err = kParamErr);
+  require_action( (start_address >= peripheral->flash_start_addr) 
+               && (start_address + length) <= ( peripheral->flash_start_addr + peripheral->flash_length), exit, err = kParamErr);
+
+  /* Embedded flash sits on the AHB bus and is read in place, SPI flash has to be copied */
+  require_action_quiet( peripheral->flash_type == FLASH_TYPE_EMBEDDED, exit, err = kUnsupportedErr );
+  *mapped = (const uint8_t *)start_address;
+
+exit:
+  return err;
+}
+
 OSStatus platform_flash_enable_protect( const platform_flash_t *peripheral, uint32_t start_address, uint32_t end_address )
 {
   OSStatus err = kNoErr;
@@ -268,8 +298,6 @@ OSStatus internalFlashErase(uint32_t StartAddress, uint32_t EndAddress)
   
   for(i = StartSector; i <= EndSector; i += 8)
   {
-    /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-    be done by word */
     _GetAddress(i, &StartAddress, &EndAddress);
     for(j=StartAddress; j<=EndAddress; j+=8){
       if( (*(uint32_t *)(j))!=0xFFFFFFFF )
@@ -277,7 +305,7 @@ OSStatus internalFlashErase(uint32_t StartAddress, uint32_t EndAddress)
     }
     if( j>EndAddress ) 
       continue;
-    require_action(FLASH_EraseSector(i, VoltageRange_3) == FLASH_COMPLETE, exit, err = kWriteErr); 
+    require_action(FLASH_EraseSector(i, INT_FLASH_VOLTAGE_RANGE) == FLASH_COMPLETE, exit, err = kWriteErr); 
   }
   
 exit:
@@ -328,18 +356,14 @@ OSStatus spiFlashErase(uint32_t StartAddress, uint32_t EndAddress)
 {
   platform_log_trace();
   OSStatus err = kNoErr;
-  uint32_t StartSector, EndSector, i = 0;
+  uint32_t StartSector, EndSector;
   
   /* Get the sector where start the user flash area */
   StartSector = StartAddress>>12;
   EndSector = EndAddress>>12;
   
-  for(i = StartSector; i <= EndSector; i += 1)
-  {
-    /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-    be done by word */
-    require_action(sflash_sector_erase(&sflash_handle, i<<12) == kNoErr, exit, err = kWriteErr); 
-  }
+  /* Whole 64K blocks inside the range are erased with one command each */
+  require_action(sflash_erase(&sflash_handle, StartSector<<12, (EndSector - StartSector + 1)<<12) == kNoErr, exit, err = kWriteErr);
   
 exit:
   return err;
@@ -351,57 +375,52 @@ OSStatus internalFlashWrite(volatile uint32_t* FlashAddress, uint32_t* Data ,uin
 {
   platform_log_trace();
   OSStatus err = kNoErr;
-  uint32_t i = 0;
-  uint32_t dataInRam;
-  uint8_t startNumber;
-  uint32_t DataLength32 = DataLength;
-  
-  /*First bytes that are not 32bit align*/
-  if(*FlashAddress%4){
-    startNumber = 4-(*FlashAddress)%4;
-    err = internalFlashByteWrite(FlashAddress, (uint8_t *)Data, startNumber);
-    require_noerr(err, exit);
-    DataLength32 = DataLength - startNumber;
-    Data = (uint32_t *)((uint32_t)Data + startNumber);
-  }
-  
-  /*Program flash by words*/
-  for (i = 0; (i < DataLength32/4) && (*FlashAddress <= (FLASH_END_ADDRESS-3)); i++)
-  {
-    /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-    be done by word */ 
-    dataInRam = *(Data+i);
-    require_action(FLASH_ProgramWord(*FlashAddress, dataInRam) == FLASH_COMPLETE, exit, err = kWriteErr); 
-    require_action(*(uint32_t*)*FlashAddress == dataInRam, exit, err = kChecksumErr); 
-    /* Increment FLASH destination address */
-    *FlashAddress += 4;
+  uint32_t start = *FlashAddress;
+  uint32_t end = *FlashAddress + DataLength;
+  uint32_t address = start & ~( INT_FLASH_PROGRAM_SIZE - 1 );
+  uint8_t *src = (uint8_t *)Data;
+  uint32_t offset, len;
+  union {
+    uint8_t  bytes[ INT_FLASH_PROGRAM_SIZE ];
+    uint32_t word;
+    uint64_t dword;
+  } unit;
+
+  require_action( FLASH_WaitForLastOperation() == FLASH_COMPLETE, exit, err = kWriteErr );
+  FLASH_ClearFlag( INT_FLASH_ERROR_FLAGS );
+
+  /* Program size and PG are set once for the whole block, each unit then only
+  waits for BSY. Error flags are sticky, so they are checked at the end */
+  FLASH->CR &= ~FLASH_CR_PSIZE;
+  FLASH->CR |= INT_FLASH_PSIZE | FLASH_CR_PG;
+
+  for( ; address < end; address += INT_FLASH_PROGRAM_SIZE )
+  {
+    offset = ( address < start ) ? start - address : 0;
+    len = ( address + INT_FLASH_PROGRAM_SIZE > end ) ? end - address - offset : INT_FLASH_PROGRAM_SIZE - offset;
+
+    /* Unaligned head and tail keep the bytes already in flash around the new
+    ones, programming them again with the same value leaves them unchanged */
+    if( len != INT_FLASH_PROGRAM_SIZE )
+      memcpy( unit.bytes, (void *)address, INT_FLASH_PROGRAM_SIZE );
+    memcpy( &unit.bytes[ offset ], src, len );
+    src += len;
+
+#ifdef INT_FLASH_EXTERNAL_VPP
+    *(__IO uint64_t*)address = unit.dword;
+#else
+    *(__IO uint32_t*)address = unit.word;
+#endif
+    while( ( FLASH->SR & FLASH_FLAG_BSY ) != 0 );
   }
-  
-  /*Last bytes that cannot be write by a 32 bit word*/
-  err = internalFlashByteWrite(FlashAddress, (uint8_t *)Data + i*4, DataLength32-i*4);
-  require_noerr(err, exit);
-  
-exit:
-  return err;
-}
 
-OSStatus internalFlashByteWrite(__IO uint32_t* FlashAddress, uint8_t* Data ,uint32_t DataLength)
-{
-  uint32_t i = 0;
-  uint32_t dataInRam;
-  OSStatus err = kNoErr;
-  
-  for (i = 0; (i < DataLength) && (*FlashAddress <= (FLASH_END_ADDRESS)); i++)
-  {
-    /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-    be done by word */ 
-    dataInRam = *(uint8_t*)(Data+i);
-    
-    require_action(FLASH_ProgramByte(*FlashAddress, dataInRam) == FLASH_COMPLETE, exit, err = kWriteErr); 
-    require_action(*(uint8_t*)*FlashAddress == dataInRam, exit, err = kChecksumErr); 
-    *FlashAddress +=1;
-  }
-  
+  FLASH->CR &= ~FLASH_CR_PG;
+  require_action( ( FLASH->SR & INT_FLASH_ERROR_FLAGS ) == 0, exit, err = kWriteErr );
+
+  /* Verified once for the whole block instead of after every word */
+  require_action( memcmp( (void *)start, Data, DataLength ) == 0, exit, err = kChecksumErr );
+  *FlashAddress = end;
+
 exit:
   return err;
 }
@@ -206,7 +206,8 @@ typedef struct
 typedef struct
 {
     platform_uart_t*           peripheral;
-    ring_buffer_t*             rx_buffer;
+    spsc_ring_buffer_t*        rx_buffer;     /* &rx_ring in ring buffer mode, NULL otherwise */
+    spsc_ring_buffer_t         rx_ring;       /* Filled by the circular RX DMA */
 #ifndef NO_MICO_RTOS
     mico_semaphore_t           rx_complete;
     mico_semaphore_t           tx_complete;
@@ -220,6 +221,11 @@ typedef struct
     volatile uint32_t          rx_size;
     volatile OSStatus          last_receive_result;
     volatile OSStatus          last_transmit_result;
+    struct platform_uart_tx_request* volatile tx_queue_head;
+    struct platform_uart_tx_request*          tx_queue_tail;
+    volatile bool              tx_draining;
+    volatile uint32_t          rx_idle_tail;
+    volatile bool              rx_frame_wait;
 } platform_uart_driver_t;
 
 typedef struct
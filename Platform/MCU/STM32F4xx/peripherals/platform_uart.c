@@ -38,6 +38,9 @@
 
 #define DMA_INTERRUPT_FLAGS  ( DMA_IT_TC | DMA_IT_TE | DMA_IT_DME | DMA_IT_FE )
 
+/* HTIFx sits one bit below TCIFx in DMA_LISR/DMA_HISR for every stream */
+#define DMA_HALF_FLAGS( complete_flags )  ( (complete_flags) >> 1 )
+
 /******************************************************
 *                   Enumerations
 ******************************************************/
@@ -115,6 +118,12 @@ static const IRQn_Type uart_irq_vectors[NUMBER_OF_UART_PORTS] =
 static OSStatus receive_bytes       ( platform_uart_driver_t* driver, void* data, uint32_t size, uint32_t timeout );
 static uint32_t get_dma_irq_status  ( DMA_Stream_TypeDef* stream );
 static void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags );
+static bool     transmit_next_chunk ( platform_uart_driver_t* driver, platform_uart_tx_request_t* request );
+static void     transmit_complete   ( platform_uart_tx_request_t* request, OSStatus result );
+static void     receive_notify      ( platform_uart_driver_t* driver, bool idle );
+static void     receive_update_tail ( platform_uart_driver_t* driver );
+static uint32_t receive_used_space  ( platform_uart_driver_t* driver );
+static uint32_t receive_frame_size  ( platform_uart_driver_t* driver, uint32_t max_size );
 
 /* Interrupt service functions - called from interrupt vector table */
 #ifndef NO_MICO_RTOS
@@ -145,6 +154,11 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   driver->last_transmit_result = kNoErr;
   driver->last_receive_result  = kNoErr;
   driver->peripheral           = (platform_uart_t*)peripheral;
+  driver->tx_queue_head        = NULL;
+  driver->tx_queue_tail        = NULL;
+  driver->tx_draining          = false;
+  driver->rx_idle_tail         = 0;
+  driver->rx_frame_wait        = false;
 #ifndef NO_MICO_RTOS
   mico_rtos_init_semaphore( &driver->tx_complete, 1 );
   mico_rtos_init_semaphore( &driver->rx_complete, 1 );
@@ -307,22 +321,27 @@ OSStatus platform_uart_init( platform_uart_driver_t* driver, const platform_uart
   peripheral->port->CR1 |= USART_CR1_TE;
   peripheral->port->CR1 |= USART_CR1_RE;
 
-  /* Setup ring buffer */
+  /* Configure RX DMA interrupt on Cortex-M3 */
+  NVIC_EnableIRQ( peripheral->rx_dma_config.irq_vector );
+
+  /* Enable TC (transfer complete) and TE (transfer error) interrupts on source */
+  clear_dma_interrupts( peripheral->rx_dma_config.stream, peripheral->rx_dma_config.complete_flags | peripheral->rx_dma_config.error_flags );
+  DMA_ITConfig( peripheral->rx_dma_config.stream, DMA_INTERRUPT_FLAGS, ENABLE );
+
+  /* Setup ring buffer, only its memory is used. The DMA fills the largest power of two
+     prefix of it, the size the lock-free ring works with */
   if ( optional_ring_buffer != NULL )
   {
-    /* Note that the ring_buffer should've been initialised first */
-    driver->rx_buffer = optional_ring_buffer;
-    driver->rx_size   = 0;
-    receive_bytes( driver, optional_ring_buffer->buffer, optional_ring_buffer->size, 0 );
-  }
-  else
-  {
-    /* Not using ring buffer. Configure RX DMA interrupt on Cortex-M3 */
-    NVIC_EnableIRQ( peripheral->rx_dma_config.irq_vector );
+    uint32_t ring_size = optional_ring_buffer->size;
 
-    /* Enable TC (transfer complete) and TE (transfer error) interrupts on source */
-    clear_dma_interrupts( peripheral->rx_dma_config.stream, peripheral->rx_dma_config.complete_flags | peripheral->rx_dma_config.error_flags );
-    DMA_ITConfig( peripheral->rx_dma_config.stream, DMA_INTERRUPT_FLAGS, ENABLE );
+    while ( ( ring_size & ( ring_size - 1 ) ) != 0 )
+    {
+      ring_size &= ring_size - 1;
+    }
+    spsc_ring_buffer_init( &driver->rx_ring, optional_ring_buffer->buffer, ring_size );
+    driver->rx_buffer = &driver->rx_ring;
+    driver->rx_size   = 0;
+    receive_bytes( driver, optional_ring_buffer->buffer, ring_size, 0 );
   }
 
 exit:
@@ -333,6 +352,8 @@ exit:
 OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
 {
   uint8_t          uart_number;
+  platform_uart_tx_request_t* request;
+  platform_uart_tx_request_t* next;
   OSStatus          err = kNoErr;
 
   platform_mcu_powersave_disable();
@@ -362,11 +383,27 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver )
   /* Disable transmit DMA interrupt at Cortex-M3 */
   NVIC_DisableIRQ( driver->peripheral->tx_dma_config.irq_vector );
 
+  /* Cancel queued transmit requests, they will never be sent */
+  request = driver->tx_queue_head;
+  if ( ( request != NULL ) || ( driver->tx_draining == true ) )
+  {
+    platform_mcu_powersave_enable();
+  }
+  driver->tx_queue_head = NULL;
+  driver->tx_queue_tail = NULL;
+  driver->tx_draining   = false;
+  for ( ; request != NULL; request = next )
+  {
+    next = request->next;
+    transmit_complete( request, kCanceledErr );
+  }
+
   /**************************************************************************
    * De-initialise STM32 USART interrupt
    **************************************************************************/
 
   USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, DISABLE );
+  USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, DISABLE );
 
   /* Disable UART interrupt vector on Cortex-M3 */
   NVIC_DisableIRQ( driver->peripheral->rx_dma_config.irq_vector );
@@ -394,52 +431,108 @@ exit:
 
 OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size )
 {
+  platform_uart_buffer_t     buffer;
+  platform_uart_tx_request_t request;
   OSStatus err = kNoErr;
 
-  platform_mcu_powersave_disable();
-  
+  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+
+  buffer.data       = data_out;
+  buffer.size       = size;
+  request.buffers   = &buffer;
+  request.count     = 1;
+  request.callback  = NULL;
+  request.arg       = NULL;
+
 #ifndef NO_MICO_RTOS
   mico_rtos_lock_mutex( &driver->tx_mutex );
+  request.semaphore = &driver->tx_complete;
+#else
+  request.semaphore = NULL;
 #endif
 
-  require_action_quiet( ( driver != NULL ) && ( data_out != NULL ) && ( size != 0 ), exit, err = kParamErr);
+  err = platform_uart_transmit_async( driver, &request );
+  require_noerr_quiet( err, exit_unlock );
 
-  /* Clear interrupt status before enabling DMA otherwise error occurs immediately */
-  clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
-
-  /* Init DMA parameters and variables */
-  driver->last_transmit_result                    = kGeneralErr;
-  driver->tx_size                                 = size;
-  driver->peripheral->tx_dma_config.stream->CR   &= ~(uint32_t) DMA_SxCR_CIRC;
-  driver->peripheral->tx_dma_config.stream->NDTR  = size;
-  driver->peripheral->tx_dma_config.stream->M0AR  = (uint32_t)data_out;
-  
-  USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, ENABLE );
-  USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
-  driver->peripheral->tx_dma_config.stream->CR   |= DMA_SxCR_EN;
-  
-/* Wait for transmission complete */
+  /* Wait for transmission complete */
 #ifndef NO_MICO_RTOS
   mico_rtos_get_semaphore( &driver->tx_complete, MICO_NEVER_TIMEOUT );
-#else 
-  while( driver->tx_complete == false );
-  driver->tx_complete = false;
+#else
+  while ( request.result == kInProgressErr );
 #endif
 
-  while ( ( driver->peripheral->port->SR & USART_SR_TC ) == 0 )
+  /* Nothing else queued: let the last byte leave the shift register before returning */
+  while ( driver->tx_draining && ( driver->peripheral->port->SR & USART_SR_TC ) == 0 )
   {
   }
 
-  /* Disable DMA and clean up */
-  USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, DISABLE );
-  driver->tx_size = 0;
-  err = driver->last_transmit_result;
+  err = request.result;
 
-exit:  
-#ifndef NO_MICO_RTOS  
+exit_unlock:
+#ifndef NO_MICO_RTOS
   mico_rtos_unlock_mutex( &driver->tx_mutex );
 #endif
-  platform_mcu_powersave_enable();
+exit:
+  return err;
+}
+
+OSStatus platform_uart_transmit_async( platform_uart_driver_t* driver, platform_uart_tx_request_t* request )
+{
+  uint32_t  primask;
+  uint32_t  i;
+  bool      powersave_held = false;
+  OSStatus  err = kNoErr;
+
+  require_action_quiet( ( driver != NULL ) && ( driver->peripheral != NULL ) && ( request != NULL ) && ( request->buffers != NULL ), exit, err = kParamErr);
+
+  for ( i = 0; i < request->count && request->buffers[i].size == 0; i++ );
+  require_action_quiet( i < request->count, exit, err = kParamErr);
+
+  request->next   = NULL;
+  request->index  = i;
+  request->offset = 0;
+  request->result = kInProgressErr;
+
+  /* Taken before the critical section as it re-enables interrupts, and given back below if the queue already holds it */
+  platform_mcu_powersave_disable();
+
+  /* The queue is shared with other threads and with the TX DMA and USART (TC) interrupts */
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if ( driver->tx_queue_head == NULL )
+  {
+    /* Idle or still draining the previous burst, which already holds off power save */
+    if ( driver->tx_draining == true )
+    {
+      USART_ITConfig( driver->peripheral->port, USART_IT_TC, DISABLE );
+      driver->tx_draining = false;
+    }
+    else
+    {
+      powersave_held = true;
+    }
+
+    driver->tx_queue_head = request;
+    driver->tx_queue_tail = request;
+    USART_DMACmd( driver->peripheral->port, USART_DMAReq_Tx, ENABLE );
+    transmit_next_chunk( driver, request );
+  }
+  else
+  {
+    /* Picked up by the TX DMA interrupt when the requests ahead of it finish */
+    driver->tx_queue_tail->next = request;
+    driver->tx_queue_tail       = request;
+  }
+
+  __set_PRIMASK( primask );
+
+  if ( powersave_held == false )
+  {
+    platform_mcu_powersave_enable();
+  }
+
+exit:
   return err;
 }
 
@@ -455,10 +548,10 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
   {
     while ( expected_data_size != 0 )
     {
-      uint32_t transfer_size = MIN( driver->rx_buffer->size / 2, expected_data_size );
+      uint32_t transfer_size = MIN( ( driver->rx_buffer->mask + 1 ) / 2, expected_data_size );
       
       /* Check if ring buffer already contains the required amount of data. */
-      if ( transfer_size > ring_buffer_used_space( driver->rx_buffer ) )
+      if ( transfer_size > receive_used_space( driver ) )
       {
         /* Set rx_size and wait in rx_complete semaphore until data reaches rx_size or timeout occurs */
         driver->last_receive_result = kNoErr;
@@ -491,15 +584,10 @@ OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* d
       // Grab data from the buffer
       do
       {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( driver->rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data_in, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data_in = ( (uint8_t*) data_in + bytes_available );
-        ring_buffer_consume( driver->rx_buffer, bytes_available );
+        uint32_t bytes_read = spsc_ring_buffer_read( driver->rx_buffer, data_in, transfer_size );
+
+        transfer_size -= bytes_read;
+        data_in = ( (uint8_t*) data_in + bytes_read );
       } while ( transfer_size != 0 );
     }
   }
@@ -520,9 +608,12 @@ static OSStatus receive_bytes( platform_uart_driver_t* driver, void* data, uint3
   {
     driver->peripheral->rx_dma_config.stream->CR |= DMA_SxCR_CIRC;
     
-    // Enabled individual byte interrupts so progress can be updated
-    USART_ClearITPendingBit( driver->peripheral->port, USART_IT_RXNE );
-    USART_ITConfig( driver->peripheral->port, USART_IT_RXNE, ENABLE );
+    // Update progress once per burst (idle line) and at half and full buffer, not on every byte
+    clear_dma_interrupts( driver->peripheral->rx_dma_config.stream, DMA_HALF_FLAGS( driver->peripheral->rx_dma_config.complete_flags ) );
+    DMA_ITConfig( driver->peripheral->rx_dma_config.stream, DMA_IT_HT, ENABLE );
+    (void) driver->peripheral->port->SR;
+    (void) driver->peripheral->port->DR;
+    USART_ITConfig( driver->peripheral->port, USART_IT_IDLE, ENABLE );
   }
   else
   {
@@ -554,9 +645,137 @@ static OSStatus receive_bytes( platform_uart_driver_t* driver, void* data, uint3
   return err;
 }
 
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* received, uint32_t timeout_ms )
+{
+  uint32_t frame_size;
+  uint32_t elapsed;
+#ifndef NO_MICO_RTOS
+  uint32_t start = mico_get_time();
+#else
+  uint32_t start = mico_get_time_no_os();
+#endif
+  OSStatus err = kNoErr;
+
+  require_action_quiet( ( driver != NULL ) && ( data_in != NULL ) && ( max_size != 0 ) && ( received != NULL ), exit, err = kParamErr);
+  *received = 0;
+  require_action_quiet( driver->rx_buffer != NULL, exit, err = kUnsupportedErr);
+
+  /* Wait until an idle line gap closes a frame, or max_size bytes are buffered */
+  while ( ( frame_size = receive_frame_size( driver, max_size ) ) == 0 )
+  {
+#ifndef NO_MICO_RTOS
+    elapsed = mico_get_time() - start;
+#else
+    elapsed = mico_get_time_no_os() - start;
+#endif
+    require_action_quiet( ( timeout_ms == MICO_NEVER_TIMEOUT ) || ( elapsed < timeout_ms ), exit, err = kTimeoutErr);
+
+#ifdef NO_MICO_RTOS
+    driver->rx_complete   = false;
+#endif
+    driver->rx_frame_wait = true;
+    driver->rx_size       = max_size;
+
+    /* Check again now that the interrupt can see us, the frame may have ended in between */
+    if ( receive_frame_size( driver, max_size ) == 0 )
+    {
+#ifndef NO_MICO_RTOS
+      mico_rtos_get_semaphore( &driver->rx_complete, ( timeout_ms == MICO_NEVER_TIMEOUT ) ? MICO_NEVER_TIMEOUT : timeout_ms - elapsed );
+#else
+      while ( ( driver->rx_complete == false ) && ( ( timeout_ms == MICO_NEVER_TIMEOUT ) || ( mico_get_time_no_os() - start < timeout_ms ) ) );
+#endif
+    }
+
+    /* Reset rx_size to prevent semaphore being set while nothing waits for the data */
+    driver->rx_size       = 0;
+    driver->rx_frame_wait = false;
+  }
+
+  *received = frame_size;
+
+  // Grab data from the buffer, receive_frame_size has checked it is all there
+  spsc_ring_buffer_read( driver->rx_buffer, data_in, frame_size );
+
+  /* Report a DMA error once */
+  err = driver->last_receive_result;
+  driver->last_receive_result = kNoErr;
+
+exit:
+  return err;
+}
+
+static uint32_t receive_frame_size( platform_uart_driver_t* driver, uint32_t max_size )
+{
+  uint32_t used  = receive_used_space( driver );
+  uint32_t frame = driver->rx_idle_tail - driver->rx_buffer->head;
+
+  if ( used >= max_size )
+  {
+    return max_size;
+  }
+
+  /* Zero if no idle gap since head, larger than used if the last one was already consumed */
+  return ( frame <= used ) ? frame : 0;
+}
+
+static void receive_notify( platform_uart_driver_t* driver, bool idle )
+{
+  uint32_t used;
+
+  receive_update_tail( driver );
+  if ( idle == true )
+  {
+    driver->rx_idle_tail = driver->rx_buffer->tail;
+  }
+  used = spsc_ring_buffer_used_space( driver->rx_buffer );
+
+  // Notify thread if sufficient data are available, or a frame it waits for has ended
+  if ( ( driver->rx_size > 0 ) && ( ( used >= driver->rx_size ) || ( ( idle == true ) && ( driver->rx_frame_wait == true ) && ( used > 0 ) ) ) )
+  {
+      #ifndef NO_MICO_RTOS
+      mico_rtos_set_semaphore( &driver->rx_complete );
+      #else
+      driver->rx_complete = true;
+      #endif
+      driver->rx_size = 0;
+  }
+#ifndef NO_MICO_RTOS
+  if( driver->sem_wakeup )
+    mico_rtos_set_semaphore( &driver->sem_wakeup );
+#endif
+}
+
+/* Move the ring tail to where the RX DMA has written up to. An overrun can't make the ring
+   look fuller than its size, the bytes written over are lost as before */
+static void receive_update_tail( platform_uart_driver_t* driver )
+{
+  spsc_ring_buffer_t* ring_buffer = driver->rx_buffer;
+  uint32_t            position    = ( ring_buffer->mask + 1 - driver->peripheral->rx_dma_config.stream->NDTR ) & ring_buffer->mask;
+  uint32_t            written     = ( position - ring_buffer->tail ) & ring_buffer->mask;
+
+  spsc_ring_buffer_commit_write( ring_buffer, MIN( written, spsc_ring_buffer_free_space( ring_buffer ) ) );
+}
+
+/* Used space seen by a reader. The tail is refreshed here as well, otherwise a continuous
+   stream is only counted at the next IDLE or half/full transfer interrupt */
+static uint32_t receive_used_space( platform_uart_driver_t* driver )
+{
+  uint32_t primask;
+  uint32_t used;
+
+  /* The interrupts write the tail too, keep them from storing a newer one in between */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  receive_update_tail( driver );
+  used = spsc_ring_buffer_used_space( driver->rx_buffer );
+  __set_PRIMASK( primask );
+
+  return used;
+}
+
 OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver )
 {  
-  return ring_buffer_used_space( driver->rx_buffer );
+  return receive_used_space( driver );
 }
 
 static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
@@ -579,6 +798,63 @@ static void clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags )
     }
 }
 
+static bool transmit_next_chunk( platform_uart_driver_t* driver, platform_uart_tx_request_t* request )
+{
+  DMA_Stream_TypeDef* stream = driver->peripheral->tx_dma_config.stream;
+  const platform_uart_buffer_t* buffer;
+
+  /* Skip finished and empty buffers */
+  while ( ( request->index < request->count ) && ( request->offset >= request->buffers[request->index].size ) )
+  {
+    request->index++;
+    request->offset = 0;
+  }
+
+  if ( request->index >= request->count )
+  {
+    return false;
+  }
+
+  /* NDTR is 16 bits wide, longer buffers go out in several chunks */
+  buffer          = &request->buffers[request->index];
+  driver->tx_size = MIN( buffer->size - request->offset, 0xFFFF );
+
+  /* Clear interrupt status before enabling DMA otherwise error occurs immediately */
+  clear_dma_interrupts( stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
+  USART_ClearFlag( driver->peripheral->port, USART_FLAG_TC );
+
+  stream->CR   &= ~(uint32_t) DMA_SxCR_CIRC;
+  stream->NDTR  = driver->tx_size;
+  stream->M0AR  = (uint32_t) ( buffer->data + request->offset );
+  stream->CR   |= DMA_SxCR_EN;
+
+  return true;
+}
+
+static void transmit_complete( platform_uart_tx_request_t* request, OSStatus result )
+{
+  /* The owner may reuse the request as soon as result is written */
+  platform_uart_tx_callback_t callback  = request->callback;
+  void*                       arg       = request->arg;
+  mico_semaphore_t*           semaphore = request->semaphore;
+
+  request->result = result;
+
+  if ( callback != NULL )
+  {
+    callback( result, arg );
+  }
+
+#ifndef NO_MICO_RTOS
+  if ( semaphore != NULL )
+  {
+    mico_rtos_set_semaphore( semaphore );
+  }
+#else
+  UNUSED_PARAMETER( semaphore );
+#endif
+}
+
 static uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )
 {
     if ( stream <= DMA1_Stream3 )
@@ -684,55 +960,99 @@ void platform_uart_irq( platform_uart_driver_t* driver )
 {
   platform_uart_port_t* uart = (platform_uart_port_t*) driver->peripheral->port;
 
-  // Clear all interrupts. It's safe to do so because only RXNE interrupt is enabled
-  uart->SR = (uint16_t) ( uart->SR | 0xffff );
+  // TC is only enabled once the transmit queue is empty: the last byte is out, release the line
+  if ( ( ( uart->CR1 & USART_CR1_TCIE ) != 0 ) && ( ( uart->SR & USART_SR_TC ) != 0 ) )
+  {
+      USART_ITConfig( uart, USART_IT_TC, DISABLE );
+      USART_DMACmd( uart, USART_DMAReq_Tx, DISABLE );
+      driver->tx_draining = false;
+      platform_mcu_powersave_enable();
+  }
 
-  // Update tail
-  driver->rx_buffer->tail = driver->rx_buffer->size - driver->peripheral->rx_dma_config.stream->NDTR;
+  if ( driver->rx_buffer == NULL )
+  {
+      return;
+  }
 
-  // Notify thread if sufficient data are available
-  if ( ( driver->rx_size > 0 ) && ( ring_buffer_used_space( driver->rx_buffer ) >= driver->rx_size ) )
+  // Line went idle after a burst. Reading SR then DR clears IDLE, DMA has already taken the last byte
+  if ( ( uart->SR & USART_SR_IDLE ) != 0 )
   {
-      #ifndef NO_MICO_RTOS
-      mico_rtos_set_semaphore( &driver->rx_complete );
-      #else
-      driver->rx_complete = true;
-      #endif
-      driver->rx_size = 0;
+      (void) uart->DR;
+      receive_notify( driver, true );
   }
-#ifndef NO_MICO_RTOS
-  if( driver->sem_wakeup )
-    mico_rtos_set_semaphore( &driver->sem_wakeup );
-#endif
 }
 
 void platform_uart_tx_dma_irq( platform_uart_driver_t* driver )
 {
-    if ( ( get_dma_irq_status( driver->peripheral->tx_dma_config.stream ) & driver->peripheral->tx_dma_config.complete_flags ) != 0 )
+    platform_uart_tx_request_t* request = driver->tx_queue_head;
+    DMA_Stream_TypeDef*         stream  = driver->peripheral->tx_dma_config.stream;
+    uint32_t                    status  = get_dma_irq_status( stream );
+
+    if ( ( status & driver->peripheral->tx_dma_config.error_flags ) != 0 )
     {
-        clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.complete_flags );
+        /* Abandon the rest of this request, the stream may still be enabled after a FIFO error */
+        clear_dma_interrupts( stream, driver->peripheral->tx_dma_config.complete_flags | driver->peripheral->tx_dma_config.error_flags );
+        stream->CR &= ~(uint32_t) DMA_SxCR_EN;
+        while ( ( stream->CR & DMA_SxCR_EN ) != 0 )
+        {
+        }
+        driver->last_transmit_result = kGeneralErr;
+    }
+    else if ( ( status & driver->peripheral->tx_dma_config.complete_flags ) != 0 )
+    {
+        clear_dma_interrupts( stream, driver->peripheral->tx_dma_config.complete_flags );
         driver->last_transmit_result = kNoErr;
     }
+    else
+    {
+        return;
+    }
 
-    if ( ( get_dma_irq_status( driver->peripheral->tx_dma_config.stream ) & driver->peripheral->tx_dma_config.error_flags ) != 0 )
+    if ( request == NULL )
     {
-        clear_dma_interrupts( driver->peripheral->tx_dma_config.stream, driver->peripheral->tx_dma_config.error_flags );
-        driver->last_transmit_result = kGeneralErr;
+        return;
     }
 
-    if ( driver->tx_size > 0 )
+    if ( driver->last_transmit_result == kNoErr )
     {
-        #ifndef NO_MICO_RTOS
-        /* Set semaphore regardless of result to prevent waiting thread from locking up */
-        mico_rtos_set_semaphore( &driver->tx_complete );
-        #else
-        driver->tx_complete = true;
-        #endif
+        request->offset += driver->tx_size;
+        if ( transmit_next_chunk( driver, request ) == true )
+        {
+            return;
+        }
+    }
+
+    /* Start the next request before running the callback so the line does not go idle */
+    driver->tx_queue_head = request->next;
+    if ( driver->tx_queue_head != NULL )
+    {
+        transmit_next_chunk( driver, driver->tx_queue_head );
+    }
+    else
+    {
+        driver->tx_queue_tail = NULL;
+        driver->tx_size       = 0;
+        driver->tx_draining   = true;
+        USART_ITConfig( driver->peripheral->port, USART_IT_TC, ENABLE );
     }
+
+    transmit_complete( request, driver->last_transmit_result );
 }
 
 void platform_uart_rx_dma_irq( platform_uart_driver_t* driver )
 {
+    if ( driver->rx_buffer != NULL )
+    {
+        /* Circular reception reached half or end of the ring buffer */
+        if ( ( get_dma_irq_status( driver->peripheral->rx_dma_config.stream ) & driver->peripheral->rx_dma_config.error_flags ) != 0 )
+        {
+            driver->last_receive_result = kGeneralErr;
+        }
+        clear_dma_interrupts( driver->peripheral->rx_dma_config.stream, DMA_HALF_FLAGS( driver->peripheral->rx_dma_config.complete_flags ) | driver->peripheral->rx_dma_config.complete_flags | driver->peripheral->rx_dma_config.error_flags );
+        receive_notify( driver, false );
+        return;
+    }
+
     if ( ( get_dma_irq_status( driver->peripheral->rx_dma_config.stream ) & driver->peripheral->rx_dma_config.complete_flags ) != 0 )
     {
         clear_dma_interrupts( driver->peripheral->rx_dma_config.stream, driver->peripheral->rx_dma_config.complete_flags );
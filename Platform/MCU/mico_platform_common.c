@@ -468,6 +468,44 @@ OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size )
   return (OSStatus) platform_uart_transmit_bytes( &platform_uart_drivers[uart], (const uint8_t*) data, size );
 }
 
+OSStatus MicoUartSendAsync( mico_uart_t uart, mico_uart_tx_request_t* request )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return (OSStatus) platform_uart_transmit_async( &platform_uart_drivers[uart], request );
+}
+
+/* MCUs without a transmit queue send the request synchronously */
+WEAK OSStatus platform_uart_transmit_async( platform_uart_driver_t* driver, platform_uart_tx_request_t* request )
+{
+  OSStatus err = kNoErr;
+  uint32_t i;
+
+  if ( ( request == NULL ) || ( request->buffers == NULL ) )
+    return kParamErr;
+
+  for ( i = 0; i < request->count && request->buffers[i].size == 0; i++ );
+  if ( i == request->count )
+    return kParamErr;
+
+  request->result = kInProgressErr;
+  for ( ; i < request->count && err == kNoErr; i++ )
+  {
+    if ( request->buffers[i].size != 0 )
+      err = platform_uart_transmit_bytes( driver, request->buffers[i].data, request->buffers[i].size );
+  }
+  request->result = err;
+
+  if ( request->callback != NULL )
+    request->callback( err, request->arg );
+#ifndef NO_MICO_RTOS
+  if ( request->semaphore != NULL )
+    mico_rtos_set_semaphore( request->semaphore );
+#endif
+  return kNoErr;
+}
+
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout )
 {
   if ( uart >= MICO_UART_NONE )
@@ -476,6 +514,47 @@ OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t tim
   return (OSStatus) platform_uart_receive_bytes( &platform_uart_drivers[uart], (uint8_t*)data, size, timeout );
 }
 
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* received, uint32_t timeout )
+{
+  if ( uart >= MICO_UART_NONE )
+    return kUnsupportedErr;
+
+  return (OSStatus) platform_uart_receive_frame( &platform_uart_drivers[uart], (uint8_t*)data, size, received, timeout );
+}
+
+#define UART_FRAME_POLL_MS            (5)
+
+/* MCUs without idle line detection end a frame when the buffer stops growing for one poll period */
+WEAK OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* received, uint32_t timeout_ms )
+{
+  OSStatus err = kNoErr;
+  uint32_t length;
+  uint32_t last_length = 0;
+  uint32_t waited = 0;
+
+  if ( ( data_in == NULL ) || ( max_size == 0 ) || ( received == NULL ) )
+    return kParamErr;
+
+  *received = 0;
+  while ( 1 )
+  {
+    length = (uint32_t) platform_uart_get_length_in_buffer( driver );
+    if ( ( length >= max_size ) || ( ( length != 0 ) && ( length == last_length ) ) )
+      break;
+    if ( ( timeout_ms != MICO_NEVER_TIMEOUT ) && ( waited >= timeout_ms ) )
+      return kTimeoutErr;
+    last_length = length;
+    mico_thread_msleep( UART_FRAME_POLL_MS );
+    waited += UART_FRAME_POLL_MS;
+  }
+
+  length = MIN( length, max_size );
+  err = platform_uart_receive_bytes( driver, data_in, length, 0 );
+  if ( err == kNoErr )
+    *received = length;
+  return err;
+}
+
 uint32_t MicoUartGetLengthInBuffer( mico_uart_t uart )
 {
   if ( uart >= MICO_UART_NONE )
@@ -511,6 +590,152 @@ mico_logic_partition_t* MicoFlashGetInfo( mico_partition_t inPartition )
     return (mico_logic_partition_t *)&mico_partitions[ inPartition ];
 }
 
+/* Read cache for flash that is not memory mapped, i.e. SPI flash. Whole sectors of
+   the partitions that opt in (PAR_OPT_CACHE_EN or MicoFlashEnableCache) are kept in
+   RAM and the least recently used one is replaced on a miss. Writes and erases
+   invalidate the sectors they touch whatever partition they go through. The device
+   mutex is always taken before flash_cache_mutex. */
+#ifndef MICO_FLASH_CACHE_SECTORS
+#define MICO_FLASH_CACHE_SECTORS      (0)
+#endif
+
+#if MICO_FLASH_CACHE_SECTORS > 0
+
+#define FLASH_CACHE_SECTOR_SIZE       (4096)
+
+typedef struct
+{
+  bool          valid;
+  mico_flash_t  owner;
+  uint32_t      address;
+  uint32_t      last_used;
+  uint8_t       data[ FLASH_CACHE_SECTOR_SIZE ];
+} flash_cache_line_t;
+
+static flash_cache_line_t       flash_cache[ MICO_FLASH_CACHE_SECTORS ];
+static uint32_t                 flash_cache_clock = 0;
+static mico_mutex_t             flash_cache_mutex = NULL;
+static mico_flash_cache_stats_t flash_cache_stats;
+/* 0: follow partition_options, 1: enabled, -1: disabled by MicoFlashEnableCache */
+static int8_t                   flash_cache_override[ MICO_PARTITION_MAX ];
+
+static bool flash_cache_enabled( mico_partition_t partition )
+{
+  if( flash_cache_override[ partition ] != 0 )
+    return ( flash_cache_override[ partition ] > 0 ) ? true : false;
+  return ( ( mico_partitions[ partition ].partition_options & PAR_OPT_CACHE_MASK ) == PAR_OPT_CACHE_EN ) ? true : false;
+}
+
+static void flash_cache_invalidate( mico_flash_t owner, uint32_t start_addr, uint32_t end_addr )
+{
+  uint32_t i;
+
+  mico_rtos_lock_mutex( &flash_cache_mutex );
+  for( i = 0; i < MICO_FLASH_CACHE_SECTORS; i++ )
+  {
+    if( flash_cache[i].valid && flash_cache[i].owner == owner
+       && flash_cache[i].address <= end_addr && flash_cache[i].address + FLASH_CACHE_SECTOR_SIZE - 1 >= start_addr )
+      flash_cache[i].valid = false;
+  }
+  mico_rtos_unlock_mutex( &flash_cache_mutex );
+}
+
+/* Called with the device mutex held, works like platform_flash_read */
+static OSStatus flash_cache_read( mico_flash_t owner, uint32_t* start_addr, uint8_t* outBuffer, uint32_t length )
+{
+  OSStatus err = kNoErr;
+  flash_cache_line_t *line, *victim;
+  uint32_t sector, offset, len, fill_addr, i;
+
+  mico_rtos_lock_mutex( &flash_cache_mutex );
+  while( length > 0 )
+  {
+    sector = *start_addr & ~( FLASH_CACHE_SECTOR_SIZE - 1 );
+    offset = *start_addr - sector;
+    len = ( length > FLASH_CACHE_SECTOR_SIZE - offset ) ? FLASH_CACHE_SECTOR_SIZE - offset : length;
+
+    line = NULL;
+    victim = &flash_cache[0];
+    for( i = 0; i < MICO_FLASH_CACHE_SECTORS; i++ )
+    {
+      if( flash_cache[i].valid && flash_cache[i].owner == owner && flash_cache[i].address == sector )
+      {
+        line = &flash_cache[i];
+        break;
+      }
+      if( victim->valid && ( !flash_cache[i].valid || flash_cache[i].last_used < victim->last_used ) )
+        victim = &flash_cache[i];
+    }
+
+    if( line == NULL )
+    {
+      fill_addr = sector;
+      victim->valid = false;
+      err = platform_flash_read( &platform_flash_peripherals[ owner ], &fill_addr, victim->data, FLASH_CACHE_SECTOR_SIZE );
+      require_noerr_quiet( err, exit );
+      victim->valid = true;
+      victim->owner = owner;
+      victim->address = sector;
+      line = victim;
+      flash_cache_stats.misses++;
+    }
+    else
+    {
+      flash_cache_stats.hits++;
+    }
+
+    line->last_used = ++flash_cache_clock;
+    memcpy( outBuffer, &line->data[ offset ], len );
+    outBuffer += len;
+    *start_addr += len;
+    length -= len;
+  }
+
+exit:
+  mico_rtos_unlock_mutex( &flash_cache_mutex );
+  return err;
+}
+#endif /* MICO_FLASH_CACHE_SECTORS > 0 */
+
+OSStatus MicoFlashEnableCache( mico_partition_t partition, bool enable )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( partition > MICO_PARTITION_ERROR, exit, err = kParamErr );
+  require_action_quiet( partition < MICO_PARTITION_MAX, exit, err = kParamErr );
+  require_action_quiet( mico_partitions[ partition ].partition_owner != MICO_FLASH_NONE, exit, err = kNotFoundErr );
+
+#if MICO_FLASH_CACHE_SECTORS > 0
+  flash_cache_override[ partition ] = enable ? 1 : -1;
+  if( enable == false && flash_cache_mutex != NULL )
+    flash_cache_invalidate( mico_partitions[ partition ].partition_owner, mico_partitions[ partition ].partition_start_addr,
+                            mico_partitions[ partition ].partition_start_addr + mico_partitions[ partition ].partition_length - 1 );
+#else
+  UNUSED_PARAMETER( enable );
+  err = kUnsupportedErr;
+#endif
+
+exit:
+  return err;
+}
+
+OSStatus MicoFlashGetCacheStats( mico_flash_cache_stats_t *stats )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( stats != NULL, exit, err = kParamErr );
+
+#if MICO_FLASH_CACHE_SECTORS > 0
+  *stats = flash_cache_stats;
+#else
+  memset( stats, 0, sizeof( mico_flash_cache_stats_t ) );
+  err = kUnsupportedErr;
+#endif
+
+exit:
+  return err;
+}
+
 
 static OSStatus MicoFlashInitialize( mico_partition_t partition )
 {
@@ -524,6 +749,13 @@ static OSStatus MicoFlashInitialize( mico_partition_t partition )
     err = mico_rtos_init_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
     require_noerr( err, exit );
   }
+
+#if MICO_FLASH_CACHE_SECTORS > 0
+  if( flash_cache_mutex == NULL ){
+    err = mico_rtos_init_mutex( &flash_cache_mutex );
+    require_noerr( err, exit );
+  }
+#endif
   
   mico_rtos_lock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
   
@@ -563,12 +795,35 @@ OSStatus MicoFlashErase(mico_partition_t partition, uint32_t off_set, uint32_t s
 
   mico_rtos_lock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
   err = platform_flash_erase( &platform_flash_peripherals[ mico_partitions[ partition ].partition_owner ], start_addr, end_addr );
+#if MICO_FLASH_CACHE_SECTORS > 0
+  flash_cache_invalidate( mico_partitions[ partition ].partition_owner, start_addr, end_addr );
+#endif
   mico_rtos_unlock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
 
 exit:
   return err;
 }
 
+static mico_partition_t            flash_write_observer_partition = MICO_PARTITION_ERROR;
+static mico_flash_write_observer_t flash_write_observer = NULL;
+static void*                       flash_write_observer_context = NULL;
+
+OSStatus MicoFlashSetWriteObserver( mico_partition_t partition, mico_flash_write_observer_t observer, void *context )
+{
+  OSStatus err = kNoErr;
+
+  require_action_quiet( partition > MICO_PARTITION_ERROR, exit, err = kParamErr );
+  require_action_quiet( partition < MICO_PARTITION_MAX, exit, err = kParamErr );
+
+  flash_write_observer = NULL;
+  flash_write_observer_context = context;
+  flash_write_observer_partition = partition;
+  flash_write_observer = observer;
+
+exit:
+  return err;
+}
+
 OSStatus MicoFlashWrite( mico_partition_t partition, volatile uint32_t* off_set, uint8_t* inBuffer ,uint32_t inBufferLength)
 {
   OSStatus err = kNoErr;
@@ -596,8 +851,14 @@ OSStatus MicoFlashWrite( mico_partition_t partition, volatile uint32_t* off_set,
 
   mico_rtos_lock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
   err = platform_flash_write( &platform_flash_peripherals[ mico_partitions[ partition ].partition_owner ], &start_addr, inBuffer, inBufferLength );
+#if MICO_FLASH_CACHE_SECTORS > 0
+  flash_cache_invalidate( mico_partitions[ partition ].partition_owner, end_addr + 1 - inBufferLength, end_addr );
+#endif
   *off_set = start_addr - mico_partitions[ partition ].partition_start_addr;
   mico_rtos_unlock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
+
+  if( err == kNoErr && flash_write_observer != NULL && flash_write_observer_partition == partition )
+    flash_write_observer( flash_write_observer_context, *off_set - inBufferLength, inBuffer, inBufferLength );
   
 exit:
   return err;
@@ -629,6 +890,11 @@ OSStatus MicoFlashRead( mico_partition_t partition, volatile uint32_t* off_set,
   }
 
   mico_rtos_lock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
+#if MICO_FLASH_CACHE_SECTORS > 0
+  if( flash_cache_enabled( partition ) )
+    err = flash_cache_read( mico_partitions[ partition ].partition_owner, &start_addr, outBuffer, inBufferLength );
+  else
+#endif
   err = platform_flash_read( &platform_flash_peripherals[ mico_partitions[ partition ].partition_owner ], &start_addr, outBuffer, inBufferLength );
   *off_set = start_addr - mico_partitions[ partition ].partition_start_addr;
   mico_rtos_unlock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
@@ -637,6 +903,95 @@ exit:
   return err;
 }
 
+WEAK OSStatus platform_flash_map( const platform_flash_t *peripheral, uint32_t start_address, uint32_t length, const uint8_t** mapped )
+{
+  UNUSED_PARAMETER( peripheral );
+  UNUSED_PARAMETER( start_address );
+  UNUSED_PARAMETER( length );
+  UNUSED_PARAMETER( mapped );
+  return kUnsupportedErr;
+}
+
+#define FLASH_CHECKSUM_MAPPED_CHUNK   (4096)
+#define FLASH_CHECKSUM_STACK_BUFFER   (256)
+
+OSStatus MicoFlashChecksum( mico_partition_t partition, volatile uint32_t* off_set, uint32_t size,
+                            const mico_flash_checksum_t *checksums, uint32_t num,
+                            uint8_t *buffer, uint32_t buffer_len )
+{
+  OSStatus err = kNoErr;
+  uint32_t start_addr, end_addr;
+  uint8_t stack_buffer[ FLASH_CHECKSUM_STACK_BUFFER ];
+  const uint8_t* mapped;
+  uint32_t len, i;
+
+  if (size == 0)
+    goto exit;
+  require_action_quiet( partition > MICO_PARTITION_ERROR, exit, err = kParamErr );
+  require_action_quiet( partition < MICO_PARTITION_MAX, exit, err = kParamErr );
+  require_action_quiet( checksums != NULL || num == 0, exit, err = kParamErr );
+
+  require_action_quiet( mico_partitions[ partition ].partition_owner != MICO_FLASH_NONE, exit, err = kNotFoundErr );
+#ifndef BOOTLOADER
+  require_action_quiet( ( mico_partitions[ partition ].partition_options & PAR_OPT_READ_MASK ) == PAR_OPT_READ_EN, exit, err = kPermissionErr );
+#endif
+
+  start_addr = mico_partitions[ partition ].partition_start_addr + *off_set;
+  end_addr = mico_partitions[ partition ].partition_start_addr + *off_set + size - 1;
+
+  require_action_quiet( start_addr >= mico_partitions[ partition ].partition_start_addr, exit, err = kParamErr );
+  require_action_quiet( end_addr < mico_partitions[ partition ].partition_start_addr + mico_partitions[ partition ].partition_length , exit, err = kParamErr );
+
+  if( platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].initialized == false )
+  {
+    err =  MicoFlashInitialize( partition );
+    require_noerr_quiet( err, exit );
+  }
+
+  if( buffer == NULL || buffer_len == 0 )
+  {
+    buffer = stack_buffer;
+    buffer_len = sizeof( stack_buffer );
+  }
+
+  /* Memory mapped flash is fed to the checksums in place, the mutex is only held
+     for one chunk at a time so that writers are not blocked for the whole image */
+  while( size > 0 )
+  {
+    len = ( size > FLASH_CHECKSUM_MAPPED_CHUNK ) ? FLASH_CHECKSUM_MAPPED_CHUNK : size;
+
+    mico_rtos_lock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
+    err = platform_flash_map( &platform_flash_peripherals[ mico_partitions[ partition ].partition_owner ], start_addr, len, &mapped );
+    if( err == kNoErr )
+    {
+      for( i = 0; i < num; i++ )
+        checksums[i].update( checksums[i].context, mapped, len );
+    }
+    else
+    {
+      /* Not mapped, copy through the scratch buffer */
+      if( len > buffer_len )
+        len = buffer_len;
+      err = platform_flash_read( &platform_flash_peripherals[ mico_partitions[ partition ].partition_owner ], &start_addr, buffer, len );
+      start_addr -= len;
+      if( err == kNoErr )
+      {
+        for( i = 0; i < num; i++ )
+          checksums[i].update( checksums[i].context, buffer, len );
+      }
+    }
+    mico_rtos_unlock_mutex( &platform_flash_drivers[ mico_partitions[ partition ].partition_owner ].flash_mutex );
+    require_noerr_quiet( err, exit );
+
+    start_addr += len;
+    size -= len;
+  }
+
+exit:
+  *off_set = start_addr - mico_partitions[ partition ].partition_start_addr;
+  return err;
+}
+
 OSStatus MicoFlashEnableSecurity( mico_partition_t partition, uint32_t off_set, uint32_t size )
 {
   OSStatus err = kNoErr;
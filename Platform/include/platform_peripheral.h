@@ -235,6 +235,41 @@ typedef struct
     uint8_t                      flags;          /**< if set, UART can wake up MCU from stop mode, reference: @ref UART_WAKEUP_DISABLE and @ref UART_WAKEUP_ENABLE*/
 } platform_uart_config_t;
 
+/**
+ * UART transmit buffer, one element of a scatter-gather list
+ */
+typedef struct
+{
+    const uint8_t* data;
+    uint32_t       size;
+} platform_uart_buffer_t;
+
+/**
+ * UART transmit completion callback, called from interrupt context
+ */
+typedef void (*platform_uart_tx_callback_t)( OSStatus result, void* arg );
+
+/**
+ * UART transmit request
+ *
+ * The request and its buffers belong to the driver from the time it is queued
+ * until result changes from kInProgressErr, after which callback (if any) is
+ * called and semaphore (if any) is set.
+ */
+typedef struct platform_uart_tx_request
+{
+    const platform_uart_buffer_t*    buffers;
+    uint32_t                         count;
+    platform_uart_tx_callback_t      callback;
+    void*                            arg;
+    mico_semaphore_t*                semaphore;
+    /* Driver private */
+    struct platform_uart_tx_request* next;
+    uint32_t                         index;
+    uint32_t                         offset;
+    volatile OSStatus                result;
+} platform_uart_tx_request_t;
+
 /**
  * SPI configuration
  */
@@ -497,6 +532,15 @@ OSStatus platform_uart_deinit( platform_uart_driver_t* driver );
 OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size );
 
 
+/**
+ * Queue a scatter-gather transmit request on the specified UART port and
+ * return without waiting for it to be sent
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_uart_transmit_async( platform_uart_driver_t* driver, platform_uart_tx_request_t* request );
+
+
 /**
  * Receive data over the specified UART port
  *
@@ -505,6 +549,15 @@ OSStatus platform_uart_transmit_bytes( platform_uart_driver_t* driver, const uin
 OSStatus platform_uart_receive_bytes( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t expected_data_size, uint32_t timeout_ms );
 
 
+/**
+ * Receive the data buffered up to the last idle line gap over the specified
+ * UART port, at most max_size bytes
+ *
+ * @return @ref OSStatus
+ */
+OSStatus platform_uart_receive_frame( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* received, uint32_t timeout_ms );
+
+
 /**
  * Receive data length in receive buffer over the specified UART port
  *
@@ -862,6 +915,15 @@ OSStatus platform_flash_write( const platform_flash_t *peripheral, volatile uint
  */
 OSStatus platform_flash_read( const platform_flash_t *peripheral, volatile uint32_t* start_address, uint8_t* data ,uint32_t length  );
 
+/**
+ * Map flash into the CPU address space for direct reads
+ *
+ * A platform whose flash is memory mapped returns a pointer to the area, so
+ * it can be checksummed in place instead of being copied by platform_flash_read.
+ * The default implementation returns kUnsupportedErr.
+ */
+OSStatus platform_flash_map( const platform_flash_t *peripheral, uint32_t start_address, uint32_t length, const uint8_t** mapped );
+
 /**
  * Flash protect operation
  *
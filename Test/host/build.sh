@@ -0,0 +1,183 @@
+#!/bin/bash
+# Builds and runs the host tests with gcc, under AddressSanitizer and UBSan.
+#
+#   ./build.sh              all tests
+#   ./build.sh mdns uart    some of them
+#
+# Each test compiles the sources it checks straight from the tree, or the functions
+# extract.py copies out of them, against the stubs in its directory. Binaries go to
+# $OUT (default _build next to this script). Benchmarks are built with BENCH_CFLAGS,
+# without sanitizers.
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+OUT=${OUT:-$HERE/_build}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--g -O1 -fsanitize=address,undefined -fno-sanitize-recover=undefined}
+CFLAGS="$CFLAGS -w"
+BENCH_CFLAGS=${BENCH_CFLAGS:--O2}
+BENCH_CFLAGS="$BENCH_CFLAGS -w"
+UTIL=$ROOT/libraries/utilities
+
+extract() { python3 "$HERE/extract.py" "$@"; }
+
+test_config_server() {
+  local d=$OUT/config_server
+  mkdir -p "$d" &&
+  extract "$ROOT/MICO/system/config_server/config_server.c" "$d/config_server_ext.c" \
+    --range "#define config_log(" "} configContext_t;" \
+    --range "#define CONFIG_CLIENT_IDLE_TIMEOUT" "static configContext_t *config_flash_owner" \
+    --fn "static OSStatus config_client_open(" \
+    --fn "static void config_client_close(" \
+    --fn "static bool config_client_request_buffered(" \
+    --fn "static struct timeval_t *config_clients_prepare(" \
+    --fn "static void config_client_refuse(" \
+    --fn "static OSStatus config_client_process(" \
+    --fn "static void config_clients_process(" \
+    --fn "static OSStatus onReceivedData(" \
+    --fn "static void onClearHTTPHeader(" &&
+  $CC $CFLAGS -I"$d" -I"$HERE/config_server" -I"$HERE/config_server/stub" -I"$ROOT/include" -I"$UTIL" \
+    -o "$d/stress" "$HERE/config_server/stress.c" \
+    "$UTIL/HTTPUtils.c" "$UTIL/StringUtils.c" "$UTIL/URLUtils.c" "$UTIL/RingBufferUtils.c" &&
+  "$d/stress"
+}
+
+test_ring() {
+  local d=$OUT/ring
+  mkdir -p "$d" &&
+  $CC $CFLAGS -pthread -I"$HERE/ring/stub" -I"$ROOT/include" -I"$UTIL" \
+    -o "$d/stress" "$HERE/ring/stress.c" "$UTIL/RingBufferUtils.c" &&
+  $CC $BENCH_CFLAGS -I"$HERE/ring/stub" -I"$ROOT/include" -I"$UTIL" \
+    -o "$d/bench" "$HERE/ring/bench.c" "$UTIL/RingBufferUtils.c" &&
+  "$d/stress" &&
+  "$d/bench"
+}
+
+test_spi_flash() {
+  local d=$OUT/spi_flash
+  mkdir -p "$d" &&
+  $CC $CFLAGS -I"$HERE/spi_flash" -I"$HERE/spi_flash/stub" -I"$ROOT/Platform/Drivers/spi_flash" \
+    -o "$d/test" "$HERE/spi_flash/chip.c" "$HERE/spi_flash/test.c" \
+    "$ROOT/Platform/Drivers/spi_flash/spi_flash.c" -lm &&
+  "$d/test"
+}
+
+# Both directions of the STM32F4 UART driver, the interrupt handlers serve both
+extract_uart() {
+  mkdir -p "$OUT/uart" &&
+  extract "$ROOT/Platform/MCU/STM32F4xx/peripherals/platform_uart.c" "$OUT/uart/uart_ext.c" \
+    --range "#define DMA_HALF_FLAGS" "#define DMA_HALF_FLAGS" \
+    --decl "static bool transmit_next_chunk(" \
+    --decl "static void transmit_complete(" \
+    --decl "static void receive_notify(" \
+    --decl "static void receive_update_tail(" \
+    --decl "static uint32_t receive_used_space(" \
+    --decl "static uint32_t receive_frame_size(" \
+    --fn "OSStatus platform_uart_transmit_bytes(" \
+    --fn "OSStatus platform_uart_transmit_async(" \
+    --fn "OSStatus platform_uart_receive_bytes(" \
+    --fn "OSStatus platform_uart_receive_frame(" \
+    --fn "static uint32_t receive_frame_size(" \
+    --fn "static void receive_notify(" \
+    --fn "static void receive_update_tail(" \
+    --fn "static uint32_t receive_used_space(" \
+    --fn "OSStatus platform_uart_get_length_in_buffer(" \
+    --fn "static bool transmit_next_chunk(" \
+    --fn "static void transmit_complete(" \
+    --fn "void platform_uart_irq(" \
+    --fn "void platform_uart_tx_dma_irq(" \
+    --fn "void platform_uart_rx_dma_irq("
+}
+
+test_uart_tx() {
+  local d=$OUT/uart
+  extract_uart &&
+  $CC $CFLAGS -I"$d" -I"$HERE/uart" -I"$HERE/uart/stub" -I"$ROOT/include" -I"$UTIL" \
+    -o "$d/tx" "$HERE/uart/tx.c" "$UTIL/RingBufferUtils.c" &&
+  "$d/tx"
+}
+
+test_uart_rx() {
+  local d=$OUT/uart
+  extract_uart &&
+  $CC $CFLAGS -I"$d" -I"$HERE/uart" -I"$HERE/uart/stub" -I"$ROOT/include" -I"$UTIL" \
+    -o "$d/rx" "$HERE/uart/rx.c" "$UTIL/RingBufferUtils.c" &&
+  "$d/rx"
+}
+
+# A test program of mico_mdns.c includes the whole file, for its static state
+MDNS_INCLUDES="-I$HERE/mdns -I$HERE/mdns/stub -I$ROOT/include -I$UTIL -I$ROOT/MICO/system/mdns"
+
+build_mdns() {
+  local d=$OUT/mdns
+  mkdir -p "$d" &&
+  $CC ${MDNS_CFLAGS:-$CFLAGS} $MDNS_INCLUDES -o "$d/$1" "$HERE/mdns/$1.c" "$HERE/mdns/host.c" "$UTIL/StringUtils.c" "${@:2}" -lm
+}
+
+test_mdns_responder() {
+  build_mdns responder &&
+  "$OUT/mdns/responder"
+}
+
+test_mdns_storm() {
+  build_mdns storm &&
+  "$OUT/mdns/storm"
+}
+
+test_mdns_malformed() {
+  build_mdns malformed &&
+  "$OUT/mdns/malformed"
+}
+
+test_mdns_dhcp() {
+  build_mdns dhcp &&
+  "$OUT/mdns/dhcp"
+}
+
+# The checks with sanitizers, then the lookup costs from an optimized build
+test_mdns_names() {
+  build_mdns names &&
+  "$OUT/mdns/names" &&
+  MDNS_CFLAGS="$BENCH_CFLAGS -DBENCHMARK" build_mdns names &&
+  "$OUT/mdns/names"
+}
+
+# Four devices in one program, each a copy of node.c with its symbols prefixed by nodeN_
+test_mdns_browse() {
+  local d=$OUT/mdns n
+  mkdir -p "$d" || return
+  for n in 0 1 2 3; do
+    $CC $CFLAGS $MDNS_INCLUDES -c -o "$d/node$n.o" "$HERE/mdns/node.c" &&
+    nm -g --defined-only "$d/node$n.o" | awk -v p="node${n}_" '{ print $3, p $3 }' > "$d/node$n.syms" &&
+    objcopy --redefine-syms="$d/node$n.syms" "$d/node$n.o" || return
+  done
+  build_mdns browse "$d/node0.o" "$d/node1.o" "$d/node2.o" "$d/node3.o" &&
+  "$d/browse"
+}
+
+test_notify() {
+  local d=$OUT/notify
+  mkdir -p "$d" &&
+  $CC $CFLAGS -pthread -I"$HERE/notify/stub" -I"$ROOT/include" \
+    -o "$d/storm" "$HERE/notify/storm.c" "$HERE/notify/rtos.c" "$ROOT/MICO/system/mico_system_notification.c" &&
+  "$d/storm"
+}
+
+ALL="config_server ring spi_flash uart_tx uart_rx mdns_responder mdns_storm mdns_malformed mdns_browse mdns_dhcp mdns_names notify"
+
+failed=""
+for t in ${@:-$ALL}; do
+  echo "== $t"
+  if ! declare -F "test_$t" > /dev/null; then
+    echo "unknown test $t, known: $ALL"
+    failed="$failed $t"
+  elif ! "test_$t"; then
+    failed="$failed $t"
+  fi
+done
+
+if [ -n "$failed" ]; then
+  echo "FAILED:$failed"
+  exit 1
+fi
+echo "all passed"
@@ -0,0 +1,55 @@
+/* What the single-thread part of config_server.c uses from the rest of MiCO, backed by the
+   fake sockets and flash of stress.c */
+#ifndef __config_server_host_h__
+#define __config_server_host_h__
+
+#include "MICO.h"
+#include "HTTPUtils.h"
+#include "StringUtils.h"
+
+#define MICO_CONFIG_SERVER_SINGLE_THREAD
+#define MAX_TCP_CLIENT_PER_SERVER  5
+
+typedef enum { MICO_PARTITION_OTA_TEMP } mico_partition_t;
+typedef enum { MICO_FLASH_NONE, MICO_INTERNAL_FLASH } mico_flash_t;
+
+typedef struct
+{
+  mico_flash_t partition_owner;
+  uint32_t     partition_start_addr;
+  uint32_t     partition_length;
+} mico_logic_partition_t;
+
+typedef struct
+{
+  uint32_t offset;
+} mico_ota_sink_t;
+
+typedef struct
+{
+  mico_mutex_t flashContentInRam_mutex;
+} mico_Context_t;
+
+typedef struct
+{
+  int free_memory;
+} micoMemInfo_t;
+
+static mico_Context_t *Context;
+
+mico_logic_partition_t* MicoFlashGetInfo( mico_partition_t inPartition );
+OSStatus MicoFlashErase( mico_partition_t inPartition, uint32_t off_set, uint32_t size );
+OSStatus mico_ota_sink_init( mico_ota_sink_t *sink, mico_partition_t partition, uint32_t trailer_len, bool use_md5 );
+OSStatus mico_ota_sink_write( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len );
+micoMemInfo_t* MicoGetMemoryInfo( void );
+OSStatus SocketSend( int fd, const uint8_t *inBuf, size_t inBufLen );
+void SocketClose( int* fd );
+
+/* Drop the OTA progress onReceivedData prints, stress.c takes printf back */
+#define printf( ... )  ( 0 )
+
+static OSStatus _LocalConfigRespondInComingMessage( int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext );
+static OSStatus onReceivedData( struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext );
+static void onClearHTTPHeader( struct _HTTPHeader_t * httpHeader, void * userContext );
+
+#endif
@@ -0,0 +1,355 @@
+/* Stress test of the single-thread config server. Clients send pipelined reads, writes,
+   OTA images and chunked bodies. The fake sockets hand the bytes over in random pieces and
+   interleave the clients, some clients hang up half way or go quiet until the idle timeout.
+
+   Checked: each request gets one answer in order, bodies arrive intact, an OTA image in
+   flash is never mixed with another client's, a refused client gets 503 or 411 and is
+   closed, the flash mutex is balanced and nothing leaks (run it under ASan). */
+#include "host.h"
+#include "config_server_ext.c"
+#undef printf
+
+#define CONNECTIONS       1000
+#define FD_BASE           100
+#define MAX_CONNS         ( FD_SETSIZE - FD_BASE )
+#define MAX_REQUESTS      4
+#define PARTITION_SIZE    0x10000
+#define TICK_MS           50
+
+enum { REQ_READ, REQ_WRITE, REQ_OTA, REQ_CHUNKED };
+
+typedef struct
+{
+  int       kind;
+  uint32_t  body_len;
+  uint32_t  body_start;   /* Offset of the body in the input */
+  uint32_t  end;          /* Offset past the request */
+} request_t;
+
+typedef struct
+{
+  bool      used;
+  bool      open;         /* Not closed by the server yet */
+  bool      stalled;      /* Stops sending, the server drops it when idle */
+  bool      rejected;     /* Closed at accept, the server was full */
+  uint32_t  id;
+  uint8_t  *in;
+  size_t    in_len, in_pos, released;
+  char     *out;
+  size_t    out_len;
+  request_t req[ MAX_REQUESTS ];
+  int       requests;
+  int       answered;     /* Requests answered 200 by the server */
+} conn_t;
+
+static conn_t   conns[ MAX_CONNS ];
+static uint32_t now_ms;
+static uint8_t  flash[ PARTITION_SIZE ];
+static int      mutex_depth;
+static int      failures;
+static mico_logic_partition_t ota_partition = { MICO_INTERNAL_FLASH, 0x08000000, PARTITION_SIZE };
+static mico_Context_t         context;
+static micoMemInfo_t          mem_info;
+
+static struct
+{
+  unsigned long served[ 4 ], refused_503, refused_411, rejected, truncated, idle, images;
+} stats;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL %s:%d: ", __FILE__, __LINE__ ); printf( __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+static uint8_t image_byte( uint32_t id, int req, uint32_t i )
+{
+  uint32_t x = id * 2654435761u ^ (uint32_t) req * 40503u ^ i * 2246822519u;
+  return (uint8_t)( x ^ ( x >> 13 ) );
+}
+
+static conn_t *conn_of( int fd )
+{
+  if( fd < FD_BASE || fd >= FD_BASE + MAX_CONNS || conns[ fd - FD_BASE ].used == false )
+    return NULL;
+  return &conns[ fd - FD_BASE ];
+}
+
+/* Fake sockets: what the peer released can be read, EOF once everything is read */
+ssize_t read( int fd, void *buf, size_t count )
+{
+  conn_t *c = conn_of( fd );
+  size_t n;
+
+  expect( c && c->open, "read on fd %d which is not open", fd );
+  if( c == NULL || c->open == false ) return -1;
+  if( c->in_pos == c->in_len ) return 0;
+  n = c->released - c->in_pos;
+  if( n == 0 ){
+    errno = EWOULDBLOCK;
+    return -1;
+  }
+  if( n > count ) n = count;
+  if( rand() % 2 ) n = 1 + rand() % n;
+  memcpy( buf, c->in + c->in_pos, n );
+  c->in_pos += n;
+  return (ssize_t) n;
+}
+
+OSStatus SocketSend( int fd, const uint8_t *inBuf, size_t inBufLen )
+{
+  conn_t *c = conn_of( fd );
+
+  expect( c && c->open, "send on fd %d which is not open", fd );
+  if( c == NULL || c->open == false ) return kConnectionErr;
+  c->out = realloc( c->out, c->out_len + inBufLen + 1 );
+  memcpy( c->out + c->out_len, inBuf, inBufLen );
+  c->out_len += inBufLen;
+  c->out[ c->out_len ] = 0;
+  return kNoErr;
+}
+
+void SocketClose( int* fd )
+{
+  conn_t *c = conn_of( *fd );
+
+  expect( c && c->open, "close of fd %d which is not open", *fd );
+  if( c ) c->open = false;
+  *fd = -1;
+}
+
+uint32_t mico_get_time( void ) { return now_ms; }
+micoMemInfo_t* MicoGetMemoryInfo( void ) { return &mem_info; }
+mico_logic_partition_t* MicoFlashGetInfo( mico_partition_t inPartition ) { (void) inPartition; return &ota_partition; }
+
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )
+{
+  (void) mutex;
+  mutex_depth++;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )
+{
+  (void) mutex;
+  expect( mutex_depth > 0, "flash mutex unlocked more often than locked" );
+  mutex_depth--;
+  return kNoErr;
+}
+
+OSStatus MicoFlashErase( mico_partition_t inPartition, uint32_t off_set, uint32_t size )
+{
+  (void) inPartition;
+  expect( off_set + size <= PARTITION_SIZE, "erase past the partition" );
+  memset( flash + off_set, 0xFF, size );
+  return kNoErr;
+}
+
+OSStatus mico_ota_sink_init( mico_ota_sink_t *sink, mico_partition_t partition, uint32_t trailer_len, bool use_md5 )
+{
+  (void) partition; (void) trailer_len; (void) use_md5;
+  sink->offset = 0;
+  return kNoErr;
+}
+
+OSStatus mico_ota_sink_write( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len )
+{
+  if( sink->offset + len > PARTITION_SIZE ) return kNoSpaceErr;
+  memcpy( flash + sink->offset, data, len );
+  sink->offset += len;
+  return kNoErr;
+}
+
+/* Stands in for the request handlers: checks the request against what the client sent */
+static OSStatus _LocalConfigRespondInComingMessage( int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext )
+{
+  conn_t *c = conn_of( fd );
+  request_t *r;
+  configContext_t *http_context = (configContext_t *) inHeader->userContext;
+  uint8_t *response = NULL;
+  size_t response_len = 0;
+  uint32_t i;
+
+  (void) inContext;
+  expect( c && c->answered < c->requests, "answer to fd %d without a request", fd );
+  if( c == NULL || c->answered >= c->requests ) return kGeneralErr;
+  r = &c->req[ c->answered ];
+
+  switch( r->kind ){
+    case REQ_READ:
+      expect( HTTPHeaderMatchURL( inHeader, kCONFIGURLRead ) == kNoErr, "conn %u: expected a read", c->id );
+      break;
+    case REQ_WRITE:
+      expect( HTTPHeaderMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr, "conn %u: expected a write", c->id );
+      expect( inHeader->contentLength == r->body_len && inHeader->extraDataLen >= r->body_len
+             && memcmp( inHeader->extraDataPtr, c->in + r->body_start, r->body_len ) == 0, "conn %u: write body differs", c->id );
+      break;
+    case REQ_OTA:
+      expect( HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr, "conn %u: expected an OTA", c->id );
+      expect( config_flash_owner == http_context && http_context->ota_sink && http_context->ota_sink->offset == r->body_len,
+             "conn %u: OTA sink holds %u of %u bytes", c->id, http_context->ota_sink ? http_context->ota_sink->offset : 0, r->body_len );
+      for( i = 0; i < r->body_len && flash[ i ] == c->in[ r->body_start + i ]; i++ );
+      expect( i == r->body_len, "conn %u: OTA image differs at %u of %u", c->id, i, r->body_len );
+      stats.images++;
+      break;
+    default:
+      expect( false, "conn %u: chunked request served", c->id );
+  }
+  stats.served[ r->kind ]++;
+  c->answered++;
+
+  CreateHTTPRespondMessageNoCopy( kStatusOK, kMIMEType_TextPlain, 0, &response, &response_len );
+  SocketSend( fd, response, response_len );
+  free( response );
+  return kNoErr;
+}
+
+static void append( conn_t *c, const void *data, size_t len )
+{
+  c->in = realloc( c->in, c->in_len + len );
+  memcpy( c->in + c->in_len, data, len );
+  c->in_len += len;
+}
+
+static void conn_script( conn_t *c )
+{
+  char header[ 200 ];
+  uint32_t i;
+  int n;
+
+  c->requests = 1 + rand() % MAX_REQUESTS;
+  for( n = 0; n < c->requests; n++ ){
+    request_t *r = &c->req[ n ];
+    int roll = rand() % 100;
+
+    r->kind = roll < 30 ? REQ_READ : roll < 55 ? REQ_WRITE : roll < 92 ? REQ_OTA : REQ_CHUNKED;
+    switch( r->kind ){
+      case REQ_READ:
+        append( c, header, sprintf( header, "GET %s HTTP/1.1\r\nHost: device\r\n\r\n", kCONFIGURLRead ) );
+        break;
+      case REQ_WRITE:
+        r->body_len = 20 + rand() % 300;
+        append( c, header, sprintf( header, "POST %s HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: %u\r\n\r\n", kCONFIGURLWrite, r->body_len ) );
+        r->body_start = c->in_len;
+        for( i = 0; i < r->body_len; i++ ) append( c, "abcdefghijklmnopqrstuvwxyz" + ( c->id + i ) % 26, 1 );
+        break;
+      case REQ_OTA:
+        r->body_len = 1 + rand() % ( PARTITION_SIZE / 8 );
+        append( c, header, sprintf( header, "POST %s HTTP/1.1\r\nContent-Type: %s\r\nContent-Length: %u\r\n\r\n", kCONFIGURLOTA, kMIMEType_MXCHIP_OTA, r->body_len ) );
+        r->body_start = c->in_len;
+        for( i = 0; i < r->body_len; i++ ){ uint8_t b = image_byte( c->id, n, i ); append( c, &b, 1 ); }
+        break;
+      default:
+        append( c, header, sprintf( header, "POST %s HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n", kCONFIGURLWrite ) );
+    }
+    r->end = c->in_len;
+  }
+
+  /* Some clients hang up half way, a few stop sending and wait */
+  if( rand() % 8 == 0 ){
+    c->in_len = rand() % c->in_len;
+    stats.truncated++;
+  }
+  else if( rand() % 50 == 0 )
+    c->stalled = true;
+}
+
+/* Check the answers of a client the server has closed */
+static void conn_finish( conn_t *c )
+{
+  const char *p = c->out ? c->out : "";
+  int status, n = 0, ok = 0;
+
+  while( ( p = strstr( p, "HTTP/1.1 " ) ) != NULL ){
+    status = atoi( p + 9 );
+    p += 9;
+    if( status == kStatusOK ){
+      expect( n == ok, "conn %u: 200 after a refusal", c->id );
+      ok++;
+    }
+    else if( status == kStatusServiceUnavailable ){
+      expect( n < c->requests && ( c->req[ n ].kind == REQ_WRITE || c->req[ n ].kind == REQ_OTA ), "conn %u: 503 for request %d", c->id, n );
+      stats.refused_503++;
+    }
+    else if( status == kStatusLengthRequired ){
+      expect( n < c->requests && c->req[ n ].kind == REQ_CHUNKED, "conn %u: 411 for request %d", c->id, n );
+      stats.refused_411++;
+    }
+    else
+      expect( false, "conn %u: unexpected status %d", c->id, status );
+    n++;
+  }
+  expect( ok == c->answered, "conn %u: %d answers sent, %d requests served", c->id, ok, c->answered );
+  expect( n == ok || n == ok + 1, "conn %u: answers after a refusal", c->id );
+
+  /* Unless refused or idle, every request sent in full is answered */
+  if( n == ok && c->stalled == false && c->rejected == false ){
+    int full = 0;
+    while( full < c->requests && c->req[ full ].end <= c->in_len ) full++;
+    expect( c->answered == full, "conn %u: %d of %d requests answered", c->id, c->answered, full );
+  }
+
+  free( c->in );
+  free( c->out );
+  memset( c, 0, sizeof( *c ) );
+}
+
+int main( int argc, char **argv )
+{
+  uint32_t opened = 0, seed = argc > 1 ? (uint32_t) atoi( argv[1] ) : 1;
+  int active, i, fd;
+  fd_set readfds;
+  struct timeval_t t;
+
+  srand( seed );
+  Context = &context;
+
+  while( 1 ){
+    /* Connect more clients than the server takes */
+    for( active = 0, i = 0; i < MAX_CONNS; i++ ) active += conns[ i ].used;
+    if( opened < CONNECTIONS && ( active < MAX_TCP_CLIENT_PER_SERVER || ( active == MAX_TCP_CLIENT_PER_SERVER && rand() % 8 == 0 ) ) && rand() % 3 == 0 ){
+      for( i = 0; conns[ i ].used; i++ );
+      conns[ i ].used = conns[ i ].open = true;
+      conns[ i ].id = opened++;
+      conn_script( &conns[ i ] );
+      fd = FD_BASE + i;
+      if( config_client_open( fd ) != kNoErr ){
+        stats.rejected++;
+        conns[ i ].rejected = true;
+        SocketClose( &fd );
+      }
+    }
+    else if( opened == CONNECTIONS && active == 0 )
+      break;
+
+    /* The peers send a little, then select picks the readable sockets */
+    for( i = 0; i < MAX_CONNS; i++ ){
+      conn_t *c = &conns[ i ];
+      if( c->used == false || c->stalled ) continue;
+      c->released += rand() % 4 ? rand() % 64 : rand() % 4096;
+      if( c->released > c->in_len ) c->released = c->in_len;
+    }
+    FD_ZERO( &readfds );
+    config_clients_prepare( &readfds, &t );
+    for( i = 0; i < MAX_CONNS; i++ ){
+      conn_t *c = &conns[ i ];
+      if( FD_ISSET( FD_BASE + i, &readfds ) && ( c->used == false || ( c->released == c->in_pos && ( c->in_pos < c->in_len || c->stalled ) ) ) )
+        FD_CLR( FD_BASE + i, &readfds );
+    }
+    now_ms += TICK_MS;
+    config_clients_process( &readfds );
+
+    for( i = 0; i < MAX_CONNS; i++ ){
+      if( conns[ i ].used && conns[ i ].open == false ){
+        if( conns[ i ].stalled ) stats.idle++;
+        conn_finish( &conns[ i ] );
+      }
+    }
+  }
+
+  expect( mutex_depth == 0, "flash mutex held %d times at the end", mutex_depth );
+  expect( config_flash_owner == NULL, "flash still owned at the end" );
+  expect( stats.images > 0 && stats.refused_503 > 0 && stats.refused_411 > 0 && stats.rejected > 0 && stats.idle > 0, "a case was not exercised" );
+
+  printf( "%u connections, %lu rejected at the limit, %lu cut, %lu dropped idle\n", opened, stats.rejected, stats.truncated, stats.idle );
+  printf( "served %lu reads, %lu writes, %lu OTA images verified, refused %lu with 503, %lu with 411\n",
+          stats.served[ REQ_READ ], stats.served[ REQ_WRITE ], stats.images, stats.refused_503, stats.refused_411 );
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,20 @@
+/* Host stand-in for MICO.h, only what HTTPUtils.c and the config server use */
+#ifndef __MICO_h__
+#define __MICO_h__
+
+#define DEBUG 0
+#include "Debug.h"
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/select.h>
+
+#define timeval_t timeval
+
+/* The fake socket layer of the test */
+ssize_t read( int fd, void *buf, size_t count );
+
+#endif
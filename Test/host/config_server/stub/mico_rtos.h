@@ -0,0 +1,13 @@
+/* Host stand-in for mico_rtos.h */
+#ifndef __mico_rtos_h__
+#define __mico_rtos_h__
+
+#include "Common.h"
+
+typedef void * mico_mutex_t;
+
+uint32_t mico_get_time( void );
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex );
+
+#endif
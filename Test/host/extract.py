@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Copy functions and declarations out of a source file of the tree, so a host test can
+compile them against its own stubs instead of the rest of the file.
+
+usage: extract.py SOURCE OUTPUT [ITEM]...
+
+ITEM is one of
+  --include HEADER     emit #include "HEADER"
+  --fn SIGNATURE       copy the function whose definition starts with SIGNATURE, e.g.
+                       "static void receive_notify(", up to its closing brace
+  --range FIRST LAST   copy from the line starting with FIRST to the line starting with LAST
+  --decl SIGNATURE     emit a prototype for the function starting with SIGNATURE
+
+Items are written in the order given. Each copied piece starts with a #line directive, so
+compiler and sanitizer reports point at the original file.
+"""
+import sys
+
+
+def line_of(text, pos):
+    return text.count('\n', 0, pos) + 1
+
+
+def find_start(text, prefix):
+    if text.startswith(prefix):
+        return 0
+    pos = text.find('\n' + prefix)
+    if pos < 0:
+        sys.exit('extract.py: "%s" not found' % prefix)
+    return pos + 1
+
+
+def find_definition(text, prefix):
+    """Start of the definition of a function, skipping its prototypes"""
+    pos = 0
+    while True:
+        start = find_start(text[pos:], prefix) + pos
+        body = text.find('{', start)
+        if body >= 0 and text.find(';', start, body) < 0:
+            return start
+        pos = start + len(prefix)
+
+
+def function_end(text, pos):
+    """Index just past the brace closing the body that starts after pos"""
+    depth = 0
+    i = text.index('{', pos)
+    while i < len(text):
+        c = text[i]
+        if text.startswith('//', i):
+            i = text.index('\n', i)
+        elif text.startswith('/*', i):
+            i = text.index('*/', i) + 1
+        elif c in '"\'':
+            i += 1
+            while text[i] != c:
+                i += 2 if text[i] == '\\' else 1
+        elif c == '{':
+            depth += 1
+        elif c == '}':
+            depth -= 1
+            if depth == 0:
+                return i + 1
+        i += 1
+    sys.exit('extract.py: unbalanced braces after line %d' % line_of(text, pos))
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.exit(__doc__)
+    source, output, items = argv[1], argv[2], argv[3:]
+    with open(source, newline='') as f:
+        text = f.read().replace('\r\n', '\n')
+
+    out = ['/* Generated by extract.py from %s, do not edit */\n' % source]
+    i = 0
+    while i < len(items):
+        kind = items[i]
+        if kind == '--include':
+            out.append('#include "%s"\n' % items[i + 1])
+            i += 2
+        elif kind == '--fn':
+            start = find_definition(text, items[i + 1])
+            out.append('#line %d "%s"\n%s\n' % (line_of(text, start), source, text[start:function_end(text, start)]))
+            i += 2
+        elif kind == '--range':
+            start = find_start(text, items[i + 1])
+            last = find_start(text[start:], items[i + 2]) + start
+            end = text.find('\n', last) + 1
+            out.append('#line %d "%s"\n%s' % (line_of(text, start), source, text[start:end]))
+            i += 3
+        elif kind == '--decl':
+            start = find_definition(text, items[i + 1])
+            out.append(' '.join(text[start:text.index(')', start) + 1].split()) + ';\n')
+            i += 2
+        else:
+            sys.exit('extract.py: unknown item %s' % kind)
+
+    with open(output, 'w') as f:
+        f.write(''.join(out))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,188 @@
+/* mdns_browse_start between four devices on one simulated link. A and B publish
+   _easylink._tcp, D browses before they start and C once they are up. At 10 minutes A says
+   goodbye, at 15 minutes B leaves without one and expires with its 4500 s TTL.
+
+   Checked: both browsers resolve both instances with host, address, port and TXT, a goodbye
+   is reported within a second, a silent device when its records expire, and the continuous
+   querying backs off. The traffic of each device is printed per phase. */
+#include "host.h"
+
+#define NODES     4
+#define SERVICE   "_easylink._tcp.local."
+
+#define NODE( n ) \
+  void node##n##_node_tick( void ); \
+  void node##n##_mdns_handler( int fd, uint8_t* pkt, int pkt_len ); \
+  OSStatus node##n##_mdns_add_record( mdns_init_t init, WiFi_Interface interface, uint32_t time_to_live ); \
+  void node##n##_mdns_suspend_record( char* service_name, WiFi_Interface interface, bool will_remove ); \
+  OSStatus node##n##_mdns_browse_start( char* service_name, mdns_browse_callback_t callback, void* arg );
+NODE( 0 ) NODE( 1 ) NODE( 2 ) NODE( 3 )
+
+static void ( *node_tick[ NODES ] )( void ) = { node0_node_tick, node1_node_tick, node2_node_tick, node3_node_tick };
+static void ( *node_handler[ NODES ] )( int, uint8_t*, int ) = { node0_mdns_handler, node1_mdns_handler, node2_mdns_handler, node3_mdns_handler };
+static const char* node_ip[ NODES ] = { "192.168.1.10", "192.168.1.11", "192.168.1.12", "192.168.1.13" };
+
+typedef struct
+{
+  uint32_t at;
+  int      from, length;
+  uint8_t  data[ 1500 ];
+} packet_t;
+
+static packet_t  queue[ 256 ];
+static int       queued;
+static int       current;
+static bool      connected[ NODES ] = { true, true, true, true };
+static long      sent_packets[ NODES ][ 2 ], sent_bytes[ NODES ][ 2 ];   /* Queries, responses */
+static uint32_t  added_at[ NODES ][ 2 ], removed_at[ NODES ][ 2 ];       /* Of A and B, seen by each browser */
+static int       failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+static void select_node( int n )
+{
+  current         = n;
+  host_station_ip = node_ip[ n ];
+}
+
+/* Delivered to every device, the sender included, 1 ms later */
+static void multicast( const uint8_t* packet, int length )
+{
+  int response = ( packet[ 2 ] & 0x80 ) != 0;
+
+  if ( !connected[ current ] ) return;
+  sent_packets[ current ][ response ]++;
+  sent_bytes[ current ][ response ] += length;
+  if ( queued == sizeof( queue ) / sizeof( queue[ 0 ] ) || length > (int) sizeof( queue[ 0 ].data ) )
+  {
+    expect( 0, "link queue full" );
+    return;
+  }
+  queue[ queued ].at     = host_now + 1;
+  queue[ queued ].from   = current;
+  queue[ queued ].length = length;
+  memcpy( queue[ queued++ ].data, packet, length );
+}
+
+static void found( mdns_browse_event_t event, const mdns_service_t* service, void* arg )
+{
+  int browser = (int) (intptr_t) arg, device = service->instance_name[ 3 ] - 'A';
+  uint8_t* ip = (uint8_t*) &service->ip;
+
+  printf( "  %8.3f s  %c: %s %s host %s %u.%u.%u.%u:%u txt %s\n", host_now / 1000.0, 'A' + browser,
+          event == MDNS_SERVICE_ADDED ? "added  " : "removed", service->instance_name, service->host_name ? service->host_name : "-",
+          ip[ 0 ], ip[ 1 ], ip[ 2 ], ip[ 3 ], service->port, service->txt_record ? service->txt_record : "-" );
+  if ( device < 0 || device > 1 ) return;
+  if ( event == MDNS_SERVICE_ADDED )
+  {
+    added_at[ browser ][ device ] = host_now;
+    expect( service->ip == inet_addr( node_ip[ device ] ) && service->port == 8000 + device, "%c: address of %s", 'A' + browser, service->instance_name );
+    expect( service->txt_record && strcmp( service->txt_record, "MAC=C8:93.Firmware Rev=1/.0" ) == 0, "%c: TXT of %s", 'A' + browser, service->instance_name );
+  }
+  else
+    removed_at[ browser ][ device ] = host_now;
+}
+
+static void publish( int n, OSStatus ( *add_record )( mdns_init_t, WiFi_Interface, uint32_t ), char* instance )
+{
+  char host[ 32 ];
+  mdns_init_t init = { SERVICE, host, instance, "MAC=C8/:93.Firmware Rev=1/.0", (uint16_t) ( 8000 + n ) };
+
+  sprintf( host, "%s.local.", instance );
+  select_node( n );
+  expect( add_record( init, Station, 4500 ) == kNoErr, "add %s", instance );
+}
+
+static void run_until( uint32_t end )
+{
+  static uint8_t copy[ 1500 ];
+  int i, n, kept;
+
+  for ( ; host_now < end; host_now++ )
+  {
+    for ( i = kept = 0; i < queued; i++ )
+    {
+      if ( queue[ i ].at > host_now )
+      {
+        queue[ kept++ ] = queue[ i ];
+        continue;
+      }
+      for ( n = 0; n < NODES; n++ )
+      {
+        if ( !connected[ n ] || !connected[ queue[ i ].from ] ) continue;
+        memcpy( copy, queue[ i ].data, queue[ i ].length );
+        select_node( n );
+        node_handler[ n ]( 3, copy, queue[ i ].length );
+      }
+    }
+    queued = kept;
+    for ( n = 0; n < NODES; n++ )
+    {
+      select_node( n );
+      node_tick[ n ]();
+    }
+  }
+}
+
+static long report( const char* label )
+{
+  long queries = 0;
+  int n;
+
+  printf( "%s\n", label );
+  for ( n = 0; n < NODES; n++ )
+  {
+    printf( "  %c: %ld queries %ld B, %ld responses %ld B\n", 'A' + n, sent_packets[ n ][ 0 ], sent_bytes[ n ][ 0 ], sent_packets[ n ][ 1 ], sent_bytes[ n ][ 1 ] );
+    queries += sent_packets[ n ][ 0 ];
+  }
+  memset( sent_packets, 0, sizeof( sent_packets ) );
+  memset( sent_bytes, 0, sizeof( sent_bytes ) );
+  return queries;
+}
+
+int main( void )
+{
+  int browser, device;
+  long queries;
+
+  host_multicast = multicast;
+  host_now = 1000;
+
+  printf( "D browses before A and B publish, C once they are up\n" );
+  select_node( 3 );
+  expect( node3_mdns_browse_start( SERVICE, found, (void*) 3 ) == kNoErr, "browse D" );
+  run_until( 3500 );
+  publish( 0, node0_mdns_add_record, "DevA" );
+  publish( 1, node1_mdns_add_record, "DevB" );
+  run_until( 8000 );
+  select_node( 2 );
+  expect( node2_mdns_browse_start( SERVICE, found, (void*) 2 ) == kNoErr, "browse C" );
+  run_until( 10000 );
+  report( "traffic 1 s - 10 s:" );
+  for ( browser = 2; browser < NODES; browser++ )
+    for ( device = 0; device < 2; device++ )
+      expect( added_at[ browser ][ device ] != 0 && added_at[ browser ][ device ] < ( browser == 3 ? 4000 : 9000 ),
+              "%c resolved Dev%c at %u ms", 'A' + browser, 'A' + device, added_at[ browser ][ device ] );
+
+  run_until( 600000 );
+  queries = report( "traffic 10 s - 10 min:" );
+  /* Intervals double from 1 s: a dozen queries per browser, not one a second */
+  expect( queries < 40, "%ld queries in 10 minutes", queries );
+
+  printf( "600 s: A says goodbye\n" );
+  select_node( 0 );
+  node0_mdns_suspend_record( SERVICE, Station, true );
+  run_until( 900000 );
+  for ( browser = 2; browser < NODES; browser++ )
+    expect( removed_at[ browser ][ 0 ] >= 600000 && removed_at[ browser ][ 0 ] < 602000, "%c removed DevA at %u ms", 'A' + browser, removed_at[ browser ][ 0 ] );
+
+  printf( "900 s: B leaves without a goodbye, its records have a TTL of 4500 s\n" );
+  connected[ 1 ] = false;
+  run_until( 900000 + 4600000 );
+  report( "traffic 10 min - 91.7 min:" );
+  for ( browser = 2; browser < NODES; browser++ )
+    expect( removed_at[ browser ][ 1 ] >= 4500000 && removed_at[ browser ][ 1 ] < 4520000, "%c removed DevB at %u ms", 'A' + browser, removed_at[ browser ][ 1 ] );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
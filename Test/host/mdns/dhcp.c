@@ -0,0 +1,59 @@
+/* The station address arrives by DHCP after NOTIFY_STATION_UP and changes on a lease
+   renewal: the host is only answered for once it has an address, with the current one. */
+#include "host.h"
+#include "mico_mdns.c"
+
+static int failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+/* The address in the answer to an A query, in the byte order the responder keeps it, 0 if none */
+static uint32_t answered_ip( void )
+{
+  host_record_t records[ 8 ];
+  host_query_t q;
+  uint32_t ip;
+  int before = host_sent_packets, i;
+
+  host_now += 2000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "MiCOKit-3165#AB12CD.local", RR_TYPE_A );
+  mdns_handler( 3, q.data, host_query_end( &q ) );
+  for ( i = 0; i < 600; i++, host_now++ )
+    if ( mdns_response_scheduled && (int32_t) ( mico_get_time() - mdns_response_due ) >= 0 )
+      mdns_send_pending_response( 3 );
+  if ( host_sent_packets == before || host_parse( host_last_packet, host_last_length, records, 8 ) < 1 || records[ 0 ].type != RR_TYPE_A )
+    return 0;
+  memcpy( &ip, host_last_packet + host_last_length - 4, 4 );
+  return ip;
+}
+
+int main( void )
+{
+  mdns_init_t init = { "_easylink._tcp.local.", "MiCOKit-3165#AB12CD.local.", "MiCOKit-3165#AB12CD", "Seed=1", 8000 };
+  uint32_t ip, first = htonl( inet_addr( "192.168.1.42" ) ), renewed = htonl( inet_addr( "192.168.1.77" ) );
+
+  host_station_ip = "0.0.0.0";
+  mdns_add_record( init, Station, 4500 );
+  available_services[ 0 ].state = RECORD_NORMAL;
+
+  BonjourNotify_WifiStatusHandler( NOTIFY_STATION_UP, NULL );
+  ip = answered_ip();
+  printf( "station up, no address yet: A %s\n", ip ? "answered" : "not answered" );
+  expect( ip == 0, "A answered without an address" );
+
+  host_station_ip = "192.168.1.42";
+  BonjourNotify_DHCPCompleteHandler( NULL, NULL );
+  ip = answered_ip();
+  printf( "DHCP completed:             A %s\n", ip == first ? "192.168.1.42" : "wrong" );
+  expect( ip == first, "A after DHCP" );
+
+  host_station_ip = "192.168.1.77";
+  BonjourNotify_DHCPCompleteHandler( NULL, NULL );
+  ip = answered_ip();
+  printf( "lease renewed, new address: A %s\n", ip == renewed ? "192.168.1.77" : "wrong" );
+  expect( ip == renewed, "A after the renewal" );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,201 @@
+/* The parts of MiCO mico_mdns.c runs on: sockets, Wi-Fi status and RTOS, on a clock that
+   only the test moves */
+#include "host.h"
+
+#undef malloc
+
+uint32_t    host_now = 1;
+const char *host_station_ip = "192.168.1.42";
+int         host_sent_packets;
+size_t      host_sent_bytes;
+int         host_malloc_calls;
+uint8_t     host_last_packet[ 1500 ];
+int         host_last_length;
+void      (*host_multicast)( const uint8_t* packet, int length );
+
+void *host_malloc( size_t size )
+{
+  host_malloc_calls++;
+  return malloc( size );
+}
+
+uint32_t inet_addr( const char* cp )
+{
+  unsigned a = 0, b = 0, c = 0, d = 0;
+  sscanf( cp, "%u.%u.%u.%u", &a, &b, &c, &d );
+  return a | b << 8 | c << 16 | (uint32_t) d << 24;
+}
+
+OSStatus micoWlanGetIPStatus( IPStatusTypedef* outNetpara, WiFi_Interface inInterface )
+{
+  (void) inInterface;
+  memset( outNetpara, 0, sizeof( *outNetpara ) );
+  strncpy( outNetpara->ip, host_station_ip, sizeof( outNetpara->ip ) - 1 );
+  return kNoErr;
+}
+
+int sendto( int sockfd, const void* data, size_t size, int flags, const struct sockaddr_t* dest_addr, socklen_t addrlen )
+{
+  (void) sockfd; (void) flags; (void) addrlen;
+  /* The broadcast copy is the same packet */
+  if ( dest_addr->s_ip != inet_addr( "224.0.0.251" ) ) return size;
+  host_sent_packets++;
+  host_sent_bytes += size;
+  host_last_length = size < sizeof( host_last_packet ) ? size : sizeof( host_last_packet );
+  memcpy( host_last_packet, data, host_last_length );
+  if ( host_multicast ) host_multicast( data, size );
+  return size;
+}
+
+int socket( int domain, int type, int protocol )                                              { (void) domain; (void) type; (void) protocol; return 3; }
+int bind( int sockfd, struct sockaddr_t* addr, socklen_t addrlen )                            { (void) sockfd; (void) addr; (void) addrlen; return 0; }
+int setsockopt( int sockfd, int level, int optname, const void* optval, socklen_t optlen )    { (void) sockfd; (void) level; (void) optname; (void) optval; (void) optlen; return 0; }
+int recvfrom( int sockfd, void* data, size_t size, int flags, struct sockaddr_t* src_addr, socklen_t* addrlen ) { (void) sockfd; (void) data; (void) size; (void) flags; (void) src_addr; (void) addrlen; return 0; }
+int mico_select( int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval_t* timeout ) { (void) nfds; (void) readfds; (void) writefds; (void) exceptfds; (void) timeout; return 0; }
+int mico_create_event_fd( mico_semaphore_t handle )                                          { (void) handle; return 4; }
+OSStatus mico_system_notify_register( int notify_type, void* functionAddress, void* arg )      { (void) notify_type; (void) functionAddress; (void) arg; return kNoErr; }
+
+uint32_t mico_get_time( void )                                  { return host_now; }
+void     mico_thread_msleep( uint32_t milliseconds )            { (void) milliseconds; }
+OSStatus mico_rtos_create_thread( mico_thread_t* thread, uint8_t priority, const char* name, void (*function)( void* ), uint32_t stack_size, void* arg )
+{
+  (void) priority; (void) name; (void) function; (void) stack_size; (void) arg;
+  *thread = (mico_thread_t) 1;
+  return kNoErr;
+}
+OSStatus mico_rtos_delete_thread( mico_thread_t* thread )       { (void) thread; return kNoErr; }
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex )            { *mutex = (mico_mutex_t) 1; return kNoErr; }
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )            { (void) mutex; return kNoErr; }
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )          { (void) mutex; return kNoErr; }
+OSStatus mico_rtos_init_semaphore( mico_semaphore_t* semaphore, int count ) { (void) count; *semaphore = (mico_semaphore_t) 1; return kNoErr; }
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms ) { (void) semaphore; (void) timeout_ms; return kNoErr; }
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore ) { (void) semaphore; return kNoErr; }
+
+OSStatus MicoRandomNumberRead( void* inBuffer, int inByteCount )
+{
+  uint8_t* p = inBuffer;
+  while ( inByteCount-- > 0 ) *p++ = (uint8_t) rand();
+  return kNoErr;
+}
+
+void host_query_begin( host_query_t* q, uint16_t flags )
+{
+  memset( q, 0, sizeof( *q ) );
+  q->p = q->data + 12;
+  q->data[ 2 ] = flags >> 8;
+  q->data[ 3 ] = flags & 0xFF;
+}
+
+void host_query_name( host_query_t* q, const char* name )
+{
+  const char* dot;
+  size_t length;
+
+  while ( *name )
+  {
+    dot    = strchr( name, '.' );
+    length = dot ? (size_t) ( dot - name ) : strlen( name );
+    *q->p++ = length;
+    memcpy( q->p, name, length );
+    q->p += length;
+    name += length;
+    if ( *name == '.' ) name++;
+  }
+  *q->p++ = 0;
+}
+
+void host_query_u16( host_query_t* q, uint16_t value )
+{
+  *q->p++ = value >> 8;
+  *q->p++ = value & 0xFF;
+}
+
+void host_query_question( host_query_t* q, const char* name, uint16_t type )
+{
+  host_query_name( q, name );
+  host_query_u16( q, type );
+  host_query_u16( q, 1 );
+  q->questions++;
+}
+
+void host_query_ptr( host_query_t* q, const char* name, const char* target, uint32_t ttl )
+{
+  uint8_t* rd_length;
+
+  host_query_name( q, name );
+  host_query_u16( q, 12 );
+  host_query_u16( q, 1 );
+  host_query_u16( q, ttl >> 16 );
+  host_query_u16( q, ttl & 0xFFFF );
+  rd_length = q->p;
+  q->p += 2;
+  host_query_name( q, target );
+  rd_length[ 0 ] = ( q->p - rd_length - 2 ) >> 8;
+  rd_length[ 1 ] = ( q->p - rd_length - 2 ) & 0xFF;
+  q->answers++;
+}
+
+int host_query_end( host_query_t* q )
+{
+  q->data[ 5 ] = q->questions;
+  q->data[ 7 ] = q->answers;
+  return q->p - q->data;
+}
+
+/* Expands the name at offset into out, returns the offset after it or -1 */
+static int parse_name( const uint8_t* packet, int length, int offset, char* out )
+{
+  int next = -1, jumps = 0, used = 0;
+
+  while ( offset < length )
+  {
+    uint8_t label = packet[ offset ];
+    if ( label == 0 )
+    {
+      out[ used ? used - 1 : 0 ] = 0;
+      return next < 0 ? offset + 1 : next;
+    }
+    if ( ( label & 0xC0 ) == 0xC0 )
+    {
+      if ( offset + 1 >= length || ++jumps > 16 ) return -1;
+      if ( next < 0 ) next = offset + 2;
+      offset = ( ( label & 0x3F ) << 8 ) | packet[ offset + 1 ];
+      continue;
+    }
+    if ( offset + 1 + label > length || used + label + 1 >= 256 ) return -1;
+    memcpy( out + used, packet + offset + 1, label );
+    used += label;
+    out[ used++ ] = '.';
+    offset += 1 + label;
+  }
+  return -1;
+}
+
+int host_parse( const uint8_t* packet, int length, host_record_t* records, int max )
+{
+  char name[ 256 ];
+  int offset = 12, i, count, questions;
+
+  if ( length < 12 ) return -1;
+  questions = packet[ 4 ] << 8 | packet[ 5 ];
+  count = ( packet[ 6 ] << 8 | packet[ 7 ] ) + ( packet[ 8 ] << 8 | packet[ 9 ] ) + ( packet[ 10 ] << 8 | packet[ 11 ] );
+  for ( i = 0; i < questions; i++ )
+  {
+    if ( ( offset = parse_name( packet, length, offset, name ) ) < 0 || offset + 4 > length ) return -1;
+    offset += 4;
+  }
+  for ( i = 0; i < count; i++ )
+  {
+    host_record_t* record = i < max ? &records[ i ] : NULL;
+    if ( ( offset = parse_name( packet, length, offset, name ) ) < 0 || offset + 10 > length ) return -1;
+    if ( record )
+    {
+      strcpy( record->name, name );
+      record->type = packet[ offset ] << 8 | packet[ offset + 1 ];
+      record->ttl  = (uint32_t) packet[ offset + 4 ] << 24 | packet[ offset + 5 ] << 16 | packet[ offset + 6 ] << 8 | packet[ offset + 7 ];
+    }
+    offset += 10 + ( packet[ offset + 8 ] << 8 | packet[ offset + 9 ] );
+    if ( offset > length ) return -1;
+  }
+  return offset == length ? count : -1;
+}
@@ -0,0 +1,51 @@
+/* Helpers shared by the mDNS host tests: the simulated clock and network of host.c, a
+   builder for the queries and responses other hosts send, and a decoder for what the
+   device multicasts */
+#ifndef __mdns_host_h__
+#define __mdns_host_h__
+
+#include "mico.h"
+
+/* Milliseconds returned by mico_get_time */
+extern uint32_t    host_now;
+
+/* What micoWlanGetIPStatus reports for the station */
+extern const char *host_station_ip;
+
+/* Multicast copies sent and their bytes, allocations by mico_mdns.c */
+extern int         host_sent_packets;
+extern size_t      host_sent_bytes;
+extern int         host_malloc_calls;
+
+/* The last packet multicast, and an optional hook that sees each one */
+extern uint8_t     host_last_packet[ 1500 ];
+extern int         host_last_length;
+extern void      (*host_multicast)( const uint8_t* packet, int length );
+
+/* Building packets, names are dotted strings */
+typedef struct
+{
+  uint8_t  data[ 512 ];
+  uint8_t* p;
+  uint16_t questions, answers;
+} host_query_t;
+
+void host_query_begin   ( host_query_t* q, uint16_t flags );
+void host_query_name    ( host_query_t* q, const char* name );
+void host_query_u16     ( host_query_t* q, uint16_t value );
+void host_query_question( host_query_t* q, const char* name, uint16_t type );
+void host_query_ptr     ( host_query_t* q, const char* name, const char* target, uint32_t ttl );
+int  host_query_end     ( host_query_t* q );
+
+/* Decoding, names of the records are expanded */
+typedef struct
+{
+  char     name[ 256 ];
+  uint16_t type;
+  uint32_t ttl;
+} host_record_t;
+
+/* Answers, authority and additional records of a packet, or -1 if it is malformed */
+int host_parse( const uint8_t* packet, int length, host_record_t* records, int max );
+
+#endif
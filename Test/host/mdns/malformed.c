@@ -0,0 +1,77 @@
+/* Malformed responses and queries, each in a buffer of exactly its size so AddressSanitizer
+   reports any read past the end: compression pointers past the end and to themselves,
+   labels longer than the packet, names without their terminator. The browser and a
+   scheduled response make the responses go through every parser. */
+#include "host.h"
+#include "mico_mdns.c"
+
+static void feed( const char* label, host_query_t* q )
+{
+  int length = host_query_end( q );
+  uint8_t* packet = malloc( length );
+
+  memcpy( packet, q->data, length );
+  mdns_handler( 3, packet, length );
+  free( packet );
+  printf( "%-40s survived\n", label );
+}
+
+int main( void )
+{
+  mdns_init_t init = { "_easylink._tcp.local.", "MiCOKit-3165#AB12CD.local.", "MiCOKit-3165#AB12CD", "Seed=1", 8000 };
+  host_query_t q;
+
+  mdns_add_record( init, Station, 4500 );
+  available_services[ 0 ].state = RECORD_NORMAL;
+  mdns_browser_count      = 1;
+  mdns_response_scheduled = true;
+
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_u16( &q, 0xFFFF );
+  host_query_u16( &q, RR_TYPE_PTR ); host_query_u16( &q, 1 ); host_query_u16( &q, 0 ); host_query_u16( &q, 4500 );
+  host_query_u16( &q, 2 ); host_query_u16( &q, 0xC00C );
+  q.answers++;
+  feed( "response, owner pointer to 0x3FFF", &q );
+
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_ptr( &q, "_easylink._tcp.local", "x", 4500 );
+  q.p[ -3 ] = 0xC1;
+  q.p[ -2 ] = 0x00;
+  q.p--;
+  feed( "response, rdata pointer to 0x100", &q );
+
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_ptr( &q, "_easylink._tcp.local", "abc", 4500 );
+  q.p[ -5 ] = 60;
+  feed( "response, rdata label past the end", &q );
+
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_u16( &q, 0xC00C );
+  host_query_u16( &q, RR_TYPE_PTR ); host_query_u16( &q, 1 ); host_query_u16( &q, 0 ); host_query_u16( &q, 4500 );
+  host_query_u16( &q, 0 );
+  q.answers++;
+  feed( "response, pointer to itself", &q );
+
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_name( &q, "_easylink._tcp.local" );
+  q.p--;
+  q.answers++;
+  feed( "response, name without terminator", &q );
+
+  mdns_response_scheduled = false;
+  host_query_begin( &q, 0 );
+  *q.p++ = 40;
+  memcpy( q.p, "_easylink", 9 );
+  q.p += 9;
+  q.questions++;
+  feed( "query, question label past the end", &q );
+
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "_easylink._tcp.local", RR_TYPE_PTR );
+  host_query_u16( &q, 0xC3FF );
+  q.answers++;
+  feed( "query, known answer pointer to 0x3FF", &q );
+
+  printf( "PASS\n" );
+  return 0;
+}
@@ -0,0 +1,129 @@
+/* The hashed name table of the mDNS responder: the record table grows up to
+   MDNS_RECORD_COUNT_MAX, names match without regard to case, removed slots and their
+   names are reused, and every entry goes with its record. Built with -DBENCHMARK it also
+   prints the cost of answering each kind of query with 4 and with 64 services. */
+#include "host.h"
+#include "mico_mdns.c"
+#include <time.h>
+
+static int failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+static char service[ 80 ][ 40 ], instance[ 80 ][ 40 ];
+
+static int entries( void )
+{
+  mdns_name_entry_t* entry;
+  int i, count = 0;
+
+  for ( i = 0; i < MDNS_NAME_HASH_SIZE; i++ )
+    for ( entry = mdns_name_table[ i ]; entry != NULL; entry = entry->next )
+      count++;
+  return count;
+}
+
+static OSStatus add( int i, const char* host, uint32_t ttl )
+{
+  mdns_init_t init = { service[ i ], (char*) host, instance[ i ], "MAC=C8/:93/:46/:AB/:12/:CD.Firmware Rev=1/.0", (uint16_t) ( 8000 + i ) };
+  OSStatus err = mdns_add_record( init, Station, ttl );
+  if ( err == kNoErr ) available_services[ find_record_by_service( service[ i ], Station ) ].state = RECORD_NORMAL;
+  return err;
+}
+
+/* Nanoseconds per query, the response is not sent */
+static double cost( host_query_t* q )
+{
+  int i, n = 200000, length = host_query_end( q );
+  clock_t start = clock();
+
+  for ( i = 0; i < n; i++ )
+  {
+    mdns_handler( 3, q->data, length );
+    mdns_response_scheduled = false;
+  }
+  return (double) ( clock() - start ) * 1e9 / CLOCKS_PER_SEC / n;
+}
+
+static void measure( int services )
+{
+  const int last = services - 1;
+  char full[ 80 ], other[ 80 ];
+  host_query_t q;
+  double ptr, srv_txt, a, known;
+  int k;
+
+#ifndef BENCHMARK
+  return;
+#endif
+  snprintf( full, sizeof( full ), "%s.%s", instance[ last ], service[ last ] );
+  host_query_begin( &q, 0 );
+  host_query_question( &q, service[ last ], RR_TYPE_PTR );
+  ptr = cost( &q );
+  host_query_begin( &q, 0 );
+  host_query_question( &q, full, RR_TYPE_SRV );
+  host_query_question( &q, full, RR_TYPE_TXT );
+  srv_txt = cost( &q );
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "MiCOBridge.local.", RR_TYPE_A );
+  a = cost( &q );
+
+  /* A browser that knows three other instances */
+  host_query_begin( &q, 0 );
+  host_query_question( &q, service[ last ], RR_TYPE_PTR );
+  for ( k = 0; k < 3; k++ )
+  {
+    snprintf( other, sizeof( other ), "Other %d.%s", k, service[ last ] );
+    host_query_ptr( &q, service[ last ], other, 4500 );
+  }
+  known = cost( &q );
+  printf( "%2d services: PTR %5.0f ns  SRV+TXT %5.0f ns  A %5.0f ns  PTR + 3 known answers %5.0f ns\n", services, ptr, srv_txt, a, known );
+}
+
+int main( void )
+{
+  int i, count;
+
+  for ( i = 0; i < 80; i++ )
+  {
+    snprintf( service[ i ], sizeof( service[ i ] ), "_svc%d._tcp.local.", i );
+    snprintf( instance[ i ], sizeof( instance[ i ] ), "Bridge Dev %d", i );
+  }
+
+  for ( i = 0; i < 4; i++ ) expect( add( i, "MiCOBridge.local.", 4500 ) == kNoErr, "add %d", i );
+  measure( 4 );
+
+  /* The table grows four slots at a time, up to the limit */
+  for ( i = 4; i < 70; i++ )
+  {
+    OSStatus err = add( i, ( i & 1 ) ? "MiCOBridge.local." : "micobridge.LOCAL.", 4500 );
+    expect( ( err == kNoErr ) == ( i < MDNS_RECORD_COUNT_MAX ), "add %d: %d", i, (int) err );
+  }
+  expect( available_service_count == MDNS_RECORD_COUNT_MAX, "%d slots", available_service_count );
+  expect( entries() == 3 * MDNS_RECORD_COUNT_MAX, "%d name entries for %d records", entries(), MDNS_RECORD_COUNT_MAX );
+  measure( MDNS_RECORD_COUNT_MAX );
+
+  /* Removed slots and their names are reused */
+  for ( i = 10; i < 20; i++ )
+  {
+    _clean_record_resource( &available_services[ i ] );
+    available_services[ i ].state = RECORD_REMOVED;
+  }
+  expect( entries() == 3 * ( MDNS_RECORD_COUNT_MAX - 10 ), "%d name entries after removing 10 records", entries() );
+  for ( i = 64; i < 74; i++ ) expect( add( i, "other.local.", 4500 ) == kNoErr, "add %d into a removed slot", i );
+  expect( available_service_count == MDNS_RECORD_COUNT_MAX && entries() == 3 * MDNS_RECORD_COUNT_MAX, "slots or entries after reuse" );
+
+  /* A service name that differs in case replaces the record */
+  strcpy( service[ 79 ], "_SVC5._TCP.local." );
+  strcpy( instance[ 79 ], "Replaced" );
+  expect( add( 79, "MiCOBridge.local.", 120 ) == kNoErr && find_record_by_service( "_svc5._tcp.local.", Station ) == 5
+          && strncmp( available_services[ 5 ].instance_name, "Replaced.", 9 ) == 0, "record of _svc5 not replaced" );
+  expect( entries() == 3 * MDNS_RECORD_COUNT_MAX, "%d name entries after a replace", entries() );
+
+  for ( i = 0; i < available_service_count; i++ ) _clean_record_resource( &available_services[ i ] );
+  count = entries();
+  expect( count == 0, "%d name entries left", count );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
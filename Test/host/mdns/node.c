@@ -0,0 +1,55 @@
+/* One device of the browse test: mico_mdns.c and one pass of its thread loop, without the
+   select. build.sh compiles it once per device and prefixes its symbols with nodeN_ */
+#include "host.h"
+#include "mico_mdns.c"
+
+void node_tick( void )
+{
+  static uint32_t last_announce;
+  mdns_response_t response;
+  int i, announcing = 0;
+
+  /* _bonjour_send_anounce_thread wakes the loop every 200 ms while records count down */
+  for ( i = 0; i < available_service_count; i++ )
+    if ( available_services[ i ].state != RECORD_REMOVED && available_services[ i ].count_down != 0 )
+      announcing = 1;
+
+  if ( announcing && host_now - last_announce >= 200 )
+  {
+    last_announce = host_now;
+    mdns_response_begin( &response, mDNS_fd, 0x0 );
+    for ( i = 0; i < available_service_count; i++ )
+    {
+      switch ( available_services[ i ].state )
+      {
+        case RECORD_REMOVE:
+          bonjour_add_record( &response, i );
+          if ( --available_services[ i ].count_down == 0 )
+          {
+            _clean_record_resource( &available_services[ i ] );
+            available_services[ i ].state = RECORD_REMOVED;
+          }
+          break;
+        case RECORD_SUSPEND:
+          if ( available_services[ i ].count_down )
+          {
+            bonjour_add_record( &response, i );
+            available_services[ i ].count_down--;
+          }
+          break;
+        case RECORD_UPDATE:
+          bonjour_add_record( &response, i );
+          if ( --available_services[ i ].count_down == 0 )
+            available_services[ i ].state = RECORD_NORMAL;
+          break;
+        default:
+          break;
+      }
+    }
+    mdns_response_send( &response );
+  }
+
+  if ( mdns_response_scheduled && (int32_t) ( mico_get_time() - mdns_response_due ) >= 0 )
+    mdns_send_pending_response( mDNS_fd );
+  mdns_browse_run( mDNS_fd );
+}
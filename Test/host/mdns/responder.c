@@ -0,0 +1,142 @@
+/* Responses of the mDNS responder: size and packet count per query, no allocation on the
+   response path, names compressed within the packet, the A record kept when one service of
+   a host says goodbye, and a name that does not fit the buffer marked as overflow. */
+#include "host.h"
+#include "mico_mdns.c"
+#include <time.h>
+
+#define HOST  "MiCOKit-3165#AB12CD.local."
+#define TXT   "MAC=C8/:93/:46/:AB/:12/:CD.Firmware Rev=MICO_EASYLINK_1/.0.Hardware Rev=MK3165_1." \
+              "MICO OS Rev=31650002/.009.Model=MiCOKit-3165.Protocol=com/.mxchip/.spp.Manufacturer=MXCHIP Inc..Seed=1"
+
+static int failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+static void add( int index, const char* service, const char* instance )
+{
+  mdns_init_t init = { (char*) service, HOST, (char*) instance, TXT, (uint16_t) ( 8000 + index ) };
+  expect( mdns_add_record( init, Station, 4500 ) == kNoErr, "add %s", service );
+  available_services[ index ].state = RECORD_NORMAL;
+}
+
+/* Runs the thread loop until the response is out, well apart from the last one */
+static void answer( host_query_t* q )
+{
+  int i;
+
+  host_now += 2000;
+  mdns_handler( 3, q->data, host_query_end( q ) );
+  for ( i = 0; i < 1000; i++, host_now++ )
+    if ( mdns_response_scheduled && (int32_t) ( mico_get_time() - mdns_response_due ) >= 0 )
+      mdns_send_pending_response( 3 );
+}
+
+static int find( host_record_t* records, int count, uint16_t type, const char* name )
+{
+  int i;
+  for ( i = 0; i < count; i++ )
+    if ( records[ i ].type == type && strcasecmp( records[ i ].name, name ) == 0 ) return i;
+  return -1;
+}
+
+typedef struct
+{
+  const char* label;
+  const char* names[ 3 ];
+  uint16_t    types[ 3 ];
+  int         records;   /* Expected in the answer, the A record once */
+} query_case_t;
+
+int main( void )
+{
+  static const query_case_t cases[] =
+  {
+    { "PTR of one service",  { "_easylink._tcp.local" },                     { RR_TYPE_PTR }, 4 },
+    { "PTR of _services",    { "_services._dns-sd._udp.local" },             { RR_TYPE_PTR }, 4 },
+    { "A of the host",       { "MiCOKit-3165#AB12CD.local" },                { RR_TYPE_A },   1 },
+    { "3 PTRs in one query", { "_easylink._tcp.local", "_easylink_config._tcp.local", "_http._tcp.local" },
+                             { RR_TYPE_PTR, RR_TYPE_PTR, RR_TYPE_PTR }, 10 },
+  };
+  host_record_t records[ 32 ];
+  host_query_t q;
+  mdns_response_t response;
+  int c, i, count, packets, mallocs, n = 200000;
+  size_t bytes;
+  clock_t start;
+
+  add( 0, "_easylink._tcp.local.", "MiCOKit-3165#AB12CD" );
+  add( 1, "_easylink_config._tcp.local.", "MiCOKit-3165#AB12CD Config" );
+  add( 2, "_http._tcp.local.", "MiCOKit-3165#AB12CD Web" );
+  add( 3, "_ota._tcp.local.", "MiCOKit-3165#AB12CD OTA" );
+
+  for ( c = 0; c < (int) ( sizeof( cases ) / sizeof( cases[ 0 ] ) ); c++ )
+  {
+    host_query_begin( &q, 0 );
+    for ( i = 0; i < 3 && cases[ c ].names[ i ]; i++ ) host_query_question( &q, cases[ c ].names[ i ], cases[ c ].types[ i ] );
+    packets = host_sent_packets; bytes = host_sent_bytes; mallocs = host_malloc_calls;
+    answer( &q );
+    count = host_parse( host_last_packet, host_last_length, records, 32 );
+    printf( "%-22s packets %d, %4zu bytes, %d allocations\n", cases[ c ].label, host_sent_packets - packets, host_sent_bytes - bytes, host_malloc_calls - mallocs );
+    expect( host_sent_packets - packets == 1, "%s: %d packets", cases[ c ].label, host_sent_packets - packets );
+    expect( count == cases[ c ].records, "%s: %d records, expected %d", cases[ c ].label, count, cases[ c ].records );
+    expect( host_malloc_calls == mallocs, "%s: response allocated", cases[ c ].label );
+  }
+
+  /* The host name appears once in full, every other occurrence is a pointer */
+  expect( memmem( host_last_packet, host_last_length, "\x13MiCOKit-3165#AB12CD\xc0", 21 ) != NULL, "host name not compressed" );
+
+  /* Announcing the four records, one by one and together. Together they take two packets of
+     the 1 KB buffer instead of four, with the _services PTR and the A record once each */
+  packets = host_sent_packets; bytes = host_sent_bytes;
+  for ( i = 0; i < 4; i++ ) bonjour_send_record( i );
+  printf( "%-22s packets %d, %4zu bytes\n", "announce one by one", host_sent_packets - packets, host_sent_bytes - bytes );
+  packets = host_sent_packets; bytes = host_sent_bytes; mallocs = host_malloc_calls;
+  mdns_response_begin( &response, 3, 0 );
+  for ( i = 0; i < 4; i++ ) bonjour_add_record( &response, i );
+  mdns_response_send( &response );
+  printf( "%-22s packets %d, %4zu bytes\n", "announce together", host_sent_packets - packets, host_sent_bytes - bytes );
+  expect( host_sent_packets - packets == 2 && host_malloc_calls == mallocs, "aggregated announcement: %d packets", host_sent_packets - packets );
+  expect( host_parse( host_last_packet, host_last_length, records, 32 ) > 0, "aggregated announcement: malformed" );
+
+  /* One service of the host says goodbye: the A record of the other one stays live */
+  available_services[ 2 ].state = available_services[ 3 ].state = RECORD_REMOVED;
+  for ( c = 0; c < 3; c++ )
+  {
+    available_services[ 0 ].state = c == 1 ? RECORD_NORMAL : RECORD_REMOVE;
+    available_services[ 1 ].state = c == 0 ? RECORD_NORMAL : RECORD_REMOVE;
+    mdns_response_begin( &response, 3, 0 );
+    bonjour_add_record( &response, c == 1 ? 1 : 0 );
+    bonjour_add_record( &response, c == 1 ? 0 : 1 );
+    mdns_response_send( &response );
+    count = host_parse( host_last_packet, host_last_length, records, 32 );
+    i = find( records, count, RR_TYPE_A, "MiCOKit-3165#AB12CD.local" );
+    expect( i >= 0 && ( records[ i ].ttl != 0 ) == ( c != 2 ), "goodbye %d: A record ttl %u", c, i >= 0 ? records[ i ].ttl : 0 );
+  }
+
+  /* A name that ends exactly at the buffer end is compressed without reading past it, one
+     that does not fit is an overflow */
+  mdns_response_begin( &response, 3, 0 );
+  mdns_response_write_name( &response, "a.local." );
+  response.message.iter = response.message.end - 14;
+  mdns_response_write_name( &response, "xyzw.a.local." );
+  expect( !response.overflow && response.message.iter == response.message.end - 7, "name at the buffer end" );
+  response.message.iter = response.message.end - 5;
+  mdns_response_write_name( &response, "xyzw.b.local." );
+  expect( response.overflow, "name past the buffer end not marked as overflow" );
+
+  available_services[ 0 ].state = available_services[ 1 ].state = RECORD_NORMAL;
+  host_query_begin( &q, 0 );
+  for ( i = 0; i < 3; i++ ) host_query_question( &q, cases[ 3 ].names[ i ], RR_TYPE_PTR );
+  count = host_query_end( &q );
+  start = clock();
+  for ( i = 0; i < n; i++ )
+  {
+    mdns_handler( 3, q.data, count );
+    mdns_response_scheduled = false;
+  }
+  printf( "3 PTRs in one query: %.2f us per query on this host\n", (double) ( clock() - start ) * 1e6 / CLOCKS_PER_SEC / n );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,224 @@
+/* Known-answer suppression, aggregation and rate limiting of the mDNS responder. Single
+   queries check each rule, then a Poisson storm of browse, _services, A and truncated
+   queries at 5, 40 and 200 queries/s, with other responders answering shared records,
+   shows what the device multicasts for it. */
+#include "host.h"
+#include "mico_mdns.c"
+#include <math.h>
+
+#define HOST      "MiCOKit-3165#AB12CD.local"
+#define INSTANCE  "MiCOKit-3165#AB12CD._easylink._tcp.local"
+#define CONFIG    "MiCOKit-3165#AB12CD Config._easylink_config._tcp.local"
+#define DURATION  60000
+#define EVENTS    40000
+
+static int failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+/* One millisecond of the mDNS thread */
+static void tick( void )
+{
+  host_now++;
+  if ( mdns_response_scheduled && (int32_t) ( mico_get_time() - mdns_response_due ) >= 0 )
+    mdns_send_pending_response( 3 );
+}
+
+/* Packets sent in reply to q within ms milliseconds, *delay is when the first one went out */
+static int replies( host_query_t* q, int ms, int* delay )
+{
+  int before = host_sent_packets, start = host_now, i;
+
+  *delay = -1;
+  mdns_handler( 3, q->data, host_query_end( q ) );
+  for ( i = 0; i < ms; i++ )
+  {
+    if ( *delay < 0 && host_sent_packets != before ) *delay = host_now - start;
+    tick();
+  }
+  if ( *delay < 0 && host_sent_packets != before ) *delay = host_now - start;
+  return host_sent_packets - before;
+}
+
+static void check_rules( void )
+{
+  host_record_t records[ 16 ];
+  host_query_t q;
+  int delay, n, count, i;
+
+  host_now += 5000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "_easylink._tcp.local", RR_TYPE_PTR );
+  n = replies( &q, 600, &delay );
+  printf( "PTR                                 %d packet after %d ms\n", n, delay );
+  expect( n == 1 && delay >= MDNS_RESPONSE_DELAY_MIN && delay <= MDNS_RESPONSE_DELAY_MAX, "PTR: %d packets after %d ms", n, delay );
+
+  host_now += 2000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "_easylink._tcp.local", RR_TYPE_PTR );
+  host_query_ptr( &q, "_easylink._tcp.local", INSTANCE, 3000 );
+  n = replies( &q, 600, &delay );
+  printf( "PTR, known answer TTL 3000 s        %d packets\n", n );
+  expect( n == 0, "PTR with a known answer above half its TTL answered" );
+
+  host_now += 2000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "_easylink._tcp.local", RR_TYPE_PTR );
+  host_query_ptr( &q, "_easylink._tcp.local", INSTANCE, 1000 );
+  n = replies( &q, 600, &delay );
+  printf( "PTR, known answer TTL 1000 s        %d packet after %d ms\n", n, delay );
+  expect( n == 1, "PTR with a known answer below half its TTL not answered" );
+
+  host_now += 2000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, HOST, RR_TYPE_A );
+  n = replies( &q, 10, &delay );
+  printf( "A                                   %d packet after %d ms\n", n, delay );
+  expect( n == 1 && delay == 0, "A: %d packets after %d ms", n, delay );
+
+  host_query_begin( &q, 0 );
+  host_query_question( &q, HOST, RR_TYPE_A );
+  n = replies( &q, 600, &delay );
+  printf( "A again 10 ms later                 %d packets\n", n );
+  expect( n == 0, "A multicast twice within a second" );
+
+  host_now += 2000;
+  host_query_begin( &q, 0 );
+  host_query_question( &q, "_services._dns-sd._udp.local", RR_TYPE_PTR );
+  mdns_handler( 3, q.data, host_query_end( &q ) );
+  host_query_begin( &q, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+  host_query_ptr( &q, "_services._dns-sd._udp.local", "_easylink._tcp.local", 1500 );
+  n = replies( &q, 600, &delay );
+  printf( "_services, another responder first  %d packets\n", n );
+  expect( n == 0, "_services answered after another responder sent it" );
+
+  /* The known answers of a truncated query come in a second packet, the PTR they hold is
+     left out of the answer that follows */
+  host_now += 2000;
+  host_query_begin( &q, DNS_MESSAGE_TRUNCATION );
+  host_query_question( &q, "_easylink._tcp.local", RR_TYPE_PTR );
+  mdns_handler( 3, q.data, host_query_end( &q ) );
+  for ( n = 0; n < 50; n++ ) tick();
+  host_query_begin( &q, 0 );
+  host_query_ptr( &q, "_easylink._tcp.local", INSTANCE, 4000 );
+  n = replies( &q, 600, &delay );
+  count = host_parse( host_last_packet, host_last_length, records, 16 );
+  for ( i = 0; i < count && records[ i ].type != RR_TYPE_PTR; i++ );
+  printf( "truncated, known PTR follows        %d packet after %d ms, %d records\n", n, delay + 50, count );
+  expect( n == 1 && count > 0 && i == count, "known PTR in the continuation of a truncated query sent" );
+  expect( delay + 50 >= MDNS_TRUNCATED_DELAY_MIN && delay + 50 <= MDNS_TRUNCATED_DELAY_MAX, "truncated query answered after %d ms", delay + 50 );
+}
+
+/* The storm */
+typedef struct
+{
+  uint32_t     at;
+  host_query_t q;
+} event_t;
+
+static event_t *events;
+static int      event_count;
+
+static double uniform( void )
+{
+  return rand() / ( RAND_MAX + 1.0 );
+}
+
+static host_query_t* event_add( uint32_t at, uint16_t flags )
+{
+  events[ event_count ].at = at;
+  host_query_begin( &events[ event_count ].q, flags );
+  return &events[ event_count++ ].q;
+}
+
+static int event_compare( const void* a, const void* b )
+{
+  return (int) ( (const event_t*) a )->at - (int) ( (const event_t*) b )->at;
+}
+
+static void storm( double rate )
+{
+  int kinds[ 4 ] = { 0 }, e, packets = host_sent_packets;
+  size_t bytes = host_sent_bytes;
+  uint32_t start = host_now;
+  host_query_t* q;
+  double t, r;
+
+  event_count = 0;
+  srand( 1 );
+  for ( t = 1000; t < DURATION && event_count < EVENTS - 2; t += -log( 1 - uniform() ) * 1000 / rate )
+  {
+    r = uniform();
+    if ( r < 0.50 )
+    {
+      /* A browser, with the answer it already has most of the time */
+      kinds[ 0 ]++;
+      q = event_add( start + t, 0 );
+      host_query_question( q, "_easylink._tcp.local", RR_TYPE_PTR );
+      if ( uniform() < 0.7 ) host_query_ptr( q, "_easylink._tcp.local", INSTANCE, 2000 + uniform() * 2500 );
+    }
+    else if ( r < 0.70 )
+    {
+      /* Service enumeration, and another device on the floor answering the shared record */
+      kinds[ 1 ]++;
+      q = event_add( start + t, 0 );
+      host_query_question( q, "_services._dns-sd._udp.local", RR_TYPE_PTR );
+      if ( uniform() < 0.5 ) host_query_ptr( q, "_services._dns-sd._udp.local", "_easylink._tcp.local", 1000 + uniform() * 500 );
+      q = event_add( start + t + 20 + uniform() * 100, DNS_MESSAGE_IS_A_RESPONSE | DNS_MESSAGE_AUTHORITATIVE );
+      host_query_ptr( q, "_services._dns-sd._udp.local", "_easylink._tcp.local", 1500 );
+    }
+    else if ( r < 0.85 )
+    {
+      kinds[ 2 ]++;
+      q = event_add( start + t, 0 );
+      host_query_question( q, HOST, RR_TYPE_A );
+    }
+    else
+    {
+      /* Two services and more known answers than fit, in a second packet */
+      kinds[ 3 ]++;
+      q = event_add( start + t, DNS_MESSAGE_TRUNCATION );
+      host_query_question( q, "_easylink._tcp.local", RR_TYPE_PTR );
+      host_query_question( q, "_easylink_config._tcp.local", RR_TYPE_PTR );
+      q = event_add( start + t + 50 + uniform() * 50, 0 );
+      host_query_ptr( q, "_easylink._tcp.local", INSTANCE, 4000 );
+      if ( uniform() < 0.5 ) host_query_ptr( q, "_easylink_config._tcp.local", CONFIG, 4000 );
+    }
+  }
+  qsort( events, event_count, sizeof( event_t ), event_compare );
+
+  for ( e = 0; host_now < start + DURATION + 1000; tick() )
+    for ( ; e < event_count && events[ e ].at == host_now; e++ )
+      mdns_handler( 3, events[ e ].q.data, host_query_end( &events[ e ].q ) );
+
+  packets = host_sent_packets - packets;
+  bytes   = host_sent_bytes - bytes;
+  printf( "%3.0f queries/s, %5d packets in (%d browse, %d _services, %d A, %d truncated): %4d packets out, %.1f/s, %.0f B/s\n",
+          rate, event_count, kinds[ 0 ], kinds[ 1 ], kinds[ 2 ], kinds[ 3 ], packets, packets / ( DURATION / 1000.0 ), bytes / ( DURATION / 1000.0 ) );
+  /* Each record at most once a second: the A and the two services' records */
+  expect( packets <= 3 * DURATION / MDNS_MULTICAST_INTERVAL, "%.0f queries/s: %d packets out", rate, packets );
+}
+
+int main( void )
+{
+  mdns_init_t init = { "_easylink._tcp.local.", HOST ".", "MiCOKit-3165#AB12CD", "MAC=C8/:93/:46/:AB/:12/:CD.Seed=1", 8000 };
+
+  expect( mdns_add_record( init, Station, 4500 ) == kNoErr, "add" );
+  available_services[ 0 ].state = RECORD_NORMAL;
+  check_rules();
+
+  init.service_name  = "_easylink_config._tcp.local.";
+  init.instance_name = "MiCOKit-3165#AB12CD Config";
+  init.service_port  = 8001;
+  expect( mdns_add_record( init, Station, 4500 ) == kNoErr, "add" );
+  available_services[ 1 ].state = RECORD_NORMAL;
+
+  events = calloc( EVENTS, sizeof( event_t ) );
+  storm( 5 );
+  storm( 40 );
+  storm( 200 );
+  free( events );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
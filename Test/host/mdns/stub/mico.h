@@ -0,0 +1,105 @@
+/* Host stand-in for mico.h, only what mico_mdns.c uses: the mDNS types of mico_system.h,
+   the socket calls, and the Wi-Fi status backed by host.c */
+#ifndef __MICO_H_
+#define __MICO_H_
+
+#define DEBUG 0
+#include "Debug.h"
+#include "Common.h"
+#include "StringUtils.h"
+#include <sys/select.h>
+
+/* Counted by host.c to tell the static response path from the allocating one */
+void *host_malloc( size_t size );
+#define malloc host_malloc
+
+/* mico_wlan.h */
+typedef enum { Soft_AP, Station } WiFi_Interface;
+typedef int WiFiEvent;
+enum { NOTIFY_STATION_UP = 1, NOTIFY_STATION_DOWN, NOTIFY_AP_UP, NOTIFY_AP_DOWN };
+
+typedef struct
+{
+  uint8_t dhcp;
+  char    ip[ 16 ];
+  char    gate[ 16 ];
+  char    mask[ 16 ];
+  char    dns[ 16 ];
+  char    mac[ 16 ];
+  char    broadcastip[ 16 ];
+} IPStatusTypedef;
+
+OSStatus micoWlanGetIPStatus( IPStatusTypedef* outNetpara, WiFi_Interface inInterface );
+
+/* mico_system.h */
+enum { mico_notify_WIFI_STATUS_CHANGED, mico_notify_DHCP_COMPLETED, mico_notify_SYS_WILL_POWER_OFF };
+OSStatus mico_system_notify_register( int notify_type, void* functionAddress, void* arg );
+
+typedef struct _mdns_init_t
+{
+  char *service_name;
+  char *host_name;
+  char *instance_name;
+  char *txt_record;
+  uint16_t service_port;
+} mdns_init_t;
+
+typedef struct _mdns_service_t
+{
+  char *instance_name;
+  char *host_name;
+  char *txt_record;
+  uint32_t ip;
+  uint16_t port;
+} mdns_service_t;
+
+typedef enum
+{
+  MDNS_SERVICE_ADDED,
+  MDNS_SERVICE_REMOVED,
+} mdns_browse_event_t;
+
+typedef void (*mdns_browse_callback_t)( mdns_browse_event_t event, const mdns_service_t *service, void *arg );
+
+/* mico_socket.h */
+struct sockaddr_t
+{
+  uint32_t s_ip;
+  uint16_t s_port;
+};
+
+struct timeval_t
+{
+  long tv_sec;
+  long tv_usec;
+};
+
+typedef int socklen_t;
+
+#define AF_INET             2
+#define SOCK_DGRM           2
+#define IPPROTO_UDP         17
+#define SOL_SOCKET          1
+#define IP_ADD_MEMBERSHIP   3
+#define INADDR_ANY          0
+#define IsValidSocket( s )  ( (s) >= 0 )
+#define htons( x )          __builtin_bswap16( x )
+#define ntohs( x )          __builtin_bswap16( x )
+#define htonl( x )          __builtin_bswap32( x )
+#define ntohl( x )          __builtin_bswap32( x )
+#define select              mico_select
+
+uint32_t inet_addr( const char* cp );
+int socket( int domain, int type, int protocol );
+int bind( int sockfd, struct sockaddr_t* addr, socklen_t addrlen );
+int setsockopt( int sockfd, int level, int optname, const void* optval, socklen_t optlen );
+int sendto( int sockfd, const void* data, size_t size, int flags, const struct sockaddr_t* dest_addr, socklen_t addrlen );
+int recvfrom( int sockfd, void* data, size_t size, int flags, struct sockaddr_t* src_addr, socklen_t* addrlen );
+int mico_select( int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval_t* timeout );
+int mico_create_event_fd( mico_semaphore_t handle );
+int close( int fd );
+
+/* MicoDriverRng.h */
+OSStatus MicoRandomNumberRead( void* inBuffer, int inByteCount );
+
+#endif
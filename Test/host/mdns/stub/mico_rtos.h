@@ -0,0 +1,25 @@
+/* Host stand-in for mico_rtos.h, nothing blocks: time only moves when a test advances it */
+#ifndef __mico_rtos_h__
+#define __mico_rtos_h__
+
+#include "Common.h"
+
+typedef void * mico_mutex_t;
+typedef void * mico_semaphore_t;
+typedef void * mico_thread_t;
+
+#define MICO_APPLICATION_PRIORITY  7
+#define MICO_WAIT_FOREVER          0xFFFFFFFF
+
+uint32_t mico_get_time( void );
+void     mico_thread_msleep( uint32_t milliseconds );
+OSStatus mico_rtos_create_thread( mico_thread_t* thread, uint8_t priority, const char* name, void (*function)( void* ), uint32_t stack_size, void* arg );
+OSStatus mico_rtos_delete_thread( mico_thread_t* thread );
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_init_semaphore( mico_semaphore_t* semaphore, int count );
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms );
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore );
+
+#endif
@@ -0,0 +1 @@
+/* Host stand-in for platform_assert.h */
@@ -0,0 +1,145 @@
+/* The RTOS calls of mico_system_notification.c, from mico_rtos.h, on pthreads. Mutexes check their owner, a
+   queue push does not wait when the queue is full, as with MICO_NO_WAIT */
+#include "Mico.h"
+#include <pthread.h>
+#include <time.h>
+
+typedef struct
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t  not_empty;
+  uint32_t        message_size;
+  uint32_t        length;
+  uint32_t        head;
+  uint32_t        count;
+  uint8_t*        buffer;
+} host_queue_t;
+
+typedef struct
+{
+  void (*function)( void* arg );
+  void* arg;
+} host_thread_t;
+
+static pthread_mutex_t scheduler = PTHREAD_MUTEX_INITIALIZER;
+
+OSStatus mico_rtos_init_mutex( mico_mutex_t* mutex )
+{
+  pthread_mutexattr_t attr;
+  pthread_mutex_t* m = malloc( sizeof( *m ) );
+
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_ERRORCHECK );
+  pthread_mutex_init( m, &attr );
+  *mutex = m;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )
+{
+  if ( pthread_mutex_lock( *mutex ) != 0 ) abort();
+  return kNoErr;
+}
+
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )
+{
+  if ( pthread_mutex_unlock( *mutex ) != 0 ) abort();
+  return kNoErr;
+}
+
+OSStatus mico_rtos_deinit_mutex( mico_mutex_t* mutex )
+{
+  pthread_mutex_destroy( *mutex );
+  free( *mutex );
+  *mutex = NULL;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_init_queue( mico_queue_t* queue, const char* name, uint32_t message_size, uint32_t number_of_messages )
+{
+  host_queue_t* q = calloc( 1, sizeof( *q ) );
+
+  (void) name;
+  pthread_mutex_init( &q->mutex, NULL );
+  pthread_cond_init( &q->not_empty, NULL );
+  q->message_size = message_size;
+  q->length = number_of_messages;
+  q->buffer = malloc( message_size * number_of_messages );
+  *queue = q;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_push_to_queue( mico_queue_t* queue, void* message, uint32_t timeout_ms )
+{
+  host_queue_t* q = *queue;
+
+  (void) timeout_ms;
+  pthread_mutex_lock( &q->mutex );
+  if ( q->count == q->length )
+  {
+    pthread_mutex_unlock( &q->mutex );
+    return kTimeoutErr;
+  }
+  memcpy( q->buffer + ( ( q->head + q->count ) % q->length ) * q->message_size, message, q->message_size );
+  q->count++;
+  pthread_cond_signal( &q->not_empty );
+  pthread_mutex_unlock( &q->mutex );
+  return kNoErr;
+}
+
+OSStatus mico_rtos_pop_from_queue( mico_queue_t* queue, void* message, uint32_t timeout_ms )
+{
+  host_queue_t* q = *queue;
+
+  (void) timeout_ms;
+  pthread_mutex_lock( &q->mutex );
+  while ( q->count == 0 )
+    pthread_cond_wait( &q->not_empty, &q->mutex );
+  memcpy( message, q->buffer + q->head * q->message_size, q->message_size );
+  q->head = ( q->head + 1 ) % q->length;
+  q->count--;
+  pthread_mutex_unlock( &q->mutex );
+  return kNoErr;
+}
+
+static void* thread_main( void* arg )
+{
+  host_thread_t t = *(host_thread_t*) arg;
+
+  free( arg );
+  t.function( t.arg );
+  return NULL;
+}
+
+OSStatus mico_rtos_create_thread( mico_thread_t* thread, uint8_t priority, const char* name, void (*function)( void* arg ), uint32_t stack_size, void* arg )
+{
+  host_thread_t* t = malloc( sizeof( *t ) );
+  pthread_t id;
+
+  (void) priority; (void) name; (void) stack_size;
+  t->function = function;
+  t->arg = arg;
+  if ( pthread_create( &id, NULL, thread_main, t ) != 0 ) return kGeneralErr;
+  pthread_detach( id );
+  *thread = (mico_thread_t) id;
+  return kNoErr;
+}
+
+void mico_rtos_suspend_all_thread( void )
+{
+  pthread_mutex_lock( &scheduler );
+}
+
+long mico_rtos_resume_all_thread( void )
+{
+  pthread_mutex_unlock( &scheduler );
+  return 0;
+}
+
+uint32_t mico_get_time( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint32_t) ( ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
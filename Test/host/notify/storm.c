@@ -0,0 +1,209 @@
+/* An event storm through mico_system_notification.c: the emitter, the wlan driver on a device,
+   triggers WiFi status and DHCP notifications while a 5 ms application handler is subscribed,
+   inline and then deferred, and a churn thread registers and removes a handler meanwhile.
+   Prints how long the emitter is blocked per event and the counters of each subscriber, then
+   checks priority order, slot exhaustion and registrations from many threads at once. */
+#include "mico_system.h"
+#include <pthread.h>
+#include <time.h>
+
+#define SLOW_MS  5
+
+void WifiStatusHandler( WiFiEvent status );
+void NetCallback( IPStatusTypedef *pnet );
+
+static int failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+static volatile int fast_calls, slow_calls, churn_calls, bad_copies, stop;
+
+static void fast_handler( WiFiEvent status, void* arg ) { fast_calls++; }
+static void churn_handler( WiFiEvent status, void* arg ) { churn_calls++; }
+
+/* A deferred handler gets a copy, the emitter reuses its buffer at once */
+static void dhcp_handler( IPStatusTypedef* pnet, void* arg )
+{
+  if ( strcmp( pnet->ip, "192.168.1.42" ) != 0 ) bad_copies++;
+}
+
+/* Not usleep, unistd.h conflicts with mico_rtos.h */
+static void sleep_us( long us )
+{
+  struct timespec ts = { us / 1000000, us % 1000000 * 1000 };
+  nanosleep( &ts, NULL );
+}
+
+static void slow_handler( WiFiEvent status, void* arg ) { sleep_us( SLOW_MS * 1000 ); slow_calls++; }
+
+static uint64_t now_us( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void* churn( void* arg )
+{
+  while ( !stop )
+  {
+    mico_system_notify_register_adv( mico_notify_WIFI_STATUS_CHANGED, (void*) churn_handler, NULL, MICO_NOTIFY_INLINE, 200 );
+    sleep_us( 1000 );
+    mico_system_notify_remove( mico_notify_WIFI_STATUS_CHANGED, (void*) churn_handler );
+    sleep_us( 1000 );
+  }
+  return NULL;
+}
+
+static int compare( const void* a, const void* b )
+{
+  uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Subscribes the slow handlers again, which clears their counters */
+static void subscribe_slow( mico_notify_delivery_t delivery )
+{
+  mico_system_notify_remove( mico_notify_WIFI_STATUS_CHANGED, (void*) slow_handler );
+  mico_system_notify_remove( mico_notify_DHCP_COMPLETED, (void*) dhcp_handler );
+  mico_system_notify_register_adv( mico_notify_WIFI_STATUS_CHANGED, (void*) slow_handler, NULL, delivery, 0 );
+  mico_system_notify_register_adv( mico_notify_DHCP_COMPLETED, (void*) dhcp_handler, NULL, delivery, 0 );
+}
+
+/* events in bursts of burst, gap_us apart, 0: one event per gap. Returns the 99th percentile
+   of the time the emitter is blocked, in us */
+static uint64_t run( const char* label, int events, int gap_us, int burst )
+{
+  uint64_t* blocked = malloc( events * sizeof( *blocked ) );
+  uint64_t start, p99;
+  IPStatusTypedef net;
+  mico_notify_stats_t stats;
+  int i;
+
+  fast_calls = slow_calls = 0;
+  for ( i = 0; i < events; i++ )
+  {
+    start = now_us();
+    WifiStatusHandler( NOTIFY_STATION_UP );
+    memset( &net, 0, sizeof( net ) );
+    strcpy( net.ip, "192.168.1.42" );
+    NetCallback( &net );
+    memset( &net, 0xEE, sizeof( net ) );
+    blocked[ i ] = now_us() - start;
+    if ( burst == 0 || ( i + 1 ) % burst == 0 ) sleep_us( gap_us );
+  }
+  sleep_us( 300000 );
+
+  qsort( blocked, events, sizeof( *blocked ), compare );
+  p99 = blocked[ events * 99 / 100 ];
+  printf( "%-28s emitter blocked p50 %5u us  p99 %5u us  max %5u us\n", label,
+          (unsigned) blocked[ events / 2 ], (unsigned) p99, (unsigned) blocked[ events - 1 ] );
+  free( blocked );
+
+  expect( fast_calls == events, "%s: fast inline handler called %d times for %d events", label, fast_calls, events );
+  expect( mico_system_notify_get_stats( mico_notify_WIFI_STATUS_CHANGED, (void*) slow_handler, &stats ) == kNoErr, "%s: stats", label );
+  printf( "    slow handler count %4u dropped %4u latency avg %5.1f ms max %4u ms, in handler max %3u ms\n", stats.count, stats.dropped,
+          stats.count ? (double) stats.latency_total / stats.count : 0, stats.latency_max, stats.duration_max );
+  expect( stats.count == (uint32_t) slow_calls && stats.count + stats.dropped == (uint32_t) events,
+          "%s: slow handler %u calls and %u dropped for %d events", label, stats.count, stats.dropped, events );
+  return p99;
+}
+
+static char order[ 8 ];
+static void first( void* arg )  { strcat( order, "1" ); }
+static void second( void* arg ) { strcat( order, "2" ); }
+static void third( void* arg )  { strcat( order, "3" ); }
+
+static void priorities( void )
+{
+  mico_system_notify_register_adv( mico_notify_SYS_WILL_POWER_OFF, (void*) third, NULL, MICO_NOTIFY_INLINE, 0 );
+  mico_system_notify_register_adv( mico_notify_SYS_WILL_POWER_OFF, (void*) first, NULL, MICO_NOTIFY_INLINE, 9 );
+  mico_system_notify_register_adv( mico_notify_SYS_WILL_POWER_OFF, (void*) second, NULL, MICO_NOTIFY_INLINE, 9 );
+  sendNotifySYSWillPowerOff();
+  expect( strcmp( order, "123" ) == 0, "called in order %s, not by priority then registration", order );
+  mico_system_notify_remove_all( mico_notify_SYS_WILL_POWER_OFF );
+}
+
+/* Every slot registers a different function, the one past the pool is refused */
+static void handler_n( void* arg ) { }
+
+static void exhaustion( void )
+{
+  int i, registered = 0;
+  OSStatus err = kNoErr;
+
+  for ( i = 0; i < 256 && err == kNoErr; i++ )
+    if ( ( err = mico_system_notify_register( mico_notify_SYS_WILL_POWER_OFF, (char*) handler_n + i, NULL ) ) == kNoErr )
+      registered++;
+  expect( err == kNoResourcesErr, "register past the pool: %d", (int) err );
+  printf( "subscriber slots free for the test: %d\n", registered );
+  mico_system_notify_remove_all( mico_notify_SYS_WILL_POWER_OFF );
+  expect( mico_system_notify_register( mico_notify_SYS_WILL_POWER_OFF, (void*) handler_n, NULL ) == kNoErr, "slots not freed by remove_all" );
+  mico_system_notify_remove_all( mico_notify_SYS_WILL_POWER_OFF );
+}
+
+/* Eight threads register at once, none of them may be lost */
+static pthread_barrier_t together;
+
+static void* register_one( void* function )
+{
+  pthread_barrier_wait( &together );
+  return (void*) (intptr_t) mico_system_notify_register( mico_notify_SYS_WILL_POWER_OFF, function, NULL );
+}
+
+static void concurrent( void )
+{
+  mico_notify_stats_t stats;
+  pthread_t threads[ 8 ];
+  void* result;
+  int round, i, missing = 0;
+
+  for ( round = 0; round < 500; round++ )
+  {
+    pthread_barrier_init( &together, NULL, 8 );
+    for ( i = 0; i < 8; i++ ) pthread_create( &threads[ i ], NULL, register_one, (char*) handler_n + i );
+    for ( i = 0; i < 8; i++ )
+    {
+      pthread_join( threads[ i ], &result );
+      if ( result != NULL ) missing++;
+    }
+    for ( i = 0; i < 8; i++ )
+      if ( mico_system_notify_get_stats( mico_notify_SYS_WILL_POWER_OFF, (char*) handler_n + i, &stats ) != kNoErr ) missing++;
+    mico_system_notify_remove_all( mico_notify_SYS_WILL_POWER_OFF );
+    pthread_barrier_destroy( &together );
+  }
+  expect( missing == 0, "%d of 4000 concurrent registrations lost", missing );
+}
+
+int main( void )
+{
+  pthread_t thread;
+  uint64_t inline_p99, deferred_p99;
+
+  mico_system_notify_register( mico_notify_WIFI_STATUS_CHANGED, (void*) fast_handler, NULL );
+  expect( mico_system_notify_register_adv( mico_notify_WIFI_SCAN_COMPLETED, (void*) fast_handler, NULL, MICO_NOTIFY_DEFERRED, 0 ) == kUnsupportedErr,
+          "a scan notification was accepted for deferred delivery" );
+  pthread_create( &thread, NULL, churn, NULL );
+
+  subscribe_slow( MICO_NOTIFY_INLINE );
+  inline_p99 = run( "slow inline: burst of 4", 200, 20000, 4 );
+  subscribe_slow( MICO_NOTIFY_DEFERRED );
+  deferred_p99 = run( "slow deferred: burst of 4", 200, 20000, 4 );
+  subscribe_slow( MICO_NOTIFY_DEFERRED );
+  run( "slow deferred: 1 per ms", 1000, 1000, 0 );
+
+  stop = 1;
+  pthread_join( thread, NULL );
+  printf( "churn handler calls %d, deferred DHCP copies corrupted %d\n", churn_calls, bad_copies );
+  expect( inline_p99 >= SLOW_MS * 1000, "inline slow handler did not block the emitter" );
+  expect( deferred_p99 < SLOW_MS * 1000 / 5, "deferred slow handler blocked the emitter %u us", (unsigned) deferred_p99 );
+  expect( bad_copies == 0, "%d deferred DHCP copies corrupted", bad_copies );
+
+  priorities();
+  exhaustion();
+  concurrent();
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,16 @@
+/* Host stand-in for MICO.h, the wlan types the notifications of mico_system_notification.c carry */
+#ifndef __MICO_h__
+#define __MICO_h__
+
+#define DEBUG 0
+#include "Debug.h"
+#include "Common.h"
+
+typedef struct { int ApNum; void *ApList; } ScanResult;
+typedef struct { int ApNum; void *ApList; } ScanResult_adv;
+typedef struct { char ssid[32]; } apinfo_adv_t;
+typedef struct { char wifi_ssid[32]; } network_InitTypeDef_st;
+typedef struct { char dhcp; char ip[16]; char gate[16]; char mask[16]; char dns[16]; char mac[16]; char broadcastip[16]; } IPStatusTypedef;
+typedef enum { NOTIFY_STATION_UP = 1, NOTIFY_STATION_DOWN, NOTIFY_AP_UP, NOTIFY_AP_DOWN } WiFiEvent;
+
+#endif
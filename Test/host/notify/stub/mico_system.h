@@ -0,0 +1,90 @@
+/* Host stand-in for mico_system.h, its notification part */
+#ifndef __MICO_SYSTEM_H__
+#define __MICO_SYSTEM_H__
+
+#include "Mico.h"
+
+/** @brief MICO system defined notifications */ 
+typedef enum{
+
+  mico_notify_WIFI_SCAN_COMPLETED,        /**< A wlan scan is completed, type: void (*function)(ScanResult *pApList, void* arg)*/  
+  mico_notify_WIFI_STATUS_CHANGED,        /**< Wlan connection status is changed, type: void (*function)(WiFiEvent status, void* arg)*/
+  mico_notify_WiFI_PARA_CHANGED,          /**< Wlan parameters has received (channel, BSSID, key...), called when connect to a wlan, type: void (*function)(apinfo_adv_t *ap_info, char *key, int key_len, void* arg)*/
+  mico_notify_DHCP_COMPLETED,             /**< MiCO has get the IP address from DHCP server, type: void (*function)(IPStatusTypedef *pnet, void* arg)*/
+  mico_notify_EASYLINK_WPS_COMPLETED,     /**< EasyLink receive SSID, Key, type: void (*function)(network_InitTypeDef_st *nwkpara, void* arg)*/
+  mico_notify_EASYLINK_GET_EXTRA_DATA,    /**< EasyLink receive extra data, type: void (*function)(int datalen, char*data, void* arg)*/
+  mico_notify_TCP_CLIENT_CONNECTED,       /**< A tcp client has connected to TCP server, type: void (*function)(int fd, void* arg)*/
+  mico_notify_DNS_RESOLVE_COMPLETED,      /**< A DNS host address has resolved, type: void (*function)(uint8_t *hostname, uint32_t ip,  void* arg)*/
+  mico_notify_SYS_WILL_POWER_OFF,         /**< System power will be turned off, type: void (*function)(void* arg)*/
+  mico_notify_WIFI_CONNECT_FAILED,        /**< A wlan connection attemption is failed, type: void join_fail(OSStatus err, void* arg)*/
+  mico_notify_WIFI_SCAN_ADV_COMPLETED,    /**< A anvanced wlan scan is completed, type: void (*function)(ScanResult_adv *pApList, void* arg)*/
+  mico_notify_WIFI_Fatal_ERROR,           /**< A fatal error occured when communicating with wlan sub-system, type: void (*function)(void* arg)*/
+  mico_notify_Stack_Overflow_ERROR,       /**< A MiCO RTOS thread's stack is over-flowed, type: void (*function)(char *taskname, void* arg)*/
+ 
+} mico_notify_types_t;
+
+/** @brief How a registered function is called when its notification is triggered */
+typedef enum{
+  MICO_NOTIFY_INLINE,     /**< Called at once in the context that triggers the notification, e.g. the wlan driver */
+  MICO_NOTIFY_DEFERRED,   /**< Queued to the notification thread, the trigger does not wait for it. Pointer arguments
+                               point to copies that are valid during the call. Not supported for the scan, wlan parameter
+                               and EasyLink notifications, whose data cannot be copied, nor for power off and stack overflow */
+} mico_notify_delivery_t;
+
+/** @brief Delivery counters of a registered function, times are in the unit of mico_get_time() */
+typedef struct{
+  uint32_t  count;          /**< Calls of the function */
+  uint32_t  dropped;        /**< Deferred notifications lost because the queue was full */
+  uint32_t  latency_total;  /**< Sum of the times from the trigger to the return of the function */
+  uint32_t  latency_max;    /**< Longest time from the trigger to the return of the function */
+  uint32_t  duration_max;   /**< Longest time spent in the function */
+} mico_notify_stats_t;
+
+/**
+  * @brief  Register a user function to a MiCO notification.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @param  arg: The address of argument, which will be called by registered user function.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_register( mico_notify_types_t notify_type, void* functionAddress, void* arg );
+
+/**
+  * @brief  Register a user function to a MiCO notification, with its delivery and priority.
+  * @note   mico_system_notify_register() is the same as MICO_NOTIFY_INLINE and priority 0.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @param  arg: The address of argument, which will be called by registered user function.
+  * @param  delivery: Call the function inline or from the notification thread.
+  * @param  priority: Functions with a higher priority are called first, in registration
+  *         order if equal.
+  * @retval kNoErr is returned on success, kNoResourcesErr if all subscriber slots are used,
+  *         kUnsupportedErr if the notification cannot be deferred, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_register_adv( mico_notify_types_t notify_type, void* functionAddress, void* arg, mico_notify_delivery_t delivery, uint8_t priority );
+
+/**
+  * @brief  Remove a user function from a MiCO notification.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_remove( mico_notify_types_t notify_type, void *functionAddress );
+
+/**
+  * @brief  Remove all user function from a MiCO notification.
+  * @param  notify_type: The type of MiCO notification.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_remove_all( mico_notify_types_t notify_type);
+
+/**
+  * @brief  Read the delivery counters of a user function registered to a MiCO notification.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @param  stats: Receives the counters.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_get_stats( mico_notify_types_t notify_type, void *functionAddress, mico_notify_stats_t *stats );
+
+#endif
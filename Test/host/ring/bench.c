@@ -0,0 +1,76 @@
+/* Write+read throughput of spsc_ring_buffer_t against ring_buffer_t on one thread, best of
+   7 runs per size. Build without sanitizers for meaningful numbers: CFLAGS=-O2 */
+#include "RingBufferUtils.h"
+#include <stdio.h>
+#include <time.h>
+
+#define TOTAL   ( 1L << 24 )
+#define RUNS    7
+
+static uint8_t ring_memory[ 4096 ], data[ 1024 ];
+
+static double now( void )
+{
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double run_ring_buffer( uint32_t length )
+{
+  ring_buffer_t ring;
+  uint8_t *available;
+  uint32_t bytes;
+  double start;
+  long i;
+
+  ring_buffer_init( &ring, ring_memory, sizeof( ring_memory ) );
+  start = now();
+  for ( i = 0; i < TOTAL; i += length )
+  {
+    ring_buffer_write( &ring, data, length );
+    while ( ring_buffer_used_space( &ring ) != 0 )
+    {
+      ring_buffer_get_data( &ring, &available, &bytes );
+      memcpy( data, available, bytes );
+      ring_buffer_consume( &ring, bytes );
+    }
+  }
+  return now() - start;
+}
+
+static double run_spsc_ring_buffer( uint32_t length )
+{
+  spsc_ring_buffer_t ring;
+  double start;
+  long i;
+
+  spsc_ring_buffer_init( &ring, ring_memory, sizeof( ring_memory ) );
+  start = now();
+  for ( i = 0; i < TOTAL; i += length )
+  {
+    spsc_ring_buffer_write( &ring, data, length );
+    spsc_ring_buffer_read( &ring, data, length );
+  }
+  return now() - start;
+}
+
+int main( void )
+{
+  static const uint32_t lengths[] = { 1, 8, 64, 700 };
+  double best_old, best_new, t;
+  int i, run;
+
+  for ( i = 0; i < (int)( sizeof( lengths ) / sizeof( lengths[ 0 ] ) ); i++ )
+  {
+    best_old = best_new = 1e9;
+    for ( run = 0; run < RUNS; run++ )
+    {
+      if ( ( t = run_ring_buffer( lengths[ i ] ) ) < best_old ) best_old = t;
+      if ( ( t = run_spsc_ring_buffer( lengths[ i ] ) ) < best_new ) best_new = t;
+    }
+    printf( "%3u byte ops: ring_buffer %6.0f MB/s, spsc_ring_buffer %6.0f MB/s\n",
+            lengths[ i ], TOTAL / 1e6 / best_old, TOTAL / 1e6 / best_new );
+  }
+  return 0;
+}
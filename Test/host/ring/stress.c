@@ -0,0 +1,112 @@
+/* Two-thread stress test of spsc_ring_buffer_t. The producer writes a numbered byte stream
+   with bulk writes and write views, the consumer reads it back with bulk reads, peeks and
+   read views, in random sizes, and checks every byte */
+#include "RingBufferUtils.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#define TOTAL       ( 1u << 28 )
+#define RING_SIZE   4096
+
+static spsc_ring_buffer_t ring;
+static uint8_t            ring_memory[ RING_SIZE ];
+
+static uint8_t stream_byte( uint32_t i )
+{
+  return (uint8_t)( i * 31 );
+}
+
+static void *producer( void *arg )
+{
+  uint8_t data[ 700 ];
+  uint32_t sent = 0, want, i, n;
+  unsigned seed = 1;
+  spsc_ring_buffer_view_t view;
+
+  (void) arg;
+  while ( sent < TOTAL )
+  {
+    want = MIN( 1 + rand_r( &seed ) % sizeof( data ), TOTAL - sent );
+    if ( rand_r( &seed ) & 1 )
+    {
+      for ( i = 0; i < want; i++ ) data[ i ] = stream_byte( sent + i );
+      n = spsc_ring_buffer_write( &ring, data, want );
+    }
+    else
+    {
+      n = MIN( spsc_ring_buffer_get_write_view( &ring, &view ), want );
+      for ( i = 0; i < n; i++ )
+      {
+        if ( i < view.length[ 0 ] ) view.data[ 0 ][ i ] = stream_byte( sent + i );
+        else                        view.data[ 1 ][ i - view.length[ 0 ] ] = stream_byte( sent + i );
+      }
+      spsc_ring_buffer_commit_write( &ring, n );
+    }
+    sent += n;
+    if ( spsc_ring_buffer_free_space( &ring ) == 0 ) sched_yield();
+  }
+  return NULL;
+}
+
+int main( void )
+{
+  uint8_t data[ 900 ], again[ 900 ];
+  uint32_t received = 0, want, i, n;
+  unsigned seed = 7;
+  spsc_ring_buffer_view_t view;
+  pthread_t thread;
+  struct timespec start, end;
+
+  if ( spsc_ring_buffer_init( &ring, ring_memory, 3000 ) != kParamErr )
+  {
+    printf( "FAIL: a size that is not a power of two was accepted\n" );
+    return 1;
+  }
+  spsc_ring_buffer_init( &ring, ring_memory, sizeof( ring_memory ) );
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  pthread_create( &thread, NULL, producer, NULL );
+  while ( received < TOTAL )
+  {
+    want = 1 + rand_r( &seed ) % sizeof( data );
+    switch ( rand_r( &seed ) % 3 )
+    {
+      case 0:
+        n = spsc_ring_buffer_read( &ring, data, want );
+        break;
+      case 1:
+        /* What was peeked stays there until committed */
+        n = spsc_ring_buffer_peek( &ring, data, want );
+        if ( n != 0 && ( spsc_ring_buffer_peek( &ring, again, n ) != n || memcmp( data, again, n ) != 0 ) )
+        {
+          printf( "FAIL: second peek differs at %u\n", received );
+          return 1;
+        }
+        spsc_ring_buffer_commit_read( &ring, n );
+        break;
+      default:
+        n = MIN( spsc_ring_buffer_get_read_view( &ring, &view ), want );
+        for ( i = 0; i < n; i++ )
+          data[ i ] = ( i < view.length[ 0 ] ) ? view.data[ 0 ][ i ] : view.data[ 1 ][ i - view.length[ 0 ] ];
+        spsc_ring_buffer_commit_read( &ring, n );
+    }
+    for ( i = 0; i < n; i++ )
+    {
+      if ( data[ i ] != stream_byte( received + i ) )
+      {
+        printf( "FAIL: byte %u is corrupted\n", received + i );
+        return 1;
+      }
+    }
+    received += n;
+    if ( n == 0 ) sched_yield();
+  }
+  pthread_join( thread, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &end );
+
+  printf( "%u bytes through a %u byte ring, %.0f MB/s\nPASS\n", TOTAL, RING_SIZE,
+          TOTAL / 1e6 / ( ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9 ) );
+  return 0;
+}
@@ -0,0 +1 @@
+/* Host stand-in for Debug.h, RingBufferUtils.c does not log */
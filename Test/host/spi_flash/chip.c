@@ -0,0 +1,119 @@
+#include "chip.h"
+#include "spi_flash_platform_interface.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define T_PAGE_PROGRAM_US   700.0
+#define T_SECTOR_ERASE_US   45000.0
+#define T_BLOCK_ERASE_US    400000.0
+#define T_COMMAND_US        5.0
+#define T_BYTE_US           ( 8.0 / 40 )
+
+uint8_t      chip_memory[ CHIP_SIZE ];
+double       chip_now_us;
+chip_stats_t chip_stats;
+
+static double busy_until_us;
+static int    write_enabled;
+
+void chip_reset_stats( void )
+{
+  if ( busy_until_us > chip_now_us ) chip_now_us = busy_until_us;
+  busy_until_us = chip_now_us = 0;
+  memset( &chip_stats, 0, sizeof( chip_stats ) );
+}
+
+void mico_thread_msleep( uint32_t milliseconds )
+{
+  /* Like a 1 ms tick: the first one ends at the next tick boundary */
+  chip_stats.sleeps++;
+  chip_now_us = ceil( chip_now_us / 1000.0 ) * 1000.0 + ( milliseconds ? milliseconds - 1 : 0 ) * 1000.0;
+}
+
+int sflash_platform_init( void* peripheral_id, void** platform_peripheral_out )
+{
+  (void) peripheral_id;
+  if ( platform_peripheral_out ) *platform_peripheral_out = NULL;
+  return 0;
+}
+
+static int chip_error( const char *what, uint8_t command )
+{
+  printf( "chip: %s, command %02X\n", what, command );
+  chip_stats.errors++;
+  return -1;
+}
+
+int sflash_platform_send_recv( const void* platform_peripheral, sflash_platform_message_segment_t* segments, unsigned int num_segments )
+{
+  uint8_t        command = *(const uint8_t*) segments[ 0 ].tx_buffer;
+  const uint8_t *address_bytes;
+  const uint8_t *data;
+  uint32_t       address = 0, page, i;
+  unsigned long  bytes = 0;
+  double         t;
+
+  (void) platform_peripheral;
+  for ( i = 0; i < num_segments; i++ ) bytes += segments[ i ].length;
+  t = T_COMMAND_US + bytes * T_BYTE_US;
+  chip_now_us += t;
+  chip_stats.transfers++;
+
+  if ( command == 0x05 )
+  {
+    chip_stats.polls++;
+    *(uint8_t*) segments[ num_segments - 1 ].rx_buffer = ( chip_now_us < busy_until_us ? 0x01 : 0 ) | ( write_enabled ? 0x02 : 0 );
+    return 0;
+  }
+  if ( chip_now_us < busy_until_us ) return chip_error( "command while busy", command );
+
+  if ( num_segments > 1 && segments[ 1 ].length == 3 )
+  {
+    address_bytes = segments[ 1 ].tx_buffer;
+    address = ( (uint32_t) address_bytes[ 0 ] << 16 ) | ( address_bytes[ 1 ] << 8 ) | address_bytes[ 2 ];
+  }
+
+  switch ( command )
+  {
+    case 0x9F:  /* JEDEC ID */
+      memcpy( segments[ num_segments - 1 ].rx_buffer, "\xC2\x20\x15", 3 );
+      return 0;
+    case 0x06:  /* Write enable */
+      write_enabled = 1;
+      return 0;
+    case 0x01:  /* Write status register */
+      chip_stats.status_writes++;
+      write_enabled = 0;
+      return 0;
+    case 0x03:  /* Read */
+      if ( address + segments[ 2 ].length > CHIP_SIZE ) return chip_error( "read past the end", command );
+      memcpy( segments[ 2 ].rx_buffer, chip_memory + address, segments[ 2 ].length );
+      return 0;
+    case 0x02:  /* Page program, wraps inside the page like the real part */
+      if ( !write_enabled ) return chip_error( "program without write enable", command );
+      if ( segments[ 2 ].length > 256 ) return chip_error( "program longer than a page", command );
+      data = segments[ 2 ].tx_buffer;
+      page = address & ~255u;
+      for ( i = 0; i < segments[ 2 ].length; i++ ) chip_memory[ page + ( ( address + i ) & 255 ) ] &= data[ i ];
+      write_enabled = 0;
+      chip_stats.programs++;
+      busy_until_us = chip_now_us + T_PAGE_PROGRAM_US;
+      return 0;
+    case 0x20:  /* Sector erase */
+      if ( !write_enabled ) return chip_error( "erase without write enable", command );
+      memset( chip_memory + ( address & ~4095u ), 0xFF, 4096 );
+      write_enabled = 0;
+      chip_stats.erases++;
+      busy_until_us = chip_now_us + T_SECTOR_ERASE_US;
+      return 0;
+    case 0xD8:  /* 64 KB block erase */
+      if ( !write_enabled ) return chip_error( "erase without write enable", command );
+      memset( chip_memory + ( address & ~65535u ), 0xFF, 65536 );
+      write_enabled = 0;
+      chip_stats.erases++;
+      busy_until_us = chip_now_us + T_BLOCK_ERASE_US;
+      return 0;
+  }
+  return chip_error( "unknown command", command );
+}
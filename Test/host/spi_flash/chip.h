@@ -0,0 +1,23 @@
+/* Simulated 2 MB SPI NOR flash behind sflash_platform_send_recv, with the typical timings
+   of an MX25L1606E on a 40 MHz bus. Time only passes on the bus and in mico_thread_msleep */
+#ifndef __chip_h__
+#define __chip_h__
+
+#include <stdint.h>
+
+#define CHIP_SIZE  ( 2u << 20 )
+
+extern uint8_t chip_memory[ CHIP_SIZE ];
+extern double  chip_now_us;
+
+typedef struct
+{
+  long transfers, polls, sleeps, programs, erases, status_writes, errors;
+} chip_stats_t;
+
+extern chip_stats_t chip_stats;
+
+/* Restart time and counters, waiting for a busy chip first */
+void chip_reset_stats( void );
+
+#endif
@@ -0,0 +1,2 @@
+/* Host stand-in for Common.h */
+#include <stdint.h>
@@ -0,0 +1,4 @@
+/* Host stand-in for mico_rtos.h, the sleep advances the simulated clock */
+#include <stdint.h>
+
+void mico_thread_msleep( uint32_t milliseconds );
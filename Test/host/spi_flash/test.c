@@ -0,0 +1,76 @@
+/* sflash_write and sflash_erase against the simulated chip: data written in one call of
+   any length and alignment reads back, erases touch only the sectors of their range and
+   use 64 KB blocks where they can, and no command is sent while the chip is busy */
+#include "chip.h"
+#include "spi_flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OTA_BASE    0x40000
+#define OTA_LENGTH  ( 512 * 1024 )
+
+static uint8_t image[ 1 << 20 ], readback[ 1 << 20 ];
+static int     failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+int main( void )
+{
+  sflash_handle_t handle;
+  double erase_us, write_us;
+  long erases;
+  uint32_t i, offset;
+  int pass;
+
+  memset( chip_memory, 0xFF, sizeof( chip_memory ) );
+  expect( init_sflash( &handle, NULL, SFLASH_WRITE_ALLOWED ) == 0, "init_sflash" );
+  srand( 1 );
+  for ( i = 0; i < sizeof( image ); i++ ) image[ i ] = (uint8_t) rand();
+
+  /* An OTA image: erase the partition, then write it in 1 KB pieces or in one call */
+  for ( pass = 0; pass < 2; pass++ )
+  {
+    chip_reset_stats();
+    expect( sflash_erase( &handle, OTA_BASE, OTA_LENGTH ) == 0, "erase" );
+    erase_us = chip_now_us;
+    erases = chip_stats.erases;
+    expect( erases == OTA_LENGTH / 0x10000, "%ld erase commands for 8 aligned blocks", erases );
+
+    chip_reset_stats();
+    if ( pass == 0 )
+      for ( offset = 0; offset < OTA_LENGTH; offset += 1024 ) expect( sflash_write( &handle, OTA_BASE + offset, image + offset, 1024 ) == 0, "write" );
+    else
+      expect( sflash_write( &handle, OTA_BASE, image, OTA_LENGTH ) == 0, "write" );
+    write_us = chip_now_us;
+
+    expect( sflash_read( &handle, OTA_BASE, readback, OTA_LENGTH ) == 0 && memcmp( readback, image, OTA_LENGTH ) == 0, "512 KB image reads back" );
+    printf( "%s erase %4.0f ms (%ld commands), write %5.0f ms %.3f MB/s, %.2f polls per page\n",
+            pass == 0 ? "1 KB writes:" : "one write:  ", erase_us / 1000, erases, write_us / 1000,
+            OTA_LENGTH / write_us, (double) chip_stats.polls / ( OTA_LENGTH / 256 ) );
+  }
+
+  /* Longer than 64 KB and not page aligned, the page count used to wrap */
+  expect( sflash_erase( &handle, 0x100000, 0x30000 ) == 0, "erase" );
+  expect( sflash_write( &handle, 0x100000 + 77, image, 0x20000 + 100 ) == 0, "write" );
+  expect( sflash_read( &handle, 0x100000 + 77, readback, 0x20000 + 100 ) == 0 && memcmp( readback, image, 0x20000 + 100 ) == 0,
+          "128 KB + 100 unaligned write reads back" );
+
+  /* An erase keeps the sectors next to its range */
+  memset( image, 0, 4096 );
+  sflash_write( &handle, 0x1F000, image, 4096 );
+  sflash_write( &handle, 0x30000, image, 4096 );
+  chip_reset_stats();
+  expect( sflash_erase( &handle, 0x20000, 0x10000 ) == 0, "erase" );
+  expect( chip_memory[ 0x1FFFF ] == 0 && chip_memory[ 0x30000 ] == 0 && chip_memory[ 0x20000 ] == 0xFF && chip_memory[ 0x2FFFF ] == 0xFF,
+          "erase of one block kept its neighbours" );
+
+  /* Unaligned range: sectors at the edges, blocks in between */
+  chip_reset_stats();
+  expect( sflash_erase( &handle, 0x0F800, 0x21000 ) == 0, "erase" );
+  expect( chip_stats.erases == 1 + 2 + 1, "%ld erase commands for 0x0F800..0x307FF", chip_stats.erases );
+
+  expect( chip_stats.errors == 0, "%ld chip errors", chip_stats.errors );
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,137 @@
+/* What the transmit and receive paths of the STM32F4 platform_uart.c use from the MCU and
+   from MiCO, backed by the USART and DMA model of each test */
+#ifndef __uart_host_h__
+#define __uart_host_h__
+
+#define DEBUG 0
+#include "Debug.h"
+#include "Common.h"
+#include "RingBufferUtils.h"
+
+/* Registers, one USART and two DMA streams per test. Reads of SR and DR go through the
+   model, which advances the hardware while the driver polls: p->SR is p->SR_[ usart_read_sr() ] */
+typedef struct
+{
+  volatile uint32_t CR, NDTR, M0AR;
+} DMA_Stream_TypeDef;
+
+typedef struct
+{
+  volatile uint16_t SR_[ 1 ], DR_[ 1 ], CR1, CR3;
+} USART_TypeDef;
+
+int usart_read_sr( void );
+int usart_read_dr( void );
+#define SR  SR_[ usart_read_sr() ]
+#define DR  DR_[ usart_read_dr() ]
+
+typedef USART_TypeDef platform_uart_port_t;
+typedef int IRQn_Type;
+
+#define USART_SR_IDLE     0x0010
+#define USART_SR_TC       0x0040
+#define USART_SR_TXE      0x0080
+#define USART_CR1_TCIE    0x0040
+#define USART_IT_TC       1
+#define USART_IT_IDLE     2
+#define USART_FLAG_TC     USART_SR_TC
+#define USART_DMAReq_Tx   0x0080
+#define USART_DMAReq_Rx   0x0040
+#define DMA_SxCR_EN       0x0001
+#define DMA_SxCR_CIRC     0x0100
+#define DMA_IT_HT         0x0008
+#define ENABLE            1
+#define DISABLE           0
+
+/* Stream flags as in DMA_LISR for stream 1: TCIF, HTIF, TEIF, DMEIF, FEIF */
+#define DMA_TC            0x0800
+#define DMA_HT            0x0400
+#define DMA_ERRORS        0x0340
+
+typedef struct
+{
+  DMA_Stream_TypeDef* stream;
+  uint32_t            complete_flags;
+  uint32_t            error_flags;
+} platform_dma_config_t;
+
+typedef struct
+{
+  USART_TypeDef*        port;
+  platform_dma_config_t tx_dma_config;
+  platform_dma_config_t rx_dma_config;
+} platform_uart_t;
+
+/* platform_peripheral.h */
+typedef struct
+{
+  const uint8_t* data;
+  uint32_t       size;
+} platform_uart_buffer_t;
+
+typedef void (*platform_uart_tx_callback_t)( OSStatus result, void* arg );
+
+typedef struct platform_uart_tx_request
+{
+  const platform_uart_buffer_t*    buffers;
+  uint32_t                         count;
+  platform_uart_tx_callback_t      callback;
+  void*                            arg;
+  mico_semaphore_t*                semaphore;
+  struct platform_uart_tx_request* next;
+  uint32_t                         index;
+  uint32_t                         offset;
+  volatile OSStatus                result;
+} platform_uart_tx_request_t;
+
+/* platform_mcu_peripheral.h */
+typedef struct
+{
+  platform_uart_t*                 peripheral;
+  spsc_ring_buffer_t*              rx_buffer;
+  spsc_ring_buffer_t               rx_ring;
+  mico_semaphore_t                 rx_complete;
+  mico_semaphore_t                 tx_complete;
+  mico_mutex_t                     tx_mutex;
+  mico_semaphore_t                 sem_wakeup;
+  volatile uint32_t                tx_size;
+  volatile uint32_t                rx_size;
+  volatile OSStatus                last_receive_result;
+  volatile OSStatus                last_transmit_result;
+  struct platform_uart_tx_request* volatile tx_queue_head;
+  struct platform_uart_tx_request*          tx_queue_tail;
+  volatile bool                    tx_draining;
+  volatile uint32_t                rx_idle_tail;
+  volatile bool                    rx_frame_wait;
+} platform_uart_driver_t;
+
+/* The driver keeps DMA addresses in 32 bits, the model puts the upper half of the host
+   pointer back from one of its own buffers */
+#define DMA_ADDRESS( base, m0ar )  ( (uint8_t*) ( ( (uintptr_t) (base) & ~(uintptr_t) 0xFFFFFFFF ) | (m0ar) ) )
+
+/* Provided by the model */
+uint32_t get_dma_irq_status  ( DMA_Stream_TypeDef* stream );
+void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags );
+OSStatus receive_bytes       ( platform_uart_driver_t* driver, void* data, uint32_t size, uint32_t timeout );
+void     USART_ITConfig      ( USART_TypeDef* usart, int interrupt, int enable );
+void     USART_DMACmd        ( USART_TypeDef* usart, int request, int enable );
+void     USART_ClearFlag     ( USART_TypeDef* usart, int flag );
+void     platform_mcu_powersave_disable( void );
+void     platform_mcu_powersave_enable ( void );
+
+/* The interrupt mask, the model holds interrupts back while it is set */
+extern uint32_t primask_bit;
+static inline uint32_t __get_PRIMASK( void )           { return primask_bit; }
+static inline void     __disable_irq( void )           { primask_bit = 1; }
+static inline void     __set_PRIMASK( uint32_t mask )  { primask_bit = mask; }
+
+OSStatus platform_uart_transmit_bytes     ( platform_uart_driver_t* driver, const uint8_t* data_out, uint32_t size );
+OSStatus platform_uart_transmit_async     ( platform_uart_driver_t* driver, platform_uart_tx_request_t* request );
+OSStatus platform_uart_receive_bytes      ( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t expected_data_size, uint32_t timeout_ms );
+OSStatus platform_uart_receive_frame      ( platform_uart_driver_t* driver, uint8_t* data_in, uint32_t max_size, uint32_t* received, uint32_t timeout_ms );
+OSStatus platform_uart_get_length_in_buffer( platform_uart_driver_t* driver );
+void     platform_uart_irq                ( platform_uart_driver_t* driver );
+void     platform_uart_tx_dma_irq         ( platform_uart_driver_t* driver );
+void     platform_uart_rx_dma_irq         ( platform_uart_driver_t* driver );
+
+#endif
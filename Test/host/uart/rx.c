@@ -0,0 +1,210 @@
+/* Receive path of the STM32F4 UART driver on a model of the USART and its circular RX DMA
+   stream into the SPSC ring, in simulated time at 921600 baud. Frames of random length with
+   gaps between them are read with MicoUartRecvFrame, and checked to come back whole, one
+   per call, with few interrupts. A burst longer than the ring, threshold reads, the length
+   seen mid-stream and an overrun are checked as well. */
+#include "host.h"
+#include "uart_ext.c"
+
+#define BYTE_NS   10850   /* 921600 baud, 8N1 */
+#define STEP_NS   250
+#define RING      2048
+#define PACKET    1024
+#define FRAMES    200
+
+uint32_t primask_bit;
+
+static uint64_t                now;
+static USART_TypeDef           usart;
+static DMA_Stream_TypeDef      rx_stream;
+static platform_uart_t         peripheral = { &usart, { NULL, 0, 0 }, { &rx_stream, DMA_TC, DMA_ERRORS } };
+static platform_uart_driver_t  driver;
+static uint8_t                 ring_memory[ RING ];
+static uint32_t                dma_flags;
+static bool                    in_irq, idle_armed, semaphore;
+static uint64_t                last_byte_at;
+static unsigned long           irqs;
+static int                     failures;
+
+/* Incoming traffic */
+static uint8_t   input[ FRAMES * 256 ];
+static uint64_t  arrival[ FRAMES * 256 ];
+static uint32_t  input_len, next_byte;
+static uint32_t  frame_end[ FRAMES ];
+static uint64_t  frame_end_at[ FRAMES ];
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )                   { (void) stream; return dma_flags; }
+void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags ) { (void) stream; dma_flags &= ~flags; }
+void     USART_ITConfig( USART_TypeDef* usart, int interrupt, int enable )  { (void) usart; (void) interrupt; (void) enable; }
+void     USART_DMACmd( USART_TypeDef* usart, int request, int enable )      { (void) usart; (void) request; (void) enable; }
+void     USART_ClearFlag( USART_TypeDef* usart, int flag )                  { (void) usart; (void) flag; }
+void     platform_mcu_powersave_disable( void )                             { }
+void     platform_mcu_powersave_enable( void )                              { }
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )                        { (void) mutex; return kNoErr; }
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )                      { (void) mutex; return kNoErr; }
+OSStatus receive_bytes( platform_uart_driver_t* d, void* data, uint32_t size, uint32_t timeout ) { (void) d; (void) data; (void) size; (void) timeout; return kUnsupportedErr; }
+uint32_t mico_get_time( void )                                              { return (uint32_t) ( now / 1000000 ); }
+
+/* Reading SR then DR clears IDLE */
+int usart_read_sr( void ) { return 0; }
+int usart_read_dr( void ) { usart.SR_[ 0 ] &= ~USART_SR_IDLE; return 0; }
+
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* s )
+{
+  if ( s == &driver.rx_complete ) semaphore = true;
+  return kNoErr;
+}
+
+static void irq( void ( *handler )( platform_uart_driver_t* ) )
+{
+  in_irq = true;
+  irqs++;
+  handler( &driver );
+  in_irq = false;
+}
+
+/* One step of the receiver, the circular DMA stream and the NVIC */
+static void hw_step( void )
+{
+  now += STEP_NS;
+  if ( next_byte < input_len && arrival[ next_byte ] <= now )
+  {
+    ring_memory[ RING - rx_stream.NDTR ] = input[ next_byte++ ];
+    if ( --rx_stream.NDTR == RING / 2 ) dma_flags |= DMA_HT;
+    if ( rx_stream.NDTR == 0 )
+    {
+      rx_stream.NDTR = RING;
+      dma_flags |= DMA_TC;
+    }
+    last_byte_at = now;
+    idle_armed   = true;
+  }
+  if ( idle_armed && now - last_byte_at >= BYTE_NS )
+  {
+    idle_armed = false;
+    usart.SR_[ 0 ] |= USART_SR_IDLE;
+  }
+
+  if ( in_irq || primask_bit ) return;
+  if ( usart.SR_[ 0 ] & USART_SR_IDLE ) irq( platform_uart_irq );
+  if ( dma_flags & ( DMA_HT | DMA_TC ) ) irq( platform_uart_rx_dma_irq );
+}
+
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* s, uint32_t timeout_ms )
+{
+  uint64_t end = now + (uint64_t) timeout_ms * 1000000;
+
+  (void) s;
+  while ( !semaphore && now < end ) hw_step();
+  if ( !semaphore ) return kTimeoutErr;
+  semaphore = false;
+  return kNoErr;
+}
+
+static void reset( void )
+{
+  memset( &driver, 0, sizeof( driver ) );
+  driver.peripheral = &peripheral;
+  spsc_ring_buffer_init( &driver.rx_ring, ring_memory, RING );
+  driver.rx_buffer = &driver.rx_ring;
+  rx_stream.NDTR = RING;
+  usart.SR_[ 0 ] = 0;
+  now = 0; next_byte = 0; dma_flags = 0; irqs = 0;
+  semaphore = idle_armed = false;
+}
+
+/* size bytes back to back from now, with a gap_ns pause after every `every` bytes */
+static void steady_input( uint32_t size, uint32_t every, uint64_t gap_ns )
+{
+  uint64_t t = 1000;
+  uint32_t i;
+
+  input_len = size;
+  for ( i = 0; i < size; i++ )
+  {
+    input[ i ]   = (uint8_t) rand();
+    arrival[ i ] = t;
+    t += BYTE_NS;
+    if ( every && i % every == every - 1 ) t += gap_ns;
+  }
+}
+
+int main( void )
+{
+  static uint8_t output[ FRAMES * 256 ], packet[ PACKET ];
+  uint64_t t = 1000000, latency, latency_sum = 0, latency_max = 0;
+  uint32_t frame, i, length, got = 0, whole = 0, reads = 0, seen;
+
+  /* 16..240 byte frames, 2..20 ms apart */
+  srand( 7 );
+  input_len = 0;
+  for ( frame = 0; frame < FRAMES; frame++ )
+  {
+    length = 16 + rand() % 225;
+    for ( i = 0; i < length; i++ )
+    {
+      input[ input_len ]     = (uint8_t) rand();
+      arrival[ input_len++ ] = t;
+      t += BYTE_NS;
+    }
+    frame_end[ frame ]    = input_len;
+    frame_end_at[ frame ] = t;
+    t += ( 2 + rand() % 19 ) * 1000000ULL;
+  }
+
+  reset();
+  frame = 0;
+  while ( got < input_len && now < arrival[ input_len - 1 ] + 2000000000ULL )
+  {
+    if ( platform_uart_receive_frame( &driver, packet, PACKET, &length, 500 ) != kNoErr || length == 0 ) continue;
+    memcpy( output + got, packet, length );
+    got += length;
+    reads++;
+    for ( ; frame < FRAMES && frame_end[ frame ] <= got; frame++ )
+    {
+      latency = now - frame_end_at[ frame ];
+      latency_sum += latency;
+      if ( latency > latency_max ) latency_max = latency;
+      if ( frame_end[ frame ] == got && ( frame == 0 ? 0 : frame_end[ frame - 1 ] ) == got - length ) whole++;
+    }
+  }
+  expect( got == input_len && memcmp( output, input, input_len ) == 0, "frames: %u of %u bytes came back intact", got, input_len );
+  expect( whole == FRAMES, "frames: %u of %u came back one per read", whole, FRAMES );
+  printf( "frames: %u bytes, %lu interrupts (%.2f per frame), %u reads, %u/%u whole, latency avg %.1f us max %.1f us\n",
+          got, irqs, (double) irqs / FRAMES, reads, whole, FRAMES, latency_sum / 1e3 / FRAMES, latency_max / 1e3 );
+
+  /* A burst longer than the ring, the half and full transfer interrupts keep the reader ahead */
+  reset();
+  steady_input( 6000, 0, 0 );
+  for ( got = 0; got < input_len && platform_uart_receive_frame( &driver, packet, 256, &length, 500 ) == kNoErr; got += length )
+    memcpy( output + got, packet, length );
+  expect( got == input_len && memcmp( output, input, input_len ) == 0, "6000 byte burst, 256 byte reads: %u bytes intact", got );
+  printf( "6000 byte burst, 256 byte reads: %lu interrupts\n", irqs );
+
+  /* MicoUartRecv waits for its size */
+  reset();
+  steady_input( 3000, 100, 3000000 );
+  for ( got = 0; got < input_len && platform_uart_receive_bytes( &driver, output + got, 100, 500 ) == kNoErr; got += 100 );
+  expect( got == input_len && memcmp( output, input, input_len ) == 0, "MicoUartRecv 100 bytes x30: %u bytes intact", got );
+
+  /* Mid-stream, before any IDLE or half transfer interrupt, the reader sees what the DMA wrote */
+  reset();
+  steady_input( 800, 0, 0 );
+  while ( next_byte < 300 ) hw_step();
+  seen = platform_uart_get_length_in_buffer( &driver );
+  expect( seen == 300 && irqs == 0, "mid-stream: %u of 300 bytes seen after %lu interrupts", seen, irqs );
+  expect( platform_uart_receive_bytes( &driver, output, 300, 0 ) == kNoErr && memcmp( output, input, 300 ) == 0, "mid-stream read without waiting" );
+
+  /* Nobody reads while three rings arrive, the ring never reports more than it holds */
+  reset();
+  steady_input( 3 * RING + 100, 0, 0 );
+  while ( next_byte < input_len ) hw_step();
+  seen = platform_uart_get_length_in_buffer( &driver );
+  expect( seen <= RING, "overrun: %u bytes buffered in a %u byte ring", seen, RING );
+  expect( platform_uart_receive_bytes( &driver, output, MIN( seen, RING / 2 ), 0 ) == kNoErr, "read after overrun" );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -0,0 +1,16 @@
+/* Host stand-in for mico_rtos.h, semaphores wait in simulated time */
+#ifndef __mico_rtos_h__
+#define __mico_rtos_h__
+
+#include "Common.h"
+
+typedef void * mico_mutex_t;
+typedef void * mico_semaphore_t;
+
+uint32_t mico_get_time( void );
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms );
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore );
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex );
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex );
+
+#endif
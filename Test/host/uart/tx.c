@@ -0,0 +1,268 @@
+/* Transmit path of the STM32F4 UART driver on a model of the USART and its TX DMA stream,
+   in simulated time at 921600 baud. Compares the blocking MicoUartSend with the queued
+   MicoUartSendAsync for log lines and for frames sent as three pieces, and checks that the
+   line carries every byte in order, that requests longer than NDTR are split, that empty
+   buffers are skipped and that power save is held exactly while the line is busy. */
+#include "host.h"
+#include "uart_ext.c"
+
+#define BYTE_NS       10850   /* 921600 baud, 8N1 */
+#define STEP_NS       50
+#define IRQ_ENTRY_NS  300     /* Exception entry and handler */
+#define WAKE_NS       12000   /* Semaphore set until the blocked thread runs again */
+#define CALL_NS       500     /* Charged per driver call from a thread */
+#define LINE          64
+#define LINES         400
+
+uint32_t primask_bit;
+
+static uint64_t                now;
+static USART_TypeDef           usart;
+static DMA_Stream_TypeDef      tx_stream;
+static platform_uart_t         peripheral = { &usart, { &tx_stream, DMA_TC, DMA_ERRORS }, { NULL, 0, 0 } };
+static platform_uart_driver_t  driver;
+static uint32_t                dma_flags;
+static bool                    dma_requests, in_irq, shifting, data_full;
+static uint8_t                 data_register;
+static uint64_t                shift_end;
+static uint8_t                 source[ 200000 ];
+static uint8_t                 wire[ 300000 ];
+static uint32_t                wire_len;
+static int                     powersave_count, semaphore_count, callbacks;
+static uint64_t                semaphore_set_at;
+static int                     failures;
+
+#define expect( cond, ... ) do { if( !( cond ) ){ failures++; printf( "FAIL: " __VA_ARGS__ ); printf( "\n" ); } } while( 0 )
+
+uint32_t get_dma_irq_status( DMA_Stream_TypeDef* stream )                   { (void) stream; return dma_flags; }
+void     clear_dma_interrupts( DMA_Stream_TypeDef* stream, uint32_t flags ) { (void) stream; dma_flags &= ~flags; }
+void     USART_DMACmd( USART_TypeDef* usart, int request, int enable )      { (void) usart; (void) request; dma_requests = enable; }
+void     USART_ClearFlag( USART_TypeDef* usart, int flag )                  { usart->SR_[ 0 ] &= ~flag; }
+void     platform_mcu_powersave_disable( void )                             { powersave_count++; }
+void     platform_mcu_powersave_enable( void )                              { powersave_count--; }
+OSStatus mico_rtos_lock_mutex( mico_mutex_t* mutex )                        { (void) mutex; return kNoErr; }
+OSStatus mico_rtos_unlock_mutex( mico_mutex_t* mutex )                      { (void) mutex; return kNoErr; }
+OSStatus receive_bytes( platform_uart_driver_t* d, void* data, uint32_t size, uint32_t timeout ) { (void) d; (void) data; (void) size; (void) timeout; return kUnsupportedErr; }
+
+void USART_ITConfig( USART_TypeDef* usart, int interrupt, int enable )
+{
+  if ( interrupt != USART_IT_TC ) return;
+  if ( enable ) usart->CR1 |= USART_CR1_TCIE; else usart->CR1 &= ~USART_CR1_TCIE;
+}
+
+static void irq( void ( *handler )( platform_uart_driver_t* ) )
+{
+  in_irq = true;
+  now += IRQ_ENTRY_NS;
+  handler( &driver );
+  in_irq = false;
+}
+
+/* One step of the shift register, the TX DMA stream and the NVIC */
+static void hw_step( void )
+{
+  now += STEP_NS;
+  if ( shifting && now >= shift_end ) shifting = false;
+  if ( !shifting && data_full )
+  {
+    wire[ wire_len++ ] = data_register;
+    data_full = false;
+    shifting  = true;
+    shift_end = now + BYTE_NS;
+  }
+  if ( ( tx_stream.CR & DMA_SxCR_EN ) && dma_requests && !data_full && tx_stream.NDTR )
+  {
+    data_register = *DMA_ADDRESS( source, tx_stream.M0AR );
+    tx_stream.M0AR++;
+    data_full = true;
+    if ( --tx_stream.NDTR == 0 )
+    {
+      tx_stream.CR &= ~DMA_SxCR_EN;
+      dma_flags |= DMA_TC;
+    }
+  }
+  usart.SR_[ 0 ] = ( data_full ? 0 : USART_SR_TXE ) | ( usart.SR_[ 0 ] & USART_SR_TC ) | ( !shifting && !data_full ? USART_SR_TC : 0 );
+
+  if ( in_irq || primask_bit ) return;
+  if ( dma_flags & ( DMA_TC | DMA_ERRORS ) ) irq( platform_uart_tx_dma_irq );
+  if ( ( usart.CR1 & USART_CR1_TCIE ) && ( usart.SR_[ 0 ] & USART_SR_TC ) ) irq( platform_uart_irq );
+}
+
+int usart_read_sr( void ) { if ( !in_irq ) hw_step(); return 0; }
+int usart_read_dr( void ) { return 0; }
+uint32_t mico_get_time( void ) { return (uint32_t) ( now / 1000000 ); }
+
+OSStatus mico_rtos_set_semaphore( mico_semaphore_t* semaphore )
+{
+  (void) semaphore;
+  semaphore_count  = 1;
+  semaphore_set_at = now;
+  return kNoErr;
+}
+
+OSStatus mico_rtos_get_semaphore( mico_semaphore_t* semaphore, uint32_t timeout_ms )
+{
+  (void) semaphore; (void) timeout_ms;
+  while ( !semaphore_count ) hw_step();
+  while ( now < semaphore_set_at + WAKE_NS ) hw_step();
+  semaphore_count = 0;
+  return kNoErr;
+}
+
+static void reset( void )
+{
+  memset( &driver, 0, sizeof( driver ) );
+  driver.peripheral = &peripheral;
+  memset( &tx_stream, 0, sizeof( tx_stream ) );
+  usart.SR_[ 0 ] = USART_SR_TXE | USART_SR_TC;
+  usart.CR1 = 0;
+  dma_flags = 0; dma_requests = shifting = data_full = false;
+  wire_len = 0; now = 0; semaphore_count = 0; powersave_count = 0; callbacks = 0;
+}
+
+static void run_until_idle( void )
+{
+  uint64_t start = now;
+  while ( ( shifting || data_full || driver.tx_queue_head || driver.tx_draining ) && now - start < 5000000000ULL ) hw_step();
+  expect( now - start < 5000000000ULL, "transmitter did not go idle" );
+}
+
+static bool wire_is( const uint8_t* data, uint32_t size )
+{
+  return wire_len == size && memcmp( wire, data, size ) == 0;
+}
+
+static void callback( OSStatus result, void* arg )
+{
+  (void) result; (void) arg;
+  callbacks++;
+}
+
+static void report( const char* name, uint64_t blocked, uint64_t longest_call, uint32_t bytes )
+{
+  printf( "%-32s %7.1f KB/s  line busy %5.1f%%  caller blocked %7.2f ms (longest call %6.1f us)\n", name,
+          bytes / ( now / 1e9 ) / 1024, 100.0 * bytes * BYTE_NS / now, blocked / 1e6, longest_call / 1e3 );
+}
+
+/* Send LINES log lines after work_ns of formatting each, in one blocking or queued call */
+static void send_lines( const char* name, bool async, uint64_t work_ns )
+{
+  static platform_uart_tx_request_t requests[ LINES ];
+  static platform_uart_buffer_t     buffers[ LINES ];
+  uint64_t start, blocked = 0, longest = 0, work_end;
+  int i;
+
+  reset();
+  for ( i = 0; i < LINES; i++ )
+  {
+    for ( work_end = now + work_ns; now < work_end; ) hw_step();
+    start = now;
+    now += CALL_NS;
+    if ( async )
+    {
+      buffers[ i ]  = (platform_uart_buffer_t){ source + i * LINE, LINE };
+      requests[ i ] = (platform_uart_tx_request_t){ &buffers[ i ], 1, callback, NULL, NULL };
+      expect( platform_uart_transmit_async( &driver, &requests[ i ] ) == kNoErr, "transmit_async" );
+    }
+    else
+      expect( platform_uart_transmit_bytes( &driver, source + i * LINE, LINE ) == kNoErr, "transmit_bytes" );
+    blocked += now - start;
+    if ( now - start > longest ) longest = now - start;
+  }
+  run_until_idle();
+  expect( wire_is( source, LINES * LINE ), "%s: line carried other bytes", name );
+  expect( !async || callbacks == LINES, "%s: %d callbacks", name, callbacks );
+  expect( powersave_count == 0, "%s: power save held %d times after the line went idle", name, powersave_count );
+  report( name, blocked, longest, LINES * LINE );
+}
+
+/* Frames of a 4 byte header, 56 byte payload and 4 byte CRC */
+static void send_frames( const char* name, bool async )
+{
+  static platform_uart_tx_request_t requests[ LINES ];
+  static platform_uart_buffer_t     buffers[ LINES ][ 3 ];
+  uint64_t start, blocked = 0, longest = 0;
+  const uint8_t* frame;
+  int i;
+
+  reset();
+  for ( i = 0; i < LINES; i++ )
+  {
+    frame = source + i * LINE;
+    start = now;
+    if ( async )
+    {
+      now += CALL_NS;
+      buffers[ i ][ 0 ] = (platform_uart_buffer_t){ frame, 4 };
+      buffers[ i ][ 1 ] = (platform_uart_buffer_t){ frame + 4, 56 };
+      buffers[ i ][ 2 ] = (platform_uart_buffer_t){ frame + 60, 4 };
+      requests[ i ] = (platform_uart_tx_request_t){ buffers[ i ], 3, callback, NULL, NULL };
+      platform_uart_transmit_async( &driver, &requests[ i ] );
+    }
+    else
+    {
+      now += 3 * CALL_NS;
+      platform_uart_transmit_bytes( &driver, frame, 4 );
+      platform_uart_transmit_bytes( &driver, frame + 4, 56 );
+      platform_uart_transmit_bytes( &driver, frame + 60, 4 );
+    }
+    blocked += now - start;
+    if ( now - start > longest ) longest = now - start;
+  }
+  run_until_idle();
+  expect( wire_is( source, LINES * LINE ), "%s: line carried other bytes", name );
+  expect( powersave_count == 0, "%s: power save held %d times after the line went idle", name, powersave_count );
+  report( name, blocked, longest, LINES * LINE );
+}
+
+int main( void )
+{
+  static platform_uart_tx_request_t requests[ 3 ];
+  static platform_uart_buffer_t     buffers[ 3 ][ 3 ];
+  uint32_t i;
+
+  srand( 1 );
+  for ( i = 0; i < sizeof( source ); i++ ) source[ i ] = (uint8_t) rand();
+
+  send_lines( "MicoUartSend, 64B x400", false, 0 );
+  send_lines( "MicoUartSendAsync, 64B x400", true, 0 );
+  send_frames( "frames 4+56+4, 3 sends", false );
+  send_frames( "frames 4+56+4, 1 async request", true );
+  send_lines( "80us work + MicoUartSend", false, 80000 );
+  send_lines( "80us work + MicoUartSendAsync", true, 80000 );
+
+  /* A buffer longer than NDTR between empty ones, then a second request behind it */
+  reset();
+  buffers[ 0 ][ 0 ] = (platform_uart_buffer_t){ source, 0 };
+  buffers[ 0 ][ 1 ] = (platform_uart_buffer_t){ source, 70000 };
+  buffers[ 0 ][ 2 ] = (platform_uart_buffer_t){ source + 70000, 0 };
+  requests[ 0 ] = (platform_uart_tx_request_t){ buffers[ 0 ], 3, callback, NULL, NULL };
+  buffers[ 1 ][ 0 ] = (platform_uart_buffer_t){ source + 70000, 10 };
+  requests[ 1 ] = (platform_uart_tx_request_t){ buffers[ 1 ], 1, callback, NULL, NULL };
+  expect( platform_uart_transmit_async( &driver, &requests[ 0 ] ) == kNoErr, "transmit_async" );
+  expect( platform_uart_transmit_async( &driver, &requests[ 1 ] ) == kNoErr, "transmit_async" );
+  requests[ 2 ] = (platform_uart_tx_request_t){ NULL, 1, callback, NULL, NULL };
+  expect( platform_uart_transmit_async( &driver, &requests[ 2 ] ) == kParamErr, "request without buffers accepted" );
+  buffers[ 2 ][ 0 ] = (platform_uart_buffer_t){ source, 0 };
+  requests[ 2 ] = (platform_uart_tx_request_t){ buffers[ 2 ], 1, callback, NULL, NULL };
+  expect( platform_uart_transmit_async( &driver, &requests[ 2 ] ) == kParamErr, "request of empty buffers accepted" );
+  while ( requests[ 0 ].result == kInProgressErr ) hw_step();
+  expect( requests[ 1 ].result == kInProgressErr, "second request finished before the first" );
+  run_until_idle();
+  expect( wire_is( source, 70010 ), "70000 + 10 byte requests: line carried other bytes" );
+  expect( callbacks == 2 && requests[ 0 ].result == kNoErr && requests[ 1 ].result == kNoErr, "70000 + 10 byte requests: results" );
+  expect( powersave_count == 0, "70000 + 10 byte requests: power save held %d times", powersave_count );
+
+  /* A blocking send right behind queued traffic goes out after it */
+  reset();
+  buffers[ 0 ][ 0 ] = (platform_uart_buffer_t){ source, 1000 };
+  requests[ 0 ] = (platform_uart_tx_request_t){ buffers[ 0 ], 1, callback, NULL, NULL };
+  platform_uart_transmit_async( &driver, &requests[ 0 ] );
+  expect( platform_uart_transmit_bytes( &driver, source + 1000, 500 ) == kNoErr, "transmit_bytes" );
+  expect( wire_len == 1500, "transmit_bytes returned before its last byte left, %u of 1500 on the line", wire_len );
+  run_until_idle();
+  expect( wire_is( source, 1500 ) && callbacks == 1 && powersave_count == 0, "async then blocking send: order or power save" );
+
+  printf( failures ? "FAIL\n" : "PASS\n" );
+  return failures != 0;
+}
@@ -46,14 +46,18 @@
 
 #define PAR_OPT_READ_POS      ( 0 )
 #define PAR_OPT_WRITE_POS     ( 1 )
+#define PAR_OPT_CACHE_POS     ( 2 )
 
 #define PAR_OPT_READ_MASK  	  ( 0x1u << PAR_OPT_READ_POS )
 #define PAR_OPT_WRITE_MASK 	  ( 0x1u << PAR_OPT_WRITE_POS )
+#define PAR_OPT_CACHE_MASK    ( 0x1u << PAR_OPT_CACHE_POS )
 
 #define PAR_OPT_READ_DIS      ( 0x0u << PAR_OPT_READ_POS )
 #define PAR_OPT_READ_EN       ( 0x1u << PAR_OPT_READ_POS )
 #define PAR_OPT_WRITE_DIS     ( 0x0u << PAR_OPT_WRITE_POS )
 #define PAR_OPT_WRITE_EN      ( 0x1u << PAR_OPT_WRITE_POS )
+#define PAR_OPT_CACHE_DIS     ( 0x0u << PAR_OPT_CACHE_POS )
+#define PAR_OPT_CACHE_EN      ( 0x1u << PAR_OPT_CACHE_POS ) /**< Read through the sector cache, see MicoFlashEnableCache() */
 
 /******************************************************
  *                   Enumerations
@@ -86,6 +90,24 @@ typedef struct
     uint32_t                   partition_options;
 } mico_logic_partition_t;
 
+/** Checksum fed by MicoFlashChecksum(), e.g. a CRC16 or MD5 update function and its context */
+typedef struct
+{
+    void                     (*update)( void *context, const uint8_t *data, uint32_t length );
+    void*                      context;
+} mico_flash_checksum_t;
+
+/** Observer called by MicoFlashWrite() with the data written to a partition, off_set is
+ *  the partition offset of the first byte */
+typedef void (*mico_flash_write_observer_t)( void *context, uint32_t off_set, const uint8_t *data, uint32_t length );
+
+/** Counters of the MicoFlashRead() sector cache, one hit or miss per sector touched */
+typedef struct
+{
+    uint32_t                   hits;
+    uint32_t                   misses;
+} mico_flash_cache_stats_t;
+
 
 /******************************************************
  *                 Global Variables
@@ -163,6 +185,71 @@ OSStatus MicoFlashRead( mico_partition_t inPartition, volatile uint32_t* off_set
  */
 OSStatus MicoFlashEnableSecurity( mico_partition_t partition, uint32_t off_set, uint32_t size );
 
+/** Feed an area on a Flash logical partition into one or more checksums in a single pass
+ *
+ * @note Flash that the platform maps into the CPU address space (platform_flash_map)
+ *       is handed to the checksums in place, other flash is read into buffer block
+ *       by block, as MicoFlashRead() would do.
+ *
+ * @param  inPartition    : The target flash logical partition
+ * @param  off_set        : Start offset in the partition, point to the first unread
+ *                          offset after this function is returned
+ * @param  size           : Length of the area
+ * @param  checksums      : Checksums updated with the content of the area
+ * @param  num            : Number of checksums
+ * @param  buffer         : Scratch buffer used when the flash is not memory mapped,
+ *                          NULL for a small internal buffer
+ * @param  buffer_len     : The length of the buffer
+ *
+ * @return    kNoErr        : On success.
+ * @return    kGeneralErr   : If an error occurred with any step
+ */
+OSStatus MicoFlashChecksum( mico_partition_t inPartition, volatile uint32_t* off_set, uint32_t size,
+                            const mico_flash_checksum_t *checksums, uint32_t num,
+                            uint8_t *buffer, uint32_t buffer_len );
+
+/** Observe the data written to a Flash logical partition by MicoFlashWrite()
+ *
+ * @note Lets a consumer hash an image while a third party (e.g. the TFTP client) is
+ *       writing it, instead of reading the partition back afterwards. Only one
+ *       observer is supported, register NULL to remove it.
+ *
+ * @param  inPartition    : The observed flash logical partition
+ * @param  observer       : Function called after each successful write, or NULL
+ * @param  context        : Argument passed to observer
+ *
+ * @return    kNoErr        : On success.
+ * @return    kParamErr     : If the partition is invalid
+ */
+OSStatus MicoFlashSetWriteObserver( mico_partition_t inPartition, mico_flash_write_observer_t observer, void *context );
+
+/** Read a Flash logical partition through the sector cache, or stop doing so
+ *
+ * @note The cache holds MICO_FLASH_CACHE_SECTORS whole 4K sectors (define it in
+ *       platform_config.h, the default 0 leaves the cache out) and replaces the
+ *       least recently used one on a miss. It is meant for flash that is not
+ *       memory mapped, like SPI flash. A partition starts with the setting of
+ *       PAR_OPT_CACHE_EN in its partition_options. MicoFlashWrite() and
+ *       MicoFlashErase() drop the sectors they touch from the cache.
+ *
+ * @param  inPartition    : The target flash logical partition
+ * @param  enable         : true: cache reads, false: read the flash directly
+ *
+ * @return    kNoErr          : On success.
+ * @return    kParamErr       : If the partition is invalid
+ * @return    kUnsupportedErr : If the cache is not built in
+ */
+OSStatus MicoFlashEnableCache( mico_partition_t inPartition, bool enable );
+
+/** Get the hit and miss counters of the sector cache
+ *
+ * @param  stats          : Filled with the counters since boot
+ *
+ * @return    kNoErr          : On success.
+ * @return    kUnsupportedErr : If the cache is not built in, stats are zeroed
+ */
+OSStatus MicoFlashGetCacheStats( mico_flash_cache_stats_t *stats );
+
 #ifdef BOOTLOADER
 OSStatus MicoFlashDisableSecurity( mico_partition_t partition, uint32_t off_set, uint32_t size );
 #endif
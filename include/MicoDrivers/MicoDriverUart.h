@@ -56,6 +56,10 @@
  ******************************************************/
  typedef platform_uart_config_t                  mico_uart_config_t;
 
+ typedef platform_uart_buffer_t                  mico_uart_buffer_t;
+
+ typedef platform_uart_tx_request_t              mico_uart_tx_request_t;
+
 /******************************************************
  *                 Function Declarations
  ******************************************************/
@@ -72,7 +76,8 @@
  *
  * @param  uart     : the interface which should be initialised
  * @param  config   : UART configuration structure
- * @param  optional_rx_buffer : Pointer to an optional RX ring buffer
+ * @param  optional_rx_buffer : Pointer to an optional RX ring buffer. Give it a power of two
+ *                              size, some platforms only use the largest power of two of it
  *
  * @return    kNoErr        : on success.
  * @return    kGeneralErr   : if an error occurred with any step
@@ -115,6 +120,23 @@ OSStatus MicoUartFinalize( mico_uart_t uart );
 OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
 
 
+/** Queue data for transmission on a UART interface and return immediately
+ *
+ * The buffers of the request are sent back to back, after any request queued
+ * before it. On completion, request->result is updated, then the optional
+ * callback is called from interrupt context and the optional semaphore is set.
+ * The request and its buffers must stay valid until then. It can be called
+ * from several threads at once and from a completion callback.
+ *
+ * @param  uart     : the UART interface
+ * @param  request  : scatter-gather list, callback and semaphore
+ *
+ * @return    kNoErr        : if the request is queued.
+ * @return    kParamErr     : if the request holds no data
+ */
+OSStatus MicoUartSendAsync( mico_uart_t uart, mico_uart_tx_request_t* request );
+
+
 /** Receive data on a UART interface
  *
  * @param  uart     : the UART interface
@@ -127,6 +149,25 @@ OSStatus MicoUartSend( mico_uart_t uart, const void* data, uint32_t size );
  */
 OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeout );
 
+
+/** Receive one frame on a UART interface, a frame being the data received
+ *  before a gap on the line. Needs the optional RX ring buffer.
+ *
+ * Frames longer than size are returned in several pieces. Frames that were
+ * already waiting back to back in the ring buffer may be returned together.
+ *
+ * @param  uart     : the UART interface
+ * @param  data     : pointer to the buffer which will store incoming data
+ * @param  size     : size of the buffer
+ * @param  received : number of bytes stored in data
+ * @param  timeout  : timeout in milisecond
+ *
+ * @return    kNoErr        : on success.
+ * @return    kTimeoutErr   : if no frame ended within timeout
+ * @return    kGeneralErr   : if an error occurred with any step
+ */
+OSStatus MicoUartRecvFrame( mico_uart_t uart, void* data, uint32_t size, uint32_t* received, uint32_t timeout );
+
 /** Read the length of the data that is already recived by uart driver and stored in buffer
  *
  * @param  uart     : the UART interface
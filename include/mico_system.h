@@ -34,6 +34,7 @@
 
 #include "common.h"
 #include "system.h"
+#include "mico_platform.h"
 #include "json_c/json.h"
 
 #ifdef __cplusplus
@@ -108,6 +109,105 @@ void appRestoreDefault_callback(void * const user_config_data, uint32_t size);
   */
 OSStatus mico_system_context_update( mico_Context_t* const in_context );
 
+/** @} */
+/*****************************************************************************/
+/** \defgroup system_kv Key-value Storage Functions
+  * @brief Typed key-value pairs stored with the core data in the parameter
+  *        partitions. A change is appended to flash as one record, so it costs
+  *        a few bytes written instead of an erase of the parameter partitions.
+  *        Space is shared with the core data journal: about 500 bytes on 4k
+  *        parameter partitions.
+  * @{
+  */
+/*****************************************************************************/
+
+#define MICO_KV_KEY_MAX         31    /**< Max length of a key, without the terminating zero */
+#define MICO_KV_TXN_MAX_OPS     8     /**< Max set and delete operations in a transaction */
+
+/** @brief Type of the value, checked on read */
+typedef enum {
+  MICO_KV_TYPE_BLOB,          /**< Binary data in any length */
+  MICO_KV_TYPE_UINT32,        /**< uint32_t */
+  MICO_KV_TYPE_INT32,         /**< int32_t */
+  MICO_KV_TYPE_STRING,        /**< Characters, the terminating zero is stored if included in length */
+} mico_kv_type_t;
+
+/** @brief Set and delete operations written to flash at once by
+  *        @ref mico_system_kv_txn_commit, keys and values are not copied and
+  *        should be kept until commit */
+typedef struct {
+  uint8_t         count;
+  struct {
+    const char    *key;
+    const void    *value;     /**< NULL to delete the key */
+    uint16_t      length;
+    uint8_t       type;
+  } ops[MICO_KV_TXN_MAX_OPS];
+} mico_kv_txn_t;
+
+/**
+  * @brief  Read the value of a key.
+  * @param  key: Key of the value.
+  * @param  type: Type of the value, should be the type that was written.
+  * @param  value: Buffer to store the value.
+  * @param  length: Length of the buffer, the length of the value is returned.
+  * @retval kNoErr is returned on success, kNotFoundErr if the key is not exist,
+  *         kTypeErr on a type mismatch, kSizeErr if the buffer is too small,
+  *         otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_get( const char *key, mico_kv_type_t type, void *value, uint32_t *length );
+
+/**
+  * @brief  Write the value of a key to non-volatile storage.
+  * @param  key: Key of the value, MICO_KV_KEY_MAX characters at most.
+  * @param  type: Type of the value.
+  * @param  value: The value.
+  * @param  length: Length of the value.
+  * @retval kNoErr is returned on success, kNoSpaceErr if the value is not fit in
+  *         the storage, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_set( const char *key, mico_kv_type_t type, const void *value, uint32_t length );
+
+/**
+  * @brief  Remove a key from non-volatile storage.
+  * @param  key: Key to be removed.
+  * @retval kNoErr is returned on success, kNotFoundErr if the key is not exist,
+  *         otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_delete( const char *key );
+
+/**
+  * @brief  Start a new transaction, operations added to a transaction are all
+  *         applied or none is applied, even if the power is lost on commit.
+  * @param  txn: The transaction.
+  * @retval None
+  */
+void mico_system_kv_txn_init( mico_kv_txn_t *txn );
+
+/**
+  * @brief  Add a write operation to a transaction, see @ref mico_system_kv_set.
+  * @retval kNoErr is returned on success, kNoResourcesErr if the transaction
+  *         is full, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_txn_set( mico_kv_txn_t *txn, const char *key, mico_kv_type_t type, const void *value, uint32_t length );
+
+/**
+  * @brief  Add a remove operation to a transaction, see @ref mico_system_kv_delete.
+  * @retval kNoErr is returned on success, kNoResourcesErr if the transaction
+  *         is full, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_txn_delete( mico_kv_txn_t *txn, const char *key );
+
+/**
+  * @brief  Write all operations in a transaction to non-volatile storage, the
+  *         transaction is empty after commit.
+  * @param  txn: The transaction.
+  * @retval kNoErr is returned on success, kNoSpaceErr if the resulting keys and
+  *         values are not fit in the storage, nothing is written then,
+  *         otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_kv_txn_commit( mico_kv_txn_t *txn );
+
 /** @} */
 /*****************************************************************************/
 /** \defgroup system System Framework Functions
@@ -281,6 +381,23 @@ typedef enum{
  
 } mico_notify_types_t;
 
+/** @brief How a registered function is called when its notification is triggered */
+typedef enum{
+  MICO_NOTIFY_INLINE,     /**< Called at once in the context that triggers the notification, e.g. the wlan driver */
+  MICO_NOTIFY_DEFERRED,   /**< Queued to the notification thread, the trigger does not wait for it. Pointer arguments
+                               point to copies that are valid during the call. Not supported for the scan, wlan parameter
+                               and EasyLink notifications, whose data cannot be copied, nor for power off and stack overflow */
+} mico_notify_delivery_t;
+
+/** @brief Delivery counters of a registered function, times are in the unit of mico_get_time() */
+typedef struct{
+  uint32_t  count;          /**< Calls of the function */
+  uint32_t  dropped;        /**< Deferred notifications lost because the queue was full */
+  uint32_t  latency_total;  /**< Sum of the times from the trigger to the return of the function */
+  uint32_t  latency_max;    /**< Longest time from the trigger to the return of the function */
+  uint32_t  duration_max;   /**< Longest time spent in the function */
+} mico_notify_stats_t;
+
 /**
   * @brief  Register a user function to a MiCO notification.
   * @param  notify_type: The type of MiCO notification.
@@ -290,6 +407,20 @@ typedef enum{
   */
 OSStatus mico_system_notify_register( mico_notify_types_t notify_type, void* functionAddress, void* arg );
 
+/**
+  * @brief  Register a user function to a MiCO notification, with its delivery and priority.
+  * @note   mico_system_notify_register() is the same as MICO_NOTIFY_INLINE and priority 0.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @param  arg: The address of argument, which will be called by registered user function.
+  * @param  delivery: Call the function inline or from the notification thread.
+  * @param  priority: Functions with a higher priority are called first, in registration
+  *         order if equal.
+  * @retval kNoErr is returned on success, kNoResourcesErr if all subscriber slots are used,
+  *         kUnsupportedErr if the notification cannot be deferred, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_register_adv( mico_notify_types_t notify_type, void* functionAddress, void* arg, mico_notify_delivery_t delivery, uint8_t priority );
+
 /**
   * @brief  Remove a user function from a MiCO notification.
   * @param  notify_type: The type of MiCO notification.
@@ -305,6 +436,15 @@ OSStatus mico_system_notify_remove( mico_notify_types_t notify_type, void *funct
   */
 OSStatus mico_system_notify_remove_all( mico_notify_types_t notify_type);
 
+/**
+  * @brief  Read the delivery counters of a user function registered to a MiCO notification.
+  * @param  notify_type: The type of MiCO notification.
+  * @param  functionAddress: The address of user function.
+  * @param  stats: Receives the counters.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_system_notify_get_stats( mico_notify_types_t notify_type, void *functionAddress, mico_notify_stats_t *stats );
+
 
 /** @} */
 /*****************************************************************************/
@@ -491,6 +631,46 @@ void mdns_resume_record( char *service_name, WiFi_Interface interface );
   */
 void mdns_update_txt_record( char *service_name, WiFi_Interface interface, char *txt_record );
 
+/** @brief A service instance found by mdns_browse_start
+  */
+typedef struct _mdns_service_t
+{
+  char *instance_name;    /**< The full instance name, example: "device_name._easylink._tcp.local."  */
+  char *host_name;        /**< The host name of the instance, example: "device_name.local."  */
+  char *txt_record;       /**< Txt record in the format of mdns_init_t.txt_record, NULL if not received  */
+  uint32_t ip;            /**< IP address of the host, in the format of inet_addr()  */
+  uint16_t port;          /**< Service port */
+} mdns_service_t;
+
+typedef enum
+{
+  MDNS_SERVICE_ADDED,     /**< An instance is resolved, its host name, IP address and port are valid */
+  MDNS_SERVICE_REMOVED,   /**< An instance said goodbye or its records expired */
+} mdns_browse_event_t;
+
+/** @brief Called from the mDNS thread, mDNS functions should not be called from it. service and
+  *        its strings are only valid during the call
+  */
+typedef void (*mdns_browse_callback_t)( mdns_browse_event_t event, const mdns_service_t *service, void *arg );
+
+/**
+  * @brief  Find the instances of a service on the network, a mDNS service daemon will be start if necessary.
+  *         The service is queried continuously, the interval starts from 1 second and doubles up to one hour.
+  *         Records overheard from other devices are cached as well.
+  * @param  service_name: The service name to browse, example: "_easylink._tcp.local."
+  * @param  callback: Called when an instance is added or removed.
+  * @param  arg: Passed to callback.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mdns_browse_start( char *service_name, mdns_browse_callback_t callback, void *arg );
+
+/**
+  * @brief  Stop browsing a service, its instances are dropped without a MDNS_SERVICE_REMOVED callback
+  * @param  service_name: The service name passed to mdns_browse_start.
+  * @retval None.
+  */
+void mdns_browse_stop( char *service_name );
+
 /** @} */
 /*****************************************************************************/
 /** \defgroup tftp_ota Firmware Update From a TFTP Server
@@ -0,0 +1,139 @@
+/**
+******************************************************************************
+* @file    mico_system_ota.h 
+* @author  MiCO Team
+* @version V1.0.0
+* @date    18-Oct-2026
+* @brief   This file provides the OTA sink, that writes an OTA image to flash and 
+*          calculates its digests while it is being received
+******************************************************************************
+*
+*  The MIT License
+*  Copyright (c) 2015 MXCHIP Inc.
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy 
+*  of this software and associated documentation files (the "Software"), to deal
+*  in the Software without restriction, including without limitation the rights 
+*  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+*  copies of the Software, and to permit persons to whom the Software is furnished
+*  to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+*  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR 
+*  IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************
+*/
+
+#pragma once
+
+#include "common.h"
+#include "mico_platform.h"
+#include "mico_security.h"
+#include "CheckSumUtils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @addtogroup MICO_SYSTEM
+  * @{
+  */
+
+/*****************************************************************************/
+/** \defgroup system_ota System OTA Sink
+  * @brief Write an OTA image to a flash partition and verify it on the fly, the
+  *        MD5 and CRC16 are updated as every block is received, so the image
+  *        does not have to be read back from flash after the download
+  * @{
+  */
+/*****************************************************************************/
+
+#define MICO_OTA_SINK_TRAILER_MAX   (16)
+
+/** @brief Rolling state of an OTA download, a copy of it is a checkpoint */
+typedef struct _mico_ota_sink_t{
+  mico_partition_t  partition;
+  uint32_t          offset;         /**< Bytes of the image seen so far */
+  uint32_t          hashed;         /**< Bytes fed into the digests, the trailer is held back */
+  uint32_t          trailer_len;    /**< Length of the trailer (e.g. an appended MD5) excluded from the digests */
+  uint8_t           trailer[MICO_OTA_SINK_TRAILER_MAX];
+  uint32_t          trailer_used;
+  bool              use_md5;
+  bool              broken;         /**< Data was not received in order, digests are invalid */
+  md5_context       md5;
+  CRC16_Context     crc16;
+} mico_ota_sink_t;
+
+/**
+  * @brief  Start a new image on a OTA sink, the partition should be erased by the caller.
+  * @param  sink: The OTA sink.
+  * @param  partition: The flash partition the image is written to.
+  * @param  trailer_len: Number of bytes at the end of the image that are not hashed, 
+  *         up to MICO_OTA_SINK_TRAILER_MAX.
+  * @param  use_md5: Calculate MD5 in addition to CRC16.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_ota_sink_init( mico_ota_sink_t *sink, mico_partition_t partition, uint32_t trailer_len, bool use_md5 );
+
+/**
+  * @brief  Write the next block of the image to flash and update the digests.
+  * @param  sink: The OTA sink.
+  * @param  data: Image data.
+  * @param  len: Length of data.
+  * @retval kNoErr is returned on success, otherwise, kXXXErr is returned.
+  */
+OSStatus mico_ota_sink_write( mico_ota_sink_t *sink, const uint8_t *data, uint32_t len );
+
+/**
+  * @brief  Update the digests with a block written to the partition by someone else,
+  *         this is a mico_flash_write_observer_t, see MicoFlashSetWriteObserver().
+  *         Blocks written again at an offset already seen are ignored.
+  * @param  context: The OTA sink.
+  * @param  off_set: Partition offset of data.
+  * @param  data: Image data.
+  * @param  len: Length of data.
+  * @retval None
+  */
+void mico_ota_sink_observer( void *context, uint32_t off_set, const uint8_t *data, uint32_t len );
+
+/**
+  * @brief  Save the rolling state, so a broken download can be resumed from here.
+  * @param  sink: The OTA sink.
+  * @param  checkpoint: Receives the state.
+  * @retval None
+  */
+void mico_ota_sink_checkpoint( const mico_ota_sink_t *sink, mico_ota_sink_t *checkpoint );
+
+/**
+  * @brief  Roll back to a checkpoint, the image is resumed at checkpoint->offset.
+  * @param  sink: The OTA sink.
+  * @param  checkpoint: State saved by mico_ota_sink_checkpoint().
+  * @retval None
+  */
+void mico_ota_sink_restore( mico_ota_sink_t *sink, const mico_ota_sink_t *checkpoint );
+
+/**
+  * @brief  Finish the image and get the digests.
+  * @param  sink: The OTA sink.
+  * @param  md5: Receives the MD5 of the image without trailer, may be NULL.
+  * @param  crc: Receives the CRC16 of the image without trailer, may be NULL.
+  * @param  trailer: Receives the trailer, may be NULL.
+  * @retval kNoErr is returned on success, kIntegrityErr if the image was not received
+  *         in order, kSizeErr if it is shorter than the trailer.
+  */
+OSStatus mico_ota_sink_final( mico_ota_sink_t *sink, uint8_t md5[16], uint16_t *crc, uint8_t *trailer );
+
+/** @} */
+
+/** @} */
+
+#ifdef __cplusplus
+} /*extern "C" */
+#endif
+
@@ -25,17 +25,55 @@
 
 #include "Common.h"
 
+/* CRC engines, trading flash for speed (CRC16 / CRC32 table sizes):
+ *   CRC_ENGINE_BITWISE : one bit per step, no table
+ *   CRC_ENGINE_NIBBLE  : 16-entry tables, 32 B / 64 B, for bootloaders
+ *   CRC_ENGINE_BYTE    : 256-entry tables, 512 B / 1 KB
+ *   CRC_ENGINE_SLICE4  : four 256-entry tables, 4 bytes per step, 2 KB / 4 KB
+ *   CRC_ENGINE_SLICE8  : eight 256-entry tables, 8 bytes per step, 4 KB / 8 KB
+ * All engines give identical results. */
+#define CRC_ENGINE_BITWISE  0
+#define CRC_ENGINE_NIBBLE   1
+#define CRC_ENGINE_BYTE     2
+#define CRC_ENGINE_SLICE4   3
+#define CRC_ENGINE_SLICE8   4
+
+#ifndef CRC_ENGINE
+#define CRC_ENGINE          CRC_ENGINE_BYTE
+#endif
+
+#if CRC_ENGINE == CRC_ENGINE_SLICE8
+#define CRC_SLICES          8
+#elif CRC_ENGINE == CRC_ENGINE_SLICE4
+#define CRC_SLICES          4
+#else
+#define CRC_SLICES          1
+#endif
+
+/* CRC16-CCITT, polynomial 0x1021, initial value 0 (XMODEM) */
 typedef struct
 {
   uint16_t crc;
 } CRC16_Context;
 
+/* CRC32 (IEEE 802.3), reflected polynomial 0xEDB88320, as used by zlib */
+typedef struct
+{
+  uint32_t crc;
+} CRC32_Context;
+
 void CRC16_Init( CRC16_Context *inContext );
 
 void CRC16_Update( CRC16_Context *inContext, const void *inSrc, size_t inLen );
 
 void CRC16_Final( CRC16_Context *inContext, uint16_t *outResult );
 
+void CRC32_Init( CRC32_Context *inContext );
+
+void CRC32_Update( CRC32_Context *inContext, const void *inSrc, size_t inLen );
+
+void CRC32_Final( CRC32_Context *inContext, uint32_t *outResult );
+
 uint8_t mico_CRC8_Table(uint8_t crc8_ori, uint8_t *p, uint32_t counter);
 
 
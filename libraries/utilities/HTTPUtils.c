@@ -23,8 +23,10 @@
 #include "MICO.h"
 #include "StringUtils.h"
 #include "HTTPUtils.h"
+#include "RingBufferUtils.h"
 #include "platform.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
 
@@ -35,6 +37,223 @@
 
 #define READ_LENGTH 1500
 
+/* Header field index, built byte by byte by findHeader() while the header is received, so 
+   field lookups do not rescan buf. It is allocated behind the HTTPHeader_t by HTTPHeaderCreate()
+   and found through its index field, headers allocated elsewhere are scanned as before. The field
+   takes the tail padding of HTTPHeader_t on Cortex-M, so headers calloc'ed by prebuilt libraries
+   keep their size and read it as NULL. */
+#define kHTTPHeaderIndexFields      12
+
+typedef struct
+{
+  uint16_t            nameOffset;
+  uint16_t            valueOffset;
+  uint16_t            valueLen;
+  uint8_t             nameLen;
+} HTTPHeaderField_t;
+
+enum
+{
+  kHTTPCommonContentLength,
+  kHTTPCommonContentType,
+  kHTTPCommonTransferEncoding,
+  kHTTPCommonConnection,
+  kHTTPCommonCount
+};
+
+static const char * const kHTTPCommonFieldNames[ kHTTPCommonCount ] =
+{
+  "Content-Length", "Content-Type", "Transfer-Encoding", "Connection"
+};
+
+enum
+{
+  kHTTPParseLineBegin = 0,
+  kHTTPParseName,
+  kHTTPParseValueSpace,
+  kHTTPParseValue,
+  kHTTPParseSkipLine,
+  kHTTPParseCR,
+  kHTTPParseDone
+};
+
+typedef struct
+{
+  uint16_t            scanPos;            //! Next byte of buf to parse.
+  uint16_t            headerEnd;          //! Header length including the empty line, valid when done.
+  uint8_t             state;              //! Line parser, lines end with CR, LF or CRLF as in HTTPGetHeaderField.
+  uint8_t             endState;           //! Empty line detector, LFLF or LFCRLF as in findHeader.
+  uint8_t             fieldCount;
+  bool                overflow;           //! More fields than kHTTPHeaderIndexFields, lookups fall back to scanning.
+  bool                lastCommitted;      //! The previous line is fields[ fieldCount - 1 ], for continuation lines.
+  uint8_t             common[ kHTTPCommonCount ]; //! Index + 1 in fields of the common fields, 0 if absent.
+  HTTPHeaderField_t   current;
+  HTTPHeaderField_t   fields[ kHTTPHeaderIndexFields ];
+} HTTPHeaderIndex_t;
+
+typedef struct
+{
+  HTTPHeader_t        header;
+  HTTPHeaderIndex_t   index;
+} HTTPHeaderIndexed_t;
+
+static HTTPHeaderIndex_t * HTTPHeaderGetIndex( HTTPHeader_t *inHeader )
+{
+  return (HTTPHeaderIndex_t *) inHeader->index;
+}
+
+static void HTTPHeaderIndexReset( HTTPHeaderIndex_t *index )
+{
+  memset( index, 0, sizeof( HTTPHeaderIndex_t ) );
+}
+
+static void HTTPHeaderIndexCommit( HTTPHeaderIndex_t *index, const char *buf )
+{
+  int i;
+
+  if( index->fieldCount >= kHTTPHeaderIndexFields ){
+    index->overflow = true;
+    return;
+  }
+
+  index->fields[ index->fieldCount++ ] = index->current;
+  index->lastCommitted = true;
+
+  for( i = 0; i < kHTTPCommonCount; i++ ){
+    if( index->common[ i ] == 0 && 
+        strnicmpx( buf + index->current.nameOffset, index->current.nameLen, kHTTPCommonFieldNames[ i ] ) == 0 ){
+      index->common[ i ] = index->fieldCount;
+      break;
+    }
+  }
+}
+
+/* Parse the bytes of buf received since the last call, return true when the empty line is found */
+static bool HTTPHeaderIndexFeed( HTTPHeaderIndex_t *index, const char *buf, size_t len )
+{
+  size_t pos;
+  char   c;
+
+  if( index->scanPos > len ) HTTPHeaderIndexReset( index );
+
+  for( pos = index->scanPos; ( pos < len ) && ( index->state != kHTTPParseDone ); ++pos )
+  {
+    c = buf[ pos ];
+
+    // The header ends with an empty line: LFLF, CRLFLF, LFCRLF or CRLFCRLF.
+    if( ( c == '\n' ) && ( index->endState != 0 ) )
+    {
+      index->headerEnd = (uint16_t)( pos + 1 );
+      index->state = kHTTPParseDone;
+      break;
+    }
+    index->endState = ( c == '\n' )? 1 : ( ( c == '\r' ) && ( index->endState == 1 ) )? 2 : 0;
+
+    // The first line is the start line, it is never a field.
+    if( pos == 0 ) index->state = kHTTPParseSkipLine;
+
+  reparse:
+    switch( index->state )
+    {
+      case kHTTPParseCR: // Line ended with CR, a LF may follow.
+        index->state = kHTTPParseLineBegin;
+        if( c == '\n' ) break;
+        goto reparse;
+
+      case kHTTPParseLineBegin:
+        if( ( c == '\r' ) || ( c == '\n' ) ){
+          index->lastCommitted = false;
+          index->state = ( c == '\r' )? kHTTPParseCR : kHTTPParseLineBegin;
+        }
+        else if( ( c == ' ' ) || ( c == '\t' ) ){ // Continuation of the previous field's value.
+          if( index->lastCommitted ){
+            index->current = index->fields[ --index->fieldCount ];
+            index->state = kHTTPParseValue;
+          }else{
+            index->state = kHTTPParseSkipLine;
+          }
+        }
+        else{
+          index->current.nameOffset = (uint16_t) pos;
+          index->state = kHTTPParseName;
+        }
+        break;
+
+      case kHTTPParseName:
+        if( c == ':' ){
+          if( pos - index->current.nameOffset > 0xFF ){
+            index->state = kHTTPParseSkipLine;
+          }else{
+            index->current.nameLen = (uint8_t)( pos - index->current.nameOffset );
+            index->state = kHTTPParseValueSpace;
+          }
+          break;
+        }
+        // Fall through, a line without ':' is not a field.
+      case kHTTPParseSkipLine:
+        if( ( c == '\r' ) || ( c == '\n' ) ){
+          index->lastCommitted = false;
+          index->state = ( c == '\r' )? kHTTPParseCR : kHTTPParseLineBegin;
+        }
+        break;
+
+      case kHTTPParseValueSpace:
+        if( ( c == ' ' ) || ( c == '\t' ) ) break;
+        index->current.valueOffset = (uint16_t) pos;
+        index->state = kHTTPParseValue;
+        goto reparse;
+
+      case kHTTPParseValue:
+        if( ( c == '\r' ) || ( c == '\n' ) ){
+          index->current.valueLen = (uint16_t)( pos - index->current.valueOffset );
+          index->lastCommitted = false;
+          HTTPHeaderIndexCommit( index, buf );
+          index->state = ( c == '\r' )? kHTTPParseCR : kHTTPParseLineBegin;
+        }
+        break;
+    }
+  }
+
+  index->scanPos = (uint16_t) pos;
+  return index->state == kHTTPParseDone;
+}
+
+/* Look up a field in the index of a received header, kUnsupportedErr if the index cannot answer */
+static OSStatus HTTPHeaderIndexFind( HTTPHeader_t *inHeader, const char *inName, const char **outValuePtr, size_t *outValueLen )
+{
+  HTTPHeaderIndex_t *       index = HTTPHeaderGetIndex( inHeader );
+  const HTTPHeaderField_t * field = NULL;
+  size_t                    nameLen;
+  int                       i;
+
+  if( ( index == NULL ) || ( index->state != kHTTPParseDone ) || ( index->headerEnd != inHeader->len ) || index->overflow )
+    return kUnsupportedErr;
+
+  for( i = 0; i < kHTTPCommonCount; i++ ){
+    if( strcmp( inName, kHTTPCommonFieldNames[ i ] ) == 0 ){
+      if( index->common[ i ] == 0 ) return kNotFoundErr;
+      field = &index->fields[ index->common[ i ] - 1 ];
+      break;
+    }
+  }
+
+  if( field == NULL ){
+    nameLen = strlen( inName );
+    for( i = 0; i < index->fieldCount; i++ ){
+      if( ( index->fields[ i ].nameLen == nameLen ) &&
+          ( strnicmp( inHeader->buf + index->fields[ i ].nameOffset, inName, nameLen ) == 0 ) ){
+        field = &index->fields[ i ];
+        break;
+      }
+    }
+    if( field == NULL ) return kNotFoundErr;
+  }
+
+  if( outValuePtr ) *outValuePtr = inHeader->buf + field->valueOffset;
+  if( outValueLen ) *outValueLen = field->valueLen;
+  return kNoErr;
+}
+
 OSStatus onReceivedDataCallbackDefault(struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext )
 {
   UNUSED_PARAMETER(httpHeader);
@@ -45,6 +264,9 @@ OSStatus onReceivedDataCallbackDefault(struct _HTTPHeader_t * httpHeader, uint32
   return kUnsupportedErr;
 }
 
+static int HTTPHeaderReceived( HTTPHeader_t *inHeader, char *end );
+static int HTTPReadBodyOnce( int inSock, HTTPHeader_t *inHeader );
+
 int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
 {
   int        err =0;
@@ -69,6 +291,45 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
     inHeader->len += len;
   }
   
+  err = HTTPHeaderReceived( inHeader, end );
+
+exit:
+  return err;
+}
+
+int SocketTryReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
+{
+  int        err = kNoErr;
+  char *          end;
+  ssize_t         n;
+
+  /* A complete header may already be buffered from the previous message */
+  if( findHeader( inHeader, &end ) == false )
+  {
+    require_action_quiet( inHeader->len < sizeof( inHeader->buf ), exit, err = kNoSpaceErr );
+    n = read( inSock, inHeader->buf + inHeader->len, sizeof( inHeader->buf ) - inHeader->len );
+    require_action_quiet( n > 0, exit, err = kConnectionErr );
+    inHeader->len += (size_t) n;
+    if( findHeader( inHeader, &end ) == false )
+      return EWOULDBLOCK;
+  }
+
+  err = HTTPHeaderReceived( inHeader, end );
+
+exit:
+  return err;
+}
+
+/* Parse the header ended at end, and keep the body data received together with it */
+static int HTTPHeaderReceived( HTTPHeader_t *inHeader, char *end )
+{
+  int        err =0;
+  char *          buf;
+  char *          dst;
+
+  buf = inHeader->buf;
+  dst = buf + inHeader->len;
+
   inHeader->len = (size_t)( end - buf );
   err = HTTPHeaderParse( inHeader );
   require_noerr( err, exit );
@@ -80,11 +341,12 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader )
 
   /* For chunked extra data without content length */
   if(inHeader->chunkedData == true){
-    inHeader->chunkedDataBufferLen = (inHeader->extraDataLen > READ_LENGTH)? inHeader->extraDataLen:READ_LENGTH;
-    inHeader->chunkedDataBufferPtr = calloc(inHeader->chunkedDataBufferLen, sizeof(uint8_t)); //Make extra data buffer larger than chunk length
+    inHeader->chunkedDataBufferLen = (inHeader->extraDataLen >= READ_LENGTH)? inHeader->extraDataLen + 1:READ_LENGTH;
+    inHeader->chunkedDataBufferPtr = calloc(inHeader->chunkedDataBufferLen, sizeof(uint8_t)); //Ring buffer for the chunk decoder, one byte is always kept free
     require_action(inHeader->chunkedDataBufferPtr, exit, err = kNoMemoryErr);
     memcpy((uint8_t *)inHeader->chunkedDataBufferPtr, end, inHeader->extraDataLen);
-    inHeader->extraDataPtr = inHeader->chunkedDataBufferPtr;
+    /* Set by SocketReadHTTPBody to the data left after the last chunk */
+    inHeader->extraDataPtr = NULL;
     return kNoErr;
   }
 
@@ -127,6 +389,7 @@ bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd)
   char *buf = (char *)inHeader->buf;
   char *src = (char *)inHeader->buf;
   size_t          len;
+  HTTPHeaderIndex_t *index;
   
   // Check for interleaved binary data (4 byte header that begins with $). See RFC 2326 section 10.12.
   if( ( ( dst - buf ) >= 4 ) && ( buf[ 0 ] == '$' ) )
@@ -134,6 +397,15 @@ bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd)
     *outHeaderEnd = buf + 4;
     return true;
   }
+
+  // Resume parsing where the last call stopped, and index the header fields on the way.
+  index = HTTPHeaderGetIndex( inHeader );
+  if( index )
+  {
+    if( HTTPHeaderIndexFeed( index, buf, inHeader->len ) == false ) return false;
+    *outHeaderEnd = buf + index->headerEnd;
+    return true;
+  }
   
   // Find an empty line (separates the header and body). The HTTP spec defines it as CRLFCRLF, but some
   // use LFLF or weird combos like CRLFLF so this handles CRLFCRLF, LFLF, and CRLFLF (but not CRCR).
@@ -163,17 +435,120 @@ bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd)
   return false;
 }
 
+/* Chunked body decoder. chunkedDataBufferPtr is used as a ring buffer, and chunk data is given to
+   onReceivedDataCallback straight from it, so chunks and trailers of any length are decoded in a 
+   fixed buffer without moving the received data. */
+typedef enum
+{
+  kHTTPChunkStateSize,
+  kHTTPChunkStateExtension,
+  kHTTPChunkStateData,
+  kHTTPChunkStateDataCR,
+  kHTTPChunkStateDataLF,
+  kHTTPChunkStateTrailer,
+  kHTTPChunkStateDone
+} HTTPChunkState_t;
+
+typedef struct
+{
+  HTTPChunkState_t    state;
+  uint64_t            remaining;          // Chunk size while the size line is parsed, then chunk data left.
+  uint32_t            pos;                // Body position of the next data given to the callback.
+  uint8_t             digits;             // Hex digits in the chunk size.
+  bool                lineEmpty;          // Nothing but CR on the current trailer line so far.
+} HTTPChunkDecoder_t;
+
+// Decodes everything buffered in ring. Returns EWOULDBLOCK when more data is needed, or kNoErr 
+// when the last chunk and the trailer are decoded, the rest of ring belongs to the next message.
+static OSStatus HTTPChunkDecode( HTTPHeader_t *inHeader, HTTPChunkDecoder_t *decoder, ring_buffer_t *ring )
+{
+  OSStatus  err = kNoErr;
+  uint8_t * data;
+  uint32_t  available;
+  uint32_t  used;
+  uint8_t   c;
+  
+  while( decoder->state != kHTTPChunkStateDone )
+  {
+    ring_buffer_get_data( ring, &data, &available );
+    if( available == 0 ) return EWOULDBLOCK;
+    
+    if( decoder->state == kHTTPChunkStateData )
+    {
+      used = ( decoder->remaining < available )? (uint32_t)decoder->remaining : available;
+      if( inHeader->onReceivedDataCallback )
+        (inHeader->onReceivedDataCallback)( inHeader, decoder->pos, data, used, inHeader->userContext );
+      decoder->pos += used;
+      decoder->remaining -= used;
+      if( decoder->remaining == 0 ) decoder->state = kHTTPChunkStateDataCR;
+      ring_buffer_consume( ring, used );
+      continue;
+    }
+    
+    for( used = 0; used < available && decoder->state != kHTTPChunkStateData && decoder->state != kHTTPChunkStateDone; )
+    {
+      c = data[ used++ ];
+      switch( decoder->state )
+      {
+        case kHTTPChunkStateSize:
+          if( isxdigit( c ) )
+          {
+            require_action( decoder->digits < 16, exit, err = kMalformedErr );
+            decoder->remaining = ( decoder->remaining << 4 ) | ( isdigit( c ) ? c - '0' : ( tolower( c ) - 'a' + 10 ) );
+            decoder->digits++;
+            break;
+          }
+          require_action( decoder->digits > 0, exit, err = kMalformedErr );
+          decoder->state = kHTTPChunkStateExtension;
+          // Fall through, the size ends with CRLF or a chunk extension.
+        case kHTTPChunkStateExtension:
+          if( c != '\n' ) break;
+          decoder->digits = 0;
+          if( decoder->remaining ) decoder->state = kHTTPChunkStateData;
+          else 
+          {
+            decoder->state = kHTTPChunkStateTrailer;
+            decoder->lineEmpty = true;
+          }
+          break;
+        case kHTTPChunkStateDataCR:
+          decoder->state = kHTTPChunkStateDataLF;
+          if( c == '\r' ) break;
+          // Fall through, accept LF without CR.
+        case kHTTPChunkStateDataLF:
+          require_action( c == '\n', exit, err = kMalformedErr );
+          decoder->state = kHTTPChunkStateSize;
+          break;
+        case kHTTPChunkStateTrailer:
+          if( c == '\n' )
+          {
+            if( decoder->lineEmpty ) decoder->state = kHTTPChunkStateDone;
+            decoder->lineEmpty = true;
+          }
+          else if( c != '\r' ) decoder->lineEmpty = false;
+          break;
+        default:
+          break;
+      }
+    }
+    ring_buffer_consume( ring, used );
+  }
+  
+exit:
+  return err;
+}
+
 OSStatus SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
 {
   OSStatus err = kParamErr;
   ssize_t readResult;
   int selectResult;
   fd_set readSet;
-  size_t    lastChunkLen, chunckheaderLen; 
-  char *nextPackagePtr;
   struct timeval_t t;
-  size_t          readLength;
-  uint32_t pos = 0;
+  ring_buffer_t ring;
+  HTTPChunkDecoder_t decoder;
+  uint8_t *space;
+  uint32_t spaceLen;
   t.tv_sec = 5;
   t.tv_usec = 0;
   
@@ -185,130 +560,32 @@ OSStatus SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
 
   /* Chunked data without content length */
   if( inHeader->chunkedData == true ){
-    do{
-      /* Find Chunk data length */
-      while ( findChunkedDataLength( inHeader->chunkedDataBufferPtr, inHeader->extraDataLen, &inHeader->extraDataPtr ,"%llu", &inHeader->contentLength ) == false){
-        require_action(inHeader->extraDataLen < inHeader->chunkedDataBufferLen, exit, err=kMalformedErr );
-
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-        readResult = read( inSock, inHeader->chunkedDataBufferPtr + inHeader->extraDataLen, (size_t)( inHeader->chunkedDataBufferLen - inHeader->extraDataLen ) );
-
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      }
-
-      chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
-
-      /* Check the last chunk */
-      if(inHeader->contentLength == 0){ 
-        while( findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) == false){ //find CRLF
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-          readResult = read( inSock,
-                            (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen ),
-                            256 - inHeader->extraDataLen ); //Assume chunk trailer length is less than 256 (256 is the min chunk buffer, maybe dangerous
-
-          if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-          else { err = kConnectionErr; goto exit; }
-          (inHeader->onReceivedDataCallback)(inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult, inHeader->userContext);
-        }
-
-        err = kNoErr;
-        goto exit;
-      } 
-      else{ // Read chunk data
-        /* Chunk package already exist, callback, move to buffer's head */
-        if( inHeader->extraDataLen >= inHeader->contentLength + chunckheaderLen + 2 ){
-          require_action( *(inHeader->extraDataPtr + inHeader->contentLength ) == '\r' &&
-                          *(inHeader->extraDataPtr + inHeader->contentLength + 1 ) == '\n', 
-                          exit, err = kMalformedErr);
-
-          (inHeader->onReceivedDataCallback)(inHeader,  pos, 
-                                                        (uint8_t *)inHeader->extraDataPtr, 
-                                                        inHeader->contentLength, 
-                                                        inHeader->userContext);
-          pos+=inHeader->contentLength;
-
-          /* Move next chunk to chunked data buffer header point */
-          lastChunkLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr + inHeader->contentLength;
-          if(inHeader->contentLength) lastChunkLen += 2;  //Last chunck data has a CRLF tail
-          memmove( inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferPtr + lastChunkLen, inHeader->chunkedDataBufferLen - lastChunkLen  );
-          inHeader->extraDataLen -= lastChunkLen;
-        }
-        /* Chunck exist without the last LF, generate callback abd recv LF */
-        /* Callback , read LF */
-        else if(inHeader->extraDataLen == inHeader->contentLength + chunckheaderLen +1){ //recv CR 
-
-          require_action( *(inHeader->chunkedDataBufferPtr + inHeader->extraDataLen - 1) == '\r' ,
-                          exit, err = kMalformedErr);
+    require_action( inHeader->chunkedDataBufferPtr, exit, err = kParamErr );
+    ring_buffer_init( &ring, (uint8_t *)inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferLen );
+    ring_buffer_produce( &ring, inHeader->extraDataLen );
+    memset( &decoder, 0x0, sizeof(decoder) );
+    inHeader->extraDataPtr = NULL;
+    inHeader->extraDataLen = 0;
 
-          (inHeader->onReceivedDataCallback)(inHeader,  pos, 
-                                                        (uint8_t *)inHeader->extraDataPtr, 
-                                                        inHeader->extraDataLen - chunckheaderLen-1, 
-                                                        inHeader->userContext);
-          pos+=inHeader->extraDataLen - chunckheaderLen-1;
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
+    while( ( err = HTTPChunkDecode( inHeader, &decoder, &ring ) ) == EWOULDBLOCK ){
+      /* Everything received is decoded, read to the start of the buffer again */
+      ring_buffer_init( &ring, (uint8_t *)inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferLen );
 
-          readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, 1);
+      selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
+      require_action( selectResult >= 1, exit, err = kNotReadableErr );
 
-          if( readResult  > 0 ) {}
-          else { err = kConnectionErr; goto exit; }
+      ring_buffer_get_space( &ring, &space, &spaceLen );
+      readResult = read( inSock, space, spaceLen );
+      if( readResult  > 0 ) ring_buffer_produce( &ring, readResult );
+      else { err = kConnectionErr; goto exit; }
+    }
+    require_noerr( err, exit );
 
-          require_action( *(inHeader->extraDataPtr) == '\n', exit, err = kMalformedErr);
-          inHeader->extraDataLen = 0;
-        }
-        else{
-          /* Callback , read , callback , read CRLF */
-          (inHeader->onReceivedDataCallback)(inHeader, pos, 
-                                                       (uint8_t *)inHeader->extraDataPtr, 
-                                                       inHeader->extraDataLen - chunckheaderLen, 
-                                                       inHeader->userContext);
-          pos += inHeader->extraDataLen - chunckheaderLen;
-
-          while ( inHeader->extraDataLen < inHeader->contentLength + chunckheaderLen  ){
-            selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-            require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-            if( inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) > inHeader->chunkedDataBufferLen - chunckheaderLen)
-              //Data needed is greater than valid buffer size
-              readLength = inHeader->chunkedDataBufferLen - chunckheaderLen; 
-            else
-              //Data needed is less than valid buffer size
-              readLength = inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) ; 
-
-            readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, readLength);
-            
-            if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-            else { err = kConnectionErr; goto exit; }
-
-            (inHeader->onReceivedDataCallback)(inHeader, pos, 
-                                                         (uint8_t *)inHeader->extraDataPtr, 
-                                                         readResult, 
-                                                         inHeader->userContext);
-            pos += readResult;
-          } 
-
-          selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-          require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-          readResult = read( inSock, (uint8_t *)inHeader->extraDataPtr, 2);
-
-          if( readResult  > 0 ) {}
-          else { err = kConnectionErr; goto exit; }
-
-
-          require_action( *(inHeader->extraDataPtr) == '\r' &&
-                          *(inHeader->extraDataPtr+1 ) == '\n', 
-                          exit, err = kMalformedErr);
-
-          inHeader->extraDataLen = 0;
-        }
-      }
-    }while(inHeader->contentLength != 0);
+    /* Data behind the trailer belongs to the next http package, HTTPHeaderClear moves it to buf */
+    ring_buffer_get_data( &ring, &space, &spaceLen );
+    inHeader->extraDataPtr = (char *)space;
+    inHeader->extraDataLen = ring_buffer_used_space( &ring );
+    goto exit;
   }
 
   /* We has extra data but total length is not clear, store them to 1500 bytes buffer 
@@ -336,25 +613,8 @@ OSStatus SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
     selectResult = select( inSock + 1, &readSet, NULL, NULL, &t );
     require_action( selectResult >= 1, exit, err = kNotReadableErr );
 
-    if(inHeader->isCallbackSupported == true){
-      /* We has extra data, and we give these data to application by onReceivedDataCallback function */
-      readLength = inHeader->contentLength - inHeader->extraDataLen > READ_LENGTH? READ_LENGTH:inHeader->contentLength - inHeader->extraDataLen;
-      readResult = read( inSock,
-                        (uint8_t*)( inHeader->extraDataPtr),
-                        readLength );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }      
-      (inHeader->onReceivedDataCallback)(inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult, inHeader->userContext);
-    }else{
-      /* We has extra data and we has a predefined buffer to store the total extra data return when all data has received*/
-      readResult = read( inSock,
-                        (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
-                        ( inHeader->contentLength - inHeader->extraDataLen ) );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }
-    }
+    err = HTTPReadBodyOnce( inSock, inHeader );
+    require_noerr_quiet( err, exit );
   }
   err = kNoErr;
   
@@ -363,6 +623,54 @@ exit:
   return err;
 }
 
+int SocketTryReadHTTPBody( int inSock, HTTPHeader_t *inHeader )
+{
+  OSStatus err = kParamErr;
+
+  require( inHeader, exit );
+
+  /* Chunked body is not read incrementally, the blocking reader would stall the caller's other sockets */
+  require_action_quiet( inHeader->chunkedData == false, exit, err = kUnsupportedErr );
+
+  if( inHeader->extraDataLen < inHeader->contentLength ){
+    err = HTTPReadBodyOnce( inSock, inHeader );
+    require_noerr_quiet( err, exit );
+  }
+
+  err = ( inHeader->extraDataLen < inHeader->contentLength )? EWOULDBLOCK : kNoErr;
+
+exit:
+  if(err != kNoErr && err != EWOULDBLOCK) inHeader->len = 0;
+  return err;
+}
+
+static int HTTPReadBodyOnce( int inSock, HTTPHeader_t *inHeader )
+{
+  ssize_t readResult;
+  size_t  readLength;
+
+  if(inHeader->isCallbackSupported == true){
+    /* We has extra data, and we give these data to application by onReceivedDataCallback function */
+    readLength = inHeader->contentLength - inHeader->extraDataLen > READ_LENGTH? READ_LENGTH:inHeader->contentLength - inHeader->extraDataLen;
+    readResult = read( inSock,
+                      (uint8_t*)( inHeader->extraDataPtr),
+                      readLength );
+    
+    if( readResult  > 0 ) inHeader->extraDataLen += readResult;
+    else return kConnectionErr;
+    (inHeader->onReceivedDataCallback)(inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult, inHeader->userContext);
+  }else{
+    /* We has extra data and we has a predefined buffer to store the total extra data return when all data has received*/
+    readResult = read( inSock,
+                      (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
+                      ( inHeader->contentLength - inHeader->extraDataLen ) );
+    
+    if( readResult  > 0 ) inHeader->extraDataLen += readResult;
+    else return kConnectionErr;
+  }
+  return kNoErr;
+}
+
 //===========================================================================================================================
 //  HTTPHeader_Parse
 //
@@ -482,16 +790,21 @@ OSStatus HTTPHeaderParse( HTTPHeader_t *ioHeader )
   require_action( ptr < end, exit, err = kMalformedErr );
   
   // Determine persistence. Note: HTTP 1.0 defaults to non-persistent if a Connection header field is not present.
-  err = HTTPGetHeaderField( ioHeader->buf, ioHeader->len, "Connection", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPHeaderGetField( ioHeader, "Connection", &value, &valueSize );
   if( err )   ioHeader->persistent = (Boolean)( strnicmpx( ioHeader->protocolPtr, ioHeader->protocolLen, "HTTP/1.0" ) != 0 );
   else        ioHeader->persistent = (Boolean)( strnicmpx( value, valueSize, "close" ) != 0 );
 
-  err = HTTPGetHeaderField( ioHeader->buf, ioHeader->len, "Transfer-Encoding", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPHeaderGetField( ioHeader, "Transfer-Encoding", &value, &valueSize );
   if( err )   ioHeader->chunkedData = false;
   else        ioHeader->chunkedData = (Boolean)( strnicmpx( value, valueSize, kTransferrEncodingType_CHUNKED ) == 0 );
   
   // Content-Length is such a common field that we get it here during general parsing.
-  HTTPScanFHeaderValue( ioHeader->buf, ioHeader->len, "Content-Length", "%llu", &ioHeader->contentLength );
+  err = HTTPHeaderGetField( ioHeader, "Content-Length", &value, &valueSize );
+  if( err == kNoErr )
+  {
+    for( ptr = value; ( ptr < value + valueSize ) && ( ( c = *ptr ) >= '0' ) && ( c <= '9' ); ++ptr )
+      ioHeader->contentLength = ( ioHeader->contentLength * 10 ) + ( c - '0' );
+  }
 
   err = kNoErr;
   
@@ -643,6 +956,16 @@ OSStatus HTTPGetHeaderField( const char *inHeaderPtr,
   return kNotFoundErr;
 }
 
+OSStatus HTTPHeaderGetField( HTTPHeader_t *inHeader, const char *inName, const char **outValuePtr, size_t *outValueLen )
+{
+  OSStatus err;
+
+  err = HTTPHeaderIndexFind( inHeader, inName, outValuePtr, outValueLen );
+  if( err == kUnsupportedErr )
+    err = HTTPGetHeaderField( inHeader->buf, inHeader->len, inName, NULL, NULL, outValuePtr, outValueLen, NULL );
+  return err;
+}
+
 int HTTPScanFHeaderValue( const char *inHeaderPtr, size_t inHeaderLen, const char *inName, const char *inFormat, ... )
 {
   int                 n;
@@ -684,16 +1007,19 @@ char* HTTPHeaderMatchPartialURL( HTTPHeader_t *inHeader, const char *url )
 
 HTTPHeader_t * HTTPHeaderCreate( void )
 {
-  HTTPHeader_t *httpHeader;
-  httpHeader = calloc(1, sizeof(HTTPHeader_t));
-  httpHeader->onReceivedDataCallback = onReceivedDataCallbackDefault;
-  return httpHeader;
+  HTTPHeaderIndexed_t *httpHeader;
+  httpHeader = calloc(1, sizeof(HTTPHeaderIndexed_t));
+  if( httpHeader == NULL ) return NULL;
+  httpHeader->header.index = &httpHeader->index;
+  httpHeader->header.onReceivedDataCallback = onReceivedDataCallbackDefault;
+  return &httpHeader->header;
 }
 
 HTTPHeader_t * HTTPHeaderCreateWithCallback( onReceivedDataCallback inRecvFunc, onClearCallback onClearFunc, void * context )
 {
   HTTPHeader_t *httpHeader;
   httpHeader = HTTPHeaderCreate();
+  if( httpHeader == NULL ) return NULL;
   httpHeader->userContext = context;
   httpHeader->onReceivedDataCallback = inRecvFunc;
   httpHeader->onClearCallback = onClearFunc;
@@ -702,24 +1028,21 @@ HTTPHeader_t * HTTPHeaderCreateWithCallback( onReceivedDataCallback inRecvFunc,
 
 void HTTPHeaderClear( HTTPHeader_t *inHeader )
 {
-  char *nextPackagePtr;
-  size_t chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
+  size_t headToEnd;
 
   if(inHeader->onClearCallback)
     (inHeader->onClearCallback)(inHeader, inHeader->userContext);
 
   if(inHeader->chunkedData && (uint32_t *)inHeader->chunkedDataBufferPtr){ //chunk data
-    /* Possible to read the header of the next http package */
-    if(findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) ){
-      if( nextPackagePtr <= inHeader->chunkedDataBufferPtr + inHeader->extraDataLen ){ //We get some data belongs to next http package
-        inHeader->len = inHeader->extraDataLen - (nextPackagePtr - inHeader->chunkedDataBufferPtr);
-        if(inHeader->len > 512)
-          inHeader->len = 0;
-        else
-          memcpy(inHeader->buf, nextPackagePtr, inHeader->len);
-      } else
-        inHeader->len = 0;
-    }
+    /* We get some data belongs to next http package, it may wrap around the end of the ring buffer */
+    if( inHeader->extraDataPtr && inHeader->extraDataLen <= sizeof( inHeader->buf ) ){
+      headToEnd = inHeader->chunkedDataBufferPtr + inHeader->chunkedDataBufferLen - inHeader->extraDataPtr;
+      if( headToEnd > inHeader->extraDataLen ) headToEnd = inHeader->extraDataLen;
+      memcpy(inHeader->buf, inHeader->extraDataPtr, headToEnd);
+      memcpy(inHeader->buf + headToEnd, inHeader->chunkedDataBufferPtr, inHeader->extraDataLen - headToEnd);
+      inHeader->len = inHeader->extraDataLen;
+    } else
+      inHeader->len = 0;
 
     inHeader->extraDataLen = 0;
     free((uint32_t *)inHeader->chunkedDataBufferPtr);
@@ -729,10 +1052,11 @@ void HTTPHeaderClear( HTTPHeader_t *inHeader )
   }else{
 
     /* We get some data belongs to next http package, this only could happen two or more
-      packages are received by SocketReadHTTPHeader */ 
-    if( inHeader->extraDataLen > inHeader->contentLength ){ 
+      packages are received by SocketReadHTTPHeader, they are still in buf behind the body */ 
+    if( inHeader->extraDataLen > inHeader->contentLength && 
+        inHeader->len + inHeader->extraDataLen <= sizeof( inHeader->buf ) ){ 
+      memmove(inHeader->buf, inHeader->buf + inHeader->len + inHeader->contentLength, inHeader->extraDataLen - inHeader->contentLength);
       inHeader->len = inHeader->extraDataLen - inHeader->contentLength;
-      memcpy(inHeader->buf, inHeader->extraDataPtr + inHeader->contentLength, inHeader->len);
     } else
       inHeader->len = 0;
 
@@ -746,6 +1070,8 @@ void HTTPHeaderClear( HTTPHeader_t *inHeader )
 
   inHeader->isCallbackSupported = false;
 
+  if( HTTPHeaderGetIndex( inHeader ) )
+    HTTPHeaderIndexReset( HTTPHeaderGetIndex( inHeader ) );
 }
 
 OSStatus CreateSimpleHTTPOKMessage( uint8_t **outMessage, size_t *outMessageSize )
@@ -846,6 +1172,10 @@ char * getStatusString(int status)
     return "Authentication Error";
   else if(status == kStatusInternalServerErr)
     return "Internal Server Error";
+  else if(status == kStatusLengthRequired)
+    return "Length Required";
+  else if(status == kStatusServiceUnavailable)
+    return "Service Unavailable";
   else
     return "OK";
 }
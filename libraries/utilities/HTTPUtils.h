@@ -66,8 +66,10 @@
 #define kStatusNotFound             404
 #define kStatusMethodNotAllowed     405
 #define kStatusForbidden            403  
+#define kStatusLengthRequired       411
 #define kStatusAuthenticationErr    470  
 #define kStatusInternalServerErr    500      
+#define kStatusServiceUnavailable   503
 
 #define kMIMEType_Binary                "application/octet-stream"
 #define kMIMEType_DMAP                  "application/x-dmap-tagged"
@@ -120,6 +122,7 @@ typedef struct _HTTPHeader_t
     bool                isCallbackSupported;
     OSStatus            (*onReceivedDataCallback) ( struct _HTTPHeader_t * , uint32_t, uint8_t *, size_t, void * ); 
     void                (*onClearCallback) ( struct _HTTPHeader_t * httpHeader, void * userContext );
+    void *              index;              //! Private, field index allocated by HTTPHeaderCreate, NULL in zero-filled headers allocated elsewhere.
 
 
 
@@ -135,6 +138,11 @@ bool findHeader ( HTTPHeader_t *inHeader,  char **  outHeaderEnd);
 
 int HTTPScanFHeaderValue( const char *inHeaderPtr, size_t inHeaderLen, const char *inName, const char *inFormat, ... );
 
+/* Find a field of a received header. Headers created by HTTPHeaderCreate are indexed while they
+   are received, Content-Length, Content-Type, Transfer-Encoding and Connection are found without
+   scanning. Otherwise it is HTTPGetHeaderField on inHeader->buf. */
+OSStatus HTTPHeaderGetField( HTTPHeader_t *inHeader, const char *inName, const char **outValuePtr, size_t *outValueLen );
+
 int findCRLF( const char *inDataPtr , size_t inDataLen, char **  nextDataPtr );
 
 int findChunkedDataLength( const char *inChunkPtr , size_t inChunkLen, char **  chunkedDataPtr, const char *inFormat, ... );
@@ -143,6 +151,13 @@ int SocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader );
 
 int SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader );
 
+/* Non-blocking variants for a server that multiplexes clients with select: read at most
+   once from a readable socket, return EWOULDBLOCK until the header or body is complete.
+   A chunked body is not decoded here, SocketTryReadHTTPBody returns kUnsupportedErr */
+int SocketTryReadHTTPHeader( int inSock, HTTPHeader_t *inHeader );
+
+int SocketTryReadHTTPBody( int inSock, HTTPHeader_t *inHeader );
+
 int HTTPHeaderParse( HTTPHeader_t *ioHeader );
 
 int HTTPHeaderMatchMethod( HTTPHeader_t *inHeader, const char *method );
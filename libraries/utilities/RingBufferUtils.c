@@ -26,6 +26,18 @@
 #define ring_buffer_utils_log(M, ...) custom_log("RingBufferUtils", M, ##__VA_ARGS__)
 #define ring_buffer_utils_log_trace() custom_log_trace("RingBufferUtils")
 
+/* Orders the buffer accesses against the head/tail updates seen by the other side */
+#if defined ( __CC_ARM ) //KEIL
+#define spsc_ring_buffer_barrier()  __dmb(0xF)
+#elif defined ( __ICCARM__ )
+#include <intrinsics.h>
+#define spsc_ring_buffer_barrier()  __DMB()
+#elif defined ( __GNUC__ )
+#define spsc_ring_buffer_barrier()  __atomic_thread_fence( __ATOMIC_ACQ_REL )
+#else
+#error "spsc_ring_buffer_barrier is not defined for this compiler"
+#endif
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
 {
     ring_buffer->buffer     = (uint8_t*)buffer;
@@ -69,6 +81,23 @@ uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed
   return 0;
 }
 
+uint8_t ring_buffer_get_space( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
+{
+  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
+  uint32_t free_space = ( ring_buffer->head + ring_buffer->size - ring_buffer->tail - 1 ) % ring_buffer->size;
+
+  *data = &(ring_buffer->buffer[ring_buffer->tail]);
+
+  *contiguous_bytes = MIN(tail_to_end, free_space);
+  return 0;
+}
+
+uint8_t ring_buffer_produce( ring_buffer_t* ring_buffer, uint32_t bytes_produced )
+{
+  ring_buffer->tail = (ring_buffer->tail + bytes_produced) % ring_buffer->size;
+  return 0;
+}
+
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
 {
   uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
@@ -90,3 +119,126 @@ uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uin
   
   return amount_to_copy;
 }
+
+OSStatus spsc_ring_buffer_init( spsc_ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
+{
+  if ( buffer == NULL || size == 0 || ( size & ( size - 1 ) ) != 0 )
+  {
+    return kParamErr;
+  }
+  ring_buffer->buffer = buffer;
+  ring_buffer->mask   = size - 1;
+  ring_buffer->head   = 0;
+  ring_buffer->tail   = 0;
+  return kNoErr;
+}
+
+uint32_t spsc_ring_buffer_used_space( spsc_ring_buffer_t* ring_buffer )
+{
+  return ring_buffer->tail - ring_buffer->head;
+}
+
+uint32_t spsc_ring_buffer_free_space( spsc_ring_buffer_t* ring_buffer )
+{
+  return ring_buffer->mask + 1 - ( ring_buffer->tail - ring_buffer->head );
+}
+
+static uint32_t spsc_ring_buffer_view( spsc_ring_buffer_t* ring_buffer, uint32_t start, uint32_t length, spsc_ring_buffer_view_t* view )
+{
+  uint32_t offset = start & ring_buffer->mask;
+  uint32_t offset_to_end = ring_buffer->mask + 1 - offset;
+
+  view->data[0]   = &ring_buffer->buffer[offset];
+  view->length[0] = MIN(length, offset_to_end);
+  view->data[1]   = ring_buffer->buffer;
+  view->length[1] = length - view->length[0];
+  return length;
+}
+
+uint32_t spsc_ring_buffer_get_write_view( spsc_ring_buffer_t* ring_buffer, spsc_ring_buffer_view_t* view )
+{
+  uint32_t tail = ring_buffer->tail;
+  uint32_t head = ring_buffer->head;
+
+  /* Don't touch the space until the consumer is done with it */
+  spsc_ring_buffer_barrier();
+  return spsc_ring_buffer_view(ring_buffer, tail, ring_buffer->mask + 1 - ( tail - head ), view);
+}
+
+void spsc_ring_buffer_commit_write( spsc_ring_buffer_t* ring_buffer, uint32_t bytes_produced )
+{
+  /* Publish the data before the new tail */
+  spsc_ring_buffer_barrier();
+  ring_buffer->tail = ring_buffer->tail + bytes_produced;
+}
+
+uint32_t spsc_ring_buffer_write( spsc_ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
+{
+  uint32_t tail = ring_buffer->tail;
+  uint32_t offset = tail & ring_buffer->mask;
+  uint32_t offset_to_end = ring_buffer->mask + 1 - offset;
+  uint32_t amount_to_copy = MIN(data_length, ring_buffer->mask + 1 - ( tail - ring_buffer->head ));
+
+  spsc_ring_buffer_barrier();
+
+  /* Copy as much as we can until we fall off the end of the buffer, then the rest to the front */
+  if (amount_to_copy <= offset_to_end)
+  {
+    memcpy(&ring_buffer->buffer[offset], data, amount_to_copy);
+  }
+  else
+  {
+    memcpy(&ring_buffer->buffer[offset], data, offset_to_end);
+    memcpy(ring_buffer->buffer, data + offset_to_end, amount_to_copy - offset_to_end);
+  }
+
+  spsc_ring_buffer_barrier();
+  ring_buffer->tail = tail + amount_to_copy;
+  return amount_to_copy;
+}
+
+uint32_t spsc_ring_buffer_get_read_view( spsc_ring_buffer_t* ring_buffer, spsc_ring_buffer_view_t* view )
+{
+  uint32_t head = ring_buffer->head;
+  uint32_t tail = ring_buffer->tail;
+
+  /* Don't read the data before the tail that published it */
+  spsc_ring_buffer_barrier();
+  return spsc_ring_buffer_view(ring_buffer, head, tail - head, view);
+}
+
+void spsc_ring_buffer_commit_read( spsc_ring_buffer_t* ring_buffer, uint32_t bytes_consumed )
+{
+  /* Finish reading the data before the producer may overwrite it */
+  spsc_ring_buffer_barrier();
+  ring_buffer->head = ring_buffer->head + bytes_consumed;
+}
+
+uint32_t spsc_ring_buffer_peek( spsc_ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length )
+{
+  uint32_t head = ring_buffer->head;
+  uint32_t offset = head & ring_buffer->mask;
+  uint32_t offset_to_end = ring_buffer->mask + 1 - offset;
+  uint32_t amount_to_copy = MIN(data_length, ring_buffer->tail - head);
+
+  spsc_ring_buffer_barrier();
+
+  if (amount_to_copy <= offset_to_end)
+  {
+    memcpy(data, &ring_buffer->buffer[offset], amount_to_copy);
+  }
+  else
+  {
+    memcpy(data, &ring_buffer->buffer[offset], offset_to_end);
+    memcpy(data + offset_to_end, ring_buffer->buffer, amount_to_copy - offset_to_end);
+  }
+  return amount_to_copy;
+}
+
+uint32_t spsc_ring_buffer_read( spsc_ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length )
+{
+  uint32_t amount_to_copy = spsc_ring_buffer_peek(ring_buffer, data, data_length);
+
+  spsc_ring_buffer_commit_read(ring_buffer, amount_to_copy);
+  return amount_to_copy;
+}
@@ -51,6 +51,52 @@ uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed
 
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
 
+/* Contiguous free space at the tail, so a producer can read() straight into the buffer. One byte
+   is always left free, so a full buffer is not mistaken for an empty one */
+uint8_t ring_buffer_get_space( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes );
+
+uint8_t ring_buffer_produce( ring_buffer_t* ring_buffer, uint32_t bytes_produced );
+
+/* Lock-free ring buffer for one producer and one consumer, e.g. a UART interrupt and a reader
+   thread. The size must be a power of two. head and tail are free running counters, so the 
+   whole buffer can be filled, and each one is only written by its own side. Producer functions 
+   are spsc_ring_buffer_write, get_write_view and commit_write, the others are for the consumer. */
+typedef struct
+{
+  uint8_t*            buffer;
+  uint32_t            mask;
+  volatile uint32_t   head;   /* Read counter, written by the consumer */
+  volatile uint32_t   tail;   /* Write counter, written by the producer */
+} spsc_ring_buffer_t;
+
+/* Up to two segments of the buffer, the second one is used when the data or space wraps around
+   its end. So callers can DMA or write() straight from/to the buffer */
+typedef struct
+{
+  uint8_t*  data[2];
+  uint32_t  length[2];
+} spsc_ring_buffer_view_t;
+
+OSStatus spsc_ring_buffer_init( spsc_ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size );
+
+uint32_t spsc_ring_buffer_used_space( spsc_ring_buffer_t* ring_buffer );
+
+uint32_t spsc_ring_buffer_free_space( spsc_ring_buffer_t* ring_buffer );
+
+uint32_t spsc_ring_buffer_write( spsc_ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
+
+uint32_t spsc_ring_buffer_get_write_view( spsc_ring_buffer_t* ring_buffer, spsc_ring_buffer_view_t* view );
+
+void spsc_ring_buffer_commit_write( spsc_ring_buffer_t* ring_buffer, uint32_t bytes_produced );
+
+uint32_t spsc_ring_buffer_read( spsc_ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length );
+
+uint32_t spsc_ring_buffer_peek( spsc_ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length );
+
+uint32_t spsc_ring_buffer_get_read_view( spsc_ring_buffer_t* ring_buffer, spsc_ring_buffer_view_t* view );
+
+void spsc_ring_buffer_commit_read( spsc_ring_buffer_t* ring_buffer, uint32_t bytes_consumed );
+
 #endif // __RingBufferUtils_h__
 
 
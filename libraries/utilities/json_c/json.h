@@ -23,6 +23,7 @@ extern "C" {
 #include "json_util.h"
 #include "json_object.h"
 #include "json_tokener.h"
+#include "json_sax.h"
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,156 @@
+/*
+ * json_arena.c
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_arena.h"
+
+#define JSON_ARENA_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+struct json_arena_block {
+	struct json_arena_block *next;
+	size_t size;
+	size_t pos;
+	size_t last;   /* offset of the most recent allocation */
+};
+
+#define JSON_ARENA_BLOCK_HDR JSON_ARENA_ALIGN(sizeof(struct json_arena_block))
+#define JSON_ARENA_BLOCK_DATA(b) ((char*)(b) + JSON_ARENA_BLOCK_HDR)
+
+struct json_arena* json_arena_new(size_t block_size)
+{
+	struct json_arena *a;
+
+	a = (struct json_arena*)calloc(1, sizeof(struct json_arena));
+	if(!a) return NULL;
+	a->block_size = block_size ? JSON_ARENA_ALIGN(block_size) : JSON_ARENA_DEF_BLOCK_SIZE;
+	a->ref_count = 1;
+	return a;
+}
+
+struct json_arena* json_arena_get(struct json_arena *a)
+{
+	if(a) a->ref_count++;
+	return a;
+}
+
+void json_arena_put(struct json_arena *a)
+{
+	struct json_arena_block *b, *next;
+
+	if(!a || --a->ref_count > 0) return;
+	for(b = a->blocks; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	free(a);
+}
+
+static struct json_arena_block* json_arena_new_block(struct json_arena *a, size_t size)
+{
+	struct json_arena_block *b;
+
+	if(size < a->block_size) size = a->block_size;
+	b = (struct json_arena_block*)malloc(JSON_ARENA_BLOCK_HDR + size);
+	if(!b) return NULL;
+	b->size = size;
+	b->pos = 0;
+	b->last = 0;
+	a->malloc_count++;
+	a->reserved += JSON_ARENA_BLOCK_HDR + size;
+	/* Oversized blocks go behind the current one, so the space left in
+	 * the current block stays usable for the small allocations to come */
+	if(a->blocks && size > a->block_size) {
+		b->next = a->blocks->next;
+		a->blocks->next = b;
+	} else {
+		b->next = a->blocks;
+		a->blocks = b;
+	}
+	return b;
+}
+
+void* json_arena_alloc(struct json_arena *a, size_t size)
+{
+	struct json_arena_block *b;
+
+	if(!a) return malloc(size);
+	size = JSON_ARENA_ALIGN(size ? size : 1);
+	b = a->blocks;
+	if(!b || b->size - b->pos < size) {
+		b = json_arena_new_block(a, size);
+		if(!b) return NULL;
+	}
+	b->last = b->pos;
+	b->pos += size;
+	a->used += size;
+	return JSON_ARENA_BLOCK_DATA(b) + b->last;
+}
+
+void* json_arena_calloc(struct json_arena *a, size_t nmemb, size_t size)
+{
+	void *p;
+
+	if(!a) return calloc(nmemb, size);
+	p = json_arena_alloc(a, nmemb * size);
+	if(p) memset(p, 0, nmemb * size);
+	return p;
+}
+
+void* json_arena_realloc(struct json_arena *a, void *p, size_t old_size, size_t new_size)
+{
+	struct json_arena_block *b;
+	void *t;
+
+	if(!a) return realloc(p, new_size);
+	if(!p) return json_arena_alloc(a, new_size);
+
+	/* Grow in place when p is the most recent allocation of a block */
+	for(b = a->blocks; b; b = b->next) {
+		if(p == JSON_ARENA_BLOCK_DATA(b) + b->last) {
+			if(b->last + JSON_ARENA_ALIGN(new_size) <= b->size) {
+				a->used += JSON_ARENA_ALIGN(new_size) - (b->pos - b->last);
+				b->pos = b->last + JSON_ARENA_ALIGN(new_size);
+				return p;
+			}
+			break;
+		}
+	}
+
+	t = json_arena_alloc(a, new_size);
+	if(t) memcpy(t, p, old_size < new_size ? old_size : new_size);
+	return t;
+}
+
+char* json_arena_strdup(struct json_arena *a, const char *s)
+{
+	size_t len;
+	char *p;
+
+	len = strlen(s) + 1;
+	p = (char*)json_arena_alloc(a, len);
+	if(p) memcpy(p, s, len);
+	return p;
+}
+
+void json_arena_release(struct json_arena *a, void *p)
+{
+	if(!a) {
+		free(p);
+		return;
+	}
+	/* Arena memory is reclaimed with the arena, the most recent allocation
+	 * of the current block can be handed back right away though */
+	if(p && a->blocks && p == JSON_ARENA_BLOCK_DATA(a->blocks) + a->blocks->last) {
+		a->used -= a->blocks->pos - a->blocks->last;
+		a->blocks->pos = a->blocks->last;
+	}
+}
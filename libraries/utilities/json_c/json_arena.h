@@ -0,0 +1,84 @@
+/*
+ * json_arena.h
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_arena_h_
+#define _json_arena_h_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Default size of a block requested from malloc by an arena.
+ */
+#ifndef JSON_ARENA_DEF_BLOCK_SIZE
+#define JSON_ARENA_DEF_BLOCK_SIZE 1024
+#endif
+
+struct json_arena_block;
+
+/**
+ * A bump allocator shared by a json_tokener and the objects it produces.
+ *
+ * Memory is taken from malloc in blocks and handed out sequentially; single
+ * allocations are never returned to the heap, the whole arena is released
+ * when its last reference is dropped. Every object allocated in the arena
+ * holds a reference, so json_object_put() on the root of a parsed tree frees
+ * the tree and the arena in one shot.
+ *
+ * An arena is not thread safe, objects drawn from it must be used by one
+ * thread at a time, and must not be added to objects living on the heap.
+ */
+struct json_arena {
+	struct json_arena_block *blocks;
+	size_t block_size;
+	int ref_count;
+	/**
+	 * Statistics: blocks requested from malloc, bytes handed out and bytes
+	 * requested from malloc.
+	 */
+	int malloc_count;
+	size_t used;
+	size_t reserved;
+};
+
+/**
+ * Create a new arena.
+ * @param block_size size of the blocks requested from malloc, 0 selects
+ * JSON_ARENA_DEF_BLOCK_SIZE.
+ * @return the arena, with one reference held by the caller, or NULL.
+ */
+extern struct json_arena* json_arena_new(size_t block_size);
+
+/**
+ * Take a reference on an arena.
+ */
+extern struct json_arena* json_arena_get(struct json_arena *a);
+
+/**
+ * Drop a reference on an arena, all its memory is released with the last one.
+ */
+extern void json_arena_put(struct json_arena *a);
+
+/**
+ * The allocation functions below fall back to the C heap when a is NULL,
+ * so callers can use one code path for arena and heap backed storage.
+ */
+extern void* json_arena_alloc(struct json_arena *a, size_t size);
+extern void* json_arena_calloc(struct json_arena *a, size_t nmemb, size_t size);
+extern void* json_arena_realloc(struct json_arena *a, void *p, size_t old_size, size_t new_size);
+extern char* json_arena_strdup(struct json_arena *a, const char *s);
+extern void json_arena_release(struct json_arena *a, void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
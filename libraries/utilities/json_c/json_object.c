@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include "debug.h"
+#include "json_arena.h"
 #include "printbuf.h"
 #include "linkhash.h"
 #include "arraylist.h"
@@ -37,7 +38,7 @@ const char *json_number_chars = "0123456789.+-eE";
 const char *json_hex_chars = "0123456789abcdef";
 
 static void json_object_generic_delete(struct json_object* jso);
-static struct json_object* json_object_new(enum json_type o_type);
+static struct json_object* json_object_new(struct json_arena *arena, enum json_type o_type);
 
 
 /* ref count debugging */
@@ -138,21 +139,24 @@ extern void json_object_put(struct json_object *jso)
 
 static void json_object_generic_delete(struct json_object* jso)
 {
+  struct json_arena *arena = jso->_arena;
 #ifdef REFCOUNT_DEBUG
   MC_DEBUG("json_object_delete_%s: %p\n",
 	   json_type_to_name(jso->o_type), jso);
   lh_table_delete(json_object_table, jso);
 #endif /* REFCOUNT_DEBUG */
   printbuf_free(jso->_pb);
-  free(jso);
+  json_arena_release(arena, jso);
+  json_arena_put(arena);
 }
 
-static struct json_object* json_object_new(enum json_type o_type)
+static struct json_object* json_object_new(struct json_arena *arena, enum json_type o_type)
 {
   struct json_object *jso;
 
-  jso = (struct json_object*)calloc(sizeof(struct json_object), 1);
+  jso = (struct json_object*)json_arena_calloc(arena, sizeof(struct json_object), 1);
   if(!jso) return NULL;
+  jso->_arena = json_arena_get(arena);
   jso->o_type = o_type;
   jso->_ref_count = 1;
   jso->_delete = &json_object_generic_delete;
@@ -232,6 +236,12 @@ static void json_object_lh_entry_free(struct lh_entry *ent)
   json_object_put((struct json_object*)ent->v);
 }
 
+/* Keys of arena objects are reclaimed with the arena */
+static void json_object_arena_lh_entry_free(struct lh_entry *ent)
+{
+  json_object_put((struct json_object*)ent->v);
+}
+
 static void json_object_object_delete(struct json_object* jso)
 {
   lh_table_free(jso->o.c_object);
@@ -240,12 +250,18 @@ static void json_object_object_delete(struct json_object* jso)
 
 struct json_object* json_object_new_object(void)
 {
-  struct json_object *jso = json_object_new(json_type_object);
+  return json_object_new_object_in(NULL);
+}
+
+struct json_object* json_object_new_object_in(struct json_arena *arena)
+{
+  struct json_object *jso = json_object_new(arena, json_type_object);
   if(!jso) return NULL;
   jso->_delete = &json_object_object_delete;
   jso->_to_json_string = &json_object_object_to_json_string;
-  jso->o.c_object = lh_kchar_table_new(JSON_OBJECT_DEF_HASH_ENTRIES,
-					NULL, &json_object_lh_entry_free);
+  jso->o.c_object = lh_kchar_table_new_in(arena, JSON_OBJECT_DEF_HASH_ENTRIES, NULL,
+					  arena ? &json_object_arena_lh_entry_free
+						: &json_object_lh_entry_free);
   return jso;
 }
 
@@ -264,7 +280,7 @@ void json_object_object_add(struct json_object* jso, const char *key,
 			    struct json_object *val)
 {
   lh_table_delete(jso->o.c_object, key);
-  lh_table_insert(jso->o.c_object, strdup(key), val);
+  lh_table_insert(jso->o.c_object, json_arena_strdup(jso->_arena, key), val);
 }
 
 struct json_object* json_object_object_get(struct json_object* jso, const char *key)
@@ -290,7 +306,12 @@ static int json_object_boolean_to_json_string(struct json_object* jso,
 
 struct json_object* json_object_new_boolean(boolean b)
 {
-  struct json_object *jso = json_object_new(json_type_boolean);
+  return json_object_new_boolean_in(NULL, b);
+}
+
+struct json_object* json_object_new_boolean_in(struct json_arena *arena, boolean b)
+{
+  struct json_object *jso = json_object_new(arena, json_type_boolean);
   if(!jso) return NULL;
   jso->_to_json_string = &json_object_boolean_to_json_string;
   jso->o.c_boolean = b;
@@ -325,7 +346,7 @@ static int json_object_int_to_json_string(struct json_object* jso,
 
 struct json_object* json_object_new_int(int32_t i)
 {
-  struct json_object *jso = json_object_new(json_type_int);
+  struct json_object *jso = json_object_new(NULL, json_type_int);
   if(!jso) return NULL;
   jso->_to_json_string = &json_object_int_to_json_string;
   jso->o.c_int64 = i;
@@ -370,7 +391,12 @@ int32_t json_object_get_int(struct json_object *jso)
 
 struct json_object* json_object_new_int64(int64_t i)
 {
-  struct json_object *jso = json_object_new(json_type_int);
+  return json_object_new_int64_in(NULL, i);
+}
+
+struct json_object* json_object_new_int64_in(struct json_arena *arena, int64_t i)
+{
+  struct json_object *jso = json_object_new(arena, json_type_int);
   if(!jso) return NULL;
   jso->_to_json_string = &json_object_int_to_json_string;
   jso->o.c_int64 = i;
@@ -407,7 +433,12 @@ static int json_object_double_to_json_string(struct json_object* jso,
 
 struct json_object* json_object_new_double(double d)
 {
-  struct json_object *jso = json_object_new(json_type_double);
+  return json_object_new_double_in(NULL, d);
+}
+
+struct json_object* json_object_new_double_in(struct json_arena *arena, double d)
+{
+  struct json_object *jso = json_object_new(arena, json_type_double);
   if(!jso) return NULL;
   jso->_to_json_string = &json_object_double_to_json_string;
   jso->o.c_double = d;
@@ -447,24 +478,29 @@ static int json_object_string_to_json_string(struct json_object* jso,
 
 static void json_object_string_delete(struct json_object* jso)
 {
-  free(jso->o.c_string.str);
+  json_arena_release(jso->_arena, jso->o.c_string.str);
   json_object_generic_delete(jso);
 }
 
 struct json_object* json_object_new_string(const char *s)
 {
-  struct json_object *jso = json_object_new(json_type_string);
+  return json_object_new_string_in(NULL, s);
+}
+
+struct json_object* json_object_new_string_in(struct json_arena *arena, const char *s)
+{
+  struct json_object *jso = json_object_new(arena, json_type_string);
   if(!jso) return NULL;
   jso->_delete = &json_object_string_delete;
   jso->_to_json_string = &json_object_string_to_json_string;
-  jso->o.c_string.str = strdup(s);
+  jso->o.c_string.str = json_arena_strdup(arena, s);
   jso->o.c_string.len = strlen(s);
   return jso;
 }
 
 struct json_object* json_object_new_string_len(const char *s, int len)
 {
-  struct json_object *jso = json_object_new(json_type_string);
+  struct json_object *jso = json_object_new(NULL, json_type_string);
   if(!jso) return NULL;
   jso->_delete = &json_object_string_delete;
   jso->_to_json_string = &json_object_string_to_json_string;
@@ -528,11 +564,16 @@ static void json_object_array_delete(struct json_object* jso)
 
 struct json_object* json_object_new_array(void)
 {
-  struct json_object *jso = json_object_new(json_type_array);
+  return json_object_new_array_in(NULL);
+}
+
+struct json_object* json_object_new_array_in(struct json_arena *arena)
+{
+  struct json_object *jso = json_object_new(arena, json_type_array);
   if(!jso) return NULL;
   jso->_delete = &json_object_array_delete;
   jso->_to_json_string = &json_object_array_to_json_string;
-  jso->o.c_array = array_list_new(&json_object_array_entry_free);
+  jso->o.c_array = array_list_new_in(arena, &json_object_array_entry_free);
   return jso;
 }
 
@@ -12,6 +12,8 @@
 #ifndef _json_object_private_h_
 #define _json_object_private_h_
 
+#include "json_arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -22,6 +24,7 @@ typedef int (json_object_to_json_string_fn)(struct json_object *o,
 
 struct json_object
 {
+  struct json_arena *_arena;
   enum json_type o_type;
   json_object_delete_fn *_delete;
   json_object_to_json_string_fn *_to_json_string;
@@ -40,6 +43,15 @@ struct json_object
   } o;
 };
 
+/* Constructors drawing from an arena (NULL for the heap), used by the
+ * tokener. Each object takes a reference on the arena. */
+extern struct json_object* json_object_new_object_in(struct json_arena *arena);
+extern struct json_object* json_object_new_array_in(struct json_arena *arena);
+extern struct json_object* json_object_new_boolean_in(struct json_arena *arena, boolean b);
+extern struct json_object* json_object_new_int64_in(struct json_arena *arena, int64_t i);
+extern struct json_object* json_object_new_double_in(struct json_arena *arena, double d);
+extern struct json_object* json_object_new_string_in(struct json_arena *arena, const char *s);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,333 @@
+/*
+ * json_sax.c
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#include "config.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "bits.h"
+#include "json_sax.h"
+
+enum json_sax_state {
+  json_sax_state_value,
+  json_sax_state_value_or_end,    /* just after '[' */
+  json_sax_state_key,             /* just after ',' in an object */
+  json_sax_state_key_or_end,      /* just after '{' */
+  json_sax_state_colon,
+  json_sax_state_after_value,
+  json_sax_state_string,
+  json_sax_state_string_escape,
+  json_sax_state_literal,
+  json_sax_state_done
+};
+
+#define IS_WS(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define IS_LITERAL(c) (((c) >= '0' && (c) <= '9') || ((c) >= 'a' && (c) <= 'z') || \
+                       ((c) >= 'A' && (c) <= 'Z') || (c) == '-' || (c) == '+' || (c) == '.')
+#define IN_OBJECT(p) ((p)->depth > 0 && ((p)->in_object & (1UL << ((p)->depth - 1))))
+
+void json_sax_init(struct json_sax_parser *p, json_sax_callback *callback, void *ctx)
+{
+  memset(p, 0, sizeof(struct json_sax_parser));
+  p->callback = callback;
+  p->ctx = ctx;
+  p->state = json_sax_state_value;
+  p->result = json_sax_continue;
+}
+
+static int json_sax_carry(struct json_sax_parser *p, const char *start, const char *end)
+{
+  int len = (int)(end - start);
+  if(p->carry_len + len > JSON_SAX_MAX_TOKEN) return -1;
+  memcpy(p->carry + p->carry_len, start, len);
+  p->carry_len += len;
+  return 0;
+}
+
+static int json_sax_literal_event(const char *str, int len)
+{
+  int i = 0;
+
+  if(json_sax_equal(str, len, "true")) return json_sax_true;
+  if(json_sax_equal(str, len, "false")) return json_sax_false;
+  if(json_sax_equal(str, len, "null")) return json_sax_null;
+
+  /* -?digits[.digits][(e|E)[+-]digits] */
+  if(i < len && str[i] == '-') i++;
+  if(i == len || str[i] < '0' || str[i] > '9') return -1;
+  while(i < len && str[i] >= '0' && str[i] <= '9') i++;
+  if(i < len && str[i] == '.') {
+    if(++i == len || str[i] < '0' || str[i] > '9') return -1;
+    while(i < len && str[i] >= '0' && str[i] <= '9') i++;
+  }
+  if(i < len && (str[i] == 'e' || str[i] == 'E')) {
+    i++;
+    if(i < len && (str[i] == '+' || str[i] == '-')) i++;
+    if(i == len || str[i] < '0' || str[i] > '9') return -1;
+    while(i < len && str[i] >= '0' && str[i] <= '9') i++;
+  }
+  return (i == len) ? json_sax_number : -1;
+}
+
+/* Report the token [start, end), prefixed by what was carried over from
+ * previous chunks */
+static enum json_sax_result json_sax_emit_token(struct json_sax_parser *p, int is_literal,
+                                                const char *start, const char *end)
+{
+  const char *str = start;
+  int len = (int)(end - start);
+  int event;
+
+  if(p->carry_len) {
+    if(json_sax_carry(p, start, end)) return json_sax_error_token;
+    str = p->carry;
+    len = p->carry_len;
+    p->carry_len = 0;
+  }
+
+  if(is_literal) {
+    event = json_sax_literal_event(str, len);
+    if(event < 0) return json_sax_error_unexpected;
+  } else {
+    event = p->is_key ? json_sax_key : json_sax_string;
+  }
+
+  if(p->callback(p, (enum json_sax_event)event, str, len)) return json_sax_stopped;
+  return json_sax_continue;
+}
+
+static void json_sax_value_end(struct json_sax_parser *p)
+{
+  if(p->depth == 0) {
+    p->state = json_sax_state_done;
+    p->result = json_sax_done;
+  } else {
+    p->state = json_sax_state_after_value;
+  }
+}
+
+enum json_sax_result json_sax_parse(struct json_sax_parser *p, const char *buf, int len)
+{
+  const char *tok = buf;
+  enum json_sax_result res;
+  int i;
+  char c;
+
+  if(p->result != json_sax_continue && p->result != json_sax_done) return p->result;
+
+  for(i = 0; i < len; i++) {
+    c = buf[i];
+
+    switch(p->state) {
+
+    case json_sax_state_string:
+      if(c == '\\') {
+        p->escaped = 1;
+        p->state = json_sax_state_string_escape;
+      } else if(c == '"') {
+        res = json_sax_emit_token(p, 0, tok, buf + i);
+        if(res != json_sax_continue) goto out_err;
+        if(p->is_key) p->state = json_sax_state_colon;
+        else json_sax_value_end(p);
+      }
+      continue;
+
+    case json_sax_state_string_escape:
+      p->state = json_sax_state_string;
+      continue;
+
+    case json_sax_state_literal:
+      if(IS_LITERAL(c)) continue;
+      res = json_sax_emit_token(p, 1, tok, buf + i);
+      if(res != json_sax_continue) goto out_err;
+      json_sax_value_end(p);
+      /* c ends the literal, handle it in the new state */
+      break;
+
+    default:
+      break;
+    }
+
+    if(IS_WS(c)) continue;
+
+    switch(p->state) {
+
+    case json_sax_state_value_or_end:
+      if(c == ']') goto close;
+      /* fall through */
+    case json_sax_state_value:
+      if(c == '{' || c == '[') {
+        if(p->depth >= JSON_SAX_MAX_DEPTH) { res = json_sax_error_depth; goto out_err; }
+        if(p->callback(p, c == '{' ? json_sax_object_start : json_sax_array_start, NULL, 0)) {
+          res = json_sax_stopped;
+          goto out_err;
+        }
+        if(c == '{') {
+          p->in_object |= (1UL << p->depth);
+          p->state = json_sax_state_key_or_end;
+        } else {
+          p->in_object &= ~(1UL << p->depth);
+          p->state = json_sax_state_value_or_end;
+        }
+        p->depth++;
+      } else if(c == '"') {
+        tok = buf + i + 1;
+        p->is_key = 0;
+        p->escaped = 0;
+        p->state = json_sax_state_string;
+      } else if(IS_LITERAL(c)) {
+        tok = buf + i;
+        p->state = json_sax_state_literal;
+      } else {
+        res = json_sax_error_unexpected;
+        goto out_err;
+      }
+      break;
+
+    case json_sax_state_key_or_end:
+      if(c == '}') goto close;
+      /* fall through */
+    case json_sax_state_key:
+      if(c != '"') { res = json_sax_error_unexpected; goto out_err; }
+      tok = buf + i + 1;
+      p->is_key = 1;
+      p->escaped = 0;
+      p->state = json_sax_state_string;
+      break;
+
+    case json_sax_state_colon:
+      if(c != ':') { res = json_sax_error_unexpected; goto out_err; }
+      p->state = json_sax_state_value;
+      break;
+
+    case json_sax_state_after_value:
+      if(c == ',') {
+        p->state = IN_OBJECT(p) ? json_sax_state_key : json_sax_state_value;
+        break;
+      }
+      if(c == '}' || c == ']') goto close;
+      res = json_sax_error_unexpected;
+      goto out_err;
+
+    default: /* json_sax_state_done */
+      res = json_sax_error_unexpected;
+      goto out_err;
+    }
+    continue;
+
+  close:
+    if((c == '}') != IN_OBJECT(p)) { res = json_sax_error_unexpected; goto out_err; }
+    p->depth--;
+    if(p->callback(p, c == '}' ? json_sax_object_end : json_sax_array_end, NULL, 0)) {
+      res = json_sax_stopped;
+      goto out_err;
+    }
+    json_sax_value_end(p);
+  }
+
+  /* Keep the head of a token that continues in the next chunk */
+  if(p->state == json_sax_state_string || p->state == json_sax_state_string_escape ||
+     p->state == json_sax_state_literal) {
+    if(json_sax_carry(p, tok, buf + len)) { res = json_sax_error_token; goto out_err; }
+  }
+  p->offset += len;
+  return p->result;
+
+ out_err:
+  p->offset += i;
+  p->result = res;
+  return res;
+}
+
+enum json_sax_result json_sax_finish(struct json_sax_parser *p)
+{
+  enum json_sax_result res;
+
+  if(p->result != json_sax_continue) return p->result;
+  if(p->state == json_sax_state_literal && p->depth == 0) {
+    res = json_sax_emit_token(p, 1, p->carry, p->carry);
+    if(res != json_sax_continue) return p->result = res;
+    json_sax_value_end(p);
+    return p->result;
+  }
+  return p->result = json_sax_error_unexpected;
+}
+
+static int json_sax_hex4(const char *s)
+{
+  int i, v = 0;
+  for(i = 0; i < 4; i++) {
+    char c = s[i];
+    v <<= 4;
+    if(c >= '0' && c <= '9') v |= c - '0';
+    else if(c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+    else if(c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+    else return -1;
+  }
+  return v;
+}
+
+int json_sax_unescape(char *dst, int dst_len, const char *src, int len)
+{
+  int i = 0, o = 0;
+  unsigned int uc;
+  int v;
+
+#define PUT(ch) do { if(o < dst_len) dst[o] = (char)(ch); o++; } while(0)
+  while(i < len) {
+    if(src[i] != '\\' || i + 1 == len) {
+      PUT(src[i++]);
+      continue;
+    }
+    i++;
+    switch(src[i++]) {
+    case 'b': PUT('\b'); break;
+    case 'f': PUT('\f'); break;
+    case 'n': PUT('\n'); break;
+    case 'r': PUT('\r'); break;
+    case 't': PUT('\t'); break;
+    case 'u':
+      if(i + 4 > len || (v = json_sax_hex4(src + i)) < 0) break;
+      i += 4;
+      uc = (unsigned int)v;
+      if((uc & 0xFC00) == 0xD800 && i + 6 <= len && src[i] == '\\' && src[i+1] == 'u' &&
+         (v = json_sax_hex4(src + i + 2)) >= 0 && (v & 0xFC00) == 0xDC00) {
+        uc = (((uc & 0x3FF) << 10) | (v & 0x3FF)) + 0x10000;
+        i += 6;
+      }
+      if(uc < 0x80) {
+        PUT(uc);
+      } else if(uc < 0x800) {
+        PUT(0xC0 | (uc >> 6));
+        PUT(0x80 | (uc & 0x3F));
+      } else if(uc < 0x10000) {
+        PUT(0xE0 | (uc >> 12));
+        PUT(0x80 | ((uc >> 6) & 0x3F));
+        PUT(0x80 | (uc & 0x3F));
+      } else {
+        PUT(0xF0 | (uc >> 18));
+        PUT(0x80 | ((uc >> 12) & 0x3F));
+        PUT(0x80 | ((uc >> 6) & 0x3F));
+        PUT(0x80 | (uc & 0x3F));
+      }
+      break;
+    default: /* '"', '\\', '/' and anything unknown stand for themselves */
+      PUT(src[i-1]);
+      break;
+    }
+  }
+#undef PUT
+  if(o < dst_len) dst[o] = '\0';
+  return o;
+}
+
+int json_sax_equal(const char *str, int len, const char *s)
+{
+  return (strncmp(str, s, len) == 0 && s[len] == '\0');
+}
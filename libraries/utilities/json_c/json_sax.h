@@ -0,0 +1,120 @@
+/*
+ * json_sax.h
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See COPYING for details.
+ *
+ */
+
+#ifndef _json_sax_h_
+#define _json_sax_h_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Event driven JSON parser.
+ *
+ * Unlike json_tokener, no object tree is built: every key and value is
+ * reported to a callback as a pointer+length slice into the input buffer,
+ * and nothing is allocated. Input may be fed in arbitrary chunks, e.g.
+ * straight from SocketReadHTTPBody(); a token split across two chunks is
+ * carried in a small buffer inside the parser, so only tokens longer than
+ * JSON_SAX_MAX_TOKEN that also straddle a chunk boundary are rejected.
+ *
+ * String slices are not unescaped, json_sax_parser.escaped is set when the
+ * slice contains escape sequences, json_sax_unescape() decodes them.
+ */
+
+#define JSON_SAX_MAX_DEPTH 32
+
+#ifndef JSON_SAX_MAX_TOKEN
+#define JSON_SAX_MAX_TOKEN 128
+#endif
+
+enum json_sax_event {
+  json_sax_object_start,
+  json_sax_object_end,
+  json_sax_array_start,
+  json_sax_array_end,
+  json_sax_key,
+  json_sax_string,
+  json_sax_number,
+  json_sax_true,
+  json_sax_false,
+  json_sax_null
+};
+
+enum json_sax_result {
+  json_sax_continue,          /* more input expected */
+  json_sax_done,              /* a complete value has been parsed */
+  json_sax_stopped,           /* the callback asked to stop */
+  json_sax_error_depth,
+  json_sax_error_token,       /* token too long to carry across chunks */
+  json_sax_error_unexpected
+};
+
+struct json_sax_parser;
+
+/**
+ * Event callback.
+ * @param p the parser, p->ctx carries the user context and p->depth the
+ * nesting level of the event (0 for the top level value).
+ * @param event the event.
+ * @param str slice of the key or value, NULL for structural events.
+ * @param len length of the slice.
+ * @return 0 to go on parsing, anything else stops the parser.
+ */
+typedef int (json_sax_callback)(struct json_sax_parser *p, enum json_sax_event event,
+                                const char *str, int len);
+
+struct json_sax_parser
+{
+  json_sax_callback *callback;
+  void *ctx;
+  int depth;
+  int escaped;
+  int offset;                 /* bytes consumed over all chunks */
+  enum json_sax_result result;
+  uint8_t state;
+  uint8_t is_key;
+  uint32_t in_object;         /* one bit per depth, set for objects */
+  int carry_len;
+  char carry[JSON_SAX_MAX_TOKEN];
+};
+
+extern void json_sax_init(struct json_sax_parser *p, json_sax_callback *callback, void *ctx);
+
+/**
+ * Feed a chunk of input.
+ * @return json_sax_continue until a complete top level value has been seen,
+ * then json_sax_done, or an error. A top level number can only be completed
+ * by json_sax_finish().
+ */
+extern enum json_sax_result json_sax_parse(struct json_sax_parser *p, const char *buf, int len);
+
+/**
+ * Signal the end of input.
+ * @return json_sax_done if a complete value was parsed.
+ */
+extern enum json_sax_result json_sax_finish(struct json_sax_parser *p);
+
+/**
+ * Decode the escape sequences of a string slice into dst (UTF-8).
+ * @return the decoded length, dst is NUL terminated when there is room.
+ */
+extern int json_sax_unescape(char *dst, int dst_len, const char *src, int len);
+
+/**
+ * Compare a key or string slice against a C string.
+ */
+extern int json_sax_equal(const char *str, int len, const char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
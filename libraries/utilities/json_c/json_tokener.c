@@ -27,8 +27,11 @@
 #include "printbuf.h"
 #include "arraylist.h"
 #include "json_inttypes.h"
+#include "json_arena.h"
 #include "json_object.h"
+#include "json_object_private.h"
 #include "json_tokener.h"
+#include "linkhash.h"
 #include "json_util.h"
 
 #include "StringUtils.h"
@@ -60,6 +63,7 @@ const char* json_tokener_errors[] = {
   "object value separator ',' expected",
   "invalid string sequence",
   "expected comment",
+  "out of memory",
 };
 
 /* Stuff for decoding unicode sequences */
@@ -80,6 +84,14 @@ struct json_tokener* json_tokener_new(void)
   return tok;
 }
 
+struct json_tokener* json_tokener_new_arena(size_t block_size)
+{
+  struct json_tokener *tok = json_tokener_new();
+  if (!tok) return NULL;
+  tok->arena_block_size = block_size ? block_size : JSON_ARENA_DEF_BLOCK_SIZE;
+  return tok;
+}
+
 void json_tokener_free(struct json_tokener *tok)
 {
   json_tokener_reset(tok);
@@ -93,7 +105,7 @@ static void json_tokener_reset_level(struct json_tokener *tok, int depth)
   tok->stack[depth].saved_state = json_tokener_state_start;
   json_object_put(tok->stack[depth].current);
   tok->stack[depth].current = NULL;
-  free(tok->stack[depth].obj_field_name);
+  json_arena_release(tok->arena, tok->stack[depth].obj_field_name);
   tok->stack[depth].obj_field_name = NULL;
 }
 
@@ -105,6 +117,8 @@ void json_tokener_reset(struct json_tokener *tok)
 
   for(i = tok->depth; i >= 0; i--)
     json_tokener_reset_level(tok, i);
+  json_arena_put(tok->arena);
+  tok->arena = NULL;
   tok->depth = 0;
   tok->err = json_tokener_success;
 }
@@ -122,6 +136,20 @@ struct json_object* json_tokener_parse(const char *str)
   return obj;
 }
 
+struct json_object* json_tokener_parse_arena(const char *str, size_t block_size)
+{
+  struct json_tokener* tok;
+  struct json_object* obj;
+
+  tok = json_tokener_new_arena(block_size);
+  if(!tok) return NULL;
+  obj = json_tokener_parse_ex(tok, str, -1);
+  if(tok->err != json_tokener_success)
+    obj = NULL;
+  json_tokener_free(tok);
+  return obj;
+}
+
 struct json_object* json_tokener_parse_verbose(const char *str, enum json_tokener_error *error)
 {
     struct json_tokener* tok;
@@ -206,6 +234,50 @@ char* strndup(const char* str, size_t n)
 /* End optimization macro defs */
 
 
+#if JSON_TOKENER_PRESIZE_OBJECTS
+/* Count the members of the object whose '{' precedes str, so its hash table
+ * can be sized once instead of growing while the members are added. Only the
+ * input of the current chunk is inspected (len < 0 means NUL terminated), so
+ * the result is a lower bound for objects split across chunks.
+ */
+static int json_tokener_count_fields(const char *str, int len)
+{
+  int depth = 0, fields = 0, seen = 0;
+  char quote = 0;
+
+  for(; len != 0 && *str; str++, len--) {
+    char c = *str;
+    if(quote) {
+      if(c == '\\') {
+        if(len == 1 || !str[1]) break;
+        str++; len--;
+      } else if(c == quote) quote = 0;
+      continue;
+    }
+    switch(c) {
+    case '"':
+    case '\'':
+      quote = c;
+      if(depth == 0) seen = 1;
+      break;
+    case '{':
+    case '[':
+      depth++;
+      break;
+    case '}':
+    case ']':
+      if(depth-- == 0) return fields + seen;
+      break;
+    case ',':
+      if(depth == 0) fields++;
+      break;
+    }
+  }
+  return fields + seen;
+}
+#endif
+
+
 struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 					  const char *str, int len)
 {
@@ -215,6 +287,15 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
   tok->char_offset = 0;
   tok->err = json_tokener_success;
 
+  /* Every document gets its own arena, owned by the objects parsed into it */
+  if(tok->arena_block_size && !tok->arena) {
+    tok->arena = json_arena_new(tok->arena_block_size);
+    if(!tok->arena) {
+      tok->err = json_tokener_error_memory;
+      return NULL;
+    }
+  }
+
   while (POP_CHAR(c, tok)) {
 
   redo_char:
@@ -241,12 +322,17 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       case '{':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_object_field_start;
-	current = json_object_new_object();
+	current = json_object_new_object_in(tok->arena);
+#if JSON_TOKENER_PRESIZE_OBJECTS
+	if(current)
+	  lh_table_reserve(json_object_get_object(current),
+			   json_tokener_count_fields(str + 1, len < 0 ? -1 : len - tok->char_offset - 1));
+#endif
 	break;
       case '[':
 	state = json_tokener_state_eatws;
 	saved_state = json_tokener_state_array;
-	current = json_object_new_array();
+	current = json_object_new_array_in(tok->arena);
 	break;
       case 'N':
       case 'n':
@@ -377,7 +463,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	while(1) {
 	  if(c == tok->quote_char) {
 	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
-	    current = json_object_new_string(tok->pb->buf);
+	    current = json_object_new_string_in(tok->arena, tok->pb->buf);
 	    saved_state = json_tokener_state_finish;
 	    state = json_tokener_state_eatws;
 	    break;
@@ -525,7 +611,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       if(strncasecmp(json_true_str, tok->pb->buf,
 		     json_min(tok->st_pos+1, strlen(json_true_str))) == 0) {
 	if(tok->st_pos == strlen(json_true_str)) {
-	  current = json_object_new_boolean(1);
+	  current = json_object_new_boolean_in(tok->arena, 1);
 	  saved_state = json_tokener_state_finish;
 	  state = json_tokener_state_eatws;
 	  goto redo_char;
@@ -533,7 +619,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       } else if(strncasecmp(json_false_str, tok->pb->buf,
 			    json_min(tok->st_pos+1, strlen(json_false_str))) == 0) {
 	if(tok->st_pos == strlen(json_false_str)) {
-	  current = json_object_new_boolean(0);
+	  current = json_object_new_boolean_in(tok->arena, 0);
 	  saved_state = json_tokener_state_finish;
 	  state = json_tokener_state_eatws;
 	  goto redo_char;
@@ -565,9 +651,9 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	int64_t num64;
 	double  numd;
 	if (!tok->is_double && json_parse_int64(tok->pb->buf, &num64) == 0) {
-		current = json_object_new_int64(num64);
+		current = json_object_new_int64_in(tok->arena, num64);
 	} else if(tok->is_double && sscanf(tok->pb->buf, "%lf", &numd) == 1) {
-          current = json_object_new_double(numd);
+          current = json_object_new_double_in(tok->arena, numd);
         } else {
           tok->err = json_tokener_error_parse_number;
           goto out;
@@ -633,7 +719,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 	while(1) {
 	  if(c == tok->quote_char) {
 	    printbuf_memappend_fast(tok->pb, case_start, str-case_start);
-	    obj_field_name = strdup(tok->pb->buf);
+	    obj_field_name = json_arena_strdup(tok->arena, tok->pb->buf);
 	    saved_state = json_tokener_state_object_field_end;
 	    state = json_tokener_state_eatws;
 	    break;
@@ -673,7 +759,7 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 
     case json_tokener_state_object_value_add:
       json_object_object_add(current, obj_field_name, obj);
-      free(obj_field_name);
+      json_arena_release(tok->arena, obj_field_name);
       obj_field_name = NULL;
       saved_state = json_tokener_state_object_sep;
       state = json_tokener_state_eatws;
@@ -704,7 +790,13 @@ struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
       tok->err = json_tokener_error_parse_eof;
   }
 
-  if(tok->err == json_tokener_success) return json_object_get(current);
+  if(tok->err == json_tokener_success) {
+    obj = json_object_get(current);
+    /* The parsed objects keep the arena alive, the next document gets a new one */
+    json_arena_put(tok->arena);
+    tok->arena = NULL;
+    return obj;
+  }
   MC_DEBUG("json_tokener_parse_ex: error %s at offset %d\n",
 	   json_tokener_errors[tok->err], tok->char_offset);
   return NULL;
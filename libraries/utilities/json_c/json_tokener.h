@@ -14,6 +14,7 @@
 
 #include <stddef.h>
 #include "json_object.h"
+#include "json_arena.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,7 +34,8 @@ enum json_tokener_error {
   json_tokener_error_parse_object_key_sep,
   json_tokener_error_parse_object_value_sep,
   json_tokener_error_parse_string,
-  json_tokener_error_parse_comment
+  json_tokener_error_parse_comment,
+  json_tokener_error_memory
 };
 
 enum json_tokener_state {
@@ -71,6 +73,13 @@ struct json_tokener_srec
 
 #define JSON_TOKENER_MAX_DEPTH 32
 
+/* Pre-size the hash table of every parsed object from the number of members
+ * found by a quick scan of the input, so large objects are not rehashed while
+ * their members are added. */
+#ifndef JSON_TOKENER_PRESIZE_OBJECTS
+#define JSON_TOKENER_PRESIZE_OBJECTS 1
+#endif
+
 struct json_tokener
 {
   char *str;
@@ -80,14 +89,22 @@ struct json_tokener
   unsigned int ucs_char;
   char quote_char;
   struct json_tokener_srec stack[JSON_TOKENER_MAX_DEPTH];
+  struct json_arena *arena;
+  size_t arena_block_size;
 };
 
 extern const char* json_tokener_errors[];
 
 extern struct json_tokener* json_tokener_new(void);
+/* Objects produced by this tokener are allocated from an arena of
+ * block_size (0 for the default) blocks instead of the heap. The arena is
+ * freed with the last object of a document, so json_object_put() on the
+ * root releases the whole tree in one shot. */
+extern struct json_tokener* json_tokener_new_arena(size_t block_size);
 extern void json_tokener_free(struct json_tokener *tok);
 extern void json_tokener_reset(struct json_tokener *tok);
 extern struct json_object* json_tokener_parse(const char *str);
+extern struct json_object* json_tokener_parse_arena(const char *str, size_t block_size);
 extern struct json_object* json_tokener_parse_verbose(const char *str, enum json_tokener_error *error);
 extern struct json_object* json_tokener_parse_ex(struct json_tokener *tok,
 						 const char *str, int len);
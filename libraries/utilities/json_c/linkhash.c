@@ -55,56 +55,119 @@ int lh_char_equal(const void *k1, const void *k2)
 	return (strcmp((const char*)k1, (const char*)k2) == 0);
 }
 
-struct lh_table* lh_table_new(int size, const char *name,
-			      lh_entry_free_fn *free_fn,
-			      lh_hash_fn *hash_fn,
-			      lh_equal_fn *equal_fn)
+static struct lh_table* lh_table_new_in(struct json_arena *arena, int size,
+					lh_entry_free_fn *free_fn,
+					lh_hash_fn *hash_fn,
+					lh_equal_fn *equal_fn)
 {
 	int i;
 	struct lh_table *t;
 
-	t = (struct lh_table*)calloc(1, sizeof(struct lh_table));
+	if(size < 1) size = 1;
+	t = (struct lh_table*)json_arena_calloc(arena, 1, sizeof(struct lh_table));
 	if(!t) lh_abort("lh_table_new: calloc failed 1, size = %d\n", sizeof(struct lh_table));
+	t->arena = arena;
 	t->count = 0;
+	t->deleted = 0;
 	t->size = size;
-	t->table = (struct lh_entry*)calloc(size, sizeof(struct lh_entry));
+	t->table = (struct lh_entry*)json_arena_alloc(arena, size * sizeof(struct lh_entry));
 	if(!t->table) lh_abort("lh_table_new: calloc failed 2, size = %d\n", sizeof(struct lh_table));
 	t->free_fn = free_fn;
 	t->hash_fn = hash_fn;
 	t->equal_fn = equal_fn;
+	memset(t->table, 0, size * sizeof(struct lh_entry));
 	for(i = 0; i < size; i++) t->table[i].k = LH_EMPTY;
 	return t;
 }
 
+struct lh_table* lh_table_new(int size, const char *name,
+			      lh_entry_free_fn *free_fn,
+			      lh_hash_fn *hash_fn,
+			      lh_equal_fn *equal_fn)
+{
+	return lh_table_new_in(NULL, size, free_fn, hash_fn, equal_fn);
+}
+
 struct lh_table* lh_kchar_table_new(int size, const char *name,
 				    lh_entry_free_fn *free_fn)
 {
 	return lh_table_new(size, name, free_fn, lh_char_hash, lh_char_equal);
 }
 
+struct lh_table* lh_kchar_table_new_in(struct json_arena *arena, int size,
+				       const char *name,
+				       lh_entry_free_fn *free_fn)
+{
+	return lh_table_new_in(arena, size, free_fn, lh_char_hash, lh_char_equal);
+}
+
 struct lh_table* lh_kptr_table_new(int size, const char *name,
 				   lh_entry_free_fn *free_fn)
 {
 	return lh_table_new(size, name, free_fn, lh_ptr_hash, lh_ptr_equal);
 }
 
+/* Put a record into the first free slot of its probe sequence and append it
+ * to the insertion ordered list. The caller guarantees a free slot exists. */
+static void lh_table_place(struct lh_table *t, void *k, const void *v)
+{
+	unsigned long n = t->hash_fn(k) % t->size;
+
+	while( 1 ) {
+		if(t->table[n].k == LH_EMPTY || t->table[n].k == LH_FREED) break;
+		if(++n == t->size) n = 0;
+	}
+
+	if(t->table[n].k == LH_FREED) t->deleted--;
+	t->table[n].k = k;
+	t->table[n].v = v;
+	t->count++;
+
+	if(t->head == NULL) {
+		t->head = t->tail = &t->table[n];
+		t->table[n].next = t->table[n].prev = NULL;
+	} else {
+		t->tail->next = &t->table[n];
+		t->table[n].prev = t->tail;
+		t->table[n].next = NULL;
+		t->tail = &t->table[n];
+	}
+}
+
 void lh_table_resize(struct lh_table *t, int new_size)
 {
-	struct lh_table *new_t;
+	struct lh_entry *old_table = t->table;
 	struct lh_entry *ent;
+	int i;
+
+	if(new_size < t->count + 1) new_size = t->count + 1;
+	t->table = (struct lh_entry*)json_arena_calloc(t->arena, new_size, sizeof(struct lh_entry));
+	if(!t->table) lh_abort("lh_table_resize: calloc failed, size = %d\n", new_size);
+	for(i = 0; i < new_size; i++) t->table[i].k = LH_EMPTY;
 
-	new_t = lh_table_new(new_size, NULL, NULL, t->hash_fn, t->equal_fn);
+	/* Rebuild in insertion order, this also drops every freed slot */
 	ent = t->head;
+	t->size = new_size;
+	t->count = 0;
+	t->deleted = 0;
+	t->head = t->tail = NULL;
 	while(ent) {
-		lh_table_insert(new_t, ent->k, ent->v);
+		lh_table_place(t, ent->k, ent->v);
 		ent = ent->next;
 	}
-	free(t->table);
-	t->table = new_t->table;
-	t->size = new_size;
-	t->head = new_t->head;
-	t->tail = new_t->tail;
-	free(new_t);
+	json_arena_release(t->arena, old_table);
+}
+
+void lh_table_reserve(struct lh_table *t, int entries)
+{
+	int new_size;
+
+#if LH_GEOMETRIC_GROWTH
+	new_size = (entries * LH_LOAD_FACTOR_DEN + LH_LOAD_FACTOR_NUM - 1) / LH_LOAD_FACTOR_NUM;
+#else
+	new_size = entries;
+#endif
+	if(new_size > t->size) lh_table_resize(t, new_size);
 }
 
 void lh_table_free(struct lh_table *t)
@@ -115,40 +178,24 @@ void lh_table_free(struct lh_table *t)
 			t->free_fn(c);
 		}
 	}
-	free(t->table);
-	free(t);
+	json_arena_release(t->arena, t->table);
+	json_arena_release(t->arena, t);
 }
 
 
 int lh_table_insert(struct lh_table *t, void *k, const void *v)
 {
-	unsigned long h, n;
-
-	//if(t->count > t->size * 0.66) lh_table_resize(t, t->size * 2); 
-	if(t->count >= t->size) lh_table_resize(t, t->size + 1); 
-
-	h = t->hash_fn(k);
-	n = h % t->size;
-
-	while( 1 ) {
-		if(t->table[n].k == LH_EMPTY || t->table[n].k == LH_FREED) break;
-		if(++n == t->size) n = 0;
-	}
-
-	t->table[n].k = k;
-	t->table[n].v = v;
-	t->count++;
-
-	if(t->head == NULL) {
-		t->head = t->tail = &t->table[n];
-		t->table[n].next = t->table[n].prev = NULL;
-	} else {
-		t->tail->next = &t->table[n];
-		t->table[n].prev = t->tail;
-		t->table[n].next = NULL;
-		t->tail = &t->table[n];
+#if LH_GEOMETRIC_GROWTH
+	if((t->count + t->deleted + 1) * LH_LOAD_FACTOR_DEN > t->size * LH_LOAD_FACTOR_NUM) {
+		/* Mostly freed slots: rehash at the same size to reclaim them */
+		if(t->deleted > t->count) lh_table_resize(t, t->size);
+		else lh_table_resize(t, t->size * 2);
 	}
+#else
+	if(t->count >= t->size) lh_table_resize(t, t->size + 1); 
+#endif
 
+	lh_table_place(t, k, v);
 	return 0;
 }
 
@@ -187,6 +234,7 @@ int lh_table_delete_entry(struct lh_table *t, struct lh_entry *e)
 
 	if(t->table[n].k == LH_EMPTY || t->table[n].k == LH_FREED) return -1;
 	t->count--;
+	t->deleted++;
 	if(t->free_fn) t->free_fn(e);
 	t->table[n].v = NULL;
 	t->table[n].k = LH_FREED;
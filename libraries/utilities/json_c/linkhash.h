@@ -12,6 +12,8 @@
 #ifndef _linkhash_h_
 #define _linkhash_h_
 
+#include "json_arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +33,29 @@ extern "C" {
  */
 #define LH_FREED (void*)-2
 
+/**
+ * Table growth policy.
+ * 1: grow geometrically (x2) once live entries plus freed slots exceed the
+ *    load factor, and rehash in place when freed slots dominate. Inserting N
+ *    keys costs O(log N) rehashes.
+ * 0: legacy policy, grow by one slot when the table is completely full. Uses
+ *    the least RAM but every insert into a full table rehashes all entries.
+ */
+#ifndef LH_GEOMETRIC_GROWTH
+#define LH_GEOMETRIC_GROWTH 1
+#endif
+
+/**
+ * Maximum load factor (LH_LOAD_FACTOR_NUM / LH_LOAD_FACTOR_DEN) used when
+ * LH_GEOMETRIC_GROWTH is enabled, freed slots are counted as used.
+ */
+#ifndef LH_LOAD_FACTOR_NUM
+#define LH_LOAD_FACTOR_NUM 3
+#endif
+#ifndef LH_LOAD_FACTOR_DEN
+#define LH_LOAD_FACTOR_DEN 4
+#endif
+
 struct lh_entry;
 
 /**
@@ -76,11 +101,15 @@ struct lh_table {
 	/**
 	 * Size of our hash.
 	 */
-	unsigned char size;
+	int size;
 	/**
 	 * Numbers of entries.
 	 */
-	unsigned char count;
+	int count;
+	/**
+	 * Numbers of freed slots (tombstones) not yet reclaimed.
+	 */
+	int deleted;
 
 	/**
 	 * The first entry.
@@ -100,6 +129,11 @@ struct lh_table {
 	lh_entry_free_fn *free_fn;
 	lh_hash_fn *hash_fn;
 	lh_equal_fn *equal_fn;
+
+	/**
+	 * Arena the table and its slots are allocated from, NULL for the heap.
+	 */
+	struct json_arena *arena;
 };
 
 
@@ -161,6 +195,19 @@ extern struct lh_table* lh_kchar_table_new(int size, const char *name,
 					   lh_entry_free_fn *free_fn);
 
 
+/**
+ * Create a new linkhash table with char keys, allocated from an arena.
+ * @param arena the arena to allocate from, NULL for the heap.
+ * @param size initial table size.
+ * @param name table name.
+ * @param free_fn callback function used to free memory for entries.
+ * @return a pointer onto the linkhash table.
+ */
+extern struct lh_table* lh_kchar_table_new_in(struct json_arena *arena, int size,
+					      const char *name,
+					      lh_entry_free_fn *free_fn);
+
+
 /**
  * Convenience function to create a new linkhash
  * table with ptr keys.
@@ -232,6 +279,15 @@ extern int lh_table_delete_entry(struct lh_table *t, struct lh_entry *e);
 extern int lh_table_delete(struct lh_table *t, const void *k);
 
 
+/**
+ * Make room for at least a total of entries records, so that inserting
+ * up to that many keys does not rehash the table.
+ * @param t the table to resize.
+ * @param entries expected number of entries.
+ */
+extern void lh_table_reserve(struct lh_table *t, int entries);
+
+
 void lh_abort(const char *msg, ...);
 void lh_table_resize(struct lh_table *t, int new_size);
 